@@ -0,0 +1,32 @@
+#ifndef _XENODON_BEAM_GLSL
+#define _XENODON_BEAM_GLSL
+
+// Results of the beam optimization pre-pass, see svo_beam.comp. The output is divided into
+// blocks of BEAM_SIZE x BEAM_SIZE pixels, and for every block the pre-pass stores the distance
+// before which none of its rays pass through an emitting voxel. The pre-pass is disabled when
+// BEAM_SIZE is 0, in which case the buffer is not read.
+
+layout(constant_id = 12) const uint BEAM_SIZE = 0;
+
+layout(binding = 3) restrict buffer BeamBuffer {
+    float distances[];
+} beam_buffer;
+
+// The distance of blocks in which no ray passes through an emitting voxel
+const float BEAM_MISS = 1e30;
+
+uvec2 beam_count() {
+    return (uniforms.output_region.extent - 1u) / BEAM_SIZE + 1u;
+}
+
+// The distance along the ray through the pixel at index from which tracing may start
+float beam_distance(uvec2 index) {
+    if (BEAM_SIZE == 0) {
+        return 0;
+    }
+
+    uvec2 beam = index / BEAM_SIZE;
+    return beam_buffer.distances[beam.y * beam_count().x + beam.x];
+}
+
+#endif
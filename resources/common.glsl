@@ -14,26 +14,43 @@ struct Rect {
     uvec2 extent;
 };
 
-struct RenderParameters {
-    vec4 voxel_ratio;
-    uvec4 model_dim;
-    float emission_coeff;
-};
-
-layout(local_size_x = 8, local_size_y = 8) in;
-
-layout(push_constant) uniform PushConstant {
-    Camera camera;
-} push;
+// The local size is supplied by the renderer, see WorkgroupTuner
+layout(local_size_x_id = 0, local_size_y_id = 1) in;
+
+// Parameters which do not change during a run are specialization constants,
+// so that the driver is able to fold them into the shader
+layout(constant_id = 2) const float VOXEL_RATIO_X = 1.0;
+layout(constant_id = 3) const float VOXEL_RATIO_Y = 1.0;
+layout(constant_id = 4) const float VOXEL_RATIO_Z = 1.0;
+layout(constant_id = 5) const uint MODEL_DIM_X = 1;
+layout(constant_id = 6) const uint MODEL_DIM_Y = 1;
+layout(constant_id = 7) const uint MODEL_DIM_Z = 1;
+layout(constant_id = 8) const float EMISSION_COEFF = 1.0;
+
+// In data-parallel mode, the offset of the part of the volume this device renders
+layout(constant_id = 9) const uint BRICK_OFFSET_X = 0;
+layout(constant_id = 10) const uint BRICK_OFFSET_Y = 0;
+layout(constant_id = 11) const uint BRICK_OFFSET_Z = 0;
+
+const vec3 VOXEL_RATIO = vec3(VOXEL_RATIO_X, VOXEL_RATIO_Y, VOXEL_RATIO_Z);
+const uvec3 MODEL_DIM = uvec3(MODEL_DIM_X, MODEL_DIM_Y, MODEL_DIM_Z);
+const uvec3 BRICK_OFFSET = uvec3(BRICK_OFFSET_X, BRICK_OFFSET_Y, BRICK_OFFSET_Z);
 
 layout(binding = 0) readonly uniform UniformBuffer {
+    Camera camera;
     Rect output_region;
     Rect display_region;
-    RenderParameters params;
+    uvec2 target_extent; // Extent of the render target when rendering at a reduced resolution
 } uniforms;
 
 layout(binding = 1, rgba8) restrict writeonly uniform image2D render_target;
 
+// When an output is rendered in tiles, the offset of the current tile in the output. This
+// is zero otherwise.
+layout(push_constant) uniform PushConstants {
+    uvec2 tile_offset;
+} push;
+
 const uint FLOAT_MANTISSA_BITS = 23;
 
 // Adjust the ray direction so that no component is zero
@@ -46,13 +63,13 @@ vec3 ray(vec2 uv) {
     uv -= 0.5;
     uv.y *= float(uniforms.display_region.extent.y) / float(uniforms.display_region.extent.x);
 
-    vec3 dir = push.camera.forward.xyz;
-    vec3 up = push.camera.up.xyz;
+    vec3 dir = uniforms.camera.forward.xyz;
+    vec3 up = uniforms.camera.up.xyz;
     vec3 right = normalize(cross(up, dir));
     up = normalize(cross(right, dir));
 
     vec3 rd = normalize(uv.x * right + uv.y * up + dir);
-    return adjust_ray(normalize(rd / uniforms.params.voxel_ratio.xyz));
+    return adjust_ray(normalize(rd / VOXEL_RATIO));
 }
 
 float min_elem(vec3 v) {
@@ -67,8 +84,8 @@ float max_elem(vec3 v) {
 // base emission coefficient is multiplied by the amount the ray is stretched
 float voxel_emission_coeff(vec3 rd) {
     vec3 rd2 = rd * rd;
-    vec3 dim2 = uniforms.params.voxel_ratio.xyz * uniforms.params.voxel_ratio.xyz;
-    return uniforms.params.emission_coeff * sqrt(dot(rd2, dim2) / dot(rd2, vec3(1)));
+    vec3 dim2 = VOXEL_RATIO * VOXEL_RATIO;
+    return EMISSION_COEFF * sqrt(dot(rd2, dim2) / dot(rd2, vec3(1)));
 }
 
 #endif
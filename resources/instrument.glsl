@@ -0,0 +1,57 @@
+#ifndef _XENODON_INSTRUMENT_GLSL
+#define _XENODON_INSTRUMENT_GLSL
+
+// Counters of the traversal work of every ray. Every traversal shader is compiled a second time
+// with INSTRUMENT defined (see meson.build), and only this variant counts. In the regular variant,
+// the counting macros expand to nothing. Shaders pass the color of every pixel through instrument().
+//
+// The counters are:
+// - Node fetches: reads of a node record of the octree. For a node and its child, this counts 2.
+// - Stack operations: pushes to and pops from the traversal stack.
+// - Steps: iterations of the traversal loops, which includes the DDA steps through voxels.
+
+#ifdef INSTRUMENT
+    // The counter which is shown as a heatmap instead of the color, where 0 shows the color and
+    // 1-3 select the node fetches, stack operations and steps. See RenderContext::Instrumentation.
+    layout(constant_id = 13) const uint HEATMAP = 0;
+
+    // The count at the top of the heatmap color scale
+    layout(constant_id = 14) const float HEATMAP_MAX = 1024.0;
+
+    // The counters of every pixel of the output region, row by row
+    layout(binding = 5) restrict writeonly buffer CounterBuffer {
+        uvec4 pixels[];
+    } counter_buffer;
+
+    uvec4 counters = uvec4(0);
+
+    #define COUNT_NODE_FETCH() (++counters.x)
+    #define COUNT_STACK_OP() (++counters.y)
+    #define COUNT_STEP() (++counters.z)
+
+    // The jet color map, on a logarithmic scale
+    vec3 heat_color(uint count) {
+        float x = log2(1.0 + float(count)) / log2(1.0 + HEATMAP_MAX);
+        return clamp(1.5 - abs(4.0 * x - vec3(3, 2, 1)), 0.0, 1.0);
+    }
+
+    vec4 instrument(uvec2 index, vec4 color) {
+        counter_buffer.pixels[index.y * uniforms.output_region.extent.x + index.x] = counters;
+
+        if (HEATMAP == 0) {
+            return color;
+        }
+
+        return vec4(heat_color(counters[HEATMAP - 1]), 1);
+    }
+#else
+    #define COUNT_NODE_FETCH()
+    #define COUNT_STACK_OP()
+    #define COUNT_STEP()
+
+    vec4 instrument(uvec2 index, vec4 color) {
+        return color;
+    }
+#endif
+
+#endif
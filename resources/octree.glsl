@@ -14,6 +14,7 @@ layout(binding = 2) readonly buffer Octree {
 } model;
 
 const uint LEAF_MASK = 1 << 31;
-const uint DEPTH_MASK = 0x7FFFFFFF;
+const uint BRICK_MASK = 1 << 30; // See BrickOctree
+const uint DEPTH_MASK = 0x3FFFFFFF;
 
 #endif
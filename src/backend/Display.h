@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <cstddef>
+#include <cassert>
 #include <vulkan/vulkan.hpp>
 #include "backend/Output.h"
 #include "backend/RenderDevice.h"
@@ -15,6 +16,53 @@ struct Display {
     virtual Output* output(size_t device_index, size_t output_index) = 0;
     virtual void swap_buffers() = 0;
     virtual void poll_events() = 0;
+
+    // Wait until all frames that are still in flight are presented. Only backends
+    // which present asynchronously need to override this.
+    virtual void flush() {
+    }
+
+    // Backends which allow the region rendered by an output to change at runtime override these.
+    // The new region may be any part of the display region which the outputs cover initially. Only
+    // called when supports_dynamic_regions returns true.
+    virtual bool supports_dynamic_regions() const {
+        return false;
+    }
+
+    virtual void set_output_region(size_t device_index, size_t output_index, vk::Rect2D region) {
+        assert(false);
+    }
+
+    // Backends which sum the frames of all devices instead of placing them next to each other
+    // override this. All outputs then cover the entire display region, which is required
+    // for data-parallel rendering.
+    virtual bool composites_outputs() const {
+        return false;
+    }
+
+    // Backends in which the devices render entire frames in turn override these. Only the
+    // device returned by frame_device renders the next frame, and swap_buffers only presents
+    // the outputs of that device.
+    virtual bool frame_parallel() const {
+        return false;
+    }
+
+    virtual size_t frame_device() const {
+        return 0;
+    }
+
+    // Backends which render several frames per submission override these. The renderer then
+    // renders up to batch_size frames to consecutive swap images, starting at the current one,
+    // and swap_batch presents the given number of frames at once. Only the last batch may
+    // be smaller than batch_size.
+    virtual size_t batch_size() const {
+        return 1;
+    }
+
+    virtual void swap_batch(size_t frames) {
+        assert(frames == 1);
+        this->swap_buffers();
+    }
 };
 
 #endif
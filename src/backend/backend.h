@@ -3,11 +3,11 @@
 
 #include <filesystem>
 #include <memory>
-#include <string_view>
 #include "backend/Display.h"
 #include "backend/Event.h"
+#include "backend/headless/HeadlessOptions.h"
 
-std::unique_ptr<Display> create_headless_backend(std::filesystem::path config, std::string_view output);
+std::unique_ptr<Display> create_headless_backend(std::filesystem::path config, const HeadlessOptions& options);
 
 std::unique_ptr<Display> create_xorg_backend(EventDispatcher& dispatcher, std::filesystem::path multi_gpu_config);
 
@@ -0,0 +1,33 @@
+#include "backend/headless/FrameWriter.h"
+#include <utility>
+
+FrameWriter::FrameWriter(vk::Extent2D extent, size_t max_buffers):
+    extent(extent),
+    max_buffers(max_buffers),
+    allocated_buffers(0) {
+}
+
+FrameWriter::FrameBuffer FrameWriter::acquire() {
+    auto lock = std::unique_lock(this->mutex);
+    this->buffer_available.wait(lock, [this] {
+        return !this->free_buffers.empty() || this->allocated_buffers < this->max_buffers;
+    });
+
+    if (!this->free_buffers.empty()) {
+        auto buffer = std::move(this->free_buffers.back());
+        this->free_buffers.pop_back();
+        return buffer;
+    }
+
+    ++this->allocated_buffers;
+    return FrameBuffer(this->extent.width * this->extent.height);
+}
+
+void FrameWriter::release(FrameBuffer&& buffer) {
+    {
+        auto lock = std::lock_guard(this->mutex);
+        this->free_buffers.push_back(std::move(buffer));
+    }
+
+    this->buffer_available.notify_one();
+}
@@ -0,0 +1,49 @@
+#ifndef _XENODON_BACKEND_HEADLESS_FRAMEWRITER_H
+#define _XENODON_BACKEND_HEADLESS_FRAMEWRITER_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <vulkan/vulkan.hpp>
+#include "backend/headless/HeadlessOutput.h"
+
+// Base class of the ways the headless backend can output frames. Frames are composed
+// in frame buffers which are recycled, and acquiring one blocks when all are in use,
+// which bounds the memory usage when writing is slower than rendering. Writers which
+// write on worker threads declare their thread pool as the last member, so that the
+// workers are joined before the state they use is destroyed.
+class FrameWriter {
+public:
+    using FrameBuffer = std::vector<Pixel>;
+
+private:
+    vk::Extent2D extent;
+    size_t max_buffers;
+    size_t allocated_buffers;
+    std::vector<FrameBuffer> free_buffers;
+
+    std::mutex mutex;
+    std::condition_variable buffer_available;
+
+public:
+    FrameWriter(vk::Extent2D extent, size_t max_buffers);
+    virtual ~FrameWriter() = default;
+
+    FrameBuffer acquire();
+
+    // Queue a frame for writing. Frames are submitted in display order.
+    virtual void write(size_t frame, FrameBuffer&& buffer) = 0;
+
+    // Block until all queued frames are written
+    virtual void wait() = 0;
+
+    vk::Extent2D frame_extent() const {
+        return this->extent;
+    }
+
+protected:
+    void release(FrameBuffer&& buffer);
+};
+
+#endif
@@ -1,26 +1,49 @@
 #include "backend/headless/HeadlessDisplay.h"
 #include <vector>
+#include <algorithm>
+#include <utility>
 #include <cassert>
-#include <fmt/format.h>
-#include <lodepng.h>
 #include "core/Logger.h"
 #include "core/Error.h"
+#include "backend/headless/headless.h"
 #include "utility/rect_union.h"
 
 namespace {
-    constexpr const auto BLACK_PIXEL = 0xFF000000;
+    constexpr const auto BLACK_PIXEL = Pixel{0, 0, 0, 255};
 }
 
-HeadlessDisplay::HeadlessDisplay(const HeadlessConfig& config, std::string_view out_path):
+HeadlessDisplay::HeadlessDisplay(const HeadlessConfig& config, const HeadlessOptions& options):
     instance(nullptr),
-    out_path(out_path),
-    frame(0) {
+    frames_in_flight(options.frames_in_flight),
+    dynamic_regions(options.dynamic_regions),
+    composite(options.composite),
+    parallel_frames(options.frame_parallel),
+    batch(options.batch_size),
+    frame(0),
+    retired(0) {
+
+    this->enclosing = rect_union(config.gpus.begin(), config.gpus.end(), [](const HeadlessConfig::Device& gpu_config) {
+        return gpu_config.region;
+    });
 
     auto gpus = this->instance.physical_devices();
     this->outputs.reserve(config.gpus.size());
     for (const auto gpu_config : config.gpus) {
-        this->outputs.emplace_back(gpus.at(gpu_config.vulkan_index), gpu_config.region);
+        // When compositing or rendering frames in parallel, every device renders the entire display
+        const auto region = options.composite || options.frame_parallel ? this->enclosing : gpu_config.region;
+
+        // With dynamic regions, every device may render any part of the display
+        const auto target_extent = options.dynamic_regions ? this->enclosing.extent : region.extent;
+        this->outputs.emplace_back(gpus.at(gpu_config.vulkan_index), region, target_extent, this->frames_in_flight, this->batch);
+    }
+
+    LOGGER.log("Frames in flight: {}", this->max_frames_in_flight());
+
+    if (this->batch > 1) {
+        LOGGER.log("Rendering {} frames per submission", this->batch);
     }
+
+    this->writer = create_frame_writer(this->enclosing.extent, options);
 }
 
 size_t HeadlessDisplay::num_render_devices() const {
@@ -37,56 +60,125 @@ Output* HeadlessDisplay::output(size_t device_index, size_t output_index) {
 }
 
 void HeadlessDisplay::swap_buffers() {
-    for (const auto& output : this->outputs) {
-        output.synchronize();
-    }
+    this->swap_batch(1);
+}
+
+void HeadlessDisplay::poll_events() {
+}
+
+bool HeadlessDisplay::supports_dynamic_regions() const {
+    return this->dynamic_regions;
+}
+
+void HeadlessDisplay::set_output_region(size_t device_index, size_t output_index, vk::Rect2D region) {
+    assert(output_index == 0);
+    this->outputs[device_index].set_region(region);
+}
+
+bool HeadlessDisplay::composites_outputs() const {
+    return this->composite;
+}
+
+bool HeadlessDisplay::frame_parallel() const {
+    return this->parallel_frames;
+}
+
+size_t HeadlessDisplay::frame_device() const {
+    return this->parallel_frames ? this->frame % this->outputs.size() : 0;
+}
+
+size_t HeadlessDisplay::batch_size() const {
+    return this->batch;
+}
 
-    if (!this->out_path.empty()) {
-        try {
-            auto path = fmt::format(this->out_path, this->frame);
-            this->save(path);
-        } catch (const fmt::format_error& e) {
-            throw Error("Failed to format output filename: {}", e.what());
+void HeadlessDisplay::swap_batch(size_t frames) {
+    assert(frames > 0 && frames <= this->batch);
+
+    if (this->parallel_frames) {
+        this->outputs[this->frame_device()].present(this->writer != nullptr);
+    } else {
+        for (auto& output : this->outputs) {
+            output.present(this->writer != nullptr, static_cast<uint32_t>(frames));
         }
     }
 
-    ++this->frame;
+    this->frame += frames;
+
+    // The render targets of the next batch need to be free before it can be rendered
+    while (this->retired + this->max_frames_in_flight() < this->frame + this->batch) {
+        this->retire(this->retired++);
+    }
 }
 
-void HeadlessDisplay::poll_events() {
+void HeadlessDisplay::flush() {
+    while (this->retired < this->frame) {
+        this->retire(this->retired++);
+    }
+
+    if (this->writer) {
+        this->writer->wait();
+    }
 }
 
-void HeadlessDisplay::save(const std::filesystem::path& path) {
-    vk::Rect2D enclosing = rect_union(this->outputs.begin(), this->outputs.end(), [](HeadlessOutput& output){
-        return output.region();
-    });
+void HeadlessDisplay::set_writer(std::unique_ptr<FrameWriter> writer) {
+    this->flush();
+    this->writer = std::move(writer);
+}
+
+void HeadlessDisplay::retire(size_t frame) {
+    if (this->parallel_frames) {
+        // Every device has its own ring of render targets, which only advances for its own frames
+        const size_t n = this->outputs.size();
+        const auto index = static_cast<uint32_t>(frame / n % this->frames_in_flight);
+        this->outputs[frame % n].synchronize(index);
+
+        if (this->writer) {
+            auto image = this->writer->acquire();
+            this->outputs[frame % n].download(index, image.data(), 0);
+            this->writer->write(frame, std::move(image));
+        }
 
-    LOGGER.log("Saving frame {}...", this->frame);
+        return;
+    }
 
-    auto image = std::vector<Pixel>(enclosing.extent.width * enclosing.extent.height, BLACK_PIXEL);
-    size_t stride = enclosing.extent.width;
+    const auto index = static_cast<uint32_t>(frame % this->max_frames_in_flight());
 
-    for (auto& output : this->outputs) {
-        vk::Rect2D region = output.region();
-        size_t start_x = static_cast<size_t>(region.offset.x - enclosing.offset.x);
-        size_t start_y = static_cast<size_t>(region.offset.y - enclosing.offset.y);
+    // All frames of a batch are presented with one submission, whose fence belongs to the first frame
+    if (index % this->batch == 0) {
+        for (const auto& output : this->outputs) {
+            output.synchronize(index);
+        }
+    }
 
-        size_t offset = start_y * stride + start_x;
-        output.download(image.data() + offset, stride);
+    if (this->writer) {
+        this->save(frame, index);
     }
+}
 
-    LOGGER.log("Compressing...");
+void HeadlessDisplay::save(size_t frame, uint32_t index) {
+    auto image = this->writer->acquire();
+    std::fill(image.begin(), image.end(), BLACK_PIXEL);
+    size_t stride = this->enclosing.extent.width;
 
-    unsigned error = lodepng::encode(
-        path.c_str(),
-        reinterpret_cast<const unsigned char*>(image.data()),
-        enclosing.extent.width,
-        enclosing.extent.height
-    );
+    for (size_t i = 0; i < this->outputs.size(); ++i) {
+        auto& output = this->outputs[i];
+        vk::Rect2D region = output.target_region(index);
+        size_t start_x = static_cast<size_t>(region.offset.x - this->enclosing.offset.x);
+        size_t start_y = static_cast<size_t>(region.offset.y - this->enclosing.offset.y);
 
-    if (error) {
-        LOGGER.log("Error saving output: {}", lodepng_error_text(error));
-    } else {
-        LOGGER.log("Saved output to '{}'", path.native());
+        size_t offset = start_y * stride + start_x;
+
+        // Emission is additive, so the sum of the partial frames is the frame of the whole volume
+        if (this->composite && i > 0) {
+            output.accumulate(index, image.data() + offset, stride);
+        } else {
+            output.download(index, image.data() + offset, stride);
+        }
     }
+
+    this->writer->write(frame, std::move(image));
+}
+
+size_t HeadlessDisplay::max_frames_in_flight() const {
+    return this->parallel_frames ? this->frames_in_flight * this->outputs.size() : this->frames_in_flight * this->batch;
 }
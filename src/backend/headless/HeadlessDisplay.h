@@ -2,35 +2,62 @@
 #define _XENODON_BACKEND_HEADLESS_HEADLESSDISPLAY_H
 
 #include <vector>
-#include <string_view>
+#include <memory>
 #include <filesystem>
 #include <cstddef>
+#include <cstdint>
 #include <vulkan/vulkan.hpp>
 #include "graphics/core/Instance.h"
 #include "backend/Display.h"
 #include "backend/Event.h"
 #include "backend/headless/HeadlessConfig.h"
 #include "backend/headless/HeadlessOutput.h"
+#include "backend/headless/HeadlessOptions.h"
+#include "backend/headless/FrameWriter.h"
 
 struct Output;
 
 class HeadlessDisplay final: public Display {
     Instance instance;
     std::vector<HeadlessOutput> outputs;
-    std::string out_path;
+    uint32_t frames_in_flight;
+    vk::Rect2D enclosing;
+    bool dynamic_regions;
+    bool composite;
+    bool parallel_frames;
+    uint32_t batch;
+    std::unique_ptr<FrameWriter> writer;
+
+    // The number of frames submitted and the number of frames saved. Frames in between
+    // are still in flight.
     size_t frame;
+    size_t retired;
 
 public:
-    HeadlessDisplay(const HeadlessConfig& config, std::string_view out_path);
+    HeadlessDisplay(const HeadlessConfig& config, const HeadlessOptions& options);
 
     size_t num_render_devices() const override;
     const RenderDevice& render_device(size_t device_index) override;
     Output* output(size_t device_index, size_t output_index) override;
     void swap_buffers() override;
     void poll_events() override;
+    void flush() override;
+    bool supports_dynamic_regions() const override;
+    void set_output_region(size_t device_index, size_t output_index, vk::Rect2D region) override;
+    bool composites_outputs() const override;
+    bool frame_parallel() const override;
+    size_t frame_device() const override;
+    size_t batch_size() const override;
+    void swap_batch(size_t frames) override;
+
+    // Replace the writer which frames are saved with. Frames passed to the writer have the
+    // size of the display, and outputs are placed at their region within it.
+    void set_writer(std::unique_ptr<FrameWriter> writer);
 
 private:
-    void save(const std::filesystem::path& path);
+    void retire(size_t frame);
+    void save(size_t frame, uint32_t index);
+    size_t max_frames_in_flight() const;
 };
 
 #endif
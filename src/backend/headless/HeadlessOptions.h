@@ -0,0 +1,34 @@
+#ifndef _XENODON_BACKEND_HEADLESS_HEADLESSOPTIONS_H
+#define _XENODON_BACKEND_HEADLESS_HEADLESSOPTIONS_H
+
+#include <string_view>
+#include <cstdint>
+
+enum class StreamFormat {
+    None, // Write each frame to its own PNG file
+    Raw, // Stream raw RGBA frames
+    Y4m // Stream YUV 4:4:4 frames in the YUV4MPEG2 container
+};
+
+struct HeadlessOptions {
+    // Path format of the PNG output, or the path of the stream when streaming. No output is
+    // saved when this is empty.
+    std::string_view output;
+    uint32_t frames_in_flight = 1;
+    StreamFormat stream_format = StreamFormat::None;
+    uint32_t stream_fps = 30;
+
+    // Allow the regions of the outputs to be changed at runtime, see Display::set_output_region
+    bool dynamic_regions = false;
+
+    // Let every device render the entire display, and save the sum of their frames
+    bool composite = false;
+
+    // Let every device render entire frames in turn, see Display::frame_parallel
+    bool frame_parallel = false;
+
+    // Render this many frames per submission, see Display::batch_size
+    uint32_t batch_size = 1;
+};
+
+#endif
@@ -1,8 +1,13 @@
 #include "backend/headless/HeadlessOutput.h"
 #include <array>
+#include <vector>
+#include <utility>
+#include <limits>
+#include <cstring>
 #include <cassert>
+#include <emmintrin.h>
 #include "core/Error.h"
-#include "graphics/memory/Buffer.h"
+#include "core/Trace.h"
 
 namespace {
     constexpr const auto RENDER_TARGET_FORMAT = vk::Format::eR8G8B8A8Unorm;
@@ -33,13 +38,30 @@ namespace {
             throw Error("Gpu does not support required queues");
         }
     }
+
+    void add_saturate(Pixel* dst, const Pixel* src, size_t n) {
+        size_t i = 0;
+
+        for (; i + 4 <= n; i += 4) {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epu8(a, b));
+        }
+
+        for (; i < n; ++i) {
+            const auto a = _mm_cvtsi32_si128(static_cast<int>(dst[i].pack()));
+            const auto b = _mm_cvtsi32_si128(static_cast<int>(src[i].pack()));
+            dst[i] = Pixel::unpack(static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_adds_epu8(a, b))));
+        }
+    }
 }
 
-HeadlessOutput::HeadlessOutput(const PhysicalDevice& physdev, vk::Rect2D render_region):
+HeadlessOutput::HeadlessOutput(const PhysicalDevice& physdev, vk::Rect2D render_region, vk::Extent2D target_extent, uint32_t frames_in_flight, uint32_t batch_size):
     render_region(render_region),
+    target_extent(target_extent),
     rendev(create_render_device(physdev)),
-    frame_fence(this->rendev.device->createFenceUnique({})),
-    render_target(this->rendev.device, render_region.extent, RENDER_TARGET_FORMAT, RENDER_TARGET_USAGE) {
+    batch_size(batch_size),
+    current_index(0) {
 
     auto sub_resource_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
 
@@ -50,29 +72,65 @@ HeadlessOutput::HeadlessOutput(const PhysicalDevice& physdev, vk::Rect2D render_
         vk::ComponentSwizzle::eA
     );
 
-    auto view_create_info = vk::ImageViewCreateInfo(
-        {},
-        this->render_target.get(),
-        vk::ImageViewType::e2D,
-        RENDER_TARGET_FORMAT,
-        component_mapping,
-        sub_resource_range
-    );
+    const auto& device = this->rendev.device;
+    const size_t size = target_extent.width * target_extent.height;
+
+    const uint32_t targets = frames_in_flight * batch_size;
+
+    this->render_targets.reserve(targets);
+    for (uint32_t i = 0; i < targets; ++i) {
+        auto image = Image(device, target_extent, RENDER_TARGET_FORMAT, RENDER_TARGET_USAGE);
+
+        auto view_create_info = vk::ImageViewCreateInfo(
+            {},
+            image.get(),
+            vk::ImageViewType::e2D,
+            RENDER_TARGET_FORMAT,
+            component_mapping,
+            sub_resource_range
+        );
 
-    this->render_target_view = this->rendev.device->createImageViewUnique(view_create_info);
+        auto readback_buffer = Buffer<Pixel>(
+            device,
+            size,
+            vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+        );
+
+        const Pixel* readback_mapping = readback_buffer.map(0, size);
+
+        // The readback is submitted to the compute queue, to which the render target belongs
+        auto cmd_buf = this->rendev.compute_command_pool.allocate_command_buffer();
+
+        this->render_targets.push_back({
+            std::move(image),
+            device->createImageViewUnique(view_create_info),
+            device->createSemaphoreUnique(vk::SemaphoreCreateInfo()),
+            device->createFenceUnique({}),
+            std::move(readback_buffer),
+            readback_mapping,
+            std::move(cmd_buf),
+            render_region,
+            vk::Extent2D{0, 0}
+        });
+
+        this->record_readback(this->render_targets.back());
+    }
 }
 
 uint32_t HeadlessOutput::num_swap_images() const {
-    return 1;
+    return static_cast<uint32_t>(this->render_targets.size());
 }
 
 uint32_t HeadlessOutput::current_swap_index() const {
-    return 0;
+    return this->current_index;
 }
 
 SwapImage HeadlessOutput::swap_image(uint32_t index) {
-    assert(index == 0);
-    return SwapImage(this->render_target.get(), this->render_target_view.get(), this->frame_fence.get());
+    const auto& target = this->render_targets.at(index);
+    auto swap_image = SwapImage(target.image.get(), target.view.get());
+    swap_image.render_finished = target.render_finished.get();
+    return swap_image;
 }
 
 vk::Rect2D HeadlessOutput::region() const {
@@ -87,50 +145,111 @@ vk::AttachmentDescription HeadlessOutput::color_attachment_descr() const {
     return descr;
 }
 
-void HeadlessOutput::synchronize() const {
-    this->rendev.device->waitForFences(this->frame_fence.get(), true, std::numeric_limits<uint64_t>::max());
-    this->rendev.device->resetFences(this->frame_fence.get());
+void HeadlessOutput::set_region(vk::Rect2D region) {
+    if (region.extent.width > this->target_extent.width || region.extent.height > this->target_extent.height) {
+        throw Error("Output region exceeds render target size");
+    }
+
+    // The command buffers which render to the region are recorded again after this
+    this->rendev.device->waitIdle();
+    this->render_region = region;
 }
 
-void HeadlessOutput::download(Pixel* output, size_t stride) {
-    if (stride == 0) {
-        stride = this->render_region.extent.width;
-    }
+void HeadlessOutput::present(bool readback, uint32_t frames) {
+    TRACE_SCOPE("HeadlessOutput::present");
+    assert(frames > 0 && frames <= this->batch_size);
+
+    auto readback_cmd_bufs = std::vector<vk::CommandBuffer>();
+    readback_cmd_bufs.reserve(frames);
+
+    for (uint32_t i = 0; i < frames; ++i) {
+        auto& target = this->render_targets[this->current_index + i];
+        target.region = this->render_region;
 
-    const size_t size = this->render_region.extent.width * this->render_region.extent.height;
+        // The previous frame of this target has been retired, so its command buffer may be recorded again
+        if (readback && target.readback_extent != target.region.extent) {
+            this->record_readback(target);
+        }
+
+        readback_cmd_bufs.push_back(target.readback_cmd_buf.get());
+    }
 
-    auto staging_buffer = Buffer<Pixel>(
-        this->rendev.device,
-        size,
-        vk::BufferUsageFlagBits::eTransferDst,
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+    // The first target of the batch is signaled when all of its frames are rendered
+    const auto& first = this->render_targets[this->current_index];
+    const auto wait_stage = vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTransfer);
+
+    // Without readback, the submission only waits for rendering to finish before signaling the fence
+    auto submit_info = vk::SubmitInfo(
+        1,
+        &first.render_finished.get(),
+        &wait_stage,
+        readback ? frames : 0,
+        readback_cmd_bufs.data()
     );
 
-    this->rendev.graphics_command_pool.one_time_submit([this, &staging_buffer](vk::CommandBuffer cmd_buf) {
-        auto copy_info = vk::BufferImageCopy(
-            0,
-            0,
-            0,
-            vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
-            {0, 0, 0},
-            {this->render_region.extent.width, this->render_region.extent.height, 1}
-        );
+    this->rendev.compute_queue->submit(1, &submit_info, first.fence.get());
 
-        cmd_buf.copyImageToBuffer(
-            this->render_target.get(),
-            vk::ImageLayout::eTransferSrcOptimal,
-            staging_buffer.get(),
-            copy_info
-        );
-    });
+    // Every batch starts at a multiple of the batch size
+    this->current_index = (this->current_index + this->batch_size) % this->num_swap_images();
+}
 
-    Pixel* pixels = staging_buffer.map(0, size);
+void HeadlessOutput::synchronize(uint32_t index) const {
+    TRACE_SCOPE("HeadlessOutput::synchronize");
+    const auto fence = this->render_targets[index].fence.get();
+    this->rendev.device->waitForFences(fence, true, std::numeric_limits<uint64_t>::max());
+    this->rendev.device->resetFences(fence);
+}
 
-    for (size_t y = 0; y < this->render_region.extent.height; ++y) {
-        for (size_t x = 0; x < this->render_region.extent.width; ++x) {
-            output[y * stride + x] = pixels[y * this->render_region.extent.width + x];
-        }
+void HeadlessOutput::download(uint32_t index, Pixel* output, size_t stride) const {
+    TRACE_SCOPE("HeadlessOutput::download");
+    const auto& target = this->render_targets[index];
+    const size_t width = target.region.extent.width;
+    const size_t height = target.region.extent.height;
+    const Pixel* pixels = target.readback_mapping;
+
+    if (stride == 0 || stride == width) {
+        std::memcpy(output, pixels, width * height * sizeof(Pixel));
+        return;
+    }
+
+    for (size_t y = 0; y < height; ++y) {
+        std::memcpy(output + y * stride, pixels + y * width, width * sizeof(Pixel));
     }
+}
+
+void HeadlessOutput::accumulate(uint32_t index, Pixel* output, size_t stride) const {
+    TRACE_SCOPE("HeadlessOutput::accumulate");
+    const auto& target = this->render_targets[index];
+    const size_t width = target.region.extent.width;
+    const size_t height = target.region.extent.height;
+    const Pixel* pixels = target.readback_mapping;
+
+    if (stride == 0 || stride == width) {
+        add_saturate(output, pixels, width * height);
+        return;
+    }
+
+    for (size_t y = 0; y < height; ++y) {
+        add_saturate(output + y * stride, pixels + y * width, width);
+    }
+}
+
+void HeadlessOutput::record_readback(RenderTarget& target) {
+    const auto extent = target.region.extent;
+
+    const auto copy_info = vk::BufferImageCopy(
+        0,
+        0,
+        0,
+        vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+        {0, 0, 0},
+        {extent.width, extent.height, 1}
+    );
+
+    auto cmd_buf = target.readback_cmd_buf.get();
+    cmd_buf.begin(vk::CommandBufferBeginInfo());
+    cmd_buf.copyImageToBuffer(target.image.get(), vk::ImageLayout::eTransferSrcOptimal, target.readback_buffer.get(), copy_info);
+    cmd_buf.end();
 
-    staging_buffer.unmap();
+    target.readback_extent = extent;
 }
@@ -2,26 +2,48 @@
 #define _XENODON_BACKEND_HEADLESS_HEADLESSOUTPUT_H
 
 #include <functional>
+#include <vector>
 #include <cstdint>
 #include "graphics/core/PhysicalDevice.h"
 #include "graphics/core/Device.h"
 #include "graphics/memory/Image.h"
+#include "graphics/memory/Buffer.h"
 #include "backend/RenderDevice.h"
 #include "backend/Output.h"
 #include "backend/headless/HeadlessConfig.h"
-
-using Pixel = uint32_t;
+#include "model/Pixel.h"
 
 class HeadlessOutput final: public Output {
+    // Each frame in flight renders to its own render target, which is copied into a
+    // persistently mapped readback buffer after rendering. The fence is signaled when
+    // both are done. When frames are rendered in batches, every frame of a batch has its
+    // own render target, and only the semaphore and fence of the first one are used.
+    struct RenderTarget {
+        Image image;
+        vk::UniqueImageView view;
+        vk::UniqueSemaphore render_finished;
+        vk::UniqueFence fence;
+        Buffer<Pixel> readback_buffer;
+        const Pixel* readback_mapping;
+        vk::UniqueCommandBuffer readback_cmd_buf;
+
+        // The region of the frame last rendered to this target, and the extent which
+        // the readback command buffer is recorded for
+        vk::Rect2D region;
+        vk::Extent2D readback_extent;
+    };
+
     vk::Rect2D render_region;
+    vk::Extent2D target_extent;
     RenderDevice rendev;
-    vk::UniqueFence frame_fence;
-
-    Image render_target;
-    vk::UniqueImageView render_target_view;
+    std::vector<RenderTarget> render_targets;
+    uint32_t batch_size;
+    uint32_t current_index;
 
 public:
-    HeadlessOutput(const PhysicalDevice& physdev, vk::Rect2D render_region);
+    // The render targets are allocated with target_extent, which must be at least as large as
+    // any region this output renders.
+    HeadlessOutput(const PhysicalDevice& physdev, vk::Rect2D render_region, vk::Extent2D target_extent, uint32_t frames_in_flight, uint32_t batch_size = 1);
 
     uint32_t num_swap_images() const override;
     uint32_t current_swap_index() const override;
@@ -29,12 +51,24 @@ public:
     vk::Rect2D region() const override;
     vk::AttachmentDescription color_attachment_descr() const override;
 
-    void synchronize() const;
-    void download(Pixel* output, size_t stride);
+    void set_region(vk::Rect2D region);
+    void present(bool readback, uint32_t frames = 1);
+    void synchronize(uint32_t index) const;
+    void download(uint32_t index, Pixel* output, size_t stride) const;
+
+    // Like download, but adds the pixels to those in output, saturating every channel
+    void accumulate(uint32_t index, Pixel* output, size_t stride) const;
+
+    vk::Rect2D target_region(uint32_t index) const {
+        return this->render_targets[index].region;
+    }
 
     RenderDevice& render_device() {
         return this->rendev;
     }
+
+private:
+    void record_readback(RenderTarget& target);
 };
 
 #endif
@@ -0,0 +1,50 @@
+#include "backend/headless/PngWriter.h"
+#include <filesystem>
+#include <utility>
+#include <fmt/format.h>
+#include <lodepng.h>
+#include "core/Logger.h"
+#include "core/Error.h"
+#include "core/Trace.h"
+
+PngWriter::PngWriter(vk::Extent2D extent, std::string_view path_format):
+    FrameWriter(extent, ThreadPool::default_threads() + 2),
+    path_format(path_format),
+    pool(ThreadPool::default_threads(), ThreadPool::default_threads()) {
+}
+
+void PngWriter::write(size_t frame, FrameBuffer&& buffer) {
+    std::filesystem::path path;
+
+    try {
+        path = fmt::format(this->path_format, frame);
+    } catch (const fmt::format_error& e) {
+        throw Error("Failed to format output filename: {}", e.what());
+    }
+
+    this->pool.submit([this, path, frame, buffer = std::move(buffer)]() mutable {
+        const auto extent = this->frame_extent();
+
+        unsigned error = [&] {
+            TRACE_SCOPE("lodepng::encode");
+            return lodepng::encode(
+                path.c_str(),
+                reinterpret_cast<const unsigned char*>(buffer.data()),
+                extent.width,
+                extent.height
+            );
+        }();
+
+        if (error) {
+            LOGGER.log("Error saving frame {}: {}", frame, lodepng_error_text(error));
+        } else {
+            LOGGER.log("Saved frame {} to '{}'", frame, path.native());
+        }
+
+        this->release(std::move(buffer));
+    });
+}
+
+void PngWriter::wait() {
+    this->pool.wait();
+}
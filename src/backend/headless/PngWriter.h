@@ -0,0 +1,25 @@
+#ifndef _XENODON_BACKEND_HEADLESS_PNGWRITER_H
+#define _XENODON_BACKEND_HEADLESS_PNGWRITER_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <vulkan/vulkan.hpp>
+#include "backend/headless/FrameWriter.h"
+#include "utility/ThreadPool.h"
+
+// Encodes frames to PNG files on a pool of worker threads. Frames may be finished out of
+// order, but each is written to the path formatted with its own frame number.
+class PngWriter final: public FrameWriter {
+    std::string path_format;
+
+    ThreadPool pool;
+
+public:
+    PngWriter(vk::Extent2D extent, std::string_view path_format);
+
+    void write(size_t frame, FrameBuffer&& buffer) override;
+    void wait() override;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "backend/headless/StreamWriter.h"
+#include <utility>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <x86intrin.h>
+#include <fmt/format.h>
+#include "core/Logger.h"
+#include "core/Error.h"
+#include "utility/take_stdout.h"
+
+namespace {
+    // Frames are converted and written by a single thread, queue a few so that
+    // the render thread does not have to wait on the stream
+    constexpr const size_t MAX_QUEUED_FRAMES = 3;
+
+    // Convert RGBA pixels to planar Y'CbCr using the BT.601 limited range coefficients:
+    // Y = ((66 R + 129 G + 25 B + 128) >> 8) + 16
+    // U = ((-38 R - 74 G + 112 B + 128) >> 8) + 128
+    // V = ((112 R - 94 G - 18 B + 128) >> 8) + 128
+    void rgba_to_yuv444(const Pixel* pixels, size_t n, uint8_t* y, uint8_t* u, uint8_t* v) {
+        const __m128i byte_mask = _mm_set1_epi32(0xFF);
+        const __m128i round = _mm_set1_epi16(128);
+        const __m128i luma_offset = _mm_set1_epi16(16);
+        const __m128i chroma_offset = _mm_set1_epi16(128);
+
+        auto channel = [&](__m128i lo, __m128i hi, int shift) {
+            // Extract one channel of 8 pixels as 16-bit values
+            const __m128i c_lo = _mm_and_si128(_mm_srli_epi32(lo, shift), byte_mask);
+            const __m128i c_hi = _mm_and_si128(_mm_srli_epi32(hi, shift), byte_mask);
+            return _mm_packs_epi32(c_lo, c_hi);
+        };
+
+        auto weighted = [&](__m128i r, __m128i g, __m128i b, short wr, short wg, short wb) {
+            __m128i sum = _mm_mullo_epi16(r, _mm_set1_epi16(wr));
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(g, _mm_set1_epi16(wg)));
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(wb)));
+            return _mm_add_epi16(sum, round);
+        };
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pixels[i]));
+            const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pixels[i + 4]));
+
+            const __m128i r = channel(lo, hi, 0);
+            const __m128i g = channel(lo, hi, 8);
+            const __m128i b = channel(lo, hi, 16);
+
+            // The luma sum does not fit in a signed 16-bit integer, but it does fit
+            // in an unsigned one, so use a logical shift.
+            const __m128i y16 = _mm_add_epi16(_mm_srli_epi16(weighted(r, g, b, 66, 129, 25), 8), luma_offset);
+            const __m128i u16 = _mm_add_epi16(_mm_srai_epi16(weighted(r, g, b, -38, -74, 112), 8), chroma_offset);
+            const __m128i v16 = _mm_add_epi16(_mm_srai_epi16(weighted(r, g, b, 112, -94, -18), 8), chroma_offset);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(&y[i]), _mm_packus_epi16(y16, y16));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(&u[i]), _mm_packus_epi16(u16, u16));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(&v[i]), _mm_packus_epi16(v16, v16));
+        }
+
+        for (; i < n; ++i) {
+            const int r = pixels[i].r;
+            const int g = pixels[i].g;
+            const int b = pixels[i].b;
+
+            y[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            u[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    std::FILE* open_stream(std::string_view path) {
+        if (path == "-") {
+            std::FILE* stream = fdopen(take_stdout(), "wb");
+            if (!stream) {
+                throw Error("Failed to open standard output: {}", std::strerror(errno));
+            }
+
+            return stream;
+        }
+
+        // Opening a named pipe blocks until a reader has opened it as well
+        auto path_str = std::string(path);
+        std::FILE* stream = std::fopen(path_str.c_str(), "wb");
+        if (!stream) {
+            throw Error("Failed to open output stream '{}': {}", path, std::strerror(errno));
+        }
+
+        return stream;
+    }
+}
+
+StreamWriter::StreamWriter(vk::Extent2D extent, std::string_view path, StreamFormat format, uint32_t fps):
+    FrameWriter(extent, MAX_QUEUED_FRAMES + 2),
+    format(format),
+    stream(open_stream(path)),
+    failed(false),
+    pool(1, MAX_QUEUED_FRAMES) {
+
+    // A reader closing the pipe should not kill the program, but simply stop the stream
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (this->format == StreamFormat::Y4m) {
+        this->planes.resize(extent.width * extent.height * 3);
+
+        // Progressive, square pixels, no subsampling
+        const auto header = fmt::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C444\n", extent.width, extent.height, fps);
+        this->write_bytes(header.data(), header.size());
+    }
+
+    LOGGER.log("Streaming {} frames to '{}'", this->format == StreamFormat::Y4m ? "Y4M" : "raw RGBA", path);
+}
+
+StreamWriter::~StreamWriter() {
+    this->pool.wait();
+    std::fclose(this->stream);
+}
+
+void StreamWriter::write(size_t frame, FrameBuffer&& buffer) {
+    // There is only one writer, so the frames are written in the order they are submitted
+    this->pool.submit([this, buffer = std::move(buffer)]() mutable {
+        this->write_frame(buffer);
+        this->release(std::move(buffer));
+    });
+}
+
+void StreamWriter::wait() {
+    this->pool.wait();
+    std::fflush(this->stream);
+}
+
+void StreamWriter::write_frame(const FrameBuffer& buffer) {
+    if (this->format == StreamFormat::Raw) {
+        this->write_bytes(buffer.data(), buffer.size() * sizeof(Pixel));
+        return;
+    }
+
+    const size_t n = buffer.size();
+    uint8_t* y = this->planes.data();
+    rgba_to_yuv444(buffer.data(), n, y, y + n, y + 2 * n);
+
+    constexpr const std::string_view frame_header = "FRAME\n";
+    this->write_bytes(frame_header.data(), frame_header.size());
+    this->write_bytes(this->planes.data(), this->planes.size());
+}
+
+void StreamWriter::write_bytes(const void* data, size_t size) {
+    if (this->failed) {
+        return;
+    }
+
+    if (std::fwrite(data, 1, size, this->stream) != size) {
+        LOGGER.log("Error: Failed to write to output stream: {}, discarding remaining frames", std::strerror(errno));
+        this->failed = true;
+    }
+}
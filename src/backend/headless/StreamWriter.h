@@ -0,0 +1,42 @@
+#ifndef _XENODON_BACKEND_HEADLESS_STREAMWRITER_H
+#define _XENODON_BACKEND_HEADLESS_STREAMWRITER_H
+
+#include <vector>
+#include <string_view>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <vulkan/vulkan.hpp>
+#include "backend/headless/FrameWriter.h"
+#include "backend/headless/HeadlessOptions.h"
+#include "utility/ThreadPool.h"
+
+// Writes uncompressed frames to a single stream, such as standard output or a named
+// pipe, so that they can be consumed directly by a video encoder. Frames are written
+// in display order, by a single writer thread.
+class StreamWriter final: public FrameWriter {
+    StreamFormat format;
+    std::FILE* stream;
+    bool failed;
+
+    // Planes of the frame being written in Y4M format, only used by the writer thread
+    std::vector<uint8_t> planes;
+
+    ThreadPool pool;
+
+public:
+    // A path of "-" denotes standard output. In that case, standard output is redirected
+    // to standard error for the remainder of the program, so that log messages do not
+    // end up in the stream.
+    StreamWriter(vk::Extent2D extent, std::string_view path, StreamFormat format, uint32_t fps);
+    ~StreamWriter() override;
+
+    void write(size_t frame, FrameBuffer&& buffer) override;
+    void wait() override;
+
+private:
+    void write_frame(const FrameBuffer& buffer);
+    void write_bytes(const void* data, size_t size);
+};
+
+#endif
@@ -4,10 +4,10 @@
 #include "core/Config.h"
 #include "backend/Event.h"
 #include "backend/headless/HeadlessConfig.h"
+#include "backend/headless/PngWriter.h"
+#include "backend/headless/StreamWriter.h"
 
-std::unique_ptr<HeadlessDisplay> create_headless_display(std::filesystem::path config, std::string_view output) {
-    LOGGER.log("Using headless presenting backend");
-
+HeadlessConfig load_headless_config(std::filesystem::path config) {
     auto in = std::ifstream(config);
     if (!in) {
         throw Error("Failed to open config file '{}'", config.native());
@@ -21,5 +21,20 @@ std::unique_ptr<HeadlessDisplay> create_headless_display(std::filesystem::path c
         throw Error("Failed to read config file '{}': {}", config.native(), err.what());
     }
 
-    return std::make_unique<HeadlessDisplay>(parsed_config, output);
+    return parsed_config;
+}
+
+std::unique_ptr<HeadlessDisplay> create_headless_display(std::filesystem::path config, const HeadlessOptions& options) {
+    LOGGER.log("Using headless presenting backend");
+    return std::make_unique<HeadlessDisplay>(load_headless_config(config), options);
+}
+
+std::unique_ptr<FrameWriter> create_frame_writer(vk::Extent2D extent, const HeadlessOptions& options) {
+    if (options.output.empty()) {
+        return nullptr;
+    } else if (options.stream_format == StreamFormat::None) {
+        return std::make_unique<PngWriter>(extent, options.output);
+    }
+
+    return std::make_unique<StreamWriter>(extent, options.output, options.stream_format, options.stream_fps);
 }
@@ -2,11 +2,18 @@
 #define _XENODON_BACKEND_HEADLESS_HEADLESS_H
 
 #include <memory>
-#include <string_view>
 #include "backend/headless/HeadlessDisplay.h"
+#include "backend/headless/HeadlessOptions.h"
+#include "backend/headless/HeadlessConfig.h"
+#include "backend/headless/FrameWriter.h"
 
 struct EventDispatcher;
 
-std::unique_ptr<HeadlessDisplay> create_headless_display(std::filesystem::path config, std::string_view output);
+HeadlessConfig load_headless_config(std::filesystem::path config);
+
+std::unique_ptr<HeadlessDisplay> create_headless_display(std::filesystem::path config, const HeadlessOptions& options);
+
+// Create the writer for the output of `options`, or return nullptr when no output is saved
+std::unique_ptr<FrameWriter> create_frame_writer(vk::Extent2D extent, const HeadlessOptions& options);
 
 #endif
@@ -0,0 +1,527 @@
+#include "bench.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <fmt/format.h>
+#include "core/arg_parse.h"
+#include "core/Error.h"
+#include "core/Json.h"
+#include "core/Logger.h"
+#include "backend/headless/headless.h"
+#include "main_loop.h"
+
+namespace {
+    constexpr const size_t DEFAULT_WARMUP_FRAMES = 10;
+    constexpr const double DEFAULT_THRESHOLD = 5.0;
+
+    // A metric which is zero in the baseline has no relative change. It only counts as a
+    // regression when it grew above this absolute value.
+    constexpr const double ZERO_BASELINE_THRESHOLD = 1e-3;
+
+    enum class BenchFormat {
+        Json,
+        Csv
+    };
+
+    struct BenchOptions {
+        std::string_view volumes;
+        std::filesystem::path config;
+        std::string_view camera;
+        std::string_view shaders;
+        std::string_view resolutions;
+        std::string_view frames_in_flight;
+        size_t warmup = DEFAULT_WARMUP_FRAMES;
+        size_t repeat = 1;
+        bool beam = false;
+        BenchFormat format = BenchFormat::Json;
+        std::string_view output = "-";
+        std::filesystem::path log_output;
+        std::filesystem::path baseline;
+        double threshold = DEFAULT_THRESHOLD;
+    };
+
+    struct Percentiles {
+        double p50;
+        double p95;
+        double p99;
+        double max;
+    };
+
+    struct BenchResult {
+        std::string volume;
+        std::string shader;
+        std::string resolution;
+        uint32_t frames_in_flight;
+        size_t frames;
+        Percentiles frame_time;
+        Percentiles dispatch_time;
+        double mrays_per_s;
+
+        // Frames per second over the whole run, which includes frames overlapping each other
+        double fps;
+    };
+
+    auto format_opt(BenchFormat* var) {
+        return [var](std::string_view arg) {
+            if (arg == "json") {
+                *var = BenchFormat::Json;
+            } else if (arg == "csv") {
+                *var = BenchFormat::Csv;
+            } else {
+                return false;
+            }
+
+            return true;
+        };
+    }
+
+    std::vector<std::string_view> split_list(std::string_view list) {
+        auto items = std::vector<std::string_view>();
+
+        while (!list.empty()) {
+            const auto comma = list.find(',');
+            const auto item = list.substr(0, comma);
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+
+            if (comma == std::string_view::npos) {
+                break;
+            }
+
+            list.remove_prefix(comma + 1);
+        }
+
+        return items;
+    }
+
+    vk::Extent2D parse_resolution(std::string_view str) {
+        const auto x = str.find('x');
+        if (x == std::string_view::npos) {
+            throw Error("Invalid resolution '{}', expected <width>x<height>", str);
+        }
+
+        auto parse_dim = [str](std::string_view dim) {
+            uint32_t value = 0;
+            auto [end, err] = std::from_chars(dim.begin(), dim.end(), value);
+            if (err != std::errc() || end != dim.end() || value == 0) {
+                throw Error("Invalid resolution '{}', expected <width>x<height>", str);
+            }
+
+            return value;
+        };
+
+        return {parse_dim(str.substr(0, x)), parse_dim(str.substr(x + 1))};
+    }
+
+    uint32_t parse_frames_in_flight(std::string_view str) {
+        uint32_t value = 0;
+        auto [end, err] = std::from_chars(str.begin(), str.end(), value);
+        if (err != std::errc() || end != str.end() || value == 0) {
+            throw Error("Invalid number of frames in flight '{}'", str);
+        }
+
+        return value;
+    }
+
+    // Divide the rows of a resolution evenly over the devices of a headless configuration
+    HeadlessConfig apply_resolution(HeadlessConfig config, vk::Extent2D extent) {
+        const auto n = static_cast<uint32_t>(config.gpus.size());
+        if (extent.height < n) {
+            throw Error("Resolution height {} is too small for {} devices", extent.height, n);
+        }
+
+        for (uint32_t i = 0; i < n; ++i) {
+            const uint32_t begin = i * extent.height / n;
+            const uint32_t end = (i + 1) * extent.height / n;
+            config.gpus[i].region = vk::Rect2D{
+                {0, static_cast<int32_t>(begin)},
+                {extent.width, end - begin}
+            };
+        }
+
+        return config;
+    }
+
+    // The extent of the union of the regions of all devices
+    vk::Extent2D total_extent(const HeadlessConfig& config) {
+        int32_t min_x = std::numeric_limits<int32_t>::max();
+        int32_t min_y = std::numeric_limits<int32_t>::max();
+        int32_t max_x = std::numeric_limits<int32_t>::min();
+        int32_t max_y = std::numeric_limits<int32_t>::min();
+
+        for (const auto& gpu : config.gpus) {
+            min_x = std::min(min_x, gpu.region.offset.x);
+            min_y = std::min(min_y, gpu.region.offset.y);
+            max_x = std::max(max_x, gpu.region.offset.x + static_cast<int32_t>(gpu.region.extent.width));
+            max_y = std::max(max_y, gpu.region.offset.y + static_cast<int32_t>(gpu.region.extent.height));
+        }
+
+        return {static_cast<uint32_t>(max_x - min_x), static_cast<uint32_t>(max_y - min_y)};
+    }
+
+    // Nearest-rank percentiles
+    Percentiles percentiles(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+
+        auto rank = [&values](double p) {
+            const auto index = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(values.size())));
+            return values[std::clamp(index, size_t{1}, values.size()) - 1];
+        };
+
+        return {rank(50), rank(95), rank(99), values.back()};
+    }
+
+    BenchResult run(const BenchOptions& opts, std::string_view volume, std::string_view shader, const HeadlessConfig& config, uint32_t frames_in_flight) {
+        auto render_params = RenderParameters();
+        render_params.volume_path = volume;
+        render_params.shader = shader;
+        render_params.camera = opts.camera;
+        render_params.repeat = opts.repeat;
+        render_params.beam = opts.beam;
+
+        // Frames are neither saved nor streamed, so that only rendering is measured
+        auto headless_opts = HeadlessOptions();
+        headless_opts.frames_in_flight = frames_in_flight;
+        auto display = HeadlessDisplay(config, headless_opts);
+        const auto frames = bench_loop(&display, render_params, opts.warmup);
+
+        if (frames.empty()) {
+            throw Error("Camera script '{}' is empty", opts.camera);
+        }
+
+        auto frame_times = std::vector<double>();
+        auto dispatch_times = std::vector<double>();
+        size_t total_rays = 0;
+        double total_render_time = 0;
+        double total_time = 0;
+
+        for (const auto& frame : frames) {
+            frame_times.push_back(frame.frame_time);
+            dispatch_times.push_back(frame.dispatch_time);
+            total_rays += frame.rays;
+            total_render_time += frame.render_time;
+            total_time += frame.frame_time;
+        }
+
+        const auto extent = total_extent(config);
+
+        return {
+            std::string(volume),
+            shader.empty() ? "default" : std::string(shader),
+            fmt::format("{}x{}", extent.width, extent.height),
+            frames_in_flight,
+            frames.size(),
+            percentiles(std::move(frame_times)),
+            percentiles(std::move(dispatch_times)),
+            static_cast<double>(total_rays) / (total_render_time * 1'000),
+            static_cast<double>(frames.size()) / (total_time / 1'000)
+        };
+    }
+
+    void write_percentiles_json(fmt::memory_buffer& out, const Percentiles& p) {
+        fmt::format_to(out, "{{\"p50\": {}, \"p95\": {}, \"p99\": {}, \"max\": {}}}", p.p50, p.p95, p.p99, p.max);
+    }
+
+    std::string to_json(const std::vector<BenchResult>& results) {
+        fmt::memory_buffer out;
+        fmt::format_to(out, "{{\n    \"results\": [\n");
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& result = results[i];
+
+            fmt::format_to(out, "        {{\n            \"volume\": ");
+            json::write_string(out, result.volume);
+            fmt::format_to(out, ",\n            \"shader\": ");
+            json::write_string(out, result.shader);
+            fmt::format_to(out, ",\n            \"resolution\": ");
+            json::write_string(out, result.resolution);
+            fmt::format_to(out, ",\n            \"frames_in_flight\": {}", result.frames_in_flight);
+            fmt::format_to(out, ",\n            \"frames\": {},\n", result.frames);
+            fmt::format_to(out, "            \"frame_time_ms\": ");
+            write_percentiles_json(out, result.frame_time);
+            fmt::format_to(out, ",\n            \"dispatch_time_ms\": ");
+            write_percentiles_json(out, result.dispatch_time);
+            fmt::format_to(out, ",\n            \"mrays_per_s\": {}", result.mrays_per_s);
+            fmt::format_to(out, ",\n            \"fps\": {}\n", result.fps);
+            fmt::format_to(out, "        }}{}\n", i + 1 == results.size() ? "" : ",");
+        }
+
+        fmt::format_to(out, "    ]\n}}\n");
+        return fmt::to_string(out);
+    }
+
+    // Append a string to `out` as a quoted CSV field, where quotes are escaped by doubling them
+    void write_csv_string(fmt::memory_buffer& out, std::string_view str) {
+        out.push_back('"');
+        for (const char c : str) {
+            if (c == '"') {
+                out.push_back('"');
+            }
+
+            out.push_back(c);
+        }
+
+        out.push_back('"');
+    }
+
+    std::string to_csv(const std::vector<BenchResult>& results) {
+        fmt::memory_buffer out;
+        fmt::format_to(
+            out,
+            "volume,shader,resolution,frames_in_flight,frames,"
+            "frame_p50_ms,frame_p95_ms,frame_p99_ms,frame_max_ms,"
+            "dispatch_p50_ms,dispatch_p95_ms,dispatch_p99_ms,dispatch_max_ms,"
+            "mrays_per_s,fps\n"
+        );
+
+        for (const auto& r : results) {
+            write_csv_string(out, r.volume);
+            out.push_back(',');
+            write_csv_string(out, r.shader);
+            out.push_back(',');
+            write_csv_string(out, r.resolution);
+            fmt::format_to(
+                out,
+                ",{},{},{},{},{},{},{},{},{},{},{},{}\n",
+                r.frames_in_flight,
+                r.frames,
+                r.frame_time.p50,
+                r.frame_time.p95,
+                r.frame_time.p99,
+                r.frame_time.max,
+                r.dispatch_time.p50,
+                r.dispatch_time.p95,
+                r.dispatch_time.p99,
+                r.dispatch_time.max,
+                r.mrays_per_s,
+                r.fps
+            );
+        }
+
+        return fmt::to_string(out);
+    }
+
+    // Compare the results against a baseline written by an earlier run with --format json, and
+    // return whether any of the metrics got worse by more than the threshold (in percent)
+    bool find_regressions(const std::vector<BenchResult>& results, const std::filesystem::path& path, double threshold) {
+        auto in = std::ifstream(path);
+        if (!in) {
+            throw Error("Failed to open baseline '{}'", path.native());
+        }
+
+        auto ss = std::stringstream();
+        ss << in.rdbuf();
+        const auto baseline = json::parse(ss.str());
+
+        bool regressed = false;
+
+        // `higher_is_worse` selects the direction in which a change is a regression
+        auto compare = [&](std::string_view metric, double base, double current, bool higher_is_worse) {
+            if (base == 0) {
+                const bool worse = higher_is_worse && current > ZERO_BASELINE_THRESHOLD;
+                regressed |= worse;
+
+                fmt::print(
+                    stderr,
+                    "  {:<18} {:>12.4f} -> {:>12.4f} (zero baseline){}\n",
+                    metric,
+                    base,
+                    current,
+                    worse ? " REGRESSION" : ""
+                );
+
+                return;
+            }
+
+            const double change = (current - base) / base * 100.0;
+            const bool worse = higher_is_worse ? change > threshold : -change > threshold;
+            regressed |= worse;
+
+            fmt::print(
+                stderr,
+                "  {:<18} {:>12.4f} -> {:>12.4f} ({:+.2f}%){}\n",
+                metric,
+                base,
+                current,
+                change,
+                worse ? " REGRESSION" : ""
+            );
+        };
+
+        // Baselines written before frames in flight were benchmarked only have a single one
+        auto frames_in_flight = [](const json::Value& entry) {
+            const auto& object = entry.as_object();
+            auto it = object.find("frames_in_flight");
+            return it == object.end() ? 1.0 : it->second.as_number();
+        };
+
+        for (const auto& result : results) {
+            const auto& entries = baseline["results"].as_array();
+            auto it = std::find_if(entries.begin(), entries.end(), [&](const json::Value& entry) {
+                return entry["volume"].as_string() == result.volume &&
+                    entry["shader"].as_string() == result.shader &&
+                    entry["resolution"].as_string() == result.resolution &&
+                    frames_in_flight(entry) == static_cast<double>(result.frames_in_flight);
+            });
+
+            fmt::print(stderr, "{} ({}, {}, {} in flight):\n", result.volume, result.shader, result.resolution, result.frames_in_flight);
+
+            if (it == entries.end()) {
+                fmt::print(stderr, "  not in baseline\n");
+                continue;
+            }
+
+            const auto& entry = *it;
+            compare("frame p50 ms", entry["frame_time_ms"]["p50"].as_number(), result.frame_time.p50, true);
+            compare("frame p95 ms", entry["frame_time_ms"]["p95"].as_number(), result.frame_time.p95, true);
+            compare("dispatch p50 ms", entry["dispatch_time_ms"]["p50"].as_number(), result.dispatch_time.p50, true);
+            compare("dispatch p95 ms", entry["dispatch_time_ms"]["p95"].as_number(), result.dispatch_time.p95, true);
+            compare("mray/s", entry["mrays_per_s"].as_number(), result.mrays_per_s, false);
+
+            if (entry.as_object().count("fps") > 0) {
+                compare("fps", entry["fps"].as_number(), result.fps, false);
+            }
+        }
+
+        return regressed;
+    }
+}
+
+bool bench(Span<const char*> args) {
+    auto opts = BenchOptions();
+
+    auto cmd = args::Command {
+        .flags = {
+            {&opts.beam, "--beam"}
+        },
+        .parameters = {
+            {args::path_opt(&opts.config), "config path", "--headless"},
+            {args::string_opt(&opts.camera), "camera", "--camera"},
+            {args::string_opt(&opts.shaders), "shaders", "--shaders", 's'},
+            {args::string_opt(&opts.resolutions), "resolutions", "--resolutions"},
+            {args::string_opt(&opts.frames_in_flight), "amounts", "--frames-in-flight"},
+            {args::int_range_opt(&opts.warmup), "frames", "--warmup"},
+            {args::int_range_opt(&opts.repeat, size_t{1}), "frame repeat", "--repeat"},
+            {format_opt(&opts.format), "format", "--format"},
+            {args::string_opt(&opts.output), "output path", "--output"},
+            {args::path_opt(&opts.log_output), "output path", "--log-output"},
+            {args::path_opt(&opts.baseline), "baseline path", "--compare"},
+            {args::float_range_opt(&opts.threshold, 0.0), "percent", "--threshold"}
+        },
+        .positional = {
+            {args::string_opt(&opts.volumes), "volume paths"}
+        }
+    };
+
+    try {
+        args::parse(args, cmd);
+
+        if (opts.config.empty()) {
+            throw Error("Missing required option --headless");
+        } else if (opts.camera.empty() || opts.camera == "orbit") {
+            throw Error("Missing required camera script --camera");
+        }
+    } catch (const Error& e) {
+        fmt::print("Error: {}\n", e.what());
+        return false;
+    }
+
+    if (!opts.log_output.empty()) {
+        LOGGER.add_sink<FileSink>(opts.log_output);
+    }
+
+    const auto volumes = split_list(opts.volumes);
+    auto shaders = split_list(opts.shaders);
+    if (shaders.empty()) {
+        // Use the default shader of every volume
+        shaders.push_back("");
+    }
+
+    auto results = std::vector<BenchResult>();
+
+    try {
+        const auto base_config = load_headless_config(opts.config);
+
+        auto configs = std::vector<HeadlessConfig>();
+        for (auto resolution : split_list(opts.resolutions)) {
+            configs.push_back(apply_resolution(base_config, parse_resolution(resolution)));
+        }
+
+        if (configs.empty()) {
+            configs.push_back(base_config);
+        }
+
+        auto frames_in_flight = std::vector<uint32_t>();
+        for (auto amount : split_list(opts.frames_in_flight)) {
+            frames_in_flight.push_back(parse_frames_in_flight(amount));
+        }
+
+        if (frames_in_flight.empty()) {
+            frames_in_flight.push_back(1);
+        }
+
+        for (auto volume : volumes) {
+            for (auto shader : shaders) {
+                for (const auto& config : configs) {
+                    for (const auto amount : frames_in_flight) {
+                        const auto extent = total_extent(config);
+                        fmt::print(
+                            stderr,
+                            "Benchmarking {} with shader {} at {}x{}, {} frames in flight...\n",
+                            volume,
+                            shader.empty() ? "default" : shader,
+                            extent.width,
+                            extent.height,
+                            amount
+                        );
+
+                        results.push_back(run(opts, volume, shader, config, amount));
+                    }
+                }
+            }
+        }
+    } catch (const Error& e) {
+        fmt::print(stderr, "Error: {}\n", e.what());
+        return false;
+    }
+
+    const auto report = opts.format == BenchFormat::Json ? to_json(results) : to_csv(results);
+
+    if (opts.output == "-") {
+        fmt::print("{}", report);
+    } else {
+        auto out = std::ofstream(std::filesystem::path(opts.output));
+        if (!out) {
+            fmt::print(stderr, "Error: Failed to open output path '{}'\n", opts.output);
+            return false;
+        }
+
+        out << report;
+    }
+
+    if (opts.baseline.empty()) {
+        return true;
+    }
+
+    try {
+        if (find_regressions(results, opts.baseline, opts.threshold)) {
+            fmt::print(stderr, "Regressions of more than {}% found\n", opts.threshold);
+            return false;
+        }
+    } catch (const Error& e) {
+        fmt::print(stderr, "Error: Failed to compare with baseline: {}\n", e.what());
+        return false;
+    }
+
+    return true;
+}
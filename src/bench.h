@@ -0,0 +1,10 @@
+#ifndef _XENODON_BENCH_H
+#define _XENODON_BENCH_H
+
+#include "utility/Span.h"
+
+// Returns false if the benchmark failed, or if a regression was found when comparing
+// against a baseline
+bool bench(Span<const char*> args);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef _XENODON_CAMERA_CAMERA_H
 #define _XENODON_CAMERA_CAMERA_H
 
+#include <algorithm>
 #include "math/Vec.h"
 
 struct Camera {
@@ -9,4 +10,14 @@ struct Camera {
     Vec3F translation;
 };
 
+inline bool operator==(const Camera& lhs, const Camera& rhs) {
+    return std::equal(lhs.forward.begin(), lhs.forward.end(), rhs.forward.begin()) &&
+        std::equal(lhs.up.begin(), lhs.up.end(), rhs.up.begin()) &&
+        std::equal(lhs.translation.begin(), lhs.translation.end(), rhs.translation.begin());
+}
+
+inline bool operator!=(const Camera& lhs, const Camera& rhs) {
+    return !(lhs == rhs);
+}
+
 #endif
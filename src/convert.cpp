@@ -6,13 +6,16 @@
 #include <fmt/format.h>
 #include "core/arg_parse.h"
 #include "core/Error.h"
+#include "core/MemoryAccounting.h"
 #include "model/Grid.h"
 #include "model/Octree.h"
+#include "model/BrickOctree.h"
 #include "model/OctreeConstruction.h"
 
 void convert(Span<const char*> args) {
     auto src = std::filesystem::path();
     auto dst = std::filesystem::path();
+    auto memory_report = std::filesystem::path();
 
     // uint8_t split_difference = 0;
     bool dag = false;
@@ -21,6 +24,9 @@ void convert(Span<const char*> args) {
     int channel_difference = -1;
     double stddev = -1;
 
+    size_t brick_size = 0;
+    double brick_density = 0.5;
+
     auto cmd = args::Command {
         .flags = {
             {&dag, "--dag"},
@@ -28,7 +34,10 @@ void convert(Span<const char*> args) {
         },
         .parameters = {
             {args::int_range_opt<int>(&channel_difference, 0, 255), "channel difference", "--chan-diff"},
-            {args::float_range_opt(&stddev, 0.0), "std. dev", "--std-dev"}
+            {args::float_range_opt(&stddev, 0.0), "std. dev", "--std-dev"},
+            {args::int_range_opt<size_t>(&brick_size, 2), "brick size", "--brick"},
+            {args::float_range_opt(&brick_density, 0.0, 1.0), "brick density", "--brick-density"},
+            {args::path_opt(&memory_report), "output path", "--memory-report"}
         },
         .positional = {
             {args::path_opt(&src), "source tiff path"},
@@ -53,6 +62,16 @@ void convert(Span<const char*> args) {
         return;
     }
 
+    if (brick_size != 0 && (brick_size & (brick_size - 1)) != 0) {
+        fmt::print("Error: brick size must be a power of 2\n");
+        return;
+    }
+
+    if (brick_size != 0 && rope) {
+        fmt::print("Error: --brick and --rope are mutually exclusive\n");
+        return;
+    }
+
     fmt::print("Loading source...\n");
     std::unique_ptr<Grid> grid;
 
@@ -70,19 +89,31 @@ void convert(Span<const char*> args) {
         fmt::print(" Size: {:n} bytes\n", grid->memory_footprint());
     }
 
-    fmt::print("Converting to octree...\n");
+    fmt::print("Converting to {}...\n", brick_size != 0 ? "brick octree" : "octree");
 
     auto stats = ConstructionStats();
+    std::unique_ptr<Octree> sparse_octree;
+    std::unique_ptr<BrickOctree> brick_octree;
+
     auto convert_octree = [&](auto heuristic) {
-        const auto type = dag ? Octree::Type::Dag : rope ? Octree::Type::Rope : Octree::Type::Sparse;
-        return build_octree(*grid, stats, heuristic, type);
+        if (brick_size != 0) {
+            const auto params = BrickParams{brick_size, brick_density};
+            brick_octree = std::make_unique<BrickOctree>(build_brick_octree(*grid, stats, heuristic, params, dag));
+        } else {
+            const auto type = dag ? Octree::Type::Dag : rope ? Octree::Type::Rope : Octree::Type::Sparse;
+            sparse_octree = std::make_unique<Octree>(build_octree(*grid, stats, heuristic, type));
+        }
     };
 
-    auto octree = stddev >= 0 ?
-        convert_octree(StdDevHeuristic{stddev}) :
+    if (stddev >= 0) {
+        convert_octree(StdDevHeuristic{stddev});
+    } else {
         convert_octree(ChannelDiffHeuristic{
-                static_cast<uint8_t>(std::max(channel_difference, 0))
+            static_cast<uint8_t>(std::max(channel_difference, 0))
         });
+    }
+
+    const Octree& octree = brick_octree ? brick_octree->octree() : *sparse_octree;
 
     {
         auto k_ary_nodes = [](size_t k, size_t h) {
@@ -112,11 +143,36 @@ void convert(Span<const char*> args) {
         fmt::print(" Total leaves: {:n}\n", stats.total_leaves);
         fmt::print(" Unique leaves: {:n}\n", stats.unique_leaves);
         fmt::print(" Depth: {:n}\n", stats.depth);
+
+        if (brick_octree) {
+            fmt::print(" Bricks: {:n} of {}x{}x{} voxels\n", stats.bricks, brick_size, brick_size, brick_size);
+            fmt::print(" Node size: {:n} bytes\n", brick_octree->nodes_footprint());
+            fmt::print(" Brick size: {:n} bytes\n", brick_octree->bricks_footprint());
+            fmt::print(" Total size: {:n} bytes\n", brick_octree->memory_footprint());
+        }
     }
 
     try {
-        octree.save_svo(dst);
+        if (brick_octree) {
+            brick_octree->save(dst);
+        } else {
+            sparse_octree->save_svo(dst);
+        }
     } catch (const std::runtime_error& e) {
         fmt::print("Error writing '{}': {}\n", dst.native(), e.what());
     }
+
+    for (const auto& line : accounting::report()) {
+        fmt::print("{}\n", line);
+    }
+
+    if (memory_report.empty()) {
+        return;
+    }
+
+    try {
+        accounting::save(memory_report);
+    } catch (const Error& e) {
+        fmt::print("Error: {}\n", e.what());
+    }
 }
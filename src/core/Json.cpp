@@ -0,0 +1,289 @@
+#include "core/Json.h"
+#include <cctype>
+#include <cstdlib>
+
+namespace json {
+    namespace {
+        class JsonParser {
+            std::string_view input;
+            size_t offset;
+
+        public:
+            JsonParser(std::string_view input):
+                input(input), offset(0) {
+            }
+
+            Value parse_document() {
+                auto value = this->parse_value();
+                this->skip_ws();
+
+                if (this->offset != this->input.size()) {
+                    throw this->error("Expected end of input");
+                }
+
+                return value;
+            }
+
+        private:
+            template <typename... Args>
+            Error error(std::string_view fmt, const Args&... args) const {
+                return Error("JSON parse error at offset {}: {}", this->offset, fmt::format(fmt, args...));
+            }
+
+            int peek() const {
+                return this->offset < this->input.size() ? this->input[this->offset] : -1;
+            }
+
+            char consume() {
+                if (this->offset == this->input.size()) {
+                    throw this->error("Unexpected end of input");
+                }
+
+                return this->input[this->offset++];
+            }
+
+            void expect(char expected) {
+                char actual = this->consume();
+                if (actual != expected) {
+                    throw this->error("Expected character '{}', found '{}'", expected, actual);
+                }
+            }
+
+            void expect_literal(std::string_view literal) {
+                if (this->input.substr(this->offset, literal.size()) != literal) {
+                    throw this->error("Expected '{}'", literal);
+                }
+
+                this->offset += literal.size();
+            }
+
+            void skip_ws() {
+                while (this->peek() >= 0 && std::isspace(this->peek())) {
+                    ++this->offset;
+                }
+            }
+
+            Value parse_value() {
+                this->skip_ws();
+
+                switch (this->peek()) {
+                    case '{':
+                        return this->parse_object();
+                    case '[':
+                        return this->parse_array();
+                    case '"':
+                        return this->parse_string();
+                    case 't':
+                        this->expect_literal("true");
+                        return true;
+                    case 'f':
+                        this->expect_literal("false");
+                        return false;
+                    case 'n':
+                        this->expect_literal("null");
+                        return Value();
+                    default:
+                        return this->parse_number();
+                }
+            }
+
+            Value parse_object() {
+                auto object = Object();
+                this->expect('{');
+                this->skip_ws();
+
+                if (this->peek() == '}') {
+                    this->consume();
+                    return object;
+                }
+
+                while (true) {
+                    this->skip_ws();
+                    auto key = this->parse_string();
+                    this->skip_ws();
+                    this->expect(':');
+                    object.insert_or_assign(std::move(key), this->parse_value());
+                    this->skip_ws();
+
+                    if (this->consume() == '}') {
+                        return object;
+                    }
+
+                    --this->offset;
+                    this->expect(',');
+                }
+            }
+
+            Value parse_array() {
+                auto array = Array();
+                this->expect('[');
+                this->skip_ws();
+
+                if (this->peek() == ']') {
+                    this->consume();
+                    return array;
+                }
+
+                while (true) {
+                    array.push_back(this->parse_value());
+                    this->skip_ws();
+
+                    if (this->consume() == ']') {
+                        return array;
+                    }
+
+                    --this->offset;
+                    this->expect(',');
+                }
+            }
+
+            std::string parse_string() {
+                auto str = std::string();
+                this->expect('"');
+
+                while (true) {
+                    char c = this->consume();
+                    if (c == '"') {
+                        return str;
+                    } else if (c != '\\') {
+                        str.push_back(c);
+                        continue;
+                    }
+
+                    c = this->consume();
+                    switch (c) {
+                        case '"':
+                        case '\\':
+                        case '/':
+                            str.push_back(c);
+                            break;
+                        case 'b':
+                            str.push_back('\b');
+                            break;
+                        case 'f':
+                            str.push_back('\f');
+                            break;
+                        case 'n':
+                            str.push_back('\n');
+                            break;
+                        case 'r':
+                            str.push_back('\r');
+                            break;
+                        case 't':
+                            str.push_back('\t');
+                            break;
+                        case 'u': {
+                            // Only code points which fit in a single byte are supported, which
+                            // is all that write_string produces
+                            const auto hex = std::string(this->input.substr(this->offset, 4));
+                            char* end;
+                            const long code_point = std::strtol(hex.c_str(), &end, 16);
+                            if (hex.size() != 4 || end != hex.c_str() + 4 || code_point > 0xFF) {
+                                throw this->error("Unsupported unicode escape '\\u{}'", hex);
+                            }
+
+                            this->offset += 4;
+                            str.push_back(static_cast<char>(code_point));
+                            break;
+                        }
+                        default:
+                            throw this->error("Invalid escape sequence '\\{}'", c);
+                    }
+                }
+            }
+
+            Value parse_number() {
+                const size_t begin = this->offset;
+                while (this->peek() >= 0 && (std::isdigit(this->peek()) || std::string_view("+-.eE").find(static_cast<char>(this->peek())) != std::string_view::npos)) {
+                    ++this->offset;
+                }
+
+                const auto number = std::string(this->input.substr(begin, this->offset - begin));
+                char* end;
+                const double value = std::strtod(number.c_str(), &end);
+
+                if (number.empty() || end != number.c_str() + number.size()) {
+                    this->offset = begin;
+                    throw this->error("Expected value");
+                }
+
+                return value;
+            }
+        };
+    }
+
+    const Array& Value::as_array() const {
+        if (!this->is<Array>()) {
+            throw Error("Expected JSON array");
+        }
+
+        return std::get<Array>(this->data);
+    }
+
+    const Object& Value::as_object() const {
+        if (!this->is<Object>()) {
+            throw Error("Expected JSON object");
+        }
+
+        return std::get<Object>(this->data);
+    }
+
+    const std::string& Value::as_string() const {
+        if (!this->is<std::string>()) {
+            throw Error("Expected JSON string");
+        }
+
+        return std::get<std::string>(this->data);
+    }
+
+    double Value::as_number() const {
+        if (!this->is<double>()) {
+            throw Error("Expected JSON number");
+        }
+
+        return std::get<double>(this->data);
+    }
+
+    const Value& Value::operator[](std::string_view key) const {
+        const auto& object = this->as_object();
+        auto it = object.find(key);
+        if (it == object.end()) {
+            throw Error("Missing JSON key '{}'", key);
+        }
+
+        return it->second;
+    }
+
+    Value parse(std::string_view str) {
+        return JsonParser(str).parse_document();
+    }
+
+    void write_string(fmt::memory_buffer& out, std::string_view str) {
+        fmt::format_to(out, "\"");
+
+        for (char c : str) {
+            switch (c) {
+                case '"':
+                    fmt::format_to(out, "\\\"");
+                    break;
+                case '\\':
+                    fmt::format_to(out, "\\\\");
+                    break;
+                case '\n':
+                    fmt::format_to(out, "\\n");
+                    break;
+                case '\t':
+                    fmt::format_to(out, "\\t");
+                    break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        fmt::format_to(out, "\\u{:04x}", static_cast<unsigned>(c));
+                    } else {
+                        fmt::format_to(out, "{}", c);
+                    }
+            }
+        }
+
+        fmt::format_to(out, "\"");
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef _XENODON_CORE_JSON_H
+#define _XENODON_CORE_JSON_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <variant>
+#include <utility>
+#include <fmt/format.h>
+#include "core/Error.h"
+
+// A minimal JSON document model, which is enough to read back the files written by Xenodon,
+// such as the results of 'xenodon bench'. Numbers are always stored as doubles.
+namespace json {
+    struct Value;
+
+    using Array = std::vector<Value>;
+    using Object = std::map<std::string, Value, std::less<>>;
+
+    struct Value {
+        std::variant<std::nullptr_t, bool, double, std::string, Array, Object> data;
+
+        Value():
+            data(nullptr) {
+        }
+
+        Value(bool value):
+            data(value) {
+        }
+
+        Value(double value):
+            data(value) {
+        }
+
+        Value(std::string&& value):
+            data(std::move(value)) {
+        }
+
+        Value(Array&& value):
+            data(std::move(value)) {
+        }
+
+        Value(Object&& value):
+            data(std::move(value)) {
+        }
+
+        template <typename T>
+        bool is() const {
+            return std::holds_alternative<T>(this->data);
+        }
+
+        // These throw an Error if the value is of a different type, or the key does not exist
+        const Array& as_array() const;
+        const Object& as_object() const;
+        const std::string& as_string() const;
+        double as_number() const;
+        const Value& operator[](std::string_view key) const;
+    };
+
+    Value parse(std::string_view str);
+
+    // Append a string to `out` as a quoted and escaped JSON string
+    void write_string(fmt::memory_buffer& out, std::string_view str);
+}
+
+#endif
@@ -18,6 +18,8 @@ void FileSink::write(std::string_view line) {
 }
 
 void Logger::write(std::string_view fmt, fmt::format_args args) {
+    auto lock = std::lock_guard(this->mutex);
+
     auto buf = fmt::memory_buffer();
     std::time_t t = std::time(nullptr);
     fmt::format_to(buf, "[{:%H:%M:%S}] ", *std::localtime(&t));
@@ -7,6 +7,7 @@
 #include <vector>
 #include <fstream>
 #include <filesystem>
+#include <mutex>
 #include <cstddef>
 #include <fmt/format.h>
 
@@ -31,6 +32,9 @@ public:
 class Logger {
     std::vector<std::unique_ptr<Sink>> sinks;
 
+    // Messages may be logged from worker threads
+    std::mutex mutex;
+
 public:
     Logger() = default;
 
@@ -0,0 +1,250 @@
+#include "core/MemoryAccounting.h"
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <mutex>
+#include <fstream>
+#include <string_view>
+#include <algorithm>
+#include <fmt/format.h>
+#include "core/Json.h"
+#include "core/Error.h"
+
+namespace accounting {
+    namespace {
+        constexpr const auto HOST_CATEGORY_NAMES = std::array<std::string_view, static_cast<size_t>(HostCategory::Max)> {
+            "grid",
+            "octree",
+            "bricks",
+            "construction"
+        };
+
+        struct Usage {
+            size_t current = 0;
+            size_t peak = 0;
+            size_t allocations = 0;
+
+            void add(size_t bytes) {
+                this->current += bytes;
+                this->peak = std::max(this->peak, this->current);
+                ++this->allocations;
+            }
+
+            void remove(size_t bytes) {
+                this->current -= bytes;
+            }
+        };
+
+        struct HeapUsage {
+            vk::MemoryHeap heap;
+            Usage usage;
+        };
+
+        struct DeviceUsage {
+            std::string name;
+            std::vector<uint32_t> memory_type_heaps;
+            std::vector<HeapUsage> heaps;
+            Usage total;
+        };
+
+        struct DeviceAllocation {
+            size_t device;
+            uint32_t heap;
+            vk::DeviceSize size;
+        };
+
+        std::mutex MUTEX;
+
+        std::array<Usage, static_cast<size_t>(HostCategory::Max)> HOST_USAGE;
+        Usage HOST_TOTAL;
+
+        std::vector<DeviceUsage> DEVICES;
+
+        // Devices are identified by the index of their registration, as handles may be
+        // reused after a device is destroyed
+        std::unordered_map<VkDevice, size_t> DEVICE_INDICES;
+        std::unordered_map<VkDeviceMemory, DeviceAllocation> DEVICE_ALLOCATIONS;
+
+        Usage& host_usage(HostCategory category) {
+            return HOST_USAGE[static_cast<size_t>(category)];
+        }
+
+        void write_usage(fmt::memory_buffer& out, const Usage& usage) {
+            fmt::format_to(
+                out,
+                "\"current\":{},\"peak\":{},\"allocations\":{}",
+                usage.current,
+                usage.peak,
+                usage.allocations
+            );
+        }
+    }
+
+    void host_allocate(HostCategory category, size_t bytes) {
+        auto lock = std::unique_lock(MUTEX);
+        host_usage(category).add(bytes);
+        HOST_TOTAL.add(bytes);
+    }
+
+    void host_free(HostCategory category, size_t bytes) {
+        auto lock = std::unique_lock(MUTEX);
+        host_usage(category).remove(bytes);
+        HOST_TOTAL.remove(bytes);
+    }
+
+    void host_transient(HostCategory category, size_t bytes) {
+        auto lock = std::unique_lock(MUTEX);
+        host_usage(category).add(bytes);
+        HOST_TOTAL.add(bytes);
+        host_usage(category).remove(bytes);
+        HOST_TOTAL.remove(bytes);
+    }
+
+    void register_device(vk::Device device, vk::PhysicalDevice physdev) {
+        const auto props = physdev.getProperties();
+        const auto mem_props = physdev.getMemoryProperties();
+
+        auto usage = DeviceUsage{
+            props.deviceName,
+            std::vector<uint32_t>(mem_props.memoryTypeCount),
+            std::vector<HeapUsage>(mem_props.memoryHeapCount),
+            Usage()
+        };
+
+        for (uint32_t i = 0; i < mem_props.memoryTypeCount; ++i) {
+            usage.memory_type_heaps[i] = mem_props.memoryTypes[i].heapIndex;
+        }
+
+        for (uint32_t i = 0; i < mem_props.memoryHeapCount; ++i) {
+            usage.heaps[i].heap = mem_props.memoryHeaps[i];
+        }
+
+        auto lock = std::unique_lock(MUTEX);
+        DEVICE_INDICES[device] = DEVICES.size();
+        DEVICES.push_back(std::move(usage));
+    }
+
+    void device_allocate(vk::Device device, uint32_t memory_type, vk::DeviceMemory memory, vk::DeviceSize size) {
+        auto lock = std::unique_lock(MUTEX);
+        const auto it = DEVICE_INDICES.find(device);
+        if (it == DEVICE_INDICES.end()) {
+            return;
+        }
+
+        auto& usage = DEVICES[it->second];
+        const uint32_t heap = usage.memory_type_heaps[memory_type];
+        usage.heaps[heap].usage.add(size);
+        usage.total.add(size);
+
+        DEVICE_ALLOCATIONS[memory] = {it->second, heap, size};
+    }
+
+    void device_free(vk::DeviceMemory memory) {
+        auto lock = std::unique_lock(MUTEX);
+        const auto it = DEVICE_ALLOCATIONS.find(memory);
+        if (it == DEVICE_ALLOCATIONS.end()) {
+            return;
+        }
+
+        const auto [device, heap, size] = it->second;
+        DEVICES[device].heaps[heap].usage.remove(size);
+        DEVICES[device].total.remove(size);
+        DEVICE_ALLOCATIONS.erase(it);
+    }
+
+    std::vector<std::string> report() {
+        auto lock = std::unique_lock(MUTEX);
+        auto lines = std::vector<std::string>();
+
+        lines.push_back(fmt::format("Host memory: {:n} bytes, peak {:n} bytes", HOST_TOTAL.current, HOST_TOTAL.peak));
+        for (size_t i = 0; i < HOST_USAGE.size(); ++i) {
+            const auto& usage = HOST_USAGE[i];
+            if (usage.allocations == 0) {
+                continue;
+            }
+
+            lines.push_back(fmt::format(" {}: {:n} bytes, peak {:n} bytes", HOST_CATEGORY_NAMES[i], usage.current, usage.peak));
+        }
+
+        for (size_t i = 0; i < DEVICES.size(); ++i) {
+            const auto& device = DEVICES[i];
+            lines.push_back(fmt::format(
+                "Device {} ({}): {:n} bytes, peak {:n} bytes in {} allocations",
+                i,
+                device.name,
+                device.total.current,
+                device.total.peak,
+                device.total.allocations
+            ));
+
+            for (size_t j = 0; j < device.heaps.size(); ++j) {
+                const auto& [heap, usage] = device.heaps[j];
+                if (usage.allocations == 0) {
+                    continue;
+                }
+
+                lines.push_back(fmt::format(
+                    " heap {} ({}{:n} bytes): {:n} bytes, peak {:n} bytes ({:.1f}%)",
+                    j,
+                    heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal ? "device local, " : "",
+                    heap.size,
+                    usage.current,
+                    usage.peak,
+                    static_cast<double>(usage.peak) / static_cast<double>(heap.size) * 100.0
+                ));
+            }
+        }
+
+        return lines;
+    }
+
+    void save(const std::filesystem::path& path) {
+        auto lock = std::unique_lock(MUTEX);
+        fmt::memory_buffer out;
+
+        fmt::format_to(out, "{{\n\"host\":{{");
+        write_usage(out, HOST_TOTAL);
+        fmt::format_to(out, ",\"categories\":{{");
+
+        for (size_t i = 0; i < HOST_USAGE.size(); ++i) {
+            fmt::format_to(out, "{}\n\"{}\":{{", i == 0 ? "" : ",", HOST_CATEGORY_NAMES[i]);
+            write_usage(out, HOST_USAGE[i]);
+            fmt::format_to(out, "}}");
+        }
+
+        fmt::format_to(out, "}}}},\n\"devices\":[");
+
+        for (size_t i = 0; i < DEVICES.size(); ++i) {
+            const auto& device = DEVICES[i];
+            fmt::format_to(out, "{}\n{{\"name\":", i == 0 ? "" : ",");
+            json::write_string(out, device.name);
+            fmt::format_to(out, ",");
+            write_usage(out, device.total);
+            fmt::format_to(out, ",\"heaps\":[");
+
+            for (size_t j = 0; j < device.heaps.size(); ++j) {
+                const auto& [heap, usage] = device.heaps[j];
+                fmt::format_to(
+                    out,
+                    "{}{{\"size\":{},\"device_local\":{},",
+                    j == 0 ? "" : ",",
+                    heap.size,
+                    heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal ? "true" : "false"
+                );
+                write_usage(out, usage);
+                fmt::format_to(out, "}}");
+            }
+
+            fmt::format_to(out, "]}}");
+        }
+
+        fmt::format_to(out, "\n]\n}}\n");
+
+        auto file = std::ofstream(path, std::ios::binary);
+        if (!file) {
+            throw Error("Failed to open memory report output '{}'", path.native());
+        }
+
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    }
+}
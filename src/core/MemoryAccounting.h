@@ -0,0 +1,87 @@
+#ifndef _XENODON_CORE_MEMORYACCOUNTING_H
+#define _XENODON_CORE_MEMORYACCOUNTING_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <vulkan/vulkan.hpp>
+
+// Accounting of the memory used by volumes on the host, and of every allocation made through
+// Device::allocate. For every host category and every heap of every device, the current and peak
+// usage are tracked, so that the sizes of volumes can be planned against the available memory.
+namespace accounting {
+    // Keep in sync with the names in MemoryAccounting.cpp
+    enum class HostCategory {
+        Grid,
+        Octree,
+        Bricks,
+        // The node list and deduplication cache which only exist while constructing an octree
+        Construction,
+        Max
+    };
+
+    void host_allocate(HostCategory category, size_t bytes);
+    void host_free(HostCategory category, size_t bytes);
+
+    // Account for memory which is allocated and freed again right away, such as the buffers
+    // of octree construction, of which only the peak size is known.
+    void host_transient(HostCategory category, size_t bytes);
+
+    // Registers the memory of an object for the lifetime of this object. Copies register the
+    // memory again, so this can be a member of the object which owns the memory.
+    class HostAllocation {
+        HostCategory category;
+        size_t bytes;
+
+    public:
+        HostAllocation(HostCategory category, size_t bytes):
+            category(category), bytes(bytes) {
+            host_allocate(this->category, this->bytes);
+        }
+
+        HostAllocation(const HostAllocation& other):
+            HostAllocation(other.category, other.bytes) {
+        }
+
+        HostAllocation(HostAllocation&& other):
+            category(other.category), bytes(std::exchange(other.bytes, 0)) {
+        }
+
+        HostAllocation& operator=(const HostAllocation& other) {
+            host_free(this->category, this->bytes);
+            this->category = other.category;
+            this->bytes = other.bytes;
+            host_allocate(this->category, this->bytes);
+            return *this;
+        }
+
+        HostAllocation& operator=(HostAllocation&& other) {
+            std::swap(this->category, other.category);
+            std::swap(this->bytes, other.bytes);
+            return *this;
+        }
+
+        ~HostAllocation() {
+            host_free(this->category, this->bytes);
+        }
+    };
+
+    // Called by Device when it is created. Allocations of a device are reported under the
+    // index of its registration.
+    void register_device(vk::Device device, vk::PhysicalDevice physdev);
+
+    void device_allocate(vk::Device device, uint32_t memory_type, vk::DeviceMemory memory, vk::DeviceSize size);
+
+    // Must be called before the memory is freed
+    void device_free(vk::DeviceMemory memory);
+
+    // A human readable report, with a line per host category and device heap which was used
+    std::vector<std::string> report();
+
+    void save(const std::filesystem::path& path);
+}
+
+#endif
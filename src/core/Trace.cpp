@@ -0,0 +1,163 @@
+#include "core/Trace.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <utility>
+#include <fmt/format.h>
+#include "core/Json.h"
+#include "core/Error.h"
+
+namespace trace {
+    namespace detail {
+        std::atomic<bool> ENABLED = false;
+    }
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        // CPU events are displayed in this process, and the GPU events in the next
+        constexpr const int CPU_PID = 0;
+        constexpr const int GPU_PID = 1;
+
+        // Events are recorded in blocks of this size. A full block is never reallocated, a
+        // new one is started instead, so recording an event never copies the earlier ones.
+        constexpr const size_t EVENT_BLOCK_SIZE = 4096;
+
+        struct Event {
+            const char* name;
+            int64_t begin;
+            int64_t end;
+
+            // -1 for events recorded on the CPU
+            int32_t device;
+            uint32_t output;
+        };
+
+        struct ThreadBuffer {
+            size_t tid;
+            std::string name;
+            std::vector<std::vector<Event>> blocks;
+        };
+
+        Clock::time_point START;
+
+        // Owns the buffers of all threads which ever recorded an event, so that they
+        // can still be saved after their thread has exited
+        std::mutex REGISTRY_MUTEX;
+        std::vector<std::unique_ptr<ThreadBuffer>> BUFFERS;
+
+        thread_local ThreadBuffer* THREAD_BUFFER = nullptr;
+
+        ThreadBuffer& thread_buffer() {
+            if (!THREAD_BUFFER) {
+                auto lock = std::unique_lock(REGISTRY_MUTEX);
+                const size_t tid = BUFFERS.size();
+                BUFFERS.push_back(std::make_unique<ThreadBuffer>(ThreadBuffer{
+                    tid,
+                    fmt::format("Thread {}", tid),
+                    std::vector<std::vector<Event>>()
+                }));
+
+                THREAD_BUFFER = BUFFERS.back().get();
+            }
+
+            return *THREAD_BUFFER;
+        }
+
+        void push(const Event& event) {
+            auto& blocks = thread_buffer().blocks;
+            if (blocks.empty() || blocks.back().size() == EVENT_BLOCK_SIZE) {
+                blocks.emplace_back().reserve(EVENT_BLOCK_SIZE);
+            }
+
+            blocks.back().push_back(event);
+        }
+
+        void write_metadata(fmt::memory_buffer& out, int pid, size_t tid, std::string_view name) {
+            fmt::format_to(out, ",\n{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":{},\"tid\":{},\"args\":{{\"name\":", pid, tid);
+            json::write_string(out, name);
+            fmt::format_to(out, "}}}}");
+        }
+
+        void write_event(fmt::memory_buffer& out, int pid, size_t tid, const Event& event) {
+            // Event times are in microseconds
+            fmt::format_to(out, ",\n{{\"ph\":\"X\",\"name\":");
+            json::write_string(out, event.name);
+            fmt::format_to(
+                out,
+                ",\"pid\":{},\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                pid,
+                tid,
+                static_cast<double>(event.begin) / 1'000.0,
+                static_cast<double>(event.end - event.begin) / 1'000.0
+            );
+        }
+    }
+
+    void enable() {
+        START = Clock::now();
+        detail::ENABLED.store(true, std::memory_order_relaxed);
+    }
+
+    int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - START).count();
+    }
+
+    void record(const char* name, int64_t begin, int64_t end) {
+        push({name, begin, end, -1, 0});
+    }
+
+    void record_gpu(size_t device, size_t output, const char* name, int64_t begin, int64_t end) {
+        push({name, begin, end, static_cast<int32_t>(device), static_cast<uint32_t>(output)});
+    }
+
+    void set_thread_name(std::string name) {
+        thread_buffer().name = std::move(name);
+    }
+
+    void save(const std::filesystem::path& path) {
+        auto lock = std::unique_lock(REGISTRY_MUTEX);
+        fmt::memory_buffer out;
+
+        fmt::format_to(out, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fmt::format_to(out, "{{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":{},\"args\":{{\"name\":\"CPU\"}}}}", CPU_PID);
+        fmt::format_to(out, ",\n{{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":{},\"args\":{{\"name\":\"GPU\"}}}}", GPU_PID);
+
+        // Every output of every device gets its own GPU track
+        auto gpu_tracks = std::set<std::pair<int32_t, uint32_t>>();
+        auto gpu_tid = [](const Event& event) {
+            return static_cast<size_t>(event.device) * 256 + event.output;
+        };
+
+        for (const auto& buffer : BUFFERS) {
+            write_metadata(out, CPU_PID, buffer->tid, buffer->name);
+
+            for (const auto& block : buffer->blocks) {
+                for (const auto& event : block) {
+                    if (event.device < 0) {
+                        write_event(out, CPU_PID, buffer->tid, event);
+                        continue;
+                    }
+
+                    if (gpu_tracks.emplace(event.device, event.output).second) {
+                        write_metadata(out, GPU_PID, gpu_tid(event), fmt::format("Device {}, output {}", event.device, event.output));
+                    }
+
+                    write_event(out, GPU_PID, gpu_tid(event), event);
+                }
+            }
+        }
+
+        fmt::format_to(out, "\n]}}\n");
+
+        auto file = std::ofstream(path, std::ios::binary);
+        if (!file) {
+            throw Error("Failed to open trace output '{}'", path.native());
+        }
+
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef _XENODON_CORE_TRACE_H
+#define _XENODON_CORE_TRACE_H
+
+#include <string>
+#include <filesystem>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Timeline tracing of host side work, such as recording and submitting command buffers and waiting
+// for fences, together with the GPU dispatch times measured by RenderStatsCollector. Traces are
+// saved in the Chrome trace event format, and can be viewed with chrome://tracing or Perfetto.
+//
+// Every thread records its events into its own buffer, so recording does not take any locks. The
+// buffers are only read by save(), which requires that no thread records events at the same time.
+// Tracing is compiled out entirely unless XENODON_TRACING is defined, see the 'tracing' build option.
+namespace trace {
+    namespace detail {
+        extern std::atomic<bool> ENABLED;
+    }
+
+    // Start recording events. The timestamps of all events are relative to this moment.
+    void enable();
+
+    inline bool enabled() {
+        return detail::ENABLED.load(std::memory_order_relaxed);
+    }
+
+    // Nanoseconds since tracing was enabled
+    int64_t now();
+
+    // Record an event of the calling thread. `name` must outlive the trace.
+    void record(const char* name, int64_t begin, int64_t end);
+
+    // Record an event on the GPU timeline of an output of a render device. The times must be
+    // converted to the host clock, see now().
+    void record_gpu(size_t device, size_t output, const char* name, int64_t begin, int64_t end);
+
+    // Set the name under which the events of the calling thread are displayed
+    void set_thread_name(std::string name);
+
+    void save(const std::filesystem::path& path);
+
+    // Records an event spanning its own lifetime, if tracing is enabled
+    class Scope {
+        const char* name;
+        int64_t begin;
+
+    public:
+        explicit Scope(const char* name):
+            name(name), begin(enabled() ? now() : -1) {
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() {
+            if (this->begin >= 0) {
+                record(this->name, this->begin, now());
+            }
+        }
+    };
+}
+
+#if defined(XENODON_TRACING)
+    #define XENODON_TRACE_CONCAT_IMPL(a, b) a##b
+    #define XENODON_TRACE_CONCAT(a, b) XENODON_TRACE_CONCAT_IMPL(a, b)
+    #define TRACE_SCOPE(name) const auto XENODON_TRACE_CONCAT(trace_scope_, __LINE__) = trace::Scope(name)
+#else
+    #define TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+#endif
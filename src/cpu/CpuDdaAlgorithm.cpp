@@ -0,0 +1,105 @@
+#include "cpu/CpuDdaAlgorithm.h"
+#include <algorithm>
+#include <utility>
+
+using simd::F32;
+using simd::I32;
+using simd::Mask;
+
+CpuDdaAlgorithm::CpuDdaAlgorithm(std::shared_ptr<Grid> grid, const CpuShaderParameters& params):
+    grid(std::move(grid)), params(params) {
+}
+
+simd::Vec3 CpuDdaAlgorithm::trace(const Vec3F& translation, const simd::Vec3& rd) const {
+    const auto dim = this->grid->dimensions();
+    const float side = static_cast<float>(std::max({dim.x, dim.y, dim.z}));
+    const auto ro = simd::splat(translation * side);
+
+    const auto rrd = simd::Vec3{1.f / rd.x, 1.f / rd.y, 1.f / rd.z};
+
+    const auto box_min = simd::Vec3{-ro.x * rrd.x, -ro.y * rrd.y, -ro.z * rrd.z};
+    const auto box_max = simd::Vec3{
+        (static_cast<float>(dim.x) - ro.x) * rrd.x,
+        (static_cast<float>(dim.y) - ro.y) * rrd.y,
+        (static_cast<float>(dim.z) - ro.z) * rrd.z
+    };
+
+    F32 t_min = simd::max_elem({simd::min(box_min.x, box_max.x), simd::min(box_min.y, box_max.y), simd::min(box_min.z, box_max.z)});
+    const F32 t_max = simd::min_elem({simd::max(box_min.x, box_max.x), simd::max(box_min.y, box_max.y), simd::max(box_min.z, box_max.z)});
+
+    // Lanes whose ray misses the bounding cube are never active
+    Mask active = t_min <= t_max;
+
+    t_min = simd::max(t_min, simd::splat(0.f));
+
+    const auto start = simd::Vec3{ro.x + rd.x * t_min, ro.y + rd.y * t_min, ro.z + rd.z * t_min};
+    I32 pos_x = __builtin_convertvector(start.x, I32);
+    I32 pos_y = __builtin_convertvector(start.y, I32);
+    I32 pos_z = __builtin_convertvector(start.z, I32);
+
+    const auto t_delta = simd::Vec3{simd::abs(rrd.x), simd::abs(rrd.y), simd::abs(rrd.z)};
+    const auto sgn = simd::Vec3{simd::sign(rd.x), simd::sign(rd.y), simd::sign(rd.z)};
+    const I32 step_x = __builtin_convertvector(sgn.x, I32);
+    const I32 step_y = __builtin_convertvector(sgn.y, I32);
+    const I32 step_z = __builtin_convertvector(sgn.z, I32);
+
+    auto side_dist = simd::Vec3{
+        (sgn.x * (simd::floor(start.x) - start.x + 0.5f) + 0.5f) * t_delta.x,
+        (sgn.y * (simd::floor(start.y) - start.y + 0.5f) + 0.5f) * t_delta.y,
+        (sgn.z * (simd::floor(start.z) - start.z + 0.5f) + 0.5f) * t_delta.z
+    };
+
+    const F32 t_end = t_max - t_min;
+    F32 t = simd::splat(0.f);
+    auto total = simd::Vec3{simd::splat(0.f), simd::splat(0.f), simd::splat(0.f)};
+
+    active &= t < t_end;
+
+    while (simd::any(active)) {
+        const Mask mask_x = side_dist.x <= simd::min(side_dist.y, side_dist.z);
+        const Mask mask_y = side_dist.y <= simd::min(side_dist.z, side_dist.x);
+        const Mask mask_z = side_dist.z <= simd::min(side_dist.x, side_dist.y);
+
+        const F32 t0 = simd::min_elem(side_dist);
+
+        // Voxels outside the grid are black, like texel fetches outside the texture
+        auto voxel = simd::Vec3{simd::splat(0.f), simd::splat(0.f), simd::splat(0.f)};
+        for (size_t i = 0; i < simd::WIDTH; ++i) {
+            if (!active[i] ||
+                pos_x[i] < 0 || static_cast<size_t>(pos_x[i]) >= dim.x ||
+                pos_y[i] < 0 || static_cast<size_t>(pos_y[i]) >= dim.y ||
+                pos_z[i] < 0 || static_cast<size_t>(pos_z[i]) >= dim.z) {
+                continue;
+            }
+
+            const auto pixel = this->grid->at({
+                static_cast<size_t>(pos_x[i]),
+                static_cast<size_t>(pos_y[i]),
+                static_cast<size_t>(pos_z[i])
+            });
+
+            voxel.x[i] = static_cast<float>(pixel.r) / 255.f;
+            voxel.y[i] = static_cast<float>(pixel.g) / 255.f;
+            voxel.z[i] = static_cast<float>(pixel.b) / 255.f;
+        }
+
+        const F32 dt = active ? t0 - t : simd::splat(0.f);
+        total.x += voxel.x * dt;
+        total.y += voxel.y * dt;
+        total.z += voxel.z * dt;
+        t = active ? t0 : t;
+
+        side_dist.x += (mask_x & active) ? t_delta.x : simd::splat(0.f);
+        side_dist.y += (mask_y & active) ? t_delta.y : simd::splat(0.f);
+        side_dist.z += (mask_z & active) ? t_delta.z : simd::splat(0.f);
+
+        pos_x += mask_x & active & step_x;
+        pos_y += mask_y & active & step_y;
+        pos_z += mask_z & active & step_z;
+
+        active &= t < t_end;
+    }
+
+    const F32 ec = voxel_emission_coeff(this->params, rd) / side;
+    return {total.x * ec, total.y * ec, total.z * ec};
+}
@@ -0,0 +1,19 @@
+#ifndef _XENODON_CPU_CPUDDAALGORITHM_H
+#define _XENODON_CPU_CPUDDAALGORITHM_H
+
+#include <memory>
+#include "cpu/CpuRaytraceAlgorithm.h"
+#include "model/Grid.h"
+
+// Port of resources/dda.comp
+class CpuDdaAlgorithm final: public CpuRaytraceAlgorithm {
+    std::shared_ptr<Grid> grid;
+    CpuShaderParameters params;
+
+public:
+    CpuDdaAlgorithm(std::shared_ptr<Grid> grid, const CpuShaderParameters& params);
+
+    simd::Vec3 trace(const Vec3F& translation, const simd::Vec3& rd) const override;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#include "cpu/CpuEsvoAlgorithm.h"
+#include <utility>
+#include <cmath>
+
+using simd::F32;
+using simd::U32;
+using simd::Mask;
+
+namespace {
+    // Same as in the shader, one less than the number of bits in the mantissa of a float
+    constexpr const uint32_t CAST_STACK_DEPTH = 23;
+
+    U32 cxor(Mask ax, Mask ay, Mask az) {
+        return (reinterpret_cast<U32>(ax) & 4u) ^ (reinterpret_cast<U32>(ay) & 2u) ^ (reinterpret_cast<U32>(az) & 1u);
+    }
+
+    U32 float_bits(F32 x) {
+        return reinterpret_cast<U32>(x);
+    }
+
+    F32 bits_float(U32 x) {
+        return reinterpret_cast<F32>(x);
+    }
+}
+
+CpuEsvoAlgorithm::CpuEsvoAlgorithm(std::shared_ptr<Octree> octree, const CpuShaderParameters& params):
+    octree(std::move(octree)), params(params) {
+}
+
+simd::Vec3 CpuEsvoAlgorithm::trace(const Vec3F& translation, const simd::Vec3& rd) const {
+    const auto nodes = this->octree->data();
+
+    // Move the ray origin onto the octree's bounding cube [1, 2]^3, see main() in the shader
+    auto ro = simd::splat(translation + 1.f);
+    {
+        const auto rrd = simd::Vec3{1.f / (rd.x + 0.00000001f), 1.f / (rd.y + 0.00000001f), 1.f / (rd.z + 0.00000001f)};
+        const auto tbot = simd::Vec3{(1.f - ro.x) * rrd.x, (1.f - ro.y) * rrd.y, (1.f - ro.z) * rrd.z};
+        const auto ttop = simd::Vec3{(2.f - ro.x) * rrd.x, (2.f - ro.y) * rrd.y, (2.f - ro.z) * rrd.z};
+        const F32 t0 = simd::max(simd::max_elem({simd::min(ttop.x, tbot.x), simd::min(ttop.y, tbot.y), simd::min(ttop.z, tbot.z)}), simd::splat(0.f));
+        ro = simd::Vec3{ro.x + t0 * rd.x, ro.y + t0 * rd.y, ro.z + t0 * rd.z};
+    }
+
+    // Every lane has its own stack, with an extra slot like the shader
+    uint32_t node_stack[CAST_STACK_DEPTH + 1][simd::WIDTH];
+    float t_max_stack[CAST_STACK_DEPTH + 1][simd::WIDTH];
+
+    const auto t_coeff = simd::Vec3{1.f / -simd::abs(rd.x), 1.f / -simd::abs(rd.y), 1.f / -simd::abs(rd.z)};
+    auto t_bias = simd::Vec3{t_coeff.x * ro.x, t_coeff.y * ro.y, t_coeff.z * ro.z};
+
+    const Mask gt0_x = rd.x > 0;
+    const Mask gt0_y = rd.y > 0;
+    const Mask gt0_z = rd.z > 0;
+    t_bias.x = gt0_x ? 3.f * t_coeff.x - t_bias.x : t_bias.x;
+    t_bias.y = gt0_y ? 3.f * t_coeff.y - t_bias.y : t_bias.y;
+    t_bias.z = gt0_z ? 3.f * t_coeff.z - t_bias.z : t_bias.z;
+    const U32 octant_mask = cxor(gt0_x, gt0_y, gt0_z);
+
+    F32 t_min = simd::max_elem({2.f * t_coeff.x - t_bias.x, 2.f * t_coeff.y - t_bias.y, 2.f * t_coeff.z - t_bias.z});
+    F32 t_max = simd::min_elem({t_coeff.x - t_bias.x, t_coeff.y - t_bias.y, t_coeff.z - t_bias.z});
+    F32 h = t_max;
+
+    t_min = simd::max(t_min, simd::splat(0.f));
+    t_max = simd::min(t_max, simd::splat(std::sqrt(3.f)));
+
+    U32 parent = simd::splat(static_cast<uint32_t>(Octree::ROOT));
+    U32 idx;
+    auto pos = simd::Vec3{simd::splat(1.f), simd::splat(1.f), simd::splat(1.f)};
+    U32 scale = simd::splat(CAST_STACK_DEPTH - 1);
+    F32 scale_exp2 = simd::splat(0.5f);
+
+    {
+        const Mask a_x = 1.5f * t_coeff.x - t_bias.x > t_min;
+        const Mask a_y = 1.5f * t_coeff.y - t_bias.y > t_min;
+        const Mask a_z = 1.5f * t_coeff.z - t_bias.z > t_min;
+        pos.x = a_x ? simd::splat(1.5f) : pos.x;
+        pos.y = a_y ? simd::splat(1.5f) : pos.y;
+        pos.z = a_z ? simd::splat(1.5f) : pos.z;
+        idx = cxor(a_x, a_y, a_z);
+    }
+
+    auto total = simd::Vec3{simd::splat(0.f), simd::splat(0.f), simd::splat(0.f)};
+    Mask active = scale < CAST_STACK_DEPTH;
+
+    while (simd::any(active)) {
+        const auto t_corner = simd::Vec3{
+            pos.x * t_coeff.x - t_bias.x,
+            pos.y * t_coeff.y - t_bias.y,
+            pos.z * t_coeff.z - t_bias.z
+        };
+        const F32 tc_max = simd::min_elem(t_corner);
+        const F32 tv_max = simd::min(t_max, tc_max);
+
+        const Mask visit = active & (t_min <= t_max) & (t_min <= tv_max);
+
+        // Fetch the children of the lanes that visit a voxel
+        U32 child = simd::splat(0u);
+        Mask leaf = simd::splat(0);
+        auto color = simd::Vec3{simd::splat(0.f), simd::splat(0.f), simd::splat(0.f)};
+        for (size_t i = 0; i < simd::WIDTH; ++i) {
+            if (!visit[i]) {
+                continue;
+            }
+
+            child[i] = nodes[parent[i]].children[idx[i] ^ octant_mask[i]];
+            const auto& node = nodes[child[i]];
+            if (node.is_leaf()) {
+                leaf[i] = -1;
+                color.x[i] = static_cast<float>(node.color.r) / 255.f;
+                color.y[i] = static_cast<float>(node.color.g) / 255.f;
+                color.z[i] = static_cast<float>(node.color.b) / 255.f;
+            }
+        }
+
+        const F32 dt = (visit & leaf) ? tv_max - t_min : simd::splat(0.f);
+        total.x += color.x * dt;
+        total.y += color.y * dt;
+        total.z += color.z * dt;
+
+        // PUSH
+        const Mask descend = visit & ~leaf;
+        const Mask push = descend & (tc_max < h);
+        for (size_t i = 0; i < simd::WIDTH; ++i) {
+            if (push[i]) {
+                node_stack[scale[i]][i] = parent[i];
+                t_max_stack[scale[i]][i] = t_max[i];
+            }
+        }
+
+        h = descend ? tc_max : h;
+        parent = descend ? child : parent;
+        scale -= reinterpret_cast<U32>(descend) & 1u;
+        scale_exp2 = descend ? scale_exp2 * 0.5f : scale_exp2;
+
+        {
+            const auto t_center = simd::Vec3{
+                scale_exp2 * t_coeff.x + t_corner.x,
+                scale_exp2 * t_coeff.y + t_corner.y,
+                scale_exp2 * t_coeff.z + t_corner.z
+            };
+
+            const Mask a_x = t_center.x > t_min;
+            const Mask a_y = t_center.y > t_min;
+            const Mask a_z = t_center.z > t_min;
+            idx = descend ? cxor(a_x, a_y, a_z) : idx;
+            pos.x += (descend & a_x) ? scale_exp2 : simd::splat(0.f);
+            pos.y += (descend & a_y) ? scale_exp2 : simd::splat(0.f);
+            pos.z += (descend & a_z) ? scale_exp2 : simd::splat(0.f);
+            t_max = descend ? tv_max : t_max;
+        }
+
+        // ADVANCE
+        const Mask advance = active & ~descend;
+        const Mask a_x = advance & (t_corner.x <= tc_max);
+        const Mask a_y = advance & (t_corner.y <= tc_max);
+        const Mask a_z = advance & (t_corner.z <= tc_max);
+        const U32 step_mask = cxor(a_x, a_y, a_z);
+        pos.x -= a_x ? scale_exp2 : simd::splat(0.f);
+        pos.y -= a_y ? scale_exp2 : simd::splat(0.f);
+        pos.z -= a_z ? scale_exp2 : simd::splat(0.f);
+
+        t_min = advance ? tc_max : t_min;
+        idx ^= step_mask;
+
+        // POP
+        const Mask pop = advance & ((idx & step_mask) != 0);
+        if (simd::any(pop)) {
+            const U32 x_x = a_x ? float_bits(pos.x) ^ float_bits(pos.x + scale_exp2) : simd::splat(0u);
+            const U32 x_y = a_y ? float_bits(pos.y) ^ float_bits(pos.y + scale_exp2) : simd::splat(0u);
+            const U32 x_z = a_z ? float_bits(pos.z) ^ float_bits(pos.z + scale_exp2) : simd::splat(0u);
+            const U32 dbits = x_x | x_y | x_z;
+
+            const U32 new_scale = (float_bits(__builtin_convertvector(dbits, F32)) >> 23) - 127;
+            scale = pop ? new_scale : scale;
+            scale_exp2 = pop ? bits_float((scale - CAST_STACK_DEPTH + 127) << 23) : scale_exp2;
+
+            // Lanes which pop out of the root are finished, and must not read the stack
+            const Mask restore = pop & (scale < CAST_STACK_DEPTH);
+            for (size_t i = 0; i < simd::WIDTH; ++i) {
+                if (restore[i]) {
+                    parent[i] = node_stack[scale[i]][i];
+                    t_max[i] = t_max_stack[scale[i]][i];
+                }
+            }
+
+            const U32 shift = restore ? scale : simd::splat(0u);
+            const U32 sh_x = float_bits(pos.x) >> shift;
+            const U32 sh_y = float_bits(pos.y) >> shift;
+            const U32 sh_z = float_bits(pos.z) >> shift;
+            pos.x = restore ? bits_float(sh_x << shift) : pos.x;
+            pos.y = restore ? bits_float(sh_y << shift) : pos.y;
+            pos.z = restore ? bits_float(sh_z << shift) : pos.z;
+
+            idx = restore ? (sh_x & 1u) * 4u + (sh_y & 1u) * 2u + (sh_z & 1u) : idx;
+            h = restore ? simd::splat(0.f) : h;
+        }
+
+        active &= scale < CAST_STACK_DEPTH;
+    }
+
+    const F32 ec = voxel_emission_coeff(this->params, rd);
+    return {total.x * ec, total.y * ec, total.z * ec};
+}
@@ -0,0 +1,19 @@
+#ifndef _XENODON_CPU_CPUESVOALGORITHM_H
+#define _XENODON_CPU_CPUESVOALGORITHM_H
+
+#include <memory>
+#include "cpu/CpuRaytraceAlgorithm.h"
+#include "model/Octree.h"
+
+// Port of resources/esvo.comp, without the beam optimization
+class CpuEsvoAlgorithm final: public CpuRaytraceAlgorithm {
+    std::shared_ptr<Octree> octree;
+    CpuShaderParameters params;
+
+public:
+    CpuEsvoAlgorithm(std::shared_ptr<Octree> octree, const CpuShaderParameters& params);
+
+    simd::Vec3 trace(const Vec3F& translation, const simd::Vec3& rd) const override;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _XENODON_CPU_CPURAYTRACEALGORITHM_H
+#define _XENODON_CPU_CPURAYTRACEALGORITHM_H
+
+#include "cpu/simd.h"
+#include "math/Vec.h"
+
+// The parameters which the GPU renderer passes as specialization constants, see resources/common.glsl
+struct CpuShaderParameters {
+    Vec3F voxel_ratio;
+    float emission_coeff;
+};
+
+// A traversal of the CPU renderer, which is a port of the corresponding shader. Implementations
+// should follow their shader closely, so that the CPU renderer can serve as a reference for it.
+class CpuRaytraceAlgorithm {
+public:
+    virtual ~CpuRaytraceAlgorithm() = default;
+
+    // Compute the color of a packet of rays as main() of the shader does. The camera translation
+    // is divided by the voxel ratio, see Renderer::write_camera.
+    virtual simd::Vec3 trace(const Vec3F& translation, const simd::Vec3& rd) const = 0;
+};
+
+// See voxel_emission_coeff in resources/common.glsl
+inline simd::F32 voxel_emission_coeff(const CpuShaderParameters& params, const simd::Vec3& rd) {
+    const auto rd2 = simd::Vec3{rd.x * rd.x, rd.y * rd.y, rd.z * rd.z};
+    const auto dim2 = simd::splat(params.voxel_ratio * params.voxel_ratio);
+    return params.emission_coeff * simd::sqrt(simd::dot(rd2, dim2) / (rd2.x + rd2.y + rd2.z));
+}
+
+#endif
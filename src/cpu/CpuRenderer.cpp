@@ -0,0 +1,81 @@
+#include "cpu/CpuRenderer.h"
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+namespace {
+    constexpr const uint32_t TILE_SIZE = 32;
+
+    // See adjust_ray in resources/common.glsl
+    simd::F32 adjust_ray(simd::F32 x) {
+        const float epsilon = 1.f / static_cast<float>(1 << 23);
+        return simd::abs(x) < epsilon ? simd::splat(epsilon) : x;
+    }
+
+    uint8_t to_unorm8(float x) {
+        return static_cast<uint8_t>(std::clamp(x, 0.f, 1.f) * 255.f + 0.5f);
+    }
+}
+
+CpuRenderer::CpuRenderer(std::unique_ptr<CpuRaytraceAlgorithm> algo, const CpuShaderParameters& params, vk::Extent2D extent, size_t threads):
+    algo(std::move(algo)), params(params), extent(extent), pool(threads) {
+}
+
+void CpuRenderer::render(const Camera& cam, std::vector<Pixel>& target) {
+    const uint32_t width = this->extent.width;
+    const uint32_t height = this->extent.height;
+    target.resize(static_cast<size_t>(width) * height);
+
+    // The camera basis is the same for every ray, see ray() in resources/common.glsl
+    const Vec3F dir = cam.forward;
+    const Vec3F right = normalize(cross(cam.up, dir));
+    const Vec3F up = normalize(cross(right, dir));
+    const Vec3F translation = cam.translation / this->params.voxel_ratio;
+    const float aspect = static_cast<float>(height) / static_cast<float>(width);
+
+    const uint32_t tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    simd::F32 lane_offset;
+    for (size_t i = 0; i < simd::WIDTH; ++i) {
+        lane_offset[i] = static_cast<float>(i);
+    }
+
+    this->pool.run(tiles_x * tiles_y, [&](size_t tile) {
+        const uint32_t x0 = static_cast<uint32_t>(tile % tiles_x) * TILE_SIZE;
+        const uint32_t y0 = static_cast<uint32_t>(tile / tiles_x) * TILE_SIZE;
+        const uint32_t x1 = std::min(x0 + TILE_SIZE, width);
+        const uint32_t y1 = std::min(y0 + TILE_SIZE, height);
+
+        for (uint32_t y = y0; y < y1; ++y) {
+            const float v = (static_cast<float>(y) / static_cast<float>(height) - 0.5f) * aspect;
+
+            for (uint32_t x = x0; x < x1; x += simd::WIDTH) {
+                const simd::F32 u = (static_cast<float>(x) + lane_offset) / static_cast<float>(width) - 0.5f;
+
+                auto rd = simd::normalize({
+                    u * right.x + v * up.x + dir.x,
+                    u * right.y + v * up.y + dir.y,
+                    u * right.z + v * up.z + dir.z
+                });
+
+                rd = simd::normalize({
+                    rd.x / this->params.voxel_ratio.x,
+                    rd.y / this->params.voxel_ratio.y,
+                    rd.z / this->params.voxel_ratio.z
+                });
+
+                rd = {adjust_ray(rd.x), adjust_ray(rd.y), adjust_ray(rd.z)};
+
+                const auto color = this->algo->trace(translation, rd);
+
+                // Lanes past the edge of the frame are traced, but not stored
+                const uint32_t lanes = std::min(static_cast<uint32_t>(simd::WIDTH), x1 - x);
+                Pixel* row = &target[static_cast<size_t>(y) * width + x];
+                for (uint32_t i = 0; i < lanes; ++i) {
+                    row[i] = {to_unorm8(color.x[i]), to_unorm8(color.y[i]), to_unorm8(color.z[i]), 255};
+                }
+            }
+        }
+    });
+}
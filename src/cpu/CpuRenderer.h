@@ -0,0 +1,33 @@
+#ifndef _XENODON_CPU_CPURENDERER_H
+#define _XENODON_CPU_CPURENDERER_H
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <vulkan/vulkan.hpp>
+#include "cpu/CpuRaytraceAlgorithm.h"
+#include "camera/Camera.h"
+#include "model/Pixel.h"
+#include "utility/WorkStealingPool.h"
+
+// Renders frames on the CPU, as a reference for the shaders and for machines without a
+// suitable GPU. A frame is divided into square tiles, which are rendered by a pool of worker
+// threads. Every tile is traced in packets of horizontally adjacent rays, one per SIMD lane.
+class CpuRenderer {
+    std::unique_ptr<CpuRaytraceAlgorithm> algo;
+    CpuShaderParameters params;
+    vk::Extent2D extent;
+    WorkStealingPool pool;
+
+public:
+    CpuRenderer(std::unique_ptr<CpuRaytraceAlgorithm> algo, const CpuShaderParameters& params, vk::Extent2D extent, size_t threads);
+
+    // Render a frame of `extent` pixels into `target`, row by row
+    void render(const Camera& cam, std::vector<Pixel>& target);
+
+    size_t threads() const {
+        return this->pool.threads();
+    }
+};
+
+#endif
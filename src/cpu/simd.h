@@ -0,0 +1,106 @@
+#ifndef _XENODON_CPU_SIMD_H
+#define _XENODON_CPU_SIMD_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "math/Vec.h"
+
+// 8-wide vectors for the CPU renderer, using the vector extensions of GCC and Clang. Lanes are
+// processed in lockstep, where control flow that differs between lanes is expressed with masks:
+// comparisons yield -1 in the lanes where they hold and 0 elsewhere, and the ternary operator
+// selects per lane. reinterpret_cast between vector types of the same size reinterprets the
+// bits, value conversions use __builtin_convertvector.
+namespace simd {
+    constexpr const size_t WIDTH = 8;
+
+    using F32 = float __attribute__((vector_size(WIDTH * sizeof(float))));
+    using I32 = int32_t __attribute__((vector_size(WIDTH * sizeof(int32_t))));
+    using U32 = uint32_t __attribute__((vector_size(WIDTH * sizeof(uint32_t))));
+
+    // The result of comparisons, which is -1 where true and 0 where false
+    using Mask = I32;
+
+    struct Vec3 {
+        F32 x, y, z;
+    };
+
+    inline F32 splat(float x) {
+        return F32{} + x;
+    }
+
+    inline I32 splat(int32_t x) {
+        return I32{} + x;
+    }
+
+    inline U32 splat(uint32_t x) {
+        return U32{} + x;
+    }
+
+    inline Vec3 splat(const Vec3F& v) {
+        return {splat(v.x), splat(v.y), splat(v.z)};
+    }
+
+    inline bool any(Mask m) {
+        for (size_t i = 0; i < WIDTH; ++i) {
+            if (m[i]) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline F32 min(F32 a, F32 b) {
+        return a < b ? a : b;
+    }
+
+    inline F32 max(F32 a, F32 b) {
+        return a > b ? a : b;
+    }
+
+    inline F32 abs(F32 a) {
+        return a < 0 ? -a : a;
+    }
+
+    inline F32 sign(F32 a) {
+        return a > 0 ? splat(1.f) : a < 0 ? splat(-1.f) : splat(0.f);
+    }
+
+    inline F32 floor(F32 a) {
+        F32 result;
+        for (size_t i = 0; i < WIDTH; ++i) {
+            result[i] = std::floor(a[i]);
+        }
+
+        return result;
+    }
+
+    inline F32 sqrt(F32 a) {
+        F32 result;
+        for (size_t i = 0; i < WIDTH; ++i) {
+            result[i] = std::sqrt(a[i]);
+        }
+
+        return result;
+    }
+
+    inline F32 min_elem(const Vec3& v) {
+        return min(v.x, min(v.y, v.z));
+    }
+
+    inline F32 max_elem(const Vec3& v) {
+        return max(v.x, max(v.y, v.z));
+    }
+
+    inline F32 dot(const Vec3& a, const Vec3& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline Vec3 normalize(const Vec3& v) {
+        const F32 inv_length = 1.f / sqrt(dot(v, v));
+        return {v.x * inv_length, v.y * inv_length, v.z * inv_length};
+    }
+}
+
+#endif
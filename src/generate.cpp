@@ -0,0 +1,932 @@
+#include "generate.h"
+#include <string_view>
+#include <filesystem>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <fmt/format.h>
+#include "core/arg_parse.h"
+#include "core/Error.h"
+#include "core/MemoryAccounting.h"
+#include "model/Grid.h"
+#include "model/Octree.h"
+#include "model/OctreeConstruction.h"
+#include "utility/WorkStealingPool.h"
+#include "volume_output.h"
+
+namespace {
+    constexpr const size_t DEFAULT_DIM = 256;
+    constexpr const size_t DEFAULT_CHUNK = 256;
+
+    // The number of points of a noise field used to find the threshold for a density
+    constexpr const size_t NOISE_SAMPLES = 1 << 16;
+
+    // The maximum number of cells along an axis of the acceleration grids of the spheres and
+    // particles
+    constexpr const size_t MAX_CELLS = 128;
+
+    // The fraction of the particles which is spread uniformly instead of in clusters
+    constexpr const double PARTICLE_BACKGROUND = 0.1;
+
+    struct GenerateOptions {
+        std::string_view type;
+        std::filesystem::path dst;
+        size_t dim = DEFAULT_DIM;
+        uint64_t seed = 1;
+        double density = -1;
+        double radius = 0;
+        size_t clusters = 16;
+        size_t level = 0;
+        size_t octaves = 4;
+        double scale = 0;
+        size_t chunk = DEFAULT_CHUNK;
+        size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+        VolumeOutputOptions output;
+        int channel_difference = 0;
+    };
+
+    // SplitMix64, so that volumes only depend on the seed and not on the order of generation
+    uint64_t hash(uint64_t x) {
+        x += 0x9E3779B97F4A7C15;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+        return x ^ (x >> 31);
+    }
+
+    uint64_t hash(uint64_t a, uint64_t b) {
+        return hash(a ^ hash(b));
+    }
+
+    // Uniform in [0, 1)
+    double unit(uint64_t h) {
+        return static_cast<double>(h >> 11) * 0x1.0p-53;
+    }
+
+    uint8_t lerp8(uint8_t a, uint8_t b, double t) {
+        return static_cast<uint8_t>(a + (b - a) * t);
+    }
+
+    // Procedural volumes, which are generated a region at a time
+    class Generator {
+    public:
+        virtual ~Generator() = default;
+
+        // Fill `grid` with the voxels of the volume at offset + (x, y, z), using the threads of `pool`.
+        // The grid is black initially.
+        virtual void generate(Grid& grid, const Vec3Sz& offset, WorkStealingPool& pool) const = 0;
+
+        // Whether the region [offset, offset + extent) certainly has no voxels
+        virtual bool empty([[maybe_unused]] const Vec3Sz& offset, [[maybe_unused]] size_t extent) const {
+            return false;
+        }
+    };
+
+    // Volumes of which every voxel is generated independently, so that the layers of a region
+    // can be generated in parallel
+    class LayerGenerator: public Generator {
+    public:
+        void generate(Grid& grid, const Vec3Sz& offset, WorkStealingPool& pool) const final {
+            pool.run(grid.dimensions().z, [&](size_t z) {
+                this->generate_layer(grid, offset, z);
+            });
+        }
+
+        // Fill layer z of `grid` with the voxels of the volume at offset + (x, y, z)
+        virtual void generate_layer(Grid& grid, const Vec3Sz& offset, size_t z) const = 0;
+    };
+
+    // The gradients of improved Perlin noise, in the order of the cases of NoiseGenerator::noise
+    constexpr const double GRADIENTS[12][3] = {
+        {1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0},
+        {1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1},
+        {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1}
+    };
+
+    // The size of the boxes, in lattice cells of an octave, over which the noise is bounded by
+    // NoiseGenerator::empty. Regions of more of these along an axis are not bounded per box.
+    constexpr const double BOUND_STEP = 0.25;
+    constexpr const double MAX_BOUND_STEPS = 8;
+
+    // Fractal gradient noise, of which the voxels above a threshold are filled
+    class NoiseGenerator final: public LayerGenerator {
+        uint64_t seed;
+        size_t octaves;
+        double frequency;
+        double threshold;
+        double max;
+
+    public:
+        NoiseGenerator(size_t dim, uint64_t seed, double density, size_t octaves, double scale):
+            seed(seed), octaves(octaves), frequency(1.0 / scale) {
+
+            // Find the threshold above which about `density` of the field lies from random samples
+            auto samples = std::vector<double>(NOISE_SAMPLES);
+            for (size_t i = 0; i < NOISE_SAMPLES; ++i) {
+                const uint64_t h = hash(seed, i);
+                samples[i] = this->fbm(
+                    unit(hash(h, 0)) * static_cast<double>(dim),
+                    unit(hash(h, 1)) * static_cast<double>(dim),
+                    unit(hash(h, 2)) * static_cast<double>(dim)
+                );
+            }
+
+            std::sort(samples.begin(), samples.end());
+            const auto rank = static_cast<size_t>((1.0 - density) * static_cast<double>(NOISE_SAMPLES));
+            this->threshold = samples[std::min(rank, NOISE_SAMPLES - 1)];
+            this->max = samples.back();
+        }
+
+        void generate_layer(Grid& grid, const Vec3Sz& offset, size_t z) const override {
+            const auto dim = grid.dimensions();
+            for (size_t y = 0; y < dim.y; ++y) {
+                for (size_t x = 0; x < dim.x; ++x) {
+                    const double v = this->fbm(
+                        static_cast<double>(offset.x + x) + 0.5,
+                        static_cast<double>(offset.y + y) + 0.5,
+                        static_cast<double>(offset.z + z) + 0.5
+                    );
+
+                    if (v > this->threshold) {
+                        const double t = std::clamp((v - this->threshold) / (this->max - this->threshold), 0.0, 1.0);
+                        grid.set({x, y, z}, {lerp8(40, 255, t), lerp8(60, 220, t), lerp8(160, 120, t), 255});
+                    }
+                }
+            }
+        }
+
+        // The fbm value of every voxel is a weighted average of the octaves, of which the noise
+        // is bounded over the region, see noise_max
+        bool empty(const Vec3Sz& offset, size_t extent) const override {
+            // The voxel centers of the region
+            const double lo[3] = {
+                static_cast<double>(offset.x) + 0.5,
+                static_cast<double>(offset.y) + 0.5,
+                static_cast<double>(offset.z) + 0.5
+            };
+
+            const double hi[3] = {
+                static_cast<double>(offset.x + extent) - 0.5,
+                static_cast<double>(offset.y + extent) - 0.5,
+                static_cast<double>(offset.z + extent) - 0.5
+            };
+
+            double total = 0;
+            double amplitude = 1;
+            double amplitudes = 0;
+            double f = this->frequency;
+
+            for (size_t i = 0; i < this->octaves; ++i) {
+                const double octave_lo[3] = {lo[0] * f, lo[1] * f, lo[2] * f};
+                const double octave_hi[3] = {hi[0] * f, hi[1] * f, hi[2] * f};
+                total += amplitude * noise_max(octave_lo, octave_hi, hash(this->seed, i));
+                amplitudes += amplitude;
+                amplitude *= 0.5;
+                f *= 2;
+            }
+
+            // Allow for rounding differences with fbm
+            return total / amplitudes < this->threshold - 1e-9;
+        }
+
+    private:
+        static uint64_t corner_hash(uint64_t octave_seed, int64_t x, int64_t y, int64_t z) {
+            return hash(hash(octave_seed, static_cast<uint64_t>(x)), hash(static_cast<uint64_t>(y), static_cast<uint64_t>(z)));
+        }
+
+        // Gradient noise with the 12 gradients of improved Perlin noise, in about [-1, 1]
+        double noise(double x, double y, double z, uint64_t octave_seed) const {
+            const double fx = std::floor(x);
+            const double fy = std::floor(y);
+            const double fz = std::floor(z);
+            const double dx = x - fx;
+            const double dy = y - fy;
+            const double dz = z - fz;
+
+            auto gradient = [&](int64_t i, int64_t j, int64_t k) {
+                const uint64_t h = corner_hash(octave_seed, static_cast<int64_t>(fx) + i, static_cast<int64_t>(fy) + j, static_cast<int64_t>(fz) + k);
+
+                const double gx = dx - static_cast<double>(i);
+                const double gy = dy - static_cast<double>(j);
+                const double gz = dz - static_cast<double>(k);
+
+                // The cases are GRADIENTS, which is slower to index here
+                switch (h % 12) {
+                    case 0: return gx + gy;
+                    case 1: return -gx + gy;
+                    case 2: return gx - gy;
+                    case 3: return -gx - gy;
+                    case 4: return gx + gz;
+                    case 5: return -gx + gz;
+                    case 6: return gx - gz;
+                    case 7: return -gx - gz;
+                    case 8: return gy + gz;
+                    case 9: return -gy + gz;
+                    case 10: return gy - gz;
+                    default: return -gy - gz;
+                }
+            };
+
+            auto lerp = [](double a, double b, double t) {
+                return a + (b - a) * t;
+            };
+
+            const double u = fade(dx);
+            const double v = fade(dy);
+            const double w = fade(dz);
+
+            return lerp(
+                lerp(lerp(gradient(0, 0, 0), gradient(1, 0, 0), u), lerp(gradient(0, 1, 0), gradient(1, 1, 0), u), v),
+                lerp(lerp(gradient(0, 0, 1), gradient(1, 0, 1), u), lerp(gradient(0, 1, 1), gradient(1, 1, 1), u), v),
+                w
+            );
+        }
+
+        double fbm(double x, double y, double z) const {
+            double total = 0;
+            double amplitude = 1;
+            double amplitudes = 0;
+            double f = this->frequency;
+
+            for (size_t i = 0; i < this->octaves; ++i) {
+                total += amplitude * this->noise(x * f, y * f, z * f, hash(this->seed, i));
+                amplitudes += amplitude;
+                amplitude *= 0.5;
+                f *= 2;
+            }
+
+            return total / amplitudes;
+        }
+
+        // An upper bound of the noise of an octave over the box [lo, hi]. The part of the box in
+        // every lattice cell is divided into boxes of at most BOUND_STEP, over which the dot
+        // products and the interpolation weights of the corners are bounded separately.
+        static double noise_max(const double (&lo)[3], const double (&hi)[3], uint64_t octave_seed) {
+            int64_t first[3];
+            int64_t last[3];
+            for (size_t a = 0; a < 3; ++a) {
+                if ((hi[a] - lo[a]) / BOUND_STEP > MAX_BOUND_STEPS) {
+                    // Every dot product is at most 2, as the gradients have two components of 1
+                    return 2;
+                }
+
+                first[a] = static_cast<int64_t>(std::floor(lo[a]));
+                last[a] = static_cast<int64_t>(std::floor(hi[a]));
+            }
+
+            double max = -2;
+            for (int64_t x = first[0]; x <= last[0]; ++x) {
+                for (int64_t y = first[1]; y <= last[1]; ++y) {
+                    for (int64_t z = first[2]; z <= last[2]; ++z) {
+                        const int64_t cell[3] = {x, y, z};
+
+                        const double* gradients[8];
+                        for (int64_t corner = 0; corner < 8; ++corner) {
+                            gradients[corner] = GRADIENTS[corner_hash(octave_seed, x + (corner & 1), y + (corner >> 1 & 1), z + (corner >> 2)) % 12];
+                        }
+
+                        // The part of the box in the cell, in the coordinates of the cell
+                        double t_lo[3];
+                        double t_hi[3];
+                        size_t steps[3];
+                        for (size_t a = 0; a < 3; ++a) {
+                            t_lo[a] = std::max(lo[a] - static_cast<double>(cell[a]), 0.0);
+                            t_hi[a] = std::min(hi[a] - static_cast<double>(cell[a]), 1.0);
+                            steps[a] = std::max(static_cast<size_t>(std::ceil((t_hi[a] - t_lo[a]) / BOUND_STEP)), size_t{1});
+                        }
+
+                        for (size_t i = 0; i < steps[0] * steps[1] * steps[2]; ++i) {
+                            const size_t step[3] = {i % steps[0], i / steps[0] % steps[1], i / (steps[0] * steps[1])};
+
+                            double b_lo[3];
+                            double b_hi[3];
+                            for (size_t a = 0; a < 3; ++a) {
+                                const double size = (t_hi[a] - t_lo[a]) / static_cast<double>(steps[a]);
+                                b_lo[a] = t_lo[a] + size * static_cast<double>(step[a]);
+                                b_hi[a] = step[a] + 1 == steps[a] ? t_hi[a] : b_lo[a] + size;
+                            }
+
+                            max = std::max(max, cell_noise_max(gradients, b_lo, b_hi));
+                        }
+                    }
+                }
+            }
+
+            return max;
+        }
+
+        // An upper bound of the noise in a lattice cell with the gradients `g` at its corners, over
+        // the box [lo, hi] in the coordinates of the cell
+        static double cell_noise_max(const double* const (&g)[8], const double (&lo)[3], const double (&hi)[3]) {
+            double dots[8];
+            double weights_lo[8];
+            double weights_hi[8];
+            size_t order[8];
+            double remaining = 1;
+
+            for (size_t corner = 0; corner < 8; ++corner) {
+                double dot = 0;
+                double weight_lo = 1;
+                double weight_hi = 1;
+
+                for (size_t a = 0; a < 3; ++a) {
+                    const auto c = static_cast<double>(corner >> a & 1);
+                    dot += std::max(g[corner][a] * (lo[a] - c), g[corner][a] * (hi[a] - c));
+
+                    // fade is increasing, and the weight of the upper corner along an axis is fade(t)
+                    weight_lo *= c > 0 ? fade(lo[a]) : 1 - fade(hi[a]);
+                    weight_hi *= c > 0 ? fade(hi[a]) : 1 - fade(lo[a]);
+                }
+
+                dots[corner] = dot;
+                weights_lo[corner] = weight_lo;
+                weights_hi[corner] = weight_hi;
+                order[corner] = corner;
+                remaining -= weight_lo;
+            }
+
+            // The weights sum to 1, so the noise is at most the weighted sum where the weight
+            // which is not fixed by the lower bounds goes to the largest dot products first
+            std::sort(std::begin(order), std::end(order), [&](size_t a, size_t b) {
+                return dots[a] > dots[b];
+            });
+
+            double max = 0;
+            for (size_t corner : order) {
+                const double weight = std::clamp(remaining, 0.0, weights_hi[corner] - weights_lo[corner]);
+                max += (weights_lo[corner] + weight) * dots[corner];
+                remaining -= weight;
+            }
+
+            return max;
+        }
+
+        static double fade(double t) {
+            return t * t * t * (t * (t * 6 - 15) + 10);
+        }
+    };
+
+    // A Menger sponge which fills the volume. Voxels are colored by their position.
+    class MengerGenerator final: public LayerGenerator {
+        size_t dim;
+        size_t level;
+
+        // The number of cells of the finest level along an axis, 3^level
+        size_t cells;
+
+    public:
+        MengerGenerator(size_t dim, size_t level):
+            dim(dim), level(level), cells(1) {
+            for (size_t i = 0; i < level; ++i) {
+                this->cells *= 3;
+            }
+        }
+
+        void generate_layer(Grid& grid, const Vec3Sz& offset, size_t z) const override {
+            const auto grid_dim = grid.dimensions();
+            const size_t cz = this->cell(offset.z + z);
+            const auto b = static_cast<uint8_t>((offset.z + z) * 255 / this->dim);
+
+            for (size_t y = 0; y < grid_dim.y; ++y) {
+                const size_t cy = this->cell(offset.y + y);
+                const auto g = static_cast<uint8_t>((offset.y + y) * 255 / this->dim);
+
+                for (size_t x = 0; x < grid_dim.x; ++x) {
+                    if (this->filled(this->cell(offset.x + x), cy, cz)) {
+                        const auto r = static_cast<uint8_t>((offset.x + x) * 255 / this->dim);
+                        grid.set({x, y, z}, {r, g, b, 255});
+                    }
+                }
+            }
+        }
+
+        // A region is empty if it lies within a single cell which is removed at some level
+        bool empty(const Vec3Sz& offset, size_t extent) const override {
+            const Vec3Sz first = {this->cell(offset.x), this->cell(offset.y), this->cell(offset.z)};
+            const Vec3Sz last = {
+                this->cell(std::min(offset.x + extent, this->dim) - 1),
+                this->cell(std::min(offset.y + extent, this->dim) - 1),
+                this->cell(std::min(offset.z + extent, this->dim) - 1)
+            };
+
+            size_t size = this->cells;
+            for (size_t i = 0; i < this->level; ++i) {
+                size /= 3;
+                if (first.x / size != last.x / size || first.y / size != last.y / size || first.z / size != last.z / size) {
+                    return false;
+                }
+
+                if (removed(first.x / size, first.y / size, first.z / size)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    private:
+        size_t cell(size_t voxel) const {
+            return voxel * this->cells / this->dim;
+        }
+
+        // Whether the cell is in the center of a face or of the cube of the next coarser level
+        static bool removed(size_t x, size_t y, size_t z) {
+            return (x % 3 == 1) + (y % 3 == 1) + (z % 3 == 1) >= 2;
+        }
+
+        bool filled(size_t x, size_t y, size_t z) const {
+            for (size_t i = 0; i < this->level; ++i) {
+                if (removed(x, y, z)) {
+                    return false;
+                }
+
+                x /= 3;
+                y /= 3;
+                z /= 3;
+            }
+
+            return true;
+        }
+    };
+
+    // A grid of cells, which lists the items that overlap every cell
+    class CellGrid {
+        size_t cell_size;
+        size_t cells;
+        std::vector<size_t> offsets;
+        std::vector<uint32_t> items;
+
+    public:
+        // `bounds(i, min, max)` gives the inclusive range of voxels that item i overlaps
+        template <typename F>
+        CellGrid(size_t dim, size_t cell_size, size_t num_items, F bounds):
+            cell_size(cell_size),
+            cells((dim + cell_size - 1) / cell_size),
+            offsets(this->cells * this->cells * this->cells + 1, 0) {
+
+            // Count the items of every cell first, and then place them
+            for (int pass = 0; pass < 2; ++pass) {
+                auto next = std::vector<size_t>();
+                if (pass == 1) {
+                    for (size_t i = 1; i < this->offsets.size(); ++i) {
+                        this->offsets[i] += this->offsets[i - 1];
+                    }
+
+                    this->items.resize(this->offsets.back());
+                    next.assign(this->offsets.begin(), this->offsets.end() - 1);
+                }
+
+                for (size_t i = 0; i < num_items; ++i) {
+                    Vec3Sz min, max;
+                    bounds(i, min, max);
+                    this->for_each_cell(min, max, [&](size_t c) {
+                        if (pass == 0) {
+                            ++this->offsets[c + 1];
+                        } else {
+                            this->items[next[c]++] = static_cast<uint32_t>(i);
+                        }
+                    });
+                }
+            }
+        }
+
+        // Call f(cell) for every cell that overlaps the inclusive range of voxels [min, max]
+        template <typename F>
+        void for_each_cell(const Vec3Sz& min, const Vec3Sz& max, F f) const {
+            for (size_t z = min.z / this->cell_size; z <= std::min(max.z / this->cell_size, this->cells - 1); ++z) {
+                for (size_t y = min.y / this->cell_size; y <= std::min(max.y / this->cell_size, this->cells - 1); ++y) {
+                    for (size_t x = min.x / this->cell_size; x <= std::min(max.x / this->cell_size, this->cells - 1); ++x) {
+                        f(x + y * this->cells + z * this->cells * this->cells);
+                    }
+                }
+            }
+        }
+
+        Span<uint32_t> cell_items(size_t cell) const {
+            return Span(this->offsets[cell + 1] - this->offsets[cell], this->items.data() + this->offsets[cell]);
+        }
+
+        size_t cell_of(size_t x, size_t y, size_t z) const {
+            return x / this->cell_size + (y / this->cell_size) * this->cells + (z / this->cell_size) * this->cells * this->cells;
+        }
+    };
+
+    struct Sphere {
+        double x, y, z;
+        double radius;
+        Pixel color;
+    };
+
+    // Randomly placed spheres of random colors, which may overlap
+    class SphereGenerator final: public LayerGenerator {
+        size_t dim;
+        std::vector<Sphere> spheres;
+        std::unique_ptr<CellGrid> cells;
+
+    public:
+        // The number of spheres is chosen so that their total volume is about `density` of the volume
+        SphereGenerator(size_t dim, uint64_t seed, double density, double radius):
+            dim(dim) {
+            const double d = static_cast<double>(dim);
+            const double sphere_volume = 4.0 / 3.0 * M_PI * radius * radius * radius;
+            const auto count = std::max(static_cast<size_t>(density * d * d * d / sphere_volume + 0.5), size_t{1});
+
+            for (size_t i = 0; i < count; ++i) {
+                const uint64_t h = hash(seed, i);
+                this->spheres.push_back({
+                    unit(hash(h, 0)) * d,
+                    unit(hash(h, 1)) * d,
+                    unit(hash(h, 2)) * d,
+                    radius * (0.5 + unit(hash(h, 3))),
+                    {
+                        static_cast<uint8_t>(64 + hash(h, 4) % 192),
+                        static_cast<uint8_t>(64 + hash(h, 5) % 192),
+                        static_cast<uint8_t>(64 + hash(h, 6) % 192),
+                        255
+                    }
+                });
+            }
+
+            fmt::print(" Spheres: {}\n", count);
+
+            const auto cell_size = std::max(static_cast<size_t>(std::ceil(radius * 3)), (dim + MAX_CELLS - 1) / MAX_CELLS);
+            this->cells = std::make_unique<CellGrid>(dim, cell_size, count, [this](size_t i, Vec3Sz& min, Vec3Sz& max) {
+                this->bounds(this->spheres[i], min, max);
+            });
+        }
+
+        void generate_layer(Grid& grid, const Vec3Sz& offset, size_t z) const override {
+            const auto grid_dim = grid.dimensions();
+            const double pz = static_cast<double>(offset.z + z) + 0.5;
+
+            for (size_t y = 0; y < grid_dim.y; ++y) {
+                const double py = static_cast<double>(offset.y + y) + 0.5;
+
+                for (size_t x = 0; x < grid_dim.x; ++x) {
+                    const double px = static_cast<double>(offset.x + x) + 0.5;
+
+                    for (uint32_t i : this->cells->cell_items(this->cells->cell_of(offset.x + x, offset.y + y, offset.z + z))) {
+                        const auto& s = this->spheres[i];
+                        const double dx = px - s.x;
+                        const double dy = py - s.y;
+                        const double dz = pz - s.z;
+                        if (dx * dx + dy * dy + dz * dz <= s.radius * s.radius) {
+                            grid.set({x, y, z}, s.color);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        bool empty(const Vec3Sz& offset, size_t extent) const override {
+            const auto max = Vec3Sz{
+                std::min(offset.x + extent, this->dim) - 1,
+                std::min(offset.y + extent, this->dim) - 1,
+                std::min(offset.z + extent, this->dim) - 1
+            };
+
+            bool empty = true;
+            this->cells->for_each_cell(offset, max, [&](size_t c) {
+                if (!empty) {
+                    return;
+                }
+
+                for (uint32_t i : this->cells->cell_items(c)) {
+                    const auto& s = this->spheres[i];
+
+                    // Distance from the center of the sphere to the closest point of the region
+                    auto axis = [](double p, size_t lo, size_t hi) {
+                        return std::max({static_cast<double>(lo) - p, p - static_cast<double>(hi + 1), 0.0});
+                    };
+
+                    const double dx = axis(s.x, offset.x, max.x);
+                    const double dy = axis(s.y, offset.y, max.y);
+                    const double dz = axis(s.z, offset.z, max.z);
+                    if (dx * dx + dy * dy + dz * dz <= s.radius * s.radius) {
+                        empty = false;
+                        return;
+                    }
+                }
+            });
+
+            return empty;
+        }
+
+    private:
+        void bounds(const Sphere& s, Vec3Sz& min, Vec3Sz& max) const {
+            auto lo = [](double p, double r) {
+                return static_cast<size_t>(std::max(p - r, 0.0));
+            };
+
+            auto hi = [this](double p, double r) {
+                return std::min(static_cast<size_t>(p + r), this->dim - 1);
+            };
+
+            min = {lo(s.x, s.radius), lo(s.y, s.radius), lo(s.z, s.radius)};
+            max = {hi(s.x, s.radius), hi(s.y, s.radius), hi(s.z, s.radius)};
+        }
+    };
+
+    struct Cluster {
+        double x, y, z;
+        double sigma;
+        double weight;
+    };
+
+    // Single-voxel particles in Gaussian clusters, over a sparse uniform background. The volume
+    // is divided into cells, and the number of particles of every cell is drawn up front from the
+    // expected number in it. The particles of a cell are generated again for every region that
+    // overlaps it, so they are never all held in memory.
+    class ParticleGenerator final: public Generator {
+        size_t dim;
+        uint64_t seed;
+        size_t cell_size;
+        size_t cells;
+        std::vector<uint32_t> counts;
+
+    public:
+        // `density` is the expected fraction of voxels with a particle
+        ParticleGenerator(size_t dim, uint64_t seed, double density, size_t num_clusters):
+            dim(dim),
+            seed(seed),
+            cell_size(std::max(size_t{8}, (dim + MAX_CELLS - 1) / MAX_CELLS)),
+            cells((dim + this->cell_size - 1) / this->cell_size),
+            counts(this->cells * this->cells * this->cells) {
+
+            const double d = static_cast<double>(dim);
+            const double total = density * d * d * d;
+
+            auto clusters = std::vector<Cluster>();
+            double weights = 0;
+            for (size_t i = 0; i < num_clusters; ++i) {
+                const uint64_t h = hash(hash(seed, 0xC1), i);
+                clusters.push_back({
+                    (0.15 + 0.7 * unit(hash(h, 0))) * d,
+                    (0.15 + 0.7 * unit(hash(h, 1))) * d,
+                    (0.15 + 0.7 * unit(hash(h, 2))) * d,
+                    (0.02 + 0.08 * unit(hash(h, 3))) * d,
+                    0.2 + unit(hash(h, 4))
+                });
+
+                weights += clusters.back().weight;
+            }
+
+            size_t particles = 0;
+            for (size_t c = 0; c < this->counts.size(); ++c) {
+                Vec3Sz min, max;
+                this->cell_bounds(c, min, max);
+
+                const double volume = static_cast<double>((max.x - min.x) * (max.y - min.y) * (max.z - min.z));
+                const double cx = static_cast<double>(min.x + max.x) / 2;
+                const double cy = static_cast<double>(min.y + max.y) / 2;
+                const double cz = static_cast<double>(min.z + max.z) / 2;
+
+                double pdf = 0;
+                for (const auto& cluster : clusters) {
+                    const double dx = cx - cluster.x;
+                    const double dy = cy - cluster.y;
+                    const double dz = cz - cluster.z;
+                    const double s2 = cluster.sigma * cluster.sigma;
+                    pdf += cluster.weight / weights * std::exp(-(dx * dx + dy * dy + dz * dz) / (2 * s2)) /
+                        (std::pow(2 * M_PI * s2, 1.5));
+                }
+
+                const double expected = total * volume * ((1 - PARTICLE_BACKGROUND) * pdf + PARTICLE_BACKGROUND / (d * d * d));
+                if (expected > 0) {
+                    auto rng = std::mt19937_64(hash(seed, c));
+                    this->counts[c] = std::poisson_distribution<uint32_t>(expected)(rng);
+                    particles += this->counts[c];
+                }
+            }
+
+            fmt::print(" Particles: {}\n", particles);
+        }
+
+        // The cells are generated in parallel, which write disjoint voxels as every particle
+        // lies in its own cell
+        void generate(Grid& grid, const Vec3Sz& offset, WorkStealingPool& pool) const override {
+            const auto grid_dim = grid.dimensions();
+            const auto min = offset;
+            const auto max = Vec3Sz{offset.x + grid_dim.x - 1, offset.y + grid_dim.y - 1, offset.z + grid_dim.z - 1};
+
+            auto cells = std::vector<size_t>();
+            this->for_each_cell(min, max, [&](size_t c) {
+                if (this->counts[c] > 0) {
+                    cells.push_back(c);
+                }
+            });
+
+            pool.run(cells.size(), [&](size_t i) {
+                this->for_each_particle(cells[i], [&](size_t x, size_t y, size_t z, Pixel color) {
+                    if (x >= min.x && x <= max.x && y >= min.y && y <= max.y && z >= min.z && z <= max.z) {
+                        grid.set({x - offset.x, y - offset.y, z - offset.z}, color);
+                    }
+                });
+            });
+        }
+
+        bool empty(const Vec3Sz& offset, size_t extent) const override {
+            const auto max = Vec3Sz{
+                std::min(offset.x + extent, this->dim) - 1,
+                std::min(offset.y + extent, this->dim) - 1,
+                std::min(offset.z + extent, this->dim) - 1
+            };
+
+            bool empty = true;
+            this->for_each_cell(offset, max, [&](size_t c) {
+                empty &= this->counts[c] == 0;
+            });
+
+            return empty;
+        }
+
+    private:
+        // The voxels [min, max) of a cell
+        void cell_bounds(size_t c, Vec3Sz& min, Vec3Sz& max) const {
+            const size_t x = c % this->cells;
+            const size_t y = c / this->cells % this->cells;
+            const size_t z = c / (this->cells * this->cells);
+
+            min = {x * this->cell_size, y * this->cell_size, z * this->cell_size};
+            max = {
+                std::min(min.x + this->cell_size, this->dim),
+                std::min(min.y + this->cell_size, this->dim),
+                std::min(min.z + this->cell_size, this->dim)
+            };
+        }
+
+        // Call f(cell) for every cell that overlaps the inclusive range of voxels [min, max]
+        template <typename F>
+        void for_each_cell(const Vec3Sz& min, const Vec3Sz& max, F f) const {
+            for (size_t z = min.z / this->cell_size; z <= max.z / this->cell_size; ++z) {
+                for (size_t y = min.y / this->cell_size; y <= max.y / this->cell_size; ++y) {
+                    for (size_t x = min.x / this->cell_size; x <= max.x / this->cell_size; ++x) {
+                        f(x + y * this->cells + z * this->cells * this->cells);
+                    }
+                }
+            }
+        }
+
+        template <typename F>
+        void for_each_particle(size_t c, F f) const {
+            Vec3Sz min, max;
+            this->cell_bounds(c, min, max);
+
+            const uint64_t h = hash(hash(this->seed, c), 1);
+            for (uint32_t i = 0; i < this->counts[c]; ++i) {
+                const uint64_t p = hash(h, i);
+                const auto brightness = static_cast<uint8_t>(128 + hash(p, 3) % 128);
+
+                f(
+                    min.x + static_cast<size_t>(unit(hash(p, 0)) * static_cast<double>(max.x - min.x)),
+                    min.y + static_cast<size_t>(unit(hash(p, 1)) * static_cast<double>(max.y - min.y)),
+                    min.z + static_cast<size_t>(unit(hash(p, 2)) * static_cast<double>(max.z - min.z)),
+                    Pixel{brightness, static_cast<uint8_t>(brightness * 3 / 4), static_cast<uint8_t>(brightness / 2), 255}
+                );
+            }
+        }
+    };
+
+    // Provides the regions of a generated volume to build_octree_chunked
+    class GeneratorSource {
+        const Generator& generator;
+        size_t dim;
+        WorkStealingPool& pool;
+
+    public:
+        GeneratorSource(const Generator& generator, size_t dim, WorkStealingPool& pool):
+            generator(generator), dim(dim), pool(pool) {
+        }
+
+        Vec3Sz dimensions() const {
+            return Vec3Sz(this->dim);
+        }
+
+        bool empty(const Vec3Sz& offset, size_t extent) const {
+            return this->generator.empty(offset, extent);
+        }
+
+        Grid grid(const Vec3Sz& offset, size_t extent) const {
+            auto grid = Grid({
+                std::min(extent, this->dim - offset.x),
+                std::min(extent, this->dim - offset.y),
+                std::min(extent, this->dim - offset.z)
+            });
+
+            this->generator.generate(grid, offset, this->pool);
+            return grid;
+        }
+    };
+
+    std::unique_ptr<Generator> create_generator(const GenerateOptions& opts) {
+        const double dim = static_cast<double>(opts.dim);
+
+        if (opts.type == "noise") {
+            const double density = opts.density >= 0 ? opts.density : 0.1;
+            const double scale = opts.scale > 0 ? opts.scale : dim / 4;
+            return std::make_unique<NoiseGenerator>(opts.dim, opts.seed, density, opts.octaves, scale);
+        } else if (opts.type == "menger") {
+            size_t level = opts.level;
+            if (level == 0) {
+                // The finest level of which the cells are at least a voxel
+                for (size_t cells = 3; cells <= opts.dim; cells *= 3) {
+                    ++level;
+                }
+            }
+
+            return std::make_unique<MengerGenerator>(opts.dim, level);
+        } else if (opts.type == "spheres") {
+            const double density = opts.density >= 0 ? opts.density : 0.05;
+            const double radius = opts.radius > 0 ? opts.radius : std::max(dim / 32, 1.0);
+            return std::make_unique<SphereGenerator>(opts.dim, opts.seed, density, radius);
+        }
+
+        const double density = opts.density >= 0 ? opts.density : 0.001;
+        return std::make_unique<ParticleGenerator>(opts.dim, opts.seed, density, opts.clusters);
+    }
+
+    void generate(const GenerateOptions& opts) {
+        const auto start = std::chrono::steady_clock::now();
+
+        fmt::print("Generating {} volume of {}x{}x{} voxels...\n", opts.type, opts.dim, opts.dim, opts.dim);
+        const auto generator = create_generator(opts);
+
+        auto pool = WorkStealingPool(opts.threads);
+        const auto source = GeneratorSource(*generator, opts.dim, pool);
+
+        if (!is_octree_path(opts.dst)) {
+            const auto grid = source.grid(Vec3Sz(0), opts.dim);
+            save_volume(grid, opts.dst, opts.output);
+        } else {
+            auto stats = ConstructionStats();
+            const auto type = opts.output.dag ? Octree::Type::Dag : Octree::Type::Sparse;
+            const auto heuristic = ChannelDiffHeuristic{opts.output.channel_difference};
+            const auto octree = build_octree_chunked(source, opts.chunk, stats, heuristic, type);
+            save_octree(octree, stats, opts.dst);
+        }
+
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+        fmt::print("Done in {:.2f}s\n", elapsed.count());
+    }
+}
+
+bool generate(Span<const char*> args) {
+    auto opts = GenerateOptions();
+
+    auto cmd = args::Command {
+        .flags = {
+            {&opts.output.dag, "--dag"}
+        },
+        .parameters = {
+            {args::int_range_opt<size_t>(&opts.dim, 1, std::numeric_limits<uint32_t>::max()), "dimension", "--dim"},
+            {args::int_range_opt<uint64_t>(&opts.seed), "seed", "--seed"},
+            {args::float_range_opt(&opts.density, 0.0, 1.0), "density", "--density"},
+            {args::float_range_opt(&opts.radius, 0.5), "radius", "--radius"},
+            {args::int_range_opt<size_t>(&opts.clusters, 1), "clusters", "--clusters"},
+            {args::int_range_opt<size_t>(&opts.level, 1, 20), "level", "--level"},
+            {args::int_range_opt<size_t>(&opts.octaves, 1, 16), "octaves", "--octaves"},
+            {args::float_range_opt(&opts.scale, 1.0), "scale", "--scale"},
+            {args::int_range_opt<size_t>(&opts.chunk, 1), "chunk size", "--chunk"},
+            {args::int_range_opt<size_t>(&opts.threads, 1), "threads", "--threads"},
+            {args::int_range_opt<int>(&opts.channel_difference, 0, 255), "channel difference", "--chan-diff"}
+        },
+        .positional = {
+            {args::string_opt(&opts.type), "volume type"},
+            {args::path_opt(&opts.dst), "destination path"}
+        }
+    };
+
+    try {
+        args::parse(args, cmd);
+
+        if (opts.type != "noise" && opts.type != "menger" && opts.type != "spheres" && opts.type != "particles") {
+            throw Error("Invalid volume type '{}'", opts.type);
+        } else if ((opts.chunk & (opts.chunk - 1)) != 0) {
+            throw Error("Chunk size must be a power of 2");
+        }
+    } catch (const Error& e) {
+        fmt::print("Error: {}\n", e.what());
+        return false;
+    }
+
+    opts.output.channel_difference = static_cast<uint8_t>(opts.channel_difference);
+
+    try {
+        generate(opts);
+    } catch (const std::exception& e) {
+        fmt::print("Error: {}\n", e.what());
+        return false;
+    }
+
+    for (const auto& line : accounting::report()) {
+        fmt::print("{}\n", line);
+    }
+
+    return true;
+}
@@ -0,0 +1,9 @@
+#ifndef _XENODON_GENERATE_H
+#define _XENODON_GENERATE_H
+
+#include "utility/Span.h"
+
+// Returns false if the volume could not be generated
+bool generate(Span<const char*> args);
+
+#endif
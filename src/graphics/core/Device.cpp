@@ -1,6 +1,7 @@
 #include "graphics/core/Device.h"
 #include <vector>
 #include <algorithm>
+#include "core/MemoryAccounting.h"
 
 Device::Device(const PhysicalDevice& physdev, Span<vk::DeviceQueueCreateInfo> queue_families, Span<const char*> extensions):
     physdev(physdev.get()) {
@@ -14,6 +15,8 @@ Device::Device(const PhysicalDevice& physdev, Span<vk::DeviceQueueCreateInfo> qu
         static_cast<uint32_t>(extensions.size()),
         extensions.data()
     });
+
+    accounting::register_device(this->dev.get(), this->physdev);
 }
 
 Device::Device(const PhysicalDevice& physdev, Span<uint32_t> queue_families, Span<const char*> extensions):
@@ -55,6 +58,8 @@ Device::Device(const PhysicalDevice& physdev, Span<uint32_t> queue_families, Spa
         extensions.data(),
         nullptr
     });
+
+    accounting::register_device(this->dev.get(), this->physdev);
 }
 
 std::optional<uint32_t> Device::find_memory_type(uint32_t filter, vk::MemoryPropertyFlags flags) const {
@@ -74,14 +79,7 @@ vk::DeviceMemory Device::allocate(vk::MemoryRequirements requirements, vk::Memor
         this->find_memory_type(requirements.memoryTypeBits, flags).value()
     );
 
-    return this->dev->allocateMemory(alloc_info);
-}
-
-vk::UniqueDeviceMemory Device::allocate_unique(vk::MemoryRequirements requirements, vk::MemoryPropertyFlags flags) const {
-    auto alloc_info = vk::MemoryAllocateInfo(
-        requirements.size,
-        this->find_memory_type(requirements.memoryTypeBits, flags).value()
-    );
-
-    return this->dev->allocateMemoryUnique(alloc_info);
+    auto memory = this->dev->allocateMemory(alloc_info);
+    accounting::device_allocate(this->dev.get(), alloc_info.memoryTypeIndex, memory, alloc_info.allocationSize);
+    return memory;
 }
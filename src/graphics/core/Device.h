@@ -17,10 +17,10 @@ public:
 
     std::optional<uint32_t> find_memory_type(uint32_t filter, vk::MemoryPropertyFlags flags) const;
 
+    // Allocations are recorded by the memory accounting, see core/MemoryAccounting.h. They must
+    // be freed after calling accounting::device_free.
     vk::DeviceMemory allocate(vk::MemoryRequirements requirements, vk::MemoryPropertyFlags flags) const;
 
-    vk::UniqueDeviceMemory allocate_unique(vk::MemoryRequirements requirements, vk::MemoryPropertyFlags flags) const;
-
     vk::Device get() const {
         return this->dev.get();
     }
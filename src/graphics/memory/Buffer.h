@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <vulkan/vulkan.hpp>
 #include "graphics/core/Device.h"
+#include "core/MemoryAccounting.h"
 
 template <typename T>
 struct Buffer {
@@ -75,6 +76,7 @@ Buffer<T>& Buffer<T>::operator=(Buffer&& other) {
 template <typename T>
 Buffer<T>::~Buffer() {
     if (this->buffer != vk::Buffer()) {
+        accounting::device_free(this->mem);
         this->dev.freeMemory(this->mem);
         this->dev.destroyBuffer(this->buffer);
     }
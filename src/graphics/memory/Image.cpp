@@ -1,4 +1,5 @@
 #include "graphics/memory/Image.h"
+#include "core/MemoryAccounting.h"
 
 Image::Image(const Device& device, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags flags):
     device(device.get()) {
@@ -39,6 +40,7 @@ Image& Image::operator=(Image&& other) {
 
 Image::~Image() {
     if (this->image != vk::Image()) {
+        accounting::device_free(this->mem);
         this->device.freeMemory(this->mem);
         this->device.destroyImage(this->image);
     }
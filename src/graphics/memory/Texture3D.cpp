@@ -1,5 +1,6 @@
 #include "graphics/memory/Texture3D.h"
 #include "core/Logger.h"
+#include "core/MemoryAccounting.h"
 
 Texture3D::Texture3D(Texture3D&& other):
     dev(other.dev),
@@ -23,6 +24,7 @@ Texture3D& Texture3D::operator=(Texture3D&& other) {
 Texture3D::~Texture3D() {
     if (this->image != vk::Image()) {
         this->dev.destroyImageView(this->image_view);
+        accounting::device_free(this->mem);
         this->dev.freeMemory(this->mem);
         this->dev.destroyImage(this->image);
     }
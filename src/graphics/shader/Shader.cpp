@@ -9,11 +9,12 @@ Shader::Shader(const Device& device, vk::ShaderStageFlagBits stage, std::string_
     });
 }
 
-vk::PipelineShaderStageCreateInfo Shader::info() const {
+vk::PipelineShaderStageCreateInfo Shader::info(const vk::SpecializationInfo* specialization) const {
     return vk::PipelineShaderStageCreateInfo(
         {},
         this->stage,
         this->shader.get(),
-        "main"
+        "main",
+        specialization
     );
 }
\ No newline at end of file
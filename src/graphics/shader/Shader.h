@@ -11,7 +11,7 @@ class Shader {
 
 public:
     Shader(const Device& device, vk::ShaderStageFlagBits stage, std::string_view source);
-    vk::PipelineShaderStageCreateInfo info() const;
+    vk::PipelineShaderStageCreateInfo info(const vk::SpecializationInfo* specialization = nullptr) const;
 
     vk::ShaderModule get() const {
         return this->shader.get();
@@ -0,0 +1,551 @@
+#include "import_particles.h"
+#include <string_view>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <fmt/format.h>
+#include "core/arg_parse.h"
+#include "core/Error.h"
+#include "core/MemoryAccounting.h"
+#include "model/Grid.h"
+#include "utility/WorkStealingPool.h"
+#include "volume_output.h"
+
+namespace {
+    // The number of particles read from the file at once
+    constexpr const size_t CHUNK_PARTICLES = 1 << 20;
+
+    // The number of bins of the histogram of log densities that the percentiles are taken from
+    constexpr const size_t HISTOGRAM_BINS = 1 << 16;
+
+    enum class ParticleFormat {
+        F32,
+        F64
+    };
+
+    enum class Colormap {
+        Magma,
+        Gray
+    };
+
+    struct ImportOptions {
+        std::filesystem::path src;
+        std::filesystem::path dst;
+        size_t dim = 512;
+        ParticleFormat format = ParticleFormat::F32;
+        bool no_weights = false;
+        double box = 0;
+        double lower = 0;
+        double upper = 100;
+        Colormap colormap = Colormap::Magma;
+        size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+        VolumeOutputOptions output;
+        int channel_difference = 0;
+    };
+
+    struct Particle {
+        double x, y, z;
+        float weight;
+    };
+
+    struct Bounds {
+        std::array<double, 3> min = {
+            std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::max()
+        };
+
+        std::array<double, 3> max = {
+            std::numeric_limits<double>::lowest(),
+            std::numeric_limits<double>::lowest(),
+            std::numeric_limits<double>::lowest()
+        };
+
+        void add(const Bounds& other) {
+            for (size_t i = 0; i < 3; ++i) {
+                this->min[i] = std::min(this->min[i], other.min[i]);
+                this->max[i] = std::max(this->max[i], other.max[i]);
+            }
+        }
+    };
+
+    // A voxel which a particle falls in, and the weight it adds to it
+    struct Sample {
+        size_t index;
+        float weight;
+    };
+
+    auto format_opt(ParticleFormat* var) {
+        return [var](std::string_view arg) {
+            if (arg == "f32") {
+                *var = ParticleFormat::F32;
+            } else if (arg == "f64") {
+                *var = ParticleFormat::F64;
+            } else {
+                return false;
+            }
+
+            return true;
+        };
+    }
+
+    auto colormap_opt(Colormap* var) {
+        return [var](std::string_view arg) {
+            if (arg == "magma") {
+                *var = Colormap::Magma;
+            } else if (arg == "gray") {
+                *var = Colormap::Gray;
+            } else {
+                return false;
+            }
+
+            return true;
+        };
+    }
+
+    template <typename T>
+    Particle read_particle(const char* record, bool weighted) {
+        T values[4] = {0, 0, 0, 1};
+        std::memcpy(values, record, (weighted ? 4 : 3) * sizeof(T));
+        return {
+            static_cast<double>(values[0]),
+            static_cast<double>(values[1]),
+            static_cast<double>(values[2]),
+            static_cast<float>(values[3])
+        };
+    }
+
+    // Reads the particle file in chunks, and reads the next chunk while the current one is processed
+    class ParticleReader {
+        std::filesystem::path path;
+        ParticleFormat format;
+        bool weighted;
+        size_t record_size;
+        size_t particles;
+
+    public:
+        ParticleReader(const std::filesystem::path& path, ParticleFormat format, bool weighted):
+            path(path),
+            format(format),
+            weighted(weighted),
+            record_size((weighted ? 4 : 3) * (format == ParticleFormat::F64 ? sizeof(double) : sizeof(float))) {
+
+            const auto size = std::filesystem::file_size(path);
+            if (size % this->record_size != 0) {
+                throw Error("Size of '{}' is not a multiple of the particle size ({} bytes)", path.native(), this->record_size);
+            }
+
+            this->particles = size / this->record_size;
+        }
+
+        size_t size() const {
+            return this->particles;
+        }
+
+        Particle particle(const char* chunk, size_t i) const {
+            const char* record = chunk + i * this->record_size;
+            return this->format == ParticleFormat::F64 ?
+                read_particle<double>(record, this->weighted) :
+                read_particle<float>(record, this->weighted);
+        }
+
+        // Call f(chunk, particles) for every chunk of the file, in order
+        void for_each_chunk(const std::function<void(const char*, size_t)>& f) const {
+            auto in = std::ifstream(this->path, std::ios::binary);
+            if (!in) {
+                throw Error("Failed to open '{}'", this->path.native());
+            }
+
+            auto current = std::vector<char>(CHUNK_PARTICLES * this->record_size);
+            auto next = std::vector<char>(current.size());
+
+            auto read = [this, &in](std::vector<char>& buffer) {
+                in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                return static_cast<size_t>(in.gcount()) / this->record_size;
+            };
+
+            size_t n = read(current);
+            while (n > 0) {
+                auto pending = std::async(std::launch::async, read, std::ref(next));
+                f(current.data(), n);
+                n = pending.get();
+                std::swap(current, next);
+            }
+        }
+    };
+
+    // Maps particle positions to voxels of a cubic grid. The bins of an axis span the bounds of
+    // that axis, like numpy.histogramdd. Voxels are laid out like the TIFF image written by
+    // make-tng-volume.py as read by Grid::load_tiff, so that the volume has the same orientation.
+    class Binning {
+        Bounds bounds;
+        size_t dim;
+
+    public:
+        Binning(const Bounds& bounds, size_t dim):
+            bounds(bounds), dim(dim) {
+        }
+
+        // Returns false for particles outside the bounds
+        bool voxel(const Particle& p, size_t& index) const {
+            const double pos[] = {p.x, p.y, p.z};
+            size_t bin[3];
+
+            for (size_t i = 0; i < 3; ++i) {
+                const double lo = this->bounds.min[i];
+                const double hi = this->bounds.max[i];
+
+                // Also rejects NaN
+                if (!(pos[i] >= lo && pos[i] <= hi)) {
+                    return false;
+                }
+
+                // The last bin includes the upper bound
+                const double t = hi > lo ? (pos[i] - lo) / (hi - lo) : 0;
+                bin[i] = std::min(static_cast<size_t>(t * static_cast<double>(this->dim)), this->dim - 1);
+            }
+
+            const size_t x = bin[2];
+            const size_t y = this->dim - 1 - bin[1];
+            const size_t z = bin[0];
+            index = x + y * this->dim + z * this->dim * this->dim;
+            return true;
+        }
+    };
+
+    Bounds find_bounds(const ParticleReader& reader, WorkStealingPool& pool) {
+        auto bounds = Bounds();
+        auto range_bounds = std::vector<Bounds>(pool.threads());
+
+        reader.for_each_chunk([&](const char* chunk, size_t n) {
+            const size_t ranges = range_bounds.size();
+            pool.run(ranges, [&](size_t r) {
+                auto& b = range_bounds[r];
+                for (size_t i = r * n / ranges; i < (r + 1) * n / ranges; ++i) {
+                    const auto p = reader.particle(chunk, i);
+                    const double pos[] = {p.x, p.y, p.z};
+                    for (size_t j = 0; j < 3; ++j) {
+                        b.min[j] = std::min(b.min[j], pos[j]);
+                        b.max[j] = std::max(b.max[j], pos[j]);
+                    }
+                }
+            });
+        });
+
+        for (const auto& b : range_bounds) {
+            bounds.add(b);
+        }
+
+        return bounds;
+    }
+
+    // Every worker owns a slab of the density grid. A chunk of particles is first divided over
+    // the workers, which sort the voxels of their particles into a bucket per slab. Each worker
+    // then adds the buckets of its own slab, so that no two workers write the same voxel.
+    size_t bin_particles(const ParticleReader& reader, const Binning& binning, WorkStealingPool& pool, float* density, size_t voxels) {
+        const size_t slabs = pool.threads();
+        const size_t slab_size = (voxels + slabs - 1) / slabs;
+
+        auto buckets = std::vector<std::vector<Sample>>(slabs * slabs);
+        auto binned = std::vector<size_t>(slabs, 0);
+
+        reader.for_each_chunk([&](const char* chunk, size_t n) {
+            pool.run(slabs, [&](size_t r) {
+                auto* range_buckets = &buckets[r * slabs];
+                for (size_t i = r * n / slabs; i < (r + 1) * n / slabs; ++i) {
+                    size_t index;
+                    const auto p = reader.particle(chunk, i);
+                    if (binning.voxel(p, index)) {
+                        range_buckets[index / slab_size].push_back({index, p.weight});
+                    }
+                }
+            });
+
+            pool.run(slabs, [&](size_t slab) {
+                for (size_t r = 0; r < slabs; ++r) {
+                    auto& bucket = buckets[r * slabs + slab];
+                    for (const auto& sample : bucket) {
+                        density[sample.index] += sample.weight;
+                    }
+
+                    binned[slab] += bucket.size();
+                    bucket.clear();
+                }
+            });
+        });
+
+        size_t total = 0;
+        for (size_t n : binned) {
+            total += n;
+        }
+
+        return total;
+    }
+
+    // Empty voxels have the logarithm of the smallest double, like log(a + sys.float_info.min)
+    // in make-tng-volume.py
+    double log_density(float v) {
+        return v > 0 ? std::log(static_cast<double>(v)) : std::log(std::numeric_limits<double>::min());
+    }
+
+    // A histogram of the logarithm of the voxels with a positive density
+    class LogHistogram {
+        double min;
+        double max;
+        size_t empty;
+        std::vector<size_t> bins;
+
+    public:
+        LogHistogram(const float* density, size_t voxels, WorkStealingPool& pool):
+            min(std::numeric_limits<double>::max()),
+            max(std::numeric_limits<double>::lowest()),
+            empty(0),
+            bins(HISTOGRAM_BINS, 0) {
+
+            const size_t ranges = pool.threads();
+            auto range_min = std::vector<double>(ranges, this->min);
+            auto range_max = std::vector<double>(ranges, this->max);
+            auto range_empty = std::vector<size_t>(ranges, 0);
+
+            pool.run(ranges, [&](size_t r) {
+                for (size_t i = r * voxels / ranges; i < (r + 1) * voxels / ranges; ++i) {
+                    if (density[i] > 0) {
+                        const double v = log_density(density[i]);
+                        range_min[r] = std::min(range_min[r], v);
+                        range_max[r] = std::max(range_max[r], v);
+                    } else {
+                        ++range_empty[r];
+                    }
+                }
+            });
+
+            for (size_t r = 0; r < ranges; ++r) {
+                this->min = std::min(this->min, range_min[r]);
+                this->max = std::max(this->max, range_max[r]);
+                this->empty += range_empty[r];
+            }
+
+            if (this->empty == voxels) {
+                return;
+            }
+
+            auto range_bins = std::vector<std::vector<size_t>>(ranges, std::vector<size_t>(HISTOGRAM_BINS, 0));
+            pool.run(ranges, [&](size_t r) {
+                auto& hist = range_bins[r];
+                for (size_t i = r * voxels / ranges; i < (r + 1) * voxels / ranges; ++i) {
+                    if (density[i] > 0) {
+                        ++hist[this->bin(log_density(density[i]))];
+                    }
+                }
+            });
+
+            for (const auto& hist : range_bins) {
+                for (size_t i = 0; i < HISTOGRAM_BINS; ++i) {
+                    this->bins[i] += hist[i];
+                }
+            }
+        }
+
+        // The log density at a percentile of all voxels, interpolated within the histogram bin
+        double percentile(double p) const {
+            size_t total = this->empty;
+            for (size_t n : this->bins) {
+                total += n;
+            }
+
+            const double rank = p / 100.0 * static_cast<double>(total - 1);
+            if (rank < static_cast<double>(this->empty)) {
+                return log_density(0);
+            }
+
+            double remaining = rank - static_cast<double>(this->empty);
+            for (size_t i = 0; i < HISTOGRAM_BINS; ++i) {
+                const auto n = static_cast<double>(this->bins[i]);
+                if (remaining < n) {
+                    return this->min + (static_cast<double>(i) + remaining / n) * this->bin_width();
+                }
+
+                remaining -= n;
+            }
+
+            return this->max;
+        }
+
+        size_t empty_voxels() const {
+            return this->empty;
+        }
+
+    private:
+        double bin_width() const {
+            return (this->max - this->min) / static_cast<double>(HISTOGRAM_BINS);
+        }
+
+        size_t bin(double v) const {
+            if (this->max <= this->min) {
+                return 0;
+            }
+
+            return std::min(static_cast<size_t>((v - this->min) / this->bin_width()), HISTOGRAM_BINS - 1);
+        }
+    };
+
+    // Polynomial fit of matplotlib's magma colormap
+    Pixel magma(double t) {
+        constexpr const double coeffs[7][3] = {
+            {-0.002136485053939582, -0.000749655052795221, -0.005386127855323933},
+            {0.2516605407371642, 0.6775232436837668, 2.494026599312351},
+            {8.353717279216625, -3.577719514958484, 0.3144679030132573},
+            {-27.66873308576866, 14.26473078096533, -13.64921318813922},
+            {52.17613981234068, -27.94360607168351, 12.94416944238394},
+            {-50.76852536473588, 29.04658282127291, 4.23415299384598},
+            {18.65570506591883, -11.48977351997711, -5.601961508734096}
+        };
+
+        uint8_t rgb[3];
+        for (size_t c = 0; c < 3; ++c) {
+            double v = coeffs[6][c];
+            for (size_t i = 6; i-- > 0;) {
+                v = v * t + coeffs[i][c];
+            }
+
+            rgb[c] = static_cast<uint8_t>(std::clamp(v, 0.0, 1.0) * 255.0 + 0.5);
+        }
+
+        return {rgb[0], rgb[1], rgb[2], 255};
+    }
+
+    // Like a matplotlib colormap, values are quantized to 256 colors
+    std::array<Pixel, 256> colormap_lut(Colormap colormap) {
+        auto lut = std::array<Pixel, 256>();
+        for (size_t i = 0; i < lut.size(); ++i) {
+            if (colormap == Colormap::Magma) {
+                lut[i] = magma(static_cast<double>(i) / 255.0);
+            } else {
+                const auto v = static_cast<uint8_t>(i);
+                lut[i] = {v, v, v, 255};
+            }
+        }
+
+        return lut;
+    }
+
+    Grid create_grid(const ImportOptions& opts, const ParticleReader& reader, const Bounds& bounds, WorkStealingPool& pool) {
+        const size_t voxels = opts.dim * opts.dim * opts.dim;
+        auto density = std::make_unique<float[]>(voxels);
+        const auto density_allocation = accounting::HostAllocation(accounting::HostCategory::Construction, voxels * sizeof(float));
+
+        fmt::print("Binning {} particles into {}x{}x{} voxels...\n", reader.size(), opts.dim, opts.dim, opts.dim);
+        const size_t binned = bin_particles(reader, Binning(bounds, opts.dim), pool, density.get(), voxels);
+        fmt::print(" Binned: {}, outside bounds: {}\n", binned, reader.size() - binned);
+
+        fmt::print("Normalizing...\n");
+        const auto hist = LogHistogram(density.get(), voxels, pool);
+        const double lo = hist.percentile(opts.lower);
+        const double hi = hist.percentile(opts.upper);
+        fmt::print(" Empty voxels: {}\n", hist.empty_voxels());
+        fmt::print(" Log density at percentile {}: {}, at percentile {}: {}\n", opts.lower, lo, opts.upper, hi);
+
+        const auto lut = colormap_lut(opts.colormap);
+        auto grid = Grid({opts.dim, opts.dim, opts.dim});
+
+        pool.run(opts.dim, [&](size_t z) {
+            const float* layer = &density[z * opts.dim * opts.dim];
+            for (size_t y = 0; y < opts.dim; ++y) {
+                for (size_t x = 0; x < opts.dim; ++x) {
+                    const double t = hi > lo ? (log_density(layer[x + y * opts.dim]) - lo) / (hi - lo) : 0;
+                    grid.set({x, y, z}, lut[static_cast<size_t>(std::clamp(t * 256.0, 0.0, 255.0))]);
+                }
+            }
+        });
+
+        return grid;
+    }
+
+    void import(const ImportOptions& opts) {
+        auto pool = WorkStealingPool(opts.threads);
+        const auto reader = ParticleReader(opts.src, opts.format, !opts.no_weights);
+
+        auto bounds = Bounds();
+        if (opts.box > 0) {
+            bounds.min = {0, 0, 0};
+            bounds.max = {opts.box, opts.box, opts.box};
+        } else {
+            fmt::print("Finding bounds of {} particles...\n", reader.size());
+            bounds = find_bounds(reader, pool);
+        }
+
+        fmt::print(
+            "Bounds: ({}, {}, {}) to ({}, {}, {})\n",
+            bounds.min[0],
+            bounds.min[1],
+            bounds.min[2],
+            bounds.max[0],
+            bounds.max[1],
+            bounds.max[2]
+        );
+
+        const auto grid = create_grid(opts, reader, bounds, pool);
+        save_volume(grid, opts.dst, opts.output);
+    }
+}
+
+bool import_particles(Span<const char*> args) {
+    auto opts = ImportOptions();
+
+    auto cmd = args::Command {
+        .flags = {
+            {&opts.no_weights, "--no-weights"},
+            {&opts.output.dag, "--dag"}
+        },
+        .parameters = {
+            {args::int_range_opt<size_t>(&opts.dim, 1, std::numeric_limits<uint16_t>::max()), "dimension", "--dim"},
+            {format_opt(&opts.format), "format", "--format"},
+            {args::float_range_opt(&opts.box, 0.0), "box size", "--box"},
+            {args::float_range_opt(&opts.lower, 0.0, 100.0), "percentile", "--lower"},
+            {args::float_range_opt(&opts.upper, 0.0, 100.0), "percentile", "--upper"},
+            {colormap_opt(&opts.colormap), "colormap", "--colormap"},
+            {args::int_range_opt<size_t>(&opts.threads, 1), "threads", "--threads"},
+            {args::int_range_opt<int>(&opts.channel_difference, 0, 255), "channel difference", "--chan-diff"}
+        },
+        .positional = {
+            {args::path_opt(&opts.src), "source particle path"},
+            {args::path_opt(&opts.dst), "destination path"}
+        }
+    };
+
+    try {
+        args::parse(args, cmd);
+
+        if (opts.lower > opts.upper) {
+            throw Error("--lower must not be larger than --upper");
+        }
+    } catch (const Error& e) {
+        fmt::print("Error: {}\n", e.what());
+        return false;
+    }
+
+    opts.output.channel_difference = static_cast<uint8_t>(opts.channel_difference);
+
+    try {
+        import(opts);
+    } catch (const std::exception& e) {
+        fmt::print("Error: {}\n", e.what());
+        return false;
+    }
+
+    for (const auto& line : accounting::report()) {
+        fmt::print("{}\n", line);
+    }
+
+    return true;
+}
@@ -0,0 +1,9 @@
+#ifndef _XENODON_IMPORT_PARTICLES_H
+#define _XENODON_IMPORT_PARTICLES_H
+
+#include "utility/Span.h"
+
+// Returns false if the particles could not be imported
+bool import_particles(Span<const char*> args);
+
+#endif
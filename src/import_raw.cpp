@@ -0,0 +1,354 @@
+#include "import_raw.h"
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <tuple>
+#include <thread>
+#include <cstring>
+#include <cstdint>
+#include <fmt/format.h>
+#include "core/arg_parse.h"
+#include "core/Error.h"
+#include "core/MemoryAccounting.h"
+#include "cpu/simd.h"
+#include "model/Grid.h"
+#include "utility/WorkStealingPool.h"
+#include "volume_output.h"
+
+using simd::F32;
+using simd::I32;
+using simd::U32;
+
+namespace {
+    using U16 = uint16_t __attribute__((vector_size(simd::WIDTH * sizeof(uint16_t))));
+    using U8 = uint8_t __attribute__((vector_size(simd::WIDTH * sizeof(uint8_t))));
+
+    enum class StackAxis {
+        X,
+        Y,
+        Z
+    };
+
+    struct ImportOptions {
+        std::filesystem::path src;
+        std::filesystem::path dst;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t bits = 8;
+        bool big_endian = false;
+        uint32_t window_min = 0;
+        uint32_t window_max = 0;
+        uint32_t threshold = 0;
+        double mask_radius = 0;
+        StackAxis stack_axis = StackAxis::Z;
+        bool flip = false;
+        size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+        VolumeOutputOptions output;
+        int channel_difference = 0;
+    };
+
+    // Parses <a><separator><b>, where both are unsigned integers
+    bool parse_pair(std::string_view arg, char separator, uint32_t& a, uint32_t& b) {
+        const auto sep = arg.find(separator);
+        if (sep == std::string_view::npos) {
+            return false;
+        }
+
+        auto parse = [](std::string_view str, uint32_t& value) {
+            auto [end, err] = std::from_chars(str.begin(), str.end(), value);
+            return err == std::errc() && end == str.end();
+        };
+
+        return parse(arg.substr(0, sep), a) && parse(arg.substr(sep + 1), b);
+    }
+
+    auto size_opt(uint32_t* width, uint32_t* height) {
+        return [width, height](std::string_view arg) {
+            return parse_pair(arg, 'x', *width, *height) && *width > 0 && *height > 0;
+        };
+    }
+
+    auto window_opt(uint32_t* min, uint32_t* max) {
+        return [min, max](std::string_view arg) {
+            return parse_pair(arg, ',', *min, *max) && *min < *max;
+        };
+    }
+
+    auto stack_axis_opt(StackAxis* var) {
+        return [var](std::string_view arg) {
+            if (arg == "x") {
+                *var = StackAxis::X;
+            } else if (arg == "y") {
+                *var = StackAxis::Y;
+            } else if (arg == "z") {
+                *var = StackAxis::Z;
+            } else {
+                return false;
+            }
+
+            return true;
+        };
+    }
+
+    // A slice and where to find it
+    struct SliceSource {
+        std::filesystem::path path;
+        size_t offset;
+    };
+
+    // The source is either a directory with a file per slice, or a single file with all slices
+    // after each other. Files named by a number are ordered numerically, like the slices of
+    // the Stanford volumes.
+    std::vector<SliceSource> find_slices(const std::filesystem::path& src, size_t slice_size) {
+        auto slices = std::vector<SliceSource>();
+
+        if (!std::filesystem::is_directory(src)) {
+            const auto size = std::filesystem::file_size(src);
+            if (size == 0 || size % slice_size != 0) {
+                throw Error("Size of '{}' is not a multiple of the slice size ({} bytes)", src.native(), slice_size);
+            }
+
+            for (size_t i = 0; i < size / slice_size; ++i) {
+                slices.push_back({src, i * slice_size});
+            }
+
+            return slices;
+        }
+
+        for (const auto& entry : std::filesystem::directory_iterator(src)) {
+            if (entry.is_regular_file()) {
+                slices.push_back({entry.path(), 0});
+            }
+        }
+
+        if (slices.empty()) {
+            throw Error("Directory '{}' has no slices", src.native());
+        }
+
+        auto key = [](const SliceSource& slice) {
+            const auto name = slice.path.filename().string();
+            const bool numeric = !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+                return c >= '0' && c <= '9';
+            });
+
+            // Numeric names sort before other names, and by length first so that 10 comes after 9
+            return std::make_tuple(!numeric, numeric ? name.size() : 0, name);
+        };
+
+        std::sort(slices.begin(), slices.end(), [&key](const SliceSource& lhs, const SliceSource& rhs) {
+            return key(lhs) < key(rhs);
+        });
+
+        return slices;
+    }
+
+    // Pixels of a slice that are outside of the circle with `radius` around its center are
+    // masked out, which makes a cylinder along the stack axis. Masked pixels are 0, others -1.
+    std::vector<int32_t> slice_mask(uint32_t width, uint32_t height, double radius, size_t padded_size) {
+        auto mask = std::vector<int32_t>(padded_size, 0);
+
+        for (uint32_t r = 0; r < height; ++r) {
+            for (uint32_t c = 0; c < width; ++c) {
+                const double dx = static_cast<double>(c) - static_cast<double>(width / 2);
+                const double dy = static_cast<double>(r) - static_cast<double>(height / 2);
+                mask[r * width + c] = radius <= 0 || dx * dx + dy * dy <= radius * radius ? -1 : 0;
+            }
+        }
+
+        return mask;
+    }
+
+    // Converts raw samples of a slice to 8-bit intensities, 8 samples at a time: swap the bytes
+    // of big-endian samples, map the window [min, max] to [0, 255], clear intensities at or
+    // below the threshold and apply the mask.
+    class SliceKernel {
+        bool swap;
+        F32 window_min;
+        F32 scale;
+        I32 threshold;
+
+    public:
+        SliceKernel(const ImportOptions& opts):
+            swap(opts.big_endian && opts.bits == 16),
+            window_min(simd::splat(static_cast<float>(opts.window_min))),
+            scale(simd::splat(255.f / static_cast<float>(opts.window_max - opts.window_min))),
+            threshold(simd::splat(static_cast<int32_t>(opts.threshold))) {
+        }
+
+        void run(const uint8_t* samples, size_t bits, const int32_t* mask, uint8_t* out, size_t n) const {
+            for (size_t i = 0; i < n; i += simd::WIDTH) {
+                U32 raw;
+                if (bits == 16) {
+                    U16 s;
+                    std::memcpy(&s, &samples[i * sizeof(uint16_t)], sizeof s);
+                    if (this->swap) {
+                        s = (s >> 8) | (s << 8);
+                    }
+
+                    raw = __builtin_convertvector(s, U32);
+                } else {
+                    U8 s;
+                    std::memcpy(&s, &samples[i], sizeof s);
+                    raw = __builtin_convertvector(s, U32);
+                }
+
+                F32 v = (__builtin_convertvector(raw, F32) - this->window_min) * this->scale;
+                v = simd::min(simd::max(v, simd::splat(0.f)), simd::splat(255.f));
+
+                I32 intensity = __builtin_convertvector(v, I32);
+                I32 m;
+                std::memcpy(&m, &mask[i], sizeof m);
+                intensity &= (intensity > this->threshold) & m;
+
+                const U8 result = __builtin_convertvector(intensity, U8);
+                std::memcpy(&out[i], &result, sizeof result);
+            }
+        }
+    };
+
+    // The location in the grid of pixel (c, r) of slice s. Rows are flipped, like the layers
+    // of a TIFF image read by Grid::load_tiff, so the top of a slice is at the top of the volume.
+    Vec3Sz voxel(StackAxis axis, Vec3Sz dim, size_t s, size_t r, size_t c) {
+        switch (axis) {
+            case StackAxis::X:
+                return {s, dim.y - r - 1, c};
+            case StackAxis::Y:
+                return {c, s, r};
+            case StackAxis::Z:
+            default:
+                return {c, dim.y - r - 1, s};
+        }
+    }
+
+    Grid import(const ImportOptions& opts) {
+        const size_t bytes_per_sample = opts.bits / 8;
+        const size_t pixels = static_cast<size_t>(opts.width) * opts.height;
+        const size_t slice_size = pixels * bytes_per_sample;
+
+        const auto slices = find_slices(opts.src, slice_size);
+        const size_t depth = slices.size();
+
+        auto dim = Vec3Sz(0);
+        switch (opts.stack_axis) {
+            case StackAxis::X:
+                dim = {depth, opts.height, opts.width};
+                break;
+            case StackAxis::Y:
+                dim = {opts.width, depth, opts.height};
+                break;
+            case StackAxis::Z:
+                dim = {opts.width, opts.height, depth};
+                break;
+        }
+
+        fmt::print("Reading {} slices of {}x{} pixels into {}x{}x{} voxels...\n", depth, opts.width, opts.height, dim.x, dim.y, dim.z);
+
+        // The kernel processes whole vectors, so the buffers are padded
+        const size_t padded = (pixels + simd::WIDTH - 1) / simd::WIDTH * simd::WIDTH;
+        const auto mask = slice_mask(opts.width, opts.height, opts.mask_radius, padded);
+        const auto kernel = SliceKernel(opts);
+
+        auto grid = Grid(dim);
+        auto pool = WorkStealingPool(opts.threads);
+        auto errors = std::vector<std::string>(depth);
+
+        pool.run(depth, [&](size_t i) {
+            auto samples = std::vector<uint8_t>(padded * bytes_per_sample, 0);
+            auto intensities = std::vector<uint8_t>(padded);
+
+            auto in = std::ifstream(slices[i].path, std::ios::binary);
+            in.seekg(static_cast<std::streamoff>(slices[i].offset));
+            in.read(reinterpret_cast<char*>(samples.data()), static_cast<std::streamsize>(slice_size));
+            if (!in) {
+                errors[i] = fmt::format("Failed to read slice {} from '{}'", i, slices[i].path.native());
+                return;
+            }
+
+            kernel.run(samples.data(), opts.bits, mask.data(), intensities.data(), padded);
+
+            const size_t s = opts.flip ? depth - i - 1 : i;
+            for (size_t r = 0; r < opts.height; ++r) {
+                for (size_t c = 0; c < opts.width; ++c) {
+                    const uint8_t v = intensities[r * opts.width + c];
+                    grid.set(voxel(opts.stack_axis, dim, s, r, c), {v, v, v, 255});
+                }
+            }
+        });
+
+        for (const auto& error : errors) {
+            if (!error.empty()) {
+                throw Error("{}", error);
+            }
+        }
+
+        return grid;
+    }
+}
+
+bool import_raw(Span<const char*> args) {
+    auto opts = ImportOptions();
+    bool window = false;
+
+    auto cmd = args::Command {
+        .flags = {
+            {&opts.big_endian, "--big-endian"},
+            {&opts.flip, "--flip"},
+            {&opts.output.dag, "--dag"}
+        },
+        .parameters = {
+            {size_opt(&opts.width, &opts.height), "size", "--size"},
+            {args::int_range_opt<uint32_t>(&opts.bits, 8, 16), "bits", "--bits"},
+            {window_opt(&opts.window_min, &opts.window_max), "window", "--window"},
+            {args::int_range_opt<uint32_t>(&opts.threshold, 0, 255), "threshold", "--threshold"},
+            {args::float_range_opt(&opts.mask_radius, 0.0), "radius", "--mask"},
+            {stack_axis_opt(&opts.stack_axis), "axis", "--stack-axis"},
+            {args::int_range_opt<size_t>(&opts.threads, 1), "threads", "--threads"},
+            {args::int_range_opt<int>(&opts.channel_difference, 0, 255), "channel difference", "--chan-diff"}
+        },
+        .positional = {
+            {args::path_opt(&opts.src), "source path"},
+            {args::path_opt(&opts.dst), "destination path"}
+        }
+    };
+
+    try {
+        args::parse(args, cmd);
+
+        window = opts.window_max != 0;
+        if (opts.width == 0) {
+            throw Error("Missing required option --size");
+        } else if (opts.bits != 8 && opts.bits != 16) {
+            throw Error("Sample bits must be 8 or 16");
+        } else if (window && opts.window_max >= (1u << opts.bits)) {
+            throw Error("Window exceeds the range of {}-bit samples", opts.bits);
+        }
+    } catch (const Error& e) {
+        fmt::print("Error: {}\n", e.what());
+        return false;
+    }
+
+    if (!window) {
+        opts.window_max = (1u << opts.bits) - 1;
+    }
+
+    opts.output.channel_difference = static_cast<uint8_t>(opts.channel_difference);
+
+    try {
+        const auto grid = import(opts);
+        save_volume(grid, opts.dst, opts.output);
+    } catch (const std::exception& e) {
+        fmt::print("Error: {}\n", e.what());
+        return false;
+    }
+
+    for (const auto& line : accounting::report()) {
+        fmt::print("{}\n", line);
+    }
+
+    return true;
+}
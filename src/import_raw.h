@@ -0,0 +1,9 @@
+#ifndef _XENODON_IMPORT_RAW_H
+#define _XENODON_IMPORT_RAW_H
+
+#include "utility/Span.h"
+
+// Returns false if the slices could not be imported
+bool import_raw(Span<const char*> args);
+
+#endif
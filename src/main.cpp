@@ -2,12 +2,17 @@
 #include <array>
 #include <filesystem>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <limits>
+#include <algorithm>
+#include <thread>
 #include <vulkan/vulkan.hpp>
 #include <fmt/format.h>
 #include "core/Logger.h"
 #include "core/Error.h"
 #include "core/arg_parse.h"
+#include "core/Trace.h"
 #include "backend/backend.h"
 #include "backend/Display.h"
 #include "backend/Event.h"
@@ -16,8 +21,16 @@
 #include "main_loop.h"
 #include "sysinfo.h"
 #include "convert.h"
+#include "bench.h"
+#include "serve.h"
+#include "import_particles.h"
+#include "import_raw.h"
+#include "generate.h"
 
 namespace {
+    // The difference per color channel up to which the frames of --cpu-compare are considered equal
+    constexpr const int32_t DEFAULT_COMPARE_TOLERANCE = 2;
+
     struct HelpTopic {
         std::string_view topic;
         std::string_view help_message;
@@ -28,6 +41,11 @@ namespace {
         HelpTopic{"sysinfo", resources::open("resources/help/sysinfo.txt")},
         HelpTopic{"convert", resources::open("resources/help/convert.txt")},
         HelpTopic{"render", resources::open("resources/help/render.txt")},
+        HelpTopic{"bench", resources::open("resources/help/bench.txt")},
+        HelpTopic{"serve", resources::open("resources/help/serve.txt")},
+        HelpTopic{"import-particles", resources::open("resources/help/import_particles.txt")},
+        HelpTopic{"import-raw", resources::open("resources/help/import_raw.txt")},
+        HelpTopic{"generate", resources::open("resources/help/generate.txt")},
         HelpTopic{"xorg-multi-gpu", resources::open("resources/help/xorg_multi_gpu.txt")},
         HelpTopic{"headless-config", resources::open("resources/help/headless_config.txt")},
         HelpTopic{"direct-config", resources::open("resources/help/direct_config.txt")},
@@ -36,12 +54,27 @@ namespace {
     struct RenderOptions {
         bool quiet = false;
         std::filesystem::path log_output;
+        std::filesystem::path trace_output;
         RenderParameters render_params;
 
+        struct {
+            bool enabled = false;
+            size_t threads = 0;
+            bool compare = false;
+            int32_t tolerance = -1;
+        } cpu;
+
         struct {
             std::filesystem::path config;
             std::string_view output;
             bool discard_output = false;
+            uint32_t frames_in_flight = 0;
+            StreamFormat stream_format = StreamFormat::None;
+            uint32_t stream_fps = 0;
+            bool dynamic_regions = false;
+            bool composite = false;
+            bool frame_parallel = false;
+            uint32_t batch_size = 0;
 
             bool enabled() const {
                 return !this->config.empty();
@@ -94,6 +127,20 @@ namespace {
         };
     }
 
+    auto stream_format_opt(StreamFormat* var) {
+        return [var](std::string_view arg) {
+            if (arg == "raw") {
+                *var = StreamFormat::Raw;
+            } else if (arg == "y4m") {
+                *var = StreamFormat::Y4m;
+            } else {
+                return false;
+            }
+
+            return true;
+        };
+    }
+
     RenderOptions parse_render_args(Span<const char*> args) {
         RenderOptions opts;
 
@@ -101,12 +148,25 @@ namespace {
             .flags = {
                 {&opts.quiet, "--quiet", 'q'},
                 {&opts.xorg.enabled, "--xorg"},
-                {&opts.headless.discard_output, "--discard-output"}
+                {&opts.headless.discard_output, "--discard-output"},
+                {&opts.render_params.tune, "--tune"},
+                {&opts.render_params.data_parallel, "--data-parallel"},
+                {&opts.headless.frame_parallel, "--frame-parallel"},
+                {&opts.render_params.continuous, "--continuous"},
+                {&opts.render_params.beam, "--beam"},
+                {&opts.render_params.instrument, "--instrument"},
+                {&opts.cpu.enabled, "--cpu"},
+                {&opts.cpu.compare, "--cpu-compare"}
             },
             .parameters = {
                 {args::path_opt(&opts.log_output), "output path", "--log-output"},
+                {args::path_opt(&opts.trace_output), "output path", "--trace"},
                 {args::path_opt(&opts.headless.config), "config path", "--headless"},
                 {args::string_opt(&opts.headless.output), "output path", "--output"},
+                {args::int_range_opt(&opts.headless.frames_in_flight, uint32_t{1}), "amount", "--frames-in-flight"},
+                {stream_format_opt(&opts.headless.stream_format), "format", "--stream"},
+                {args::int_range_opt(&opts.headless.stream_fps, uint32_t{1}), "fps", "--stream-fps"},
+                {args::int_range_opt(&opts.headless.batch_size, uint32_t{1}), "frames", "--batch"},
                 {args::path_opt(&opts.direct.config), "config path", "--direct"},
                 {args::path_opt(&opts.xorg.multi_gpu_config), "config path", "--xorg-multi-gpu"},
                 {args::float_range_opt(&opts.render_params.emission_coeff, 0.f), "emission coefficient", "--emission-coeff", 'e'},
@@ -114,8 +174,16 @@ namespace {
                 {args::string_opt(&opts.render_params.shader), "shader", "--shader", 's'},
                 {voxel_ratio_opt(&opts.render_params.voxel_ratio), "voxel dimension ratio", "--voxel-ratio", 'r'},
                 {args::path_opt(&opts.render_params.stats_save_path), "stats output", "--stats-output"},
+                {args::path_opt(&opts.render_params.memory_report_path), "output path", "--memory-report"},
                 {args::string_opt(&opts.render_params.camera), "camera", "--camera"},
-                {args::int_range_opt(&opts.render_params.repeat), "frame repeat", "--repeat"}
+                {args::int_range_opt(&opts.render_params.repeat), "frame repeat", "--repeat"},
+                {args::int_range_opt(&opts.render_params.balance, size_t{1}), "frames", "--balance"},
+                {args::float_range_opt(&opts.render_params.target_fps, std::numeric_limits<float>::min()), "fps", "--target-fps"},
+                {args::float_range_opt(&opts.render_params.tile_budget, std::numeric_limits<float>::min()), "ms", "--tile-budget"},
+                {args::string_opt(&opts.render_params.heatmap), "counter", "--heatmap"},
+                {args::float_range_opt(&opts.render_params.heatmap_max, 1.f), "count", "--heatmap-max"},
+                {args::int_range_opt(&opts.cpu.threads, size_t{1}), "threads", "--cpu-threads"},
+                {args::int_range_opt(&opts.cpu.tolerance, int32_t{0}, int32_t{255}), "difference", "--compare-tolerance"}
             },
             .positional = {
                 {args::path_opt(&opts.render_params.volume_path), "volume path"}
@@ -124,6 +192,12 @@ namespace {
 
         args::parse(args, cmd);
 
+        #if !defined(XENODON_TRACING)
+            if (!opts.trace_output.empty()) {
+                throw Error("--trace requires Xenodon to be built with tracing support");
+            }
+        #endif
+
         int enabled_backends =
             static_cast<int>(opts.xorg.enabled) +
             static_cast<int>(opts.headless.enabled()) +
@@ -139,21 +213,140 @@ namespace {
             throw Error("--dont-save requires --headless");
         }
 
+        if (opts.headless.stream_format != StreamFormat::None && !opts.headless.enabled()) {
+            throw Error("--stream requires --headless");
+        } else if (opts.headless.stream_format != StreamFormat::None && opts.headless.discard_output) {
+            throw Error("--stream and --discard-output are mutually exclusive");
+        }
+
+        if (opts.headless.stream_fps != 0 && opts.headless.stream_format != StreamFormat::Y4m) {
+            throw Error("--stream-fps requires --stream y4m");
+        } else if (opts.headless.stream_fps == 0) {
+            opts.headless.stream_fps = 30;
+        }
+
         if (!opts.headless.output.empty() && !opts.headless.enabled()) {
             throw Error("--output requires --headless");
         } else if (opts.headless.output.empty()) {
-            opts.headless.output = "out-{}.png";
+            // Stream to standard output by default
+            opts.headless.output = opts.headless.stream_format == StreamFormat::None ? "out-{}.png" : "-";
         } else if (opts.headless.discard_output) {
             throw Error("--dont-save and --output are mutually exclusive");
         }
 
+        if (opts.headless.frames_in_flight != 0 && !opts.headless.enabled()) {
+            throw Error("--frames-in-flight requires --headless");
+        } else if (opts.headless.frames_in_flight == 0) {
+            opts.headless.frames_in_flight = 1;
+        }
+
+        // The regions of xorg and direct outputs are physical screens, so only the headless
+        // backend can redistribute them
+        if (opts.render_params.balance != 0 && !opts.headless.enabled()) {
+            throw Error("--balance requires --headless");
+        } else if (opts.render_params.balance != 0) {
+            opts.headless.dynamic_regions = true;
+        }
+
+        // Partial frames are summed on the host, which only the headless backend does
+        if (opts.render_params.data_parallel && !opts.headless.enabled()) {
+            throw Error("--data-parallel requires --headless");
+        } else if (opts.render_params.data_parallel && opts.render_params.balance != 0) {
+            throw Error("--data-parallel and --balance are mutually exclusive");
+        } else if (opts.render_params.data_parallel) {
+            opts.headless.composite = true;
+        }
+
+        if (opts.headless.frame_parallel && !opts.headless.enabled()) {
+            throw Error("--frame-parallel requires --headless");
+        } else if (opts.headless.frame_parallel && (opts.render_params.data_parallel || opts.render_params.balance != 0)) {
+            throw Error("--frame-parallel cannot be combined with --data-parallel or --balance");
+        } else if (opts.headless.frame_parallel && opts.render_params.tune) {
+            throw Error("--frame-parallel and --tune are mutually exclusive");
+        }
+
+        // Batches are only useful for camera scripts, where all cameras are known in advance
+        if (opts.headless.batch_size != 0 && !opts.headless.enabled()) {
+            throw Error("--batch requires --headless");
+        } else if (opts.headless.batch_size != 0 && (opts.render_params.camera.empty() || opts.render_params.camera == "orbit")) {
+            throw Error("--batch requires a camera script");
+        } else if (opts.headless.batch_size != 0 && (opts.headless.frame_parallel || opts.render_params.balance != 0)) {
+            throw Error("--batch cannot be combined with --frame-parallel or --balance");
+        } else if (opts.headless.batch_size != 0 && (opts.render_params.target_fps > 0 || opts.render_params.tune)) {
+            throw Error("--batch cannot be combined with --target-fps or --tune");
+        } else if (opts.headless.batch_size == 0) {
+            opts.headless.batch_size = 1;
+        }
+
+        // Tiles are rendered directly to the outputs
+        if (opts.render_params.tile_budget > 0 && (opts.render_params.target_fps > 0 || opts.headless.batch_size > 1)) {
+            throw Error("--tile-budget cannot be combined with --target-fps or --batch");
+        }
+
         if (!opts.xorg.multi_gpu_config.empty() && !opts.xorg.enabled) {
             throw Error("--xorg-multi-gpu requires --xorg");
         }
 
+        // The heatmap is rendered by the instrumented shaders. Partial frames of the data-parallel
+        // mode are summed, which would mix the colors of the heatmap.
+        if (!opts.render_params.heatmap.empty() && opts.render_params.data_parallel) {
+            throw Error("--heatmap and --data-parallel are mutually exclusive");
+        } else if (!opts.render_params.heatmap.empty()) {
+            opts.render_params.instrument = true;
+        }
+
+        // Counting slows down the shaders, so they should not be used to pick workgroup sizes
+        if (opts.render_params.instrument && opts.render_params.tune) {
+            throw Error("--instrument and --heatmap cannot be combined with --tune");
+        }
+
+        // Frames rendered while tuning are not interesting
+        if (opts.render_params.tune && opts.headless.stream_format != StreamFormat::None) {
+            throw Error("--tune and --stream are mutually exclusive");
+        } else if (opts.render_params.tune) {
+            opts.headless.discard_output = true;
+        }
+
+        // Comparing renders the same frames with both renderers, so only the options of the CPU renderer apply
+        if (opts.cpu.tolerance >= 0 && !opts.cpu.compare) {
+            throw Error("--compare-tolerance requires --cpu-compare");
+        } else if (opts.cpu.compare) {
+            opts.cpu.enabled = true;
+        }
+
+        if (opts.cpu.tolerance < 0) {
+            opts.cpu.tolerance = DEFAULT_COMPARE_TOLERANCE;
+        }
+
+        // The CPU renderer only supports the options which do not depend on the GPU renderer
+        if (opts.cpu.threads != 0 && !opts.cpu.enabled) {
+            throw Error("--cpu-threads requires --cpu");
+        } else if (opts.cpu.enabled && !opts.headless.enabled()) {
+            throw Error("--cpu requires --headless");
+        } else if (opts.cpu.enabled && (opts.render_params.camera.empty() || opts.render_params.camera == "orbit")) {
+            throw Error("--cpu requires a camera script");
+        } else if (opts.cpu.enabled && (opts.render_params.data_parallel || opts.render_params.balance != 0 || opts.headless.frame_parallel)) {
+            throw Error("--cpu cannot be combined with --data-parallel, --balance or --frame-parallel");
+        } else if (opts.cpu.enabled && (opts.render_params.tune || opts.render_params.instrument || opts.render_params.beam)) {
+            throw Error("--cpu cannot be combined with --tune, --instrument, --heatmap or --beam");
+        } else if (opts.cpu.enabled && (opts.render_params.target_fps > 0 || opts.render_params.tile_budget > 0 || opts.headless.batch_size > 1)) {
+            throw Error("--cpu cannot be combined with --target-fps, --tile-budget or --batch");
+        } else if (opts.cpu.enabled && opts.cpu.threads == 0) {
+            opts.cpu.threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
         return opts;
     }
 
+    void save_trace(const std::filesystem::path& path) {
+        try {
+            trace::save(path);
+            LOGGER.log("Saved trace to '{}'", path.native());
+        } catch (const Error& e) {
+            fmt::print("Error: {}\n", e.what());
+        }
+    }
+
     void render(Span<const char*> args) {
         RenderOptions opts;
         try {
@@ -171,6 +364,42 @@ namespace {
             LOGGER.add_sink<FileSink>(opts.log_output);
         }
 
+        // Start tracing before the backend is created, so that its setup is included as well
+        if (!opts.trace_output.empty()) {
+            trace::enable();
+            trace::set_thread_name("Main thread");
+        }
+
+        auto headless_options = HeadlessOptions {
+            .output = opts.headless.discard_output ? "" : opts.headless.output,
+            .frames_in_flight = opts.headless.frames_in_flight,
+            .stream_format = opts.headless.stream_format,
+            .stream_fps = opts.headless.stream_fps,
+            .dynamic_regions = opts.headless.dynamic_regions,
+            .composite = opts.headless.composite,
+            .frame_parallel = opts.headless.frame_parallel,
+            .batch_size = opts.headless.batch_size
+        };
+
+        // The CPU renderer does not need a backend at all, and comparing creates its own headless display
+        if (opts.cpu.enabled) {
+            try {
+                if (opts.cpu.compare) {
+                    compare_loop(opts.render_params, opts.headless.config, opts.cpu.threads, static_cast<uint32_t>(opts.cpu.tolerance));
+                } else {
+                    cpu_loop(opts.render_params, opts.headless.config, headless_options, opts.cpu.threads);
+                }
+            } catch (const Error& e) {
+                fmt::print("Error: {}\n", e.what());
+            }
+
+            if (!opts.trace_output.empty()) {
+                save_trace(opts.trace_output);
+            }
+
+            return;
+        }
+
         auto dispatcher = EventDispatcher();
         std::unique_ptr<Display> display;
 
@@ -180,8 +409,7 @@ namespace {
             } else if (opts.direct.enabled()) {
                 display = create_direct_backend(dispatcher, opts.direct.config);
             } else {
-                std::string_view output = opts.headless.discard_output ? "" : opts.headless.output;
-                display = create_headless_backend(opts.headless.config, output);
+                display = create_headless_backend(opts.headless.config, headless_options);
             }
         } catch (const Error& e) {
             fmt::print("Error: Failed to initialize backend: {}\n", e.what());
@@ -193,6 +421,14 @@ namespace {
         } catch (const Error& e) {
             fmt::print("Error: {}\n", e.what());
         }
+
+        if (opts.trace_output.empty()) {
+            return;
+        }
+
+        // Destroying the display waits for its worker threads, after which no more events are recorded
+        display.reset();
+        save_trace(opts.trace_output);
     }
 
     void help(const char* program_name, Span<const char*> args) {
@@ -238,6 +474,16 @@ int main(int argc, const char* argv[]) {
         render(args);
     } else if (subcommand == "convert") {
         convert(args);
+    } else if (subcommand == "bench") {
+        return bench(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (subcommand == "serve") {
+        return serve(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (subcommand == "import-particles") {
+        return import_particles(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (subcommand == "import-raw") {
+        return import_raw(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (subcommand == "generate") {
+        return generate(args) ? EXIT_SUCCESS : EXIT_FAILURE;
     } else {
         fmt::print("Error: Invalid subcommand '{}', see '{} help'\n", subcommand, argv[0]);
     }
@@ -2,6 +2,9 @@
 #include <chrono>
 #include <memory>
 #include <array>
+#include <optional>
+#include <vector>
+#include <thread>
 #include <algorithm>
 #include <cassert>
 #include <fmt/format.h>
@@ -10,21 +13,43 @@
 #include "render/RenderAlgorithm.h"
 #include "render/SvoRaytraceAlgorithm.h"
 #include "render/DdaRaytraceAlgorithm.h"
+#include "render/BrickRaytraceAlgorithm.h"
 #include "render/RenderContext.h"
 #include "render/MultiplexRenderer.h"
+#include "render/WorkgroupTuner.h"
+#include "render/LoadBalancer.h"
+#include "render/ResolutionScaler.h"
+#include "render/RenderStats.h"
+#include "cpu/CpuRenderer.h"
+#include "cpu/CpuDdaAlgorithm.h"
+#include "cpu/CpuEsvoAlgorithm.h"
+#include "backend/headless/headless.h"
 #include "camera/Camera.h"
 #include "camera/OrbitCameraController.h"
 #include "camera/ScriptCameraController.h"
 #include "core/Logger.h"
 #include "core/Error.h"
+#include "core/Trace.h"
+#include "core/MemoryAccounting.h"
 #include "model/Grid.h"
 #include "model/Octree.h"
+#include "model/BrickOctree.h"
+#include "model/Pixel.h"
+#include "utility/rect_union.h"
 #include "resources.h"
 
 namespace {
+    // How long to wait between polling for events when there is nothing to render
+    constexpr const auto IDLE_INTERVAL = std::chrono::milliseconds{10};
+
+    // Rays which graze the edge of a voxel may step through different voxels on the GPU and on the
+    // CPU, so this fraction of the pixels of a frame may exceed the tolerance of compare_loop
+    constexpr const double MAX_DIFFERING_FRACTION = 0.001;
+
     enum class FileType {
         Tiff,
         Svo,
+        Brick,
         Unknown
     };
 
@@ -32,14 +57,29 @@ namespace {
         std::string_view option;
         FileType required_type;
         std::string_view source;
+
+        // The variant which counts the traversal work of every ray, see resources/instrument.glsl
+        std::string_view instrumented_source;
     };
 
     constexpr const auto SHADER_OPTIONS = std::array {
-        ShaderOption{"dda", FileType::Tiff, resources::open("resources/dda.comp")},
-        ShaderOption{"svo-naive", FileType::Svo, resources::open("resources/svo_naive.comp")},
-        ShaderOption{"esvo", FileType::Svo, resources::open("resources/esvo.comp")},
-        ShaderOption{"svo-df", FileType::Svo, resources::open("resources/svo_df.comp")},
-        ShaderOption{"svo-rope", FileType::Svo, resources::open("resources/svo_rope.comp")}
+        ShaderOption{"dda", FileType::Tiff, resources::open("resources/dda.comp"), resources::open("resources/instrumented/dda.comp")},
+        ShaderOption{"svo-naive", FileType::Svo, resources::open("resources/svo_naive.comp"), resources::open("resources/instrumented/svo_naive.comp")},
+        ShaderOption{"esvo", FileType::Svo, resources::open("resources/esvo.comp"), resources::open("resources/instrumented/esvo.comp")},
+        ShaderOption{"svo-df", FileType::Svo, resources::open("resources/svo_df.comp"), resources::open("resources/instrumented/svo_df.comp")},
+        ShaderOption{"svo-rope", FileType::Svo, resources::open("resources/svo_rope.comp"), resources::open("resources/instrumented/svo_rope.comp")},
+        ShaderOption{"svo-brick", FileType::Brick, resources::open("resources/svo_brick.comp"), resources::open("resources/instrumented/svo_brick.comp")}
+    };
+
+    struct HeatmapOption {
+        std::string_view option;
+        RenderContext::HeatmapCounter counter;
+    };
+
+    constexpr const auto HEATMAP_OPTIONS = std::array {
+        HeatmapOption{"nodes", RenderContext::HeatmapCounter::NodeFetches},
+        HeatmapOption{"stack", RenderContext::HeatmapCounter::StackOps},
+        HeatmapOption{"steps", RenderContext::HeatmapCounter::Steps}
     };
 
     void check_setup(Display* display) {
@@ -74,6 +114,8 @@ namespace {
                 return "tiff";
             case FileType::Svo:
                 return "svo";
+            case FileType::Brick:
+                return "brick";
             default:
             case FileType::Unknown:
                 return "unknown";
@@ -85,6 +127,8 @@ namespace {
             return FileType::Tiff;
         } else if (str == "svo") {
             return FileType::Svo;
+        } else if (str == "brick") {
+            return FileType::Brick;
         }
 
         return FileType::Unknown;
@@ -140,9 +184,10 @@ namespace {
     struct CreateRenderAlgorithmResult {
         std::unique_ptr<RenderAlgorithm> algo;
         Vec3Sz model_dim;
+        std::string_view shader;
     };
 
-    CreateRenderAlgorithmResult create_render_algorithm(const RenderParameters& render_params) {
+    CreateRenderAlgorithmResult create_render_algorithm(const RenderParameters& render_params, size_t bricks) {
         FileType model_type = guess_file_type(render_params);
         if (model_type == FileType::Unknown) {
             throw Error("Failed to parse model file type");
@@ -152,20 +197,32 @@ namespace {
         const ShaderOption shader = select_shader(render_params, model_type);
         LOGGER.log("Using shader '{}'", shader.option);
 
+        const auto source = render_params.instrument ? shader.instrumented_source : shader.source;
+
         switch (model_type) {
             case FileType::Tiff: {
                 // There is only one DDA shader, so that should always be picked here
                 auto grid = std::make_shared<Grid>(Grid::load_tiff(render_params.volume_path));
                 return {
-                    std::make_unique<DdaRaytraceAlgorithm>(grid),
-                    grid->dimensions()
+                    std::make_unique<DdaRaytraceAlgorithm>(source, grid, bricks),
+                    grid->dimensions(),
+                    shader.option
                 };
             }
             case FileType::Svo: {
                 auto octree = std::make_shared<Octree>(Octree::load_svo(render_params.volume_path));
                 return {
-                    std::make_unique<SvoRaytraceAlgorithm>(shader.source, octree),
-                    Vec3Sz(octree->side())
+                    std::make_unique<SvoRaytraceAlgorithm>(source, octree, bricks),
+                    Vec3Sz(octree->side()),
+                    shader.option
+                };
+            }
+            case FileType::Brick: {
+                auto octree = std::make_shared<BrickOctree>(BrickOctree::load(render_params.volume_path));
+                return {
+                    std::make_unique<BrickRaytraceAlgorithm>(source, octree, bricks),
+                    Vec3Sz(octree->octree().side()),
+                    shader.option
                 };
             }
             default:
@@ -173,6 +230,63 @@ namespace {
         }
     }
 
+    struct RendererSetup {
+        std::unique_ptr<RenderAlgorithm> algo;
+        RenderContext::ShaderParameters shader_params;
+        std::string_view shader;
+    };
+
+    // Load the volume, and check whether its shader supports the requested options
+    RendererSetup setup_renderer(const RenderParameters& render_params, size_t bricks) {
+        auto [algo, dim, shader] = create_render_algorithm(render_params, bricks);
+        LOGGER.log("Model dimensions: {}x{}x{}", dim.x, dim.y, dim.z);
+
+        if (render_params.beam && algo->beam_shader().empty()) {
+            throw Error("Shader '{}' does not support the beam optimization", shader);
+        } else if (render_params.beam) {
+            LOGGER.log("Using beam optimization pre-pass");
+        }
+
+        auto shader_params = RenderContext::ShaderParameters {
+            .voxel_ratio = render_params.voxel_ratio,
+            .model_dim = static_cast<Vec3<uint32_t>>(dim),
+            .emission_coeff = render_params.emission_coeff
+        };
+
+        if (render_params.tile_budget > 0) {
+            LOGGER.log("Rendering in tiles, with a budget of {} ms per submission", render_params.tile_budget);
+        }
+
+        return {std::move(algo), shader_params, shader};
+    }
+
+    RenderContext::Instrumentation select_instrumentation(const RenderParameters& render_params) {
+        auto instrumentation = RenderContext::Instrumentation();
+        instrumentation.enabled = render_params.instrument;
+        instrumentation.heatmap_max = render_params.heatmap_max;
+
+        if (!render_params.instrument) {
+            return instrumentation;
+        }
+
+        LOGGER.log("Counting the traversal work of every ray");
+
+        if (!render_params.heatmap.empty()) {
+            auto it = std::find_if(HEATMAP_OPTIONS.begin(), HEATMAP_OPTIONS.end(), [&](const auto& opt) {
+                return opt.option == render_params.heatmap;
+            });
+
+            if (it == HEATMAP_OPTIONS.end()) {
+                throw Error("Invalid heatmap counter '{}'", render_params.heatmap);
+            }
+
+            LOGGER.log("Rendering a heatmap of '{}' per ray", it->option);
+            instrumentation.heatmap = it->counter;
+        }
+
+        return instrumentation;
+    }
+
     std::unique_ptr<CameraController> create_camera_controller(EventDispatcher& dispatcher, const RenderParameters& render_params) {
         if (render_params.camera == "orbit" || render_params.camera == "") {
             LOGGER.log("Using orbit camera controller. Controls: ");
@@ -186,24 +300,184 @@ namespace {
             return std::make_unique<ScriptCameraController>(render_params.camera);
         }
     }
+
+    // Render the next batch of frames of a camera script in one submission, and return whether
+    // the script has ended. Every camera is still rendered `repeat` times.
+    bool render_batch(MultiplexRenderer& renderer, CameraController& controller, size_t batch_size, size_t repeat, size_t& total_frames, RenderStatsAccumulator& accum) {
+        auto cams = std::vector<Camera>();
+        cams.reserve(batch_size);
+
+        bool done = false;
+        while (cams.size() < batch_size && !done) {
+            cams.push_back(controller.camera());
+            ++total_frames;
+
+            // Camera scripts do not depend on the frame time
+            if (total_frames % repeat == 0) {
+                done = controller.update(0);
+            }
+        }
+
+        renderer.render_batch(cams);
+
+        // Statistics lag one batch behind
+        for (size_t i = 0; i < renderer.stats_frames(); ++i) {
+            accum(renderer.stats(i));
+        }
+
+        return done;
+    }
+
+    // The CPU renderer has a port of the DDA and ESVO shaders, which are also the defaults for
+    // their model type
+    std::unique_ptr<CpuRaytraceAlgorithm> create_cpu_algorithm(const RenderParameters& render_params, const CpuShaderParameters& params) {
+        FileType model_type = guess_file_type(render_params);
+        if (model_type == FileType::Unknown) {
+            throw Error("Failed to parse model file type");
+        }
+
+        LOGGER.log("Model file type: '{}'", file_type_to_string(model_type));
+
+        // Reject invalid and incompatible shaders the same way as the GPU renderer
+        if (!render_params.shader.empty()) {
+            select_shader(render_params, model_type);
+        }
+
+        switch (model_type) {
+            case FileType::Tiff: {
+                if (!render_params.shader.empty() && render_params.shader != "dda") {
+                    throw Error("Shader '{}' is not supported by the CPU renderer (supported: 'dda')", render_params.shader);
+                }
+
+                LOGGER.log("Using shader 'dda'");
+                auto grid = std::make_shared<Grid>(Grid::load_tiff(render_params.volume_path));
+                const auto dim = grid->dimensions();
+                LOGGER.log("Model dimensions: {}x{}x{}", dim.x, dim.y, dim.z);
+                return std::make_unique<CpuDdaAlgorithm>(grid, params);
+            }
+            case FileType::Svo: {
+                if (!render_params.shader.empty() && render_params.shader != "esvo") {
+                    throw Error("Shader '{}' is not supported by the CPU renderer (supported: 'esvo')", render_params.shader);
+                }
+
+                LOGGER.log("Using shader 'esvo'");
+                auto octree = std::make_shared<Octree>(Octree::load_svo(render_params.volume_path));
+                const size_t side = octree->side();
+                LOGGER.log("Model dimensions: {}x{}x{}", side, side, side);
+                return std::make_unique<CpuEsvoAlgorithm>(octree, params);
+            }
+            default:
+                throw Error("Model type '{}' is not supported by the CPU renderer", file_type_to_string(model_type));
+        }
+    }
+
+    // Keeps the last frame saved by the headless display, so that it can be compared with the
+    // frame of the CPU renderer
+    class CaptureWriter final: public FrameWriter {
+        std::optional<FrameBuffer> captured;
+
+    public:
+        explicit CaptureWriter(vk::Extent2D extent):
+            FrameWriter(extent, 2) {
+        }
+
+        void write(size_t, FrameBuffer&& buffer) override {
+            this->captured = std::move(buffer);
+        }
+
+        void wait() override {
+        }
+
+        FrameBuffer take() {
+            auto buffer = std::move(this->captured.value());
+            this->captured.reset();
+            return buffer;
+        }
+
+        void recycle(FrameBuffer&& buffer) {
+            this->release(std::move(buffer));
+        }
+    };
+
+    // The largest difference of any channel of two pixels
+    uint32_t pixel_difference(Pixel a, Pixel b) {
+        auto channel = [](uint8_t x, uint8_t y) {
+            return static_cast<uint32_t>(x > y ? x - y : y - x);
+        };
+
+        return std::max({channel(a.r, b.r), channel(a.g, b.g), channel(a.b, b.b), channel(a.a, b.a)});
+    }
+
+    // Divide the rows of a frame of `extent` evenly over the devices, starting at the top left of `display_region`
+    std::vector<vk::Rect2D> divide_rows(vk::Rect2D display_region, vk::Extent2D extent, size_t devices) {
+        auto regions = std::vector<vk::Rect2D>();
+        const auto n = static_cast<uint32_t>(devices);
+
+        for (uint32_t i = 0; i < n; ++i) {
+            const uint32_t begin = i * extent.height / n;
+            const uint32_t end = (i + 1) * extent.height / n;
+            regions.push_back({
+                {display_region.offset.x, display_region.offset.y + static_cast<int32_t>(begin)},
+                {extent.width, end - begin}
+            });
+        }
+
+        return regions;
+    }
+
+    void poll_events(Display* display) {
+        TRACE_SCOPE("Display::poll_events");
+        display->poll_events();
+    }
 }
 
 void main_loop(EventDispatcher& dispatcher, Display* display, const RenderParameters& render_params) {
     check_setup(display);
 
-    auto [algo, dim] = create_render_algorithm(render_params);
-    LOGGER.log("Model dimensions: {}x{}x{}", dim.x, dim.y, dim.z);
+    size_t bricks = 1;
+    if (render_params.data_parallel) {
+        if (!display->composites_outputs()) {
+            throw Error("Display does not support data-parallel rendering");
+        }
 
-    auto shader_params = RenderContext::ShaderParameters {
-        .voxel_ratio = Vec4F(render_params.voxel_ratio, 0),
-        .model_dim = Vec4<unsigned>(static_cast<Vec3<unsigned>>(dim), 0),
-        .emission_coeff = render_params.emission_coeff
-    };
+        // Every device renders its own part of the volume
+        bricks = display->num_render_devices();
+        LOGGER.log("Data-parallel rendering with {} bricks", bricks);
+    }
 
-    auto renderer = MultiplexRenderer(display, std::move(algo), shader_params);
+    const auto instrumentation = select_instrumentation(render_params);
+    auto [algo, shader_params, shader] = setup_renderer(render_params, bricks);
+
+    const bool dynamic_resolution = render_params.target_fps > 0;
+    auto renderer = MultiplexRenderer(display, std::move(algo), shader_params, dynamic_resolution, render_params.tile_budget, render_params.beam, instrumentation);
 
     auto controller = create_camera_controller(dispatcher, render_params);
 
+    auto workgroup_cache = WorkgroupCache();
+    if (render_params.tune) {
+        tune_workgroup_sizes(renderer, controller->camera(), shader, workgroup_cache);
+        display->flush();
+        workgroup_cache.save();
+        return;
+    }
+
+    apply_cached_workgroup_sizes(renderer, shader, workgroup_cache);
+
+    std::optional<LoadBalancer> balancer;
+    if (render_params.balance > 0) {
+        if (!display->supports_dynamic_regions()) {
+            throw Error("Display does not support load balancing");
+        }
+
+        balancer.emplace(renderer, render_params.balance);
+    }
+
+    std::optional<ResolutionScaler> scaler;
+    if (dynamic_resolution) {
+        LOGGER.log("Target frame rate: {} fps", render_params.target_fps);
+        scaler.emplace(render_params.target_fps);
+    }
+
     bool quit = false;
     dispatcher.bind_close([&quit] {
         quit = true;
@@ -213,11 +487,23 @@ void main_loop(EventDispatcher& dispatcher, Display* display, const RenderParame
         quit = true;
     });
 
-    dispatcher.bind_swapchain_recreate([&renderer](size_t device, size_t output) {
+    // Set when the outputs change, in which case the frame needs to be rendered again
+    bool outputs_changed = true;
+
+    dispatcher.bind_swapchain_recreate([&renderer, &outputs_changed](size_t device, size_t output) {
         LOGGER.log("Resizing device {}, output {}", device, output);
         renderer.recreate(device, output);
+        outputs_changed = true;
     });
 
+    // Camera scripts are rendered in full, but an interactive camera is only rendered when
+    // something changed. The last frame then stays on the outputs.
+    const bool on_demand = !render_params.continuous && (render_params.camera == "orbit" || render_params.camera == "");
+    std::optional<Camera> last_camera;
+    bool idle = false;
+
+    const size_t batch_size = display->batch_size();
+
     auto start = std::chrono::high_resolution_clock::now();
     auto last_frame = start;
     size_t frames = 0;
@@ -228,11 +514,76 @@ void main_loop(EventDispatcher& dispatcher, Display* display, const RenderParame
 
     LOGGER.log("Starting render loop...");
     while (!quit) {
-        ++frames;
-        ++total_frames;
+        if (batch_size > 1) {
+            if (render_batch(renderer, *controller, batch_size, render_params.repeat, total_frames, accum)) {
+                break;
+            }
 
-        renderer.render(controller->camera());
-        accum(renderer.stats());
+            continue;
+        }
+
+        const auto cam = controller->camera();
+
+        // When rendering in time slices, a frame is submitted over several iterations, and events
+        // are handled in between. That frame is finished before anything else is considered.
+        const bool new_frame = !renderer.frame_in_progress();
+
+        // Every camera is rendered --repeat times before the controller is updated, so only
+        // consider skipping frames after that. With dynamic resolution, keep rendering until
+        // the full resolution is restored.
+        const bool unchanged = !outputs_changed && last_camera == cam && (!scaler || scaler->current_scale() >= 1);
+        if (new_frame && on_demand && total_frames % render_params.repeat == 0 && unchanged) {
+            if (!idle) {
+                // Make sure the last frame is presented before waiting
+                for (const auto& stats : renderer.finish_stats()) {
+                    accum(stats);
+                }
+
+                display->flush();
+                idle = true;
+            }
+
+            std::this_thread::sleep_for(IDLE_INTERVAL);
+            poll_events(display);
+
+            auto now = std::chrono::high_resolution_clock::now();
+            if (controller->update(std::chrono::duration<float>(now - last_frame).count())) {
+                break;
+            }
+
+            // Idle time should not count towards the frame rate
+            last_frame = now;
+            start = now;
+            frames = 0;
+            continue;
+        }
+
+        if (new_frame) {
+            idle = false;
+            outputs_changed = false;
+            last_camera = cam;
+
+            ++frames;
+            ++total_frames;
+        }
+
+        if (!renderer.render_slice(cam)) {
+            poll_events(display);
+            continue;
+        }
+
+        // Statistics lag one frame behind, so the balancer and scaler react to the previous frame
+        if (renderer.stats_frames() > 0) {
+            accum(renderer.stats());
+
+            if (balancer) {
+                balancer->update(renderer);
+            }
+
+            if (scaler) {
+                renderer.set_render_scale(scaler->update(renderer.stats(), controller->camera()));
+            }
+        }
 
         auto frame_end = std::chrono::high_resolution_clock::now();
         float dt = std::chrono::duration<float>(frame_end - last_frame).count();
@@ -250,13 +601,28 @@ void main_loop(EventDispatcher& dispatcher, Display* display, const RenderParame
 
         if (diff > std::chrono::seconds{5}) {
             LOGGER.log("FPS: {}", static_cast<double>(frames) / diff.count());
+
+            if (scaler) {
+                LOGGER.log("Render scale: {}", scaler->current_scale());
+            }
+
             frames = 0;
             start = now;
         }
 
-        display->poll_events();
+        poll_events(display);
     }
 
+    // A frame which is still being rendered in time slices is completed before quitting
+    if (renderer.frame_in_progress()) {
+        renderer.render(controller->camera());
+    }
+
+    for (const auto& stats : renderer.finish_stats()) {
+        accum(stats);
+    }
+
+    display->flush();
     accum.stop();
     LOGGER.log(
         "total rays: {}, total render time: {}ms, mray/s: {}",
@@ -272,8 +638,323 @@ void main_loop(EventDispatcher& dispatcher, Display* display, const RenderParame
         accum.total_time().count()
     );
 
+    const auto counters = accum.total_counters();
+    if (counters.rays > 0) {
+        const auto rays = static_cast<double>(counters.rays);
+        LOGGER.log(
+            "per ray: {} node fetches (max {}), {} stack operations (max {}), {} steps (max {})",
+            static_cast<double>(counters.node_fetches) / rays,
+            counters.max_node_fetches,
+            static_cast<double>(counters.stack_ops) / rays,
+            counters.max_stack_ops,
+            static_cast<double>(counters.steps) / rays,
+            counters.max_steps
+        );
+    }
+
     if (!render_params.stats_save_path.empty()) {
         accum.save(render_params.stats_save_path);
         LOGGER.log("Saved stats to '{}'", render_params.stats_save_path.native());
     }
+
+    for (const auto& line : accounting::report()) {
+        LOGGER.log("{}", line);
+    }
+
+    if (!render_params.memory_report_path.empty()) {
+        accounting::save(render_params.memory_report_path);
+        LOGGER.log("Saved memory report to '{}'", render_params.memory_report_path.native());
+    }
+}
+
+std::vector<BenchFrame> bench_loop(Display* display, const RenderParameters& render_params, size_t warmup) {
+    check_setup(display);
+
+    auto [algo, shader_params, shader] = setup_renderer(render_params, 1);
+    auto renderer = MultiplexRenderer(display, std::move(algo), shader_params, false, render_params.tile_budget, render_params.beam);
+
+    auto workgroup_cache = WorkgroupCache();
+    apply_cached_workgroup_sizes(renderer, shader, workgroup_cache);
+
+    auto controller = ScriptCameraController(render_params.camera);
+
+    // Let the driver settle, load the volume into caches and such
+    for (size_t i = 0; i < warmup; ++i) {
+        renderer.render(controller.camera());
+    }
+
+    renderer.finish_stats();
+    display->flush();
+
+    auto frames = std::vector<BenchFrame>();
+
+    // Statistics lag behind the frames, so they are assigned to the oldest frame without any
+    auto assign_stats = [&frames, stats_index = size_t{0}](const RenderStats& stats) mutable {
+        auto& frame = frames[stats_index++];
+        frame.dispatch_time = stats.max_render_time;
+        frame.render_time = stats.total_render_time;
+        frame.rays = stats.total_rays;
+    };
+
+    bool done = false;
+    auto frame_start = std::chrono::high_resolution_clock::now();
+
+    while (!done) {
+        const auto cam = controller.camera();
+
+        for (size_t i = 0; i < render_params.repeat; ++i) {
+            renderer.render(cam);
+            frames.push_back({});
+
+            if (renderer.stats_frames() > 0) {
+                assign_stats(renderer.stats());
+            }
+
+            // Frames overlap, so a frame lasts until the next one starts
+            const auto frame_end = std::chrono::high_resolution_clock::now();
+            frames.back().frame_time = std::chrono::duration<double, std::milli>(frame_end - frame_start).count();
+            frame_start = frame_end;
+        }
+
+        done = controller.update(0);
+    }
+
+    for (const auto& stats : renderer.finish_stats()) {
+        assign_stats(stats);
+    }
+
+    display->flush();
+
+    // The last frame also includes waiting for all frames in flight
+    const auto end = std::chrono::high_resolution_clock::now();
+    frames.back().frame_time += std::chrono::duration<double, std::milli>(end - frame_start).count();
+
+    return frames;
+}
+
+void serve_loop(Display* display, const RenderParameters& render_params, const std::function<std::vector<ServeFrame>()>& next_batch) {
+    check_setup(display);
+
+    if (!display->supports_dynamic_regions()) {
+        throw Error("Display does not support changing the resolution");
+    }
+
+    auto [algo, shader_params, shader] = setup_renderer(render_params, 1);
+    auto renderer = MultiplexRenderer(display, std::move(algo), shader_params, false, 0, render_params.beam);
+
+    auto workgroup_cache = WorkgroupCache();
+    apply_cached_workgroup_sizes(renderer, shader, workgroup_cache);
+
+    const auto max_region = renderer.display_region();
+    auto extent = max_region.extent;
+    LOGGER.log("Serving frames of up to {}x{} pixels", extent.width, extent.height);
+
+    while (true) {
+        const auto frames = next_batch();
+        if (frames.empty()) {
+            break;
+        }
+
+        auto accum = RenderStatsAccumulator();
+        accum.start();
+
+        for (const auto& frame : frames) {
+            assert(frame.extent.width <= max_region.extent.width && frame.extent.height <= max_region.extent.height);
+
+            if (frame.extent != extent) {
+                // The rays of the frames in flight are counted with their own regions
+                for (const auto& stats : renderer.finish_stats()) {
+                    accum(stats);
+                }
+
+                renderer.set_regions(divide_rows(max_region, frame.extent, renderer.num_devices()));
+                extent = frame.extent;
+            }
+
+            renderer.render(frame.camera);
+            if (renderer.stats_frames() > 0) {
+                accum(renderer.stats());
+            }
+        }
+
+        // The frames of the batch are all in flight now, wait for them to be saved
+        for (const auto& stats : renderer.finish_stats()) {
+            accum(stats);
+        }
+
+        display->flush();
+        accum.stop();
+
+        LOGGER.log(
+            "batch of {} frames, total render time: {}ms, mray/s: {}, total time: {}s",
+            accum.frames(),
+            accum.total_render_time(),
+            accum.mrays_per_s(),
+            accum.total_time().count()
+        );
+    }
+
+    for (const auto& line : accounting::report()) {
+        LOGGER.log("{}", line);
+    }
+}
+
+void cpu_loop(const RenderParameters& render_params, const std::filesystem::path& headless_config, const HeadlessOptions& options, size_t threads) {
+    const auto config = load_headless_config(headless_config);
+    const auto extent = rect_union(config.gpus.begin(), config.gpus.end(), [](const HeadlessConfig::Device& gpu_config) {
+        return gpu_config.region;
+    }).extent;
+
+    auto writer = create_frame_writer(extent, options);
+
+    const auto params = CpuShaderParameters{render_params.voxel_ratio, render_params.emission_coeff};
+    auto renderer = CpuRenderer(create_cpu_algorithm(render_params, params), params, extent, threads);
+    LOGGER.log("Rendering {}x{} frames on the CPU with {} threads", extent.width, extent.height, renderer.threads());
+
+    auto controller = ScriptCameraController(render_params.camera);
+    auto scratch = std::vector<Pixel>();
+    size_t frame = 0;
+    bool done = false;
+
+    auto accum = RenderStatsAccumulator();
+    accum.start();
+
+    LOGGER.log("Starting render loop...");
+    while (!done) {
+        const auto cam = controller.camera();
+
+        for (size_t i = 0; i < render_params.repeat; ++i) {
+            auto buffer = writer ? writer->acquire() : std::move(scratch);
+
+            const auto render_start = std::chrono::high_resolution_clock::now();
+            {
+                TRACE_SCOPE("CpuRenderer::render");
+                renderer.render(cam, buffer);
+            }
+            const auto render_end = std::chrono::high_resolution_clock::now();
+            const double render_time = std::chrono::duration<double, std::milli>(render_end - render_start).count();
+
+            auto stats = RenderStats();
+            stats.total_rays = buffer.size();
+            stats.outputs = 1;
+            stats.total_render_time = render_time;
+            stats.max_render_time = render_time;
+            stats.min_render_time = render_time;
+            accum(stats);
+
+            if (writer) {
+                writer->write(frame, std::move(buffer));
+            } else {
+                scratch = std::move(buffer);
+            }
+
+            ++frame;
+        }
+
+        done = controller.update(0);
+    }
+
+    if (writer) {
+        writer->wait();
+    }
+
+    accum.stop();
+    LOGGER.log(
+        "total rays: {}, total render time: {}ms, mray/s: {}",
+        accum.total_rays(),
+        accum.total_render_time(),
+        accum.mrays_per_s()
+    );
+
+    LOGGER.log(
+        "frames: {}, fps: {}, total time: {}s",
+        accum.frames(),
+        accum.fps(),
+        accum.total_time().count()
+    );
+
+    if (!render_params.stats_save_path.empty()) {
+        accum.save(render_params.stats_save_path);
+        LOGGER.log("Saved stats to '{}'", render_params.stats_save_path.native());
+    }
+
+    for (const auto& line : accounting::report()) {
+        LOGGER.log("{}", line);
+    }
+
+    if (!render_params.memory_report_path.empty()) {
+        accounting::save(render_params.memory_report_path);
+        LOGGER.log("Saved memory report to '{}'", render_params.memory_report_path.native());
+    }
+}
+
+void compare_loop(const RenderParameters& render_params, const std::filesystem::path& headless_config, size_t threads, uint32_t tolerance) {
+    const auto config = load_headless_config(headless_config);
+    const auto extent = rect_union(config.gpus.begin(), config.gpus.end(), [](const HeadlessConfig::Device& gpu_config) {
+        return gpu_config.region;
+    }).extent;
+
+    // Both renderers need to run the same traversal, so use the shader which the CPU renderer has a port of
+    auto params = render_params;
+    if (params.shader.empty()) {
+        params.shader = guess_file_type(params) == FileType::Tiff ? "dda" : "esvo";
+    }
+
+    const auto cpu_params = CpuShaderParameters{params.voxel_ratio, params.emission_coeff};
+    auto cpu_renderer = CpuRenderer(create_cpu_algorithm(params, cpu_params), cpu_params, extent, threads);
+
+    auto display = HeadlessDisplay(config, HeadlessOptions());
+    auto writer = std::make_unique<CaptureWriter>(extent);
+    auto& captured = *writer;
+    display.set_writer(std::move(writer));
+
+    auto [algo, shader_params, shader] = setup_renderer(params, 1);
+    auto renderer = MultiplexRenderer(&display, std::move(algo), shader_params);
+
+    auto controller = ScriptCameraController(params.camera);
+    auto cpu_frame = std::vector<Pixel>();
+    size_t frames = 0;
+    size_t failed_frames = 0;
+    bool done = false;
+
+    LOGGER.log("Comparing shader '{}' with the CPU renderer, with a tolerance of {} per channel", shader, tolerance);
+    while (!done) {
+        const auto cam = controller.camera();
+
+        renderer.render(cam);
+        display.flush();
+        auto gpu_frame = captured.take();
+
+        cpu_renderer.render(cam, cpu_frame);
+
+        size_t differing = 0;
+        uint32_t max_difference = 0;
+        for (size_t i = 0; i < cpu_frame.size(); ++i) {
+            const uint32_t difference = pixel_difference(gpu_frame[i], cpu_frame[i]);
+            max_difference = std::max(max_difference, difference);
+            differing += difference > tolerance ? 1 : 0;
+        }
+
+        captured.recycle(std::move(gpu_frame));
+
+        const bool failed = static_cast<double>(differing) > MAX_DIFFERING_FRACTION * static_cast<double>(cpu_frame.size());
+        LOGGER.log(
+            "Frame {}: {} of {} pixels exceed the tolerance, maximum difference {}{}",
+            frames,
+            differing,
+            cpu_frame.size(),
+            max_difference,
+            failed ? " (mismatch)" : ""
+        );
+
+        failed_frames += failed ? 1 : 0;
+        ++frames;
+        done = controller.update(0);
+    }
+
+    if (failed_frames > 0) {
+        throw Error("{} of {} frames differ from the CPU renderer", failed_frames, frames);
+    }
+
+    LOGGER.log("All {} frames match the CPU renderer", frames);
 }
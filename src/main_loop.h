@@ -3,9 +3,13 @@
 
 #include <string_view>
 #include <filesystem>
+#include <vector>
+#include <functional>
 #include <cstddef>
 #include "utility/Span.h"
 #include "math/Vec.h"
+#include "camera/Camera.h"
+#include "backend/headless/HeadlessOptions.h"
 
 struct EventDispatcher;
 struct Display;
@@ -15,12 +19,65 @@ struct RenderParameters {
     std::string_view volume_type_override;
     std::string_view shader;
     std::filesystem::path stats_save_path;
+    std::filesystem::path memory_report_path;
     Vec3F voxel_ratio = Vec3F(1, 1, 1);
     std::string_view camera;
     float emission_coeff = 1.f;
     size_t repeat = 1;
+    size_t balance = 0;
+    bool data_parallel = false;
+    float target_fps = 0;
+    float tile_budget = 0;
+    bool beam = false;
+    bool instrument = false;
+    std::string_view heatmap;
+    float heatmap_max = 1024;
+    bool continuous = false;
+    bool tune = false;
+};
+
+// The timings of a single frame rendered by bench_loop
+struct BenchFrame {
+    // Wall-clock time from the start of the frame until the start of the next one, in ms.
+    // The last frame lasts until all frames have finished.
+    double frame_time;
+
+    // Time of the slowest dispatch of the frame, in ms
+    double dispatch_time;
+
+    // Sum of the dispatch times of all outputs, in ms
+    double render_time;
+
+    size_t rays;
+};
+
+// A frame requested from serve_loop
+struct ServeFrame {
+    Camera camera;
+    vk::Extent2D extent;
 };
 
 void main_loop(EventDispatcher& dispatcher, Display* display, const RenderParameters& render_params);
 
+// Render the camera script of render_params without any interaction or dynamic adjustments,
+// and return the timings of every frame. The first camera is first rendered `warmup` times,
+// and these frames are not included.
+std::vector<BenchFrame> bench_loop(Display* display, const RenderParameters& render_params, size_t warmup);
+
+// Render frames on demand, see 'xenodon serve'. `next_batch` blocks until frames are requested,
+// and returns them, or an empty vector to stop. A frame may be at most as large as the display
+// region initially covered by the outputs, and its rows are divided over the devices. The display
+// is flushed after every batch. Requires a display which supports dynamic regions.
+void serve_loop(Display* display, const RenderParameters& render_params, const std::function<std::vector<ServeFrame>()>& next_batch);
+
+// Render the camera script of render_params with the CPU renderer, using `threads` worker threads.
+// The frames have the size of the headless configuration, and are saved like the headless backend
+// saves them. No Vulkan device is created.
+void cpu_loop(const RenderParameters& render_params, const std::filesystem::path& headless_config, const HeadlessOptions& options, size_t threads);
+
+// Render the camera script of render_params with a GPU shader and with its port in the CPU renderer,
+// and compare the frames. A pixel differs when any channel differs by more than `tolerance`. Throws
+// when more than a small fraction of the pixels of any frame differ.
+void compare_loop(const RenderParameters& render_params, const std::filesystem::path& headless_config, size_t threads, uint32_t tolerance);
+
 #endif
@@ -0,0 +1,54 @@
+#include "microbench/Microbench.h"
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace microbench {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        // The time of a sample of `ops` operations, in seconds
+        double sample(const Case& c, size_t ops) {
+            const auto start = Clock::now();
+            c.run(ops);
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+    }
+
+    Result run(const Case& c, const Options& opts) {
+        const size_t bytes_per_op = c.setup();
+
+        // The first runs also warm up the caches
+        size_t ops = 1;
+        while (sample(c, ops) < opts.min_sample_time.count()) {
+            ops *= 2;
+        }
+
+        auto times = std::vector<double>(opts.samples);
+        for (auto& time : times) {
+            time = sample(c, ops) * 1e9 / static_cast<double>(ops);
+        }
+
+        std::sort(times.begin(), times.end());
+
+        const auto n = static_cast<double>(times.size());
+        const double mean = std::accumulate(times.begin(), times.end(), 0.0) / n;
+        const double variance = std::accumulate(times.begin(), times.end(), 0.0, [mean](double acc, double time) {
+            return acc + (time - mean) * (time - mean);
+        }) / n;
+
+        const size_t mid = times.size() / 2;
+        const double median = times.size() % 2 == 0 ? (times[mid - 1] + times[mid]) / 2 : times[mid];
+
+        return {
+            c.name,
+            ops,
+            median,
+            times.front(),
+            std::sqrt(variance),
+            // Bytes per ns is GB/s
+            static_cast<double>(bytes_per_op) / median
+        };
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef _XENODON_MICROBENCH_MICROBENCH_H
+#define _XENODON_MICROBENCH_MICROBENCH_H
+
+#include <string>
+#include <functional>
+#include <chrono>
+#include <cstddef>
+
+// A minimal harness for the microbenchmarks of xenodon-bench. Every case is first calibrated, by
+// doubling the number of operations until a single sample takes at least the minimum sample time.
+// The case is then measured for a number of samples of that many operations.
+namespace microbench {
+    // Keep the compiler from optimizing away the computation of a value
+    template <typename T>
+    inline void do_not_optimize(const T& value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    struct Case {
+        std::string name;
+
+        // Prepare the data of the case, which is not measured, and return the number of bytes
+        // processed by a single operation, from which the throughput is computed. Cases for which
+        // this is 0 only report the time per operation.
+        std::function<size_t()> setup;
+
+        // Perform the given number of operations
+        std::function<void(size_t ops)> run;
+    };
+
+    struct Options {
+        std::chrono::duration<double> min_sample_time = std::chrono::milliseconds{50};
+        size_t samples = 10;
+    };
+
+    struct Result {
+        std::string name;
+        size_t ops_per_sample;
+
+        // Statistics of the time per operation over all samples, in ns
+        double median_ns;
+        double min_ns;
+        double stddev_ns;
+
+        // Throughput of the median sample in GB/s, or 0 if the case does not process bytes
+        double gb_per_s;
+    };
+
+    Result run(const Case& c, const Options& opts);
+}
+
+#endif
@@ -0,0 +1,462 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <random>
+#include <charconv>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <fmt/format.h>
+#include "core/arg_parse.h"
+#include "core/Error.h"
+#include "model/Grid.h"
+#include "model/Octree.h"
+#include "model/OctreeConstruction.h"
+#include "utility/Span.h"
+#include "microbench/Microbench.h"
+
+namespace {
+    constexpr const std::string_view USAGE =
+        "Usage: xenodon-bench [options...]\n"
+        "Run microbenchmarks of the CPU side volume processing on synthetic grids.\n"
+        "\n"
+        "Options:\n"
+        "--filter <text>          Only run cases of which the name contains <text>.\n"
+        "--sizes <list>           Comma-separated side lengths of the grids. Defaults to 32,64,128.\n"
+        "--densities <list>       Comma-separated fractions of occupied voxels of the grids.\n"
+        "                         Defaults to 0.01,0.1,0.5.\n"
+        "--samples <amount>       Samples taken of every case. Defaults to 10.\n"
+        "--min-time <ms>          Minimum duration of a sample. Defaults to 50.\n"
+        "--format <format>        Either 'table' (default) or 'csv'.\n"
+        "--list                   List the cases instead of running them.\n"
+        "--help                   Show this message.\n";
+
+    // Voxels are occupied in blocks of this size, so that the octrees of the grids
+    // have some structure
+    constexpr const size_t BLOCK_SIZE = 4;
+
+    // The extent of the regions of the partial scans
+    constexpr const size_t SCAN_EXTENT = 8;
+
+    // The amount of lookups of a single find operation
+    constexpr const size_t FIND_LOOKUPS = 1024;
+
+    constexpr const uint8_t CHANNEL_DIFF = 8;
+
+    enum class Format {
+        Table,
+        Csv
+    };
+
+    struct Options {
+        std::string_view filter;
+        std::string_view sizes = "32,64,128";
+        std::string_view densities = "0.01,0.1,0.5";
+        size_t samples = 10;
+        size_t min_time = 50;
+        Format format = Format::Table;
+        bool list = false;
+        bool help = false;
+    };
+
+    auto format_opt(Format* var) {
+        return [var](std::string_view arg) {
+            if (arg == "table") {
+                *var = Format::Table;
+            } else if (arg == "csv") {
+                *var = Format::Csv;
+            } else {
+                return false;
+            }
+
+            return true;
+        };
+    }
+
+    std::vector<std::string_view> split_list(std::string_view list) {
+        auto items = std::vector<std::string_view>();
+
+        while (!list.empty()) {
+            const auto comma = list.find(',');
+            const auto item = list.substr(0, comma);
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+
+            if (comma == std::string_view::npos) {
+                break;
+            }
+
+            list.remove_prefix(comma + 1);
+        }
+
+        return items;
+    }
+
+    std::vector<size_t> parse_sizes(std::string_view list) {
+        auto sizes = std::vector<size_t>();
+        for (auto item : split_list(list)) {
+            size_t size = 0;
+            auto [end, err] = std::from_chars(item.begin(), item.end(), size);
+            if (err != std::errc() || end != item.end() || size == 0) {
+                throw Error("Invalid grid size '{}'", item);
+            }
+
+            sizes.push_back(size);
+        }
+
+        return sizes;
+    }
+
+    std::vector<double> parse_densities(std::string_view list) {
+        auto densities = std::vector<double>();
+        for (auto item : split_list(list)) {
+            double density = 0;
+            if (!args::parse_float(item, density) || density < 0 || density > 1) {
+                throw Error("Invalid grid density '{}', expected a value in [0, 1]", item);
+            }
+
+            densities.push_back(density);
+        }
+
+        return densities;
+    }
+
+    // A deterministic hash of a block, so that every run generates the same grids
+    uint32_t hash_block(const Vec3Sz& block) {
+        auto h = static_cast<uint32_t>(block.x * 73856093u ^ block.y * 19349663u ^ block.z * 83492791u);
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // Generate a grid of `size`³ voxels, where about `density` of the blocks are
+    // filled with a color of their own
+    Grid synthetic_grid(size_t size, double density) {
+        auto grid = Grid(Vec3Sz(size));
+        const auto threshold = static_cast<uint32_t>(density * static_cast<double>(UINT32_MAX));
+
+        for (size_t z = 0; z < size; ++z) {
+            for (size_t y = 0; y < size; ++y) {
+                for (size_t x = 0; x < size; ++x) {
+                    const uint32_t h = hash_block(Vec3Sz{x, y, z} / BLOCK_SIZE);
+                    const bool occupied = density > 0 && h <= threshold;
+                    grid.set({x, y, z}, occupied ? Pixel::unpack(h | 0xFF000000u) : Pixel{0, 0, 0, 0});
+                }
+            }
+        }
+
+        return grid;
+    }
+
+    // The data of the cases of a single grid. It is created by the setup of the first case
+    // which needs it, so that listing and filtering cases does not generate any grids.
+    struct Fixture {
+        size_t size;
+        double density;
+        std::unique_ptr<Grid> grid;
+        std::unique_ptr<Octree> octree;
+        std::unique_ptr<Octree> rope_octree;
+        std::vector<Vec3Sz> lookups;
+        std::filesystem::path svo_path;
+
+        Fixture(size_t size, double density):
+            size(size), density(density) {
+        }
+
+        Fixture(const Fixture&) = delete;
+        Fixture& operator=(const Fixture&) = delete;
+
+        ~Fixture() {
+            if (!this->svo_path.empty()) {
+                auto ec = std::error_code();
+                std::filesystem::remove(this->svo_path, ec);
+            }
+        }
+
+        const Grid& get_grid() {
+            if (!this->grid) {
+                this->grid = std::make_unique<Grid>(synthetic_grid(this->size, this->density));
+            }
+
+            return *this->grid;
+        }
+
+        const Octree& get_octree() {
+            if (!this->octree) {
+                auto stats = ConstructionStats();
+                this->octree = std::make_unique<Octree>(build_octree(
+                    this->get_grid(),
+                    stats,
+                    ChannelDiffHeuristic{CHANNEL_DIFF},
+                    Octree::Type::Sparse
+                ));
+            }
+
+            return *this->octree;
+        }
+
+        Octree& get_rope_octree() {
+            if (!this->rope_octree) {
+                this->rope_octree = std::make_unique<Octree>(this->get_octree());
+            }
+
+            return *this->rope_octree;
+        }
+
+        const std::vector<Vec3Sz>& get_lookups() {
+            if (this->lookups.empty()) {
+                auto rng = std::mt19937_64(this->size);
+                auto dist = std::uniform_int_distribution<size_t>(0, this->size - 1);
+                for (size_t i = 0; i < FIND_LOOKUPS; ++i) {
+                    this->lookups.push_back({dist(rng), dist(rng), dist(rng)});
+                }
+            }
+
+            return this->lookups;
+        }
+
+        const std::filesystem::path& get_svo_path() {
+            if (this->svo_path.empty()) {
+                this->svo_path = std::filesystem::temp_directory_path() /
+                    fmt::format("xenodon-bench-{}-{}.svo", this->size, this->density);
+                this->get_octree().save_svo(this->svo_path);
+            }
+
+            return this->svo_path;
+        }
+    };
+
+    void add_cases(std::vector<microbench::Case>& cases, Fixture* f) {
+        const auto prefix = fmt::format("{}^3/{}", f->size, f->density);
+        const size_t grid_bytes = f->size * f->size * f->size * sizeof(Pixel);
+
+        auto name = [&prefix](std::string_view c) {
+            return fmt::format("{}/{}", c, prefix);
+        };
+
+        cases.push_back({name("vol_scan"), [f, grid_bytes]{ f->get_grid(); return grid_bytes; }, [f](size_t ops) {
+            const auto& grid = f->get_grid();
+            for (size_t i = 0; i < ops; ++i) {
+                microbench::do_not_optimize(grid.vol_scan(Vec3Sz(0), grid.dimensions()));
+            }
+        }});
+
+        // Scans of small regions, which dominate the octree construction
+        const size_t scan_extent = std::min(SCAN_EXTENT, f->size);
+        const size_t scan_bytes = scan_extent * scan_extent * scan_extent * sizeof(Pixel);
+
+        cases.push_back({name("vol_scan_block"), [f, scan_bytes]{ f->get_grid(); return scan_bytes; }, [f, scan_extent](size_t ops) {
+            const auto& grid = f->get_grid();
+            const size_t blocks = f->size / scan_extent;
+            for (size_t i = 0; i < ops; ++i) {
+                const size_t block = i % (blocks * blocks * blocks);
+                const auto offset = Vec3Sz{block % blocks, block / blocks % blocks, block / blocks / blocks} * scan_extent;
+                microbench::do_not_optimize(grid.vol_scan(offset, offset + scan_extent));
+            }
+        }});
+
+        cases.push_back({name("stddev_scan"), [f, grid_bytes]{ f->get_grid(); return grid_bytes; }, [f](size_t ops) {
+            const auto& grid = f->get_grid();
+            for (size_t i = 0; i < ops; ++i) {
+                microbench::do_not_optimize(grid.stddev_scan(Vec3Sz(0), grid.dimensions()));
+            }
+        }});
+
+        for (auto [type, type_name] : {std::pair{Octree::Type::Sparse, "sparse"}, std::pair{Octree::Type::Dag, "dag"}}) {
+            cases.push_back({name(fmt::format("build_octree_{}", type_name)), [f, grid_bytes]{ f->get_grid(); return grid_bytes; }, [f, type = type](size_t ops) {
+                for (size_t i = 0; i < ops; ++i) {
+                    auto stats = ConstructionStats();
+                    auto octree = build_octree(f->get_grid(), stats, ChannelDiffHeuristic{CHANNEL_DIFF}, type);
+                    microbench::do_not_optimize(octree.data().size());
+                }
+            }});
+        }
+
+        // Deduplication of the nodes of the sparse octree, one node per operation
+        cases.push_back({name("hash_cache"), [f]{ f->get_octree(); return sizeof(Octree::Node); }, [f](size_t ops) {
+            const auto nodes = f->get_octree().data();
+            auto cache = HashCache{};
+            for (size_t i = 0; i < ops; ++i) {
+                const size_t index = i % nodes.size();
+                if (index == 0) {
+                    cache.cache.clear();
+                }
+
+                microbench::do_not_optimize(cache(nodes[index], static_cast<uint32_t>(index)));
+            }
+        }});
+
+        // A single lookup of a random voxel per operation, down to the leaves
+        cases.push_back({name("octree_find"), [f]{ f->get_octree(); f->get_lookups(); return size_t{0}; }, [f](size_t ops) {
+            const auto& octree = f->get_octree();
+            const auto& lookups = f->get_lookups();
+            for (size_t i = 0; i < ops; ++i) {
+                microbench::do_not_optimize(octree.find(lookups[i % lookups.size()], std::numeric_limits<size_t>::max()));
+            }
+        }});
+
+        // The remaining cases process the entire octree in every operation
+        auto octree_bytes = [f] {
+            f->get_svo_path();
+            return f->get_octree().data().size() * sizeof(Octree::Node);
+        };
+
+        cases.push_back({name("save_svo"), octree_bytes, [f](size_t ops) {
+            const auto& octree = f->get_octree();
+            for (size_t i = 0; i < ops; ++i) {
+                octree.save_svo(f->get_svo_path());
+            }
+        }});
+
+        cases.push_back({name("load_svo"), octree_bytes, [f](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) {
+                auto octree = Octree::load_svo(f->get_svo_path());
+                microbench::do_not_optimize(octree.data().size());
+            }
+        }});
+
+        // Ropes are regenerated from scratch, so this can be repeated on the same octree
+        cases.push_back({name("generate_ropes"), [f, octree_bytes]{ f->get_rope_octree(); return octree_bytes(); }, [f](size_t ops) {
+            auto& octree = f->get_rope_octree();
+            for (size_t i = 0; i < ops; ++i) {
+                octree.generate_ropes();
+                microbench::do_not_optimize(octree.data().size());
+            }
+        }});
+    }
+
+    void print_table_header() {
+        fmt::print(
+            "{:<40} {:>12} {:>14} {:>14} {:>10} {:>10}\n",
+            "case",
+            "ops/sample",
+            "median ns/op",
+            "min ns/op",
+            "stddev %",
+            "GB/s"
+        );
+    }
+
+    void print_result(Format format, const microbench::Result& result) {
+        const double rel_stddev = result.median_ns > 0 ? result.stddev_ns / result.median_ns * 100.0 : 0.0;
+
+        if (format == Format::Csv) {
+            fmt::print(
+                "{},{},{:.3f},{:.3f},{:.3f},{:.3f}\n",
+                result.name,
+                result.ops_per_sample,
+                result.median_ns,
+                result.min_ns,
+                result.stddev_ns,
+                result.gb_per_s
+            );
+        } else if (result.gb_per_s > 0) {
+            fmt::print(
+                "{:<40} {:>12} {:>14.1f} {:>14.1f} {:>10.2f} {:>10.3f}\n",
+                result.name,
+                result.ops_per_sample,
+                result.median_ns,
+                result.min_ns,
+                rel_stddev,
+                result.gb_per_s
+            );
+        } else {
+            fmt::print(
+                "{:<40} {:>12} {:>14.1f} {:>14.1f} {:>10.2f} {:>10}\n",
+                result.name,
+                result.ops_per_sample,
+                result.median_ns,
+                result.min_ns,
+                rel_stddev,
+                "-"
+            );
+        }
+
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    auto opts = Options();
+
+    auto cmd = args::Command {
+        .flags = {
+            {&opts.list, "--list"},
+            {&opts.help, "--help", 'h'}
+        },
+        .parameters = {
+            {args::string_opt(&opts.filter), "text", "--filter"},
+            {args::string_opt(&opts.sizes), "sizes", "--sizes"},
+            {args::string_opt(&opts.densities), "densities", "--densities"},
+            {args::int_range_opt(&opts.samples, size_t{1}), "amount", "--samples"},
+            {args::int_range_opt(&opts.min_time, size_t{1}), "ms", "--min-time"},
+            {format_opt(&opts.format), "format", "--format"}
+        }
+    };
+
+    auto sizes = std::vector<size_t>();
+    auto densities = std::vector<double>();
+
+    try {
+        args::parse(Span<const char*>(static_cast<size_t>(argc - 1), &argv[1]), cmd);
+        sizes = parse_sizes(opts.sizes);
+        densities = parse_densities(opts.densities);
+    } catch (const Error& e) {
+        fmt::print(stderr, "Error: {}\n{}", e.what(), USAGE);
+        return EXIT_FAILURE;
+    }
+
+    if (opts.help) {
+        fmt::print("{}", USAGE);
+        return EXIT_SUCCESS;
+    }
+
+    auto fixtures = std::vector<std::unique_ptr<Fixture>>();
+    auto cases = std::vector<microbench::Case>();
+
+    for (size_t size : sizes) {
+        for (double density : densities) {
+            fixtures.push_back(std::make_unique<Fixture>(size, density));
+            add_cases(cases, fixtures.back().get());
+        }
+    }
+
+    auto bench_opts = microbench::Options();
+    bench_opts.samples = opts.samples;
+    bench_opts.min_sample_time = std::chrono::milliseconds{opts.min_time};
+
+    if (opts.format == Format::Csv) {
+        fmt::print("case,ops_per_sample,median_ns,min_ns,stddev_ns,gb_per_s\n");
+    } else if (!opts.list) {
+        print_table_header();
+    }
+
+    try {
+        for (const auto& c : cases) {
+            if (c.name.find(opts.filter) == std::string::npos) {
+                continue;
+            } else if (opts.list) {
+                fmt::print("{}\n", c.name);
+                continue;
+            }
+
+            print_result(opts.format, microbench::run(c, bench_opts));
+        }
+    } catch (const Error& e) {
+        fmt::print(stderr, "Error: {}\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#include "model/BrickOctree.h"
+#include <fstream>
+#include <string_view>
+#include <fmt/format.h>
+#include "core/Error.h"
+#include "utility/serialization.h"
+
+namespace {
+    constexpr const std::string_view BRICK_FMT_ID = "XNDN-BRK";
+}
+
+BrickOctree::BrickOctree(Octree&& tree, size_t brick_size, std::vector<Pixel>&& voxels):
+    tree(std::move(tree)),
+    side(brick_size),
+    voxels(std::move(voxels)),
+    allocation(accounting::HostCategory::Bricks, this->voxels.size() * sizeof(Pixel)) {
+}
+
+BrickOctree BrickOctree::load(const std::filesystem::path& path) {
+    auto in = std::ifstream(path, std::ios::binary);
+    if (!in) {
+        throw Error("Failed to open");
+    }
+
+    char id[BRICK_FMT_ID.size()];
+    in.read(id, BRICK_FMT_ID.size());
+    if (BRICK_FMT_ID != std::string_view(id, BRICK_FMT_ID.size())) {
+        throw Error("Invalid format id");
+    }
+
+    uint64_t dim = read_uint_le<uint64_t>(in);
+    uint64_t brick_size = read_uint_le<uint64_t>(in);
+    uint64_t num_nodes = read_uint_le<uint64_t>(in);
+    uint64_t num_bricks = read_uint_le<uint64_t>(in);
+
+    if (brick_size == 0 || dim % brick_size != 0) {
+        throw Error("Invalid brick size {}", brick_size);
+    }
+
+    auto pos = in.tellg();
+    if (pos == std::ifstream::pos_type(-1)) {
+        throw Error("Failed to tell");
+    }
+
+    in.seekg(0, std::ios_base::end);
+    auto end = in.tellg();
+    if (end == std::ifstream::pos_type(-1)) {
+        throw Error("Failed to tell");
+    }
+
+    in.seekg(pos);
+    const uint64_t num_voxels = num_bricks * brick_size * brick_size * brick_size;
+    size_t remaining = static_cast<size_t>(end - pos);
+    if (remaining != sizeof(Octree::Node) * num_nodes + sizeof(Pixel) * num_voxels) {
+        throw Error("File size does not match number of nodes and bricks");
+    }
+
+    auto nodes = std::vector<Octree::Node>(num_nodes);
+    for (auto& node : nodes) {
+        node = Octree::read_node(in);
+
+        if (node.is_brick() && node.children[0] >= num_bricks) {
+            throw Error("Invalid brick index {}", node.children[0]);
+        }
+    }
+
+    auto voxels = std::vector<Pixel>(num_voxels);
+    for (auto& voxel : voxels) {
+        voxel = Pixel::unpack(read_uint_le<uint32_t>(in));
+    }
+
+    return BrickOctree(
+        Octree(static_cast<size_t>(dim), std::move(nodes)),
+        static_cast<size_t>(brick_size),
+        std::move(voxels)
+    );
+}
+
+void BrickOctree::save(const std::filesystem::path& path) const {
+    auto out = std::ofstream(path, std::ios::binary);
+    if (!out) {
+        throw Error("Failed to open");
+    }
+
+    out.write(BRICK_FMT_ID.data(), BRICK_FMT_ID.size());
+    write_uint_le(out, this->tree.side());
+    write_uint_le(out, this->side);
+    write_uint_le(out, this->tree.data().size());
+    write_uint_le(out, this->num_bricks());
+
+    for (const auto& node : this->tree.data()) {
+        Octree::write_node(out, node);
+    }
+
+    for (const auto& voxel : this->voxels) {
+        write_uint_le(out, voxel.pack());
+    }
+}
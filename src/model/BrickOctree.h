@@ -0,0 +1,63 @@
+#ifndef _XENODON_MODEL_BRICKOCTREE_H
+#define _XENODON_MODEL_BRICKOCTREE_H
+
+#include <vector>
+#include <filesystem>
+#include <cstddef>
+#include "model/Octree.h"
+#include "model/Pixel.h"
+#include "utility/Span.h"
+#include "core/MemoryAccounting.h"
+
+// A hybrid of a sparse voxel octree and a uniform grid. Construction of the tree stops at
+// regions of brick_size³ voxels which are mostly occupied, and the voxels of such a region
+// are stored in a brick instead. These leaves are marked with Octree::BRICK, and store
+// the index of their brick in their first child.
+class BrickOctree {
+    Octree tree;
+    size_t side;
+    std::vector<Pixel> voxels;
+    accounting::HostAllocation allocation;
+
+public:
+    BrickOctree(Octree&& tree, size_t brick_size, std::vector<Pixel>&& voxels);
+
+    static BrickOctree load(const std::filesystem::path& path);
+
+    void save(const std::filesystem::path& path) const;
+
+    const Octree& octree() const {
+        return this->tree;
+    }
+
+    size_t brick_size() const {
+        return this->side;
+    }
+
+    size_t brick_volume() const {
+        return this->side * this->side * this->side;
+    }
+
+    size_t num_bricks() const {
+        return this->voxels.size() / this->brick_volume();
+    }
+
+    // The voxels of a brick, with x varying fastest
+    Span<Pixel> brick(size_t index) const {
+        return Span(this->brick_volume(), this->voxels.data() + index * this->brick_volume());
+    }
+
+    size_t nodes_footprint() const {
+        return this->tree.data().size() * sizeof(Octree::Node);
+    }
+
+    size_t bricks_footprint() const {
+        return this->voxels.size() * sizeof(Pixel);
+    }
+
+    size_t memory_footprint() const {
+        return sizeof(BrickOctree) + this->nodes_footprint() + this->bricks_footprint();
+    }
+};
+
+#endif
@@ -17,7 +17,9 @@ namespace {
 }
 
 Grid::Grid(Vec3Sz dim):
-    dim(dim), data(std::make_unique<Pixel[]>(this->size())) {
+    dim(dim),
+    data(std::make_unique<Pixel[]>(this->size())),
+    allocation(accounting::HostCategory::Grid, this->size() * sizeof(Pixel)) {
 
     for (size_t i = 0; i < this->size(); ++i) {
         this->data[i] = {0, 0, 0, 0};
@@ -78,6 +80,47 @@ Grid Grid::load_tiff(const std::filesystem::path& path) {
     );
 }
 
+void Grid::save_tiff(const std::filesystem::path& path) const {
+    // Large volumes easily exceed the 4 GiB limit of classic TIFF files
+    auto tiff = TiffPtr(TIFFOpen(path.c_str(), "w8"));
+    if (!tiff) {
+        throw Error("Failed to open");
+    }
+
+    const auto width = static_cast<uint32_t>(this->dim.x);
+    const auto height = static_cast<uint32_t>(this->dim.y);
+    const size_t layer_stride = this->dim.x * this->dim.y;
+
+    for (size_t z = 0; z < this->dim.z; ++z) {
+        TIFFSetField(tiff.get(), TIFFTAG_IMAGEWIDTH, width);
+        TIFFSetField(tiff.get(), TIFFTAG_IMAGELENGTH, height);
+        TIFFSetField(tiff.get(), TIFFTAG_SAMPLESPERPIXEL, 4);
+        TIFFSetField(tiff.get(), TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tiff.get(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+        TIFFSetField(tiff.get(), TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tiff.get(), TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+        TIFFSetField(tiff.get(), TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+        TIFFSetField(tiff.get(), TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tiff.get(), 0));
+        TIFFSetField(tiff.get(), TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+        TIFFSetField(tiff.get(), TIFFTAG_PAGENUMBER, static_cast<uint16_t>(z), static_cast<uint16_t>(this->dim.z));
+
+        const uint16_t extra_samples[] = {EXTRASAMPLE_UNASSALPHA};
+        TIFFSetField(tiff.get(), TIFFTAG_EXTRASAMPLES, 1, extra_samples);
+
+        // TIFFReadRGBAImage returns the bottom row first, so the rows are written in reverse
+        for (uint32_t row = 0; row < height; ++row) {
+            auto* scanline = &this->data[layer_stride * z + (height - row - 1) * this->dim.x];
+            if (TIFFWriteScanline(tiff.get(), scanline, row, 0) < 0) {
+                throw Error("Failed to write layer {}", z);
+            }
+        }
+
+        if (!TIFFWriteDirectory(tiff.get())) {
+            throw Error("Failed to write layer {}", z);
+        }
+    }
+}
+
 Grid::VolScanResult Grid::vol_scan(Vec3Sz bmin, Vec3Sz bmax) const {
     struct {
         size_t r, g, b, a;
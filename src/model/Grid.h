@@ -9,6 +9,7 @@
 #include "math/Vec.h"
 #include "utility/Span.h"
 #include "model/Pixel.h"
+#include "core/MemoryAccounting.h"
 
 class Grid {
 public:
@@ -25,9 +26,12 @@ public:
 private:
     Vec3Sz dim;
     std::unique_ptr<Pixel[]> data;
+    accounting::HostAllocation allocation;
 
     Grid(Vec3Sz dim, std::unique_ptr<Pixel[]>&& data):
-        dim(dim), data(std::move(data)) {
+        dim(dim),
+        data(std::move(data)),
+        allocation(accounting::HostCategory::Grid, this->size() * sizeof(Pixel)) {
     }
 
 public:
@@ -35,6 +39,9 @@ public:
 
     static Grid load_tiff(const std::filesystem::path& path);
 
+    // Save as 3D TIFF image with one page per layer, which load_tiff reads back to the same grid
+    void save_tiff(const std::filesystem::path& path) const;
+
     VolScanResult vol_scan(Vec3Sz bmin, Vec3Sz bmax) const;
 
     StdDevResult stddev_scan(Vec3Sz bmin, Vec3Sz bmax) const;
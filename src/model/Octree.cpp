@@ -44,7 +44,9 @@ bool operator!=(const Octree::Node& lhs, const Octree::Node& rhs) {
 }
 
 Octree::Octree(size_t dim, std::vector<Node>&& nodes):
-    dim(dim), nodes(std::move(nodes)) {
+    dim(dim),
+    nodes(std::move(nodes)),
+    allocation(accounting::HostCategory::Octree, this->nodes.size() * sizeof(Node)) {
 }
 
 Octree Octree::load_svo(const std::filesystem::path& path) {
@@ -82,12 +84,7 @@ Octree Octree::load_svo(const std::filesystem::path& path) {
 
     auto nodes = std::vector<Node>(num_nodes);
     for (auto& node : nodes) {
-        for (uint32_t& child : node.children) {
-            child = read_uint_le<uint32_t>(in);
-        }
-
-        node.color = Pixel::unpack(read_uint_le<uint32_t>(in));
-        node.is_leaf_depth = read_uint_le<uint32_t>(in);
+        node = read_node(in);
     }
 
     return Octree(static_cast<size_t>(dim), std::move(nodes));
@@ -104,13 +101,28 @@ void Octree::save_svo(const std::filesystem::path& path) const {
     write_uint_le(out, this->nodes.size());
 
     for (const auto& node : this->nodes) {
-        for (uint32_t child : node.children) {
-            write_uint_le(out, child);
-        }
+        write_node(out, node);
+    }
+}
 
-        write_uint_le(out, node.color.pack());
-        write_uint_le(out, node.is_leaf_depth);
+Octree::Node Octree::read_node(std::istream& in) {
+    auto node = Node();
+    for (uint32_t& child : node.children) {
+        child = read_uint_le<uint32_t>(in);
     }
+
+    node.color = Pixel::unpack(read_uint_le<uint32_t>(in));
+    node.is_leaf_depth = read_uint_le<uint32_t>(in);
+    return node;
+}
+
+void Octree::write_node(std::ostream& out, const Node& node) {
+    for (uint32_t child : node.children) {
+        write_uint_le(out, child);
+    }
+
+    write_uint_le(out, node.color.pack());
+    write_uint_le(out, node.is_leaf_depth);
 }
 
 std::pair<const Octree::Node*, size_t> Octree::find(const Vec3Sz& pos, size_t max_depth) const {
@@ -199,3 +211,74 @@ void Octree::generate_ropes() {
         node.children[5] = static_cast<uint32_t>(node_zneg);
     });
 }
+
+Octree Octree::subset(size_t depth, const std::function<bool(size_t)>& include) const {
+    auto nodes = std::vector<Node>();
+    auto copied = std::unordered_map<uint32_t, uint32_t>();
+
+    // Subtrees below `depth` are copied as-is, nodes shared in a DAG are copied only once
+    auto copy = [&](auto& self, uint32_t index) -> uint32_t {
+        if (auto it = copied.find(index); it != copied.end()) {
+            return it->second;
+        }
+
+        const Node& node = this->nodes[index];
+        const auto new_index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(node);
+
+        if (!node.is_leaf()) {
+            for (size_t i = 0; i < 8; ++i) {
+                const uint32_t child = self(self, node.children[i]);
+                nodes[new_index].children[i] = child;
+            }
+        }
+
+        copied.emplace(index, new_index);
+        return new_index;
+    };
+
+    auto select = [&](auto& self, uint32_t index, size_t level, size_t path) -> uint32_t {
+        const Node& node = this->nodes[index];
+
+        if (level == depth || node.is_leaf()) {
+            if (include(path << (3 * (depth - level)))) {
+                return copy(copy, index);
+            }
+
+            // Empty leaves are not shared, so that ropes can be generated for them
+            nodes.push_back(Node{
+                .children = {0},
+                .color = Pixel{0, 0, 0, 0},
+                .is_leaf_depth = LEAF | static_cast<uint32_t>(level)
+            });
+
+            return static_cast<uint32_t>(nodes.size() - 1);
+        }
+
+        const auto new_index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(node);
+
+        for (size_t i = 0; i < 8; ++i) {
+            const uint32_t child = self(self, node.children[i], level + 1, path * 8 + i);
+            nodes[new_index].children[i] = child;
+        }
+
+        return new_index;
+    };
+
+    select(select, ROOT, 0, 0);
+
+    auto result = Octree(this->dim, std::move(nodes));
+
+    const bool has_ropes = std::any_of(this->nodes.begin(), this->nodes.end(), [](const Node& node) {
+        return node.is_leaf() && std::any_of(node.children.begin(), node.children.end(), [](uint32_t child) {
+            return child != 0;
+        });
+    });
+
+    if (has_ropes) {
+        result.generate_ropes();
+    }
+
+    return result;
+}
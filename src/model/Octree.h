@@ -7,11 +7,13 @@
 #include <array>
 #include <utility>
 #include <functional>
+#include <iosfwd>
 #include <cstddef>
 #include <cstdint>
 #include "math/Vec.h"
 #include "model/Pixel.h"
 #include "utility/Span.h"
+#include "core/MemoryAccounting.h"
 
 class Octree {
 public:
@@ -29,6 +31,11 @@ public:
     constexpr const static size_t Z_POS = 1 << 0;
 
     constexpr const static uint32_t LEAF = 1u << 31u;
+
+    // Leaves of a hybrid tree which refer to a brick of voxels rather than a single color,
+    // see BrickOctree. The index of the brick is stored in the first child.
+    constexpr const static uint32_t BRICK = 1u << 30u;
+    constexpr const static uint32_t DEPTH_MASK = BRICK - 1;
     constexpr const static size_t ROOT = 0;
 
     // This struct should be kept in sync with resources/svo.frag
@@ -40,6 +47,14 @@ public:
         bool is_leaf() const {
             return (this->is_leaf_depth & LEAF) != 0;
         }
+
+        bool is_brick() const {
+            return (this->is_leaf_depth & BRICK) != 0;
+        }
+
+        uint32_t depth() const {
+            return this->is_leaf_depth & DEPTH_MASK;
+        }
     };
 
     static_assert(sizeof(Node) == 40, "Compiler didnt pack Node struct properly");
@@ -47,6 +62,7 @@ public:
 private:
     size_t dim;
     std::vector<Node> nodes;
+    accounting::HostAllocation allocation;
 
 public:
     Octree(size_t dim, std::vector<Node>&& nodes);
@@ -55,10 +71,20 @@ public:
 
     void save_svo(const std::filesystem::path& path) const;
 
+    // Serialize a single node, in the format used by .svo files
+    static Node read_node(std::istream& in);
+    static void write_node(std::ostream& out, const Node& node);
+
     std::pair<const Octree::Node*, size_t> find(const Vec3Sz& pos, size_t max_depth) const;
 
     void generate_ropes();
 
+    // Returns a copy of this octree which only contains the subtrees at `depth` for which
+    // `include` returns true, the others are replaced by empty leaves. A subtree is identified
+    // by the path from the root to it, with 3 bits per level. Leaves above `depth` belong to the
+    // subtree of their first descendant. Ropes are regenerated if this octree has them.
+    Octree subset(size_t depth, const std::function<bool(size_t)>& include) const;
+
     Span<Node> data() const {
         return this->nodes;
     }
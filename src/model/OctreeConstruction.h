@@ -3,17 +3,30 @@
 
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
 #include <utility>
+#include <array>
+#include <cmath>
 #include <cstdint>
 #include <cstddef>
+#include <x86intrin.h>
 #include <fmt/format.h>
 #include "model/Octree.h"
+#include "model/BrickOctree.h"
 #include "model/Grid.h"
+#include "core/MemoryAccounting.h"
 
 struct NoopCache {
     uint32_t operator()([[maybe_unused]] const Octree::Node& node, uint32_t index) {
         return index;
     }
+
+    void erase([[maybe_unused]] const Octree::Node& node) {
+    }
+
+    size_t memory_footprint() const {
+        return 0;
+    }
 };
 
 struct HashCache {
@@ -27,6 +40,95 @@ struct HashCache {
 
         return it->second;
     }
+
+    void erase(const Octree::Node& node) {
+        this->cache.erase(node);
+    }
+
+    // An estimate, assuming that every entry is allocated separately together with a pointer
+    // to the next entry and its hash
+    size_t memory_footprint() const {
+        using Entry = std::pair<const Octree::Node, uint32_t>;
+        return this->cache.bucket_count() * sizeof(void*) + this->cache.size() * (sizeof(Entry) + 2 * sizeof(void*));
+    }
+};
+
+// The voxels of a region, in a form which can be combined with that of the neighbouring regions.
+// Used by build_octree_chunked to decide on regions which are larger than a single grid.
+struct RegionSummary {
+    size_t voxels = 0;
+    std::array<size_t, 4> sum = {0, 0, 0, 0};
+
+    // Of all channels
+    size_t sum_squares = 0;
+
+    Pixel min = {255, 255, 255, 255};
+    Pixel max = {0, 0, 0, 0};
+
+    // Add `n` voxels of the given color
+    void add(Pixel voxel, size_t n = 1) {
+        const uint8_t channels[] = {voxel.r, voxel.g, voxel.b, voxel.a};
+        for (size_t i = 0; i < 4; ++i) {
+            this->sum[i] += channels[i] * n;
+            this->sum_squares += size_t{channels[i]} * channels[i] * n;
+        }
+
+        this->voxels += n;
+        this->min = {std::min(this->min.r, voxel.r), std::min(this->min.g, voxel.g), std::min(this->min.b, voxel.b), std::min(this->min.a, voxel.a)};
+        this->max = {std::max(this->max.r, voxel.r), std::max(this->max.g, voxel.g), std::max(this->max.b, voxel.b), std::max(this->max.a, voxel.a)};
+    }
+
+    void combine(const RegionSummary& other) {
+        for (size_t i = 0; i < 4; ++i) {
+            this->sum[i] += other.sum[i];
+        }
+
+        this->voxels += other.voxels;
+        this->sum_squares += other.sum_squares;
+        this->min = {std::min(this->min.r, other.min.r), std::min(this->min.g, other.min.g), std::min(this->min.b, other.min.b), std::min(this->min.a, other.min.a)};
+        this->max = {std::max(this->max.r, other.max.r), std::max(this->max.g, other.max.g), std::max(this->max.b, other.max.b), std::max(this->max.a, other.max.a)};
+    }
+
+    // The same as the average of Grid::vol_scan
+    Pixel avg() const {
+        if (this->voxels == 0) {
+            return {0, 0, 0, 0};
+        }
+
+        return {
+            static_cast<uint8_t>(this->sum[0] / this->voxels),
+            static_cast<uint8_t>(this->sum[1] / this->voxels),
+            static_cast<uint8_t>(this->sum[2] / this->voxels),
+            static_cast<uint8_t>(this->sum[3] / this->voxels)
+        };
+    }
+
+    static RegionSummary scan(const Grid& grid) {
+        std::array<size_t, 4> sum = {0, 0, 0, 0};
+        size_t sum_squares = 0;
+        __m128i xmin = _mm_cvtsi32_si128(static_cast<int>(0xFFFFFFFF));
+        __m128i xmax = _mm_cvtsi32_si128(0x00000000);
+
+        for (const Pixel voxel : grid.pixels()) {
+            const __m128i xpix = _mm_cvtsi32_si128(static_cast<int>(voxel.pack()));
+            xmin = _mm_min_epu8(xmin, xpix);
+            xmax = _mm_max_epu8(xmax, xpix);
+
+            sum[0] += voxel.r;
+            sum[1] += voxel.g;
+            sum[2] += voxel.b;
+            sum[3] += voxel.a;
+            sum_squares += size_t{voxel.r} * voxel.r + size_t{voxel.g} * voxel.g + size_t{voxel.b} * voxel.b + size_t{voxel.a} * voxel.a;
+        }
+
+        auto summary = RegionSummary();
+        summary.voxels = grid.size();
+        summary.sum = sum;
+        summary.sum_squares = sum_squares;
+        summary.min = Pixel::unpack(static_cast<uint32_t>(_mm_cvtsi128_si32(xmin)));
+        summary.max = Pixel::unpack(static_cast<uint32_t>(_mm_cvtsi128_si32(xmax)));
+        return summary;
+    }
 };
 
 struct ChannelDiffHeuristic {
@@ -36,6 +138,22 @@ struct ChannelDiffHeuristic {
         const auto [avg, max_diff] = grid.vol_scan(offset, offset + extent);
         return {avg, max_diff > this->channel_diff};
     }
+
+    // The same result as grid_scan of the voxels of the summary
+    std::pair<Pixel, bool> summary_scan(const RegionSummary& summary) const {
+        if (summary.voxels == 0) {
+            return {summary.avg(), false};
+        }
+
+        const int max_diff = std::max({
+            summary.max.r - summary.min.r,
+            summary.max.g - summary.min.g,
+            summary.max.b - summary.min.b,
+            summary.max.a - summary.min.a
+        });
+
+        return {summary.avg(), max_diff > this->channel_diff};
+    }
 };
 
 struct StdDevHeuristic {
@@ -45,6 +163,29 @@ struct StdDevHeuristic {
         const auto [avg, stddev] = grid.stddev_scan(offset, offset + extent);
         return {avg, stddev > this->stddev};
     }
+
+    // Like grid_scan of the voxels of the summary, up to rounding of the standard deviation
+    std::pair<Pixel, bool> summary_scan(const RegionSummary& summary) const {
+        if (summary.voxels == 0) {
+            return {summary.avg(), false};
+        }
+
+        const double n = static_cast<double>(summary.voxels);
+        double variance = static_cast<double>(summary.sum_squares) / n;
+        for (size_t sum : summary.sum) {
+            const double mean = static_cast<double>(sum) / n;
+            variance -= mean * mean;
+        }
+
+        return {summary.avg(), std::sqrt(std::max(variance, 0.0)) > this->stddev};
+    }
+};
+
+// Parameters of hybrid trees, see BrickOctree. Regions of `size`³ voxels which would be split
+// are stored as a brick instead, if at least `min_density` of their voxels are not black.
+struct BrickParams {
+    size_t size;
+    double min_density;
 };
 
 struct ConstructionStats {
@@ -52,12 +193,14 @@ struct ConstructionStats {
     size_t unique_leaves;
     size_t total_nodes;
     size_t depth;
+    size_t bricks;
 
     ConstructionStats():
         total_leaves(0),
         unique_leaves(0),
         total_nodes(0),
-        depth(0) {
+        depth(0),
+        bricks(0) {
     }
 };
 
@@ -89,6 +232,18 @@ namespace detail {
             return {actual_index, inserted};
         }
 
+        // Remove the nodes inserted after the first `size`, which may not be referred to anymore
+        void truncate(size_t size) {
+            while (this->nodes.size() > size) {
+                this->cache.erase(this->nodes.back());
+                this->nodes.pop_back();
+            }
+        }
+
+        size_t memory_footprint() const {
+            return this->nodes.capacity() * sizeof(Octree::Node) + this->cache.memory_footprint();
+        }
+
         Octree build() && {
             this->nodes.shrink_to_fit();
             std::reverse(this->nodes.begin(), this->nodes.end());
@@ -97,7 +252,10 @@ namespace detail {
 
             for (auto& node : this->nodes) {
                 // If the node is a leaf, reset all of its child pointers to the root.
-                if (node.is_leaf()) {
+                // Bricks keep the index of their brick.
+                if (node.is_brick()) {
+                    continue;
+                } else if (node.is_leaf()) {
                     for (uint32_t& child : node.children) {
                         child = Octree::ROOT;
                     }
@@ -118,8 +276,38 @@ namespace detail {
         const SplitHeuristic& heuristic;
         OctreeBuilder<Cache> builder;
         ConstructionStats& stats;
+
+        // Only set when constructing a hybrid tree
+        const BrickParams* brick_params;
+        std::vector<Pixel>* brick_voxels;
     };
 
+    // Append the voxels of [offset, offset + extent) to `voxels`, where voxels outside the grid
+    // are black. Returns the number of voxels which are not black.
+    inline size_t gather_brick(const Grid& grid, const Vec3Sz& offset, size_t extent, std::vector<Pixel>& voxels) {
+        const auto dim = grid.dimensions();
+        size_t occupied = 0;
+
+        for (size_t z = offset.z; z < offset.z + extent; ++z) {
+            for (size_t y = offset.y; y < offset.y + extent; ++y) {
+                for (size_t x = offset.x; x < offset.x + extent; ++x) {
+                    auto voxel = Pixel{0, 0, 0, 0};
+                    if (x < dim.x && y < dim.y && z < dim.z) {
+                        voxel = grid.at({x, y, z});
+                    }
+
+                    if (voxel.r != 0 || voxel.g != 0 || voxel.b != 0) {
+                        ++occupied;
+                    }
+
+                    voxels.push_back(voxel);
+                }
+            }
+        }
+
+        return occupied;
+    }
+
     template <typename SplitHeuristic, typename Cache>
     uint32_t construct(Context<SplitHeuristic, Cache>& ctx, const Vec3Sz& offset, size_t extent, size_t depth) {
         ctx.stats.depth = std::max(ctx.stats.depth, depth);
@@ -159,8 +347,29 @@ namespace detail {
             offset.z + extent <= ctx.grid.dimensions().z;
 
         const auto [avg, split] = ctx.heuristic.grid_scan(ctx.grid, offset, extent);
+        const bool leaf = (!split && partly_in_grid) || extent == 1;
+
+        if (!leaf && ctx.brick_params && extent == ctx.brick_params->size) {
+            auto& voxels = *ctx.brick_voxels;
+            const size_t brick_begin = voxels.size();
+            const size_t occupied = gather_brick(ctx.grid, offset, extent, voxels);
+            const double density = static_cast<double>(occupied) / static_cast<double>(extent * extent * extent);
+
+            if (density >= ctx.brick_params->min_density) {
+                const auto node = Octree::Node{
+                    .children = {static_cast<uint32_t>(ctx.stats.bricks++)},
+                    .color = avg,
+                    .is_leaf_depth = Octree::LEAF | Octree::BRICK | static_cast<uint32_t>(depth),
+                };
+
+                return insert(node, true);
+            }
+
+            // Too sparse, continue constructing the tree instead
+            voxels.resize(brick_begin);
+        }
 
-        if ((!split && partly_in_grid) || extent == 1) {
+        if (leaf) {
             // This node is a leaf node
             const auto node = Octree::Node{
                 .children = {0},
@@ -194,7 +403,14 @@ namespace detail {
     }
 
     template <typename SplitHeuristic, typename Cache>
-    Octree build_octree(const Grid& grid, ConstructionStats& stats, const SplitHeuristic& heuristic, const Cache& cache) {
+    Octree build_octree(
+        const Grid& grid,
+        ConstructionStats& stats,
+        const SplitHeuristic& heuristic,
+        const Cache& cache,
+        const BrickParams* brick_params = nullptr,
+        std::vector<Pixel>* brick_voxels = nullptr
+    ) {
         // https://graphics.stanford.edu/~seander/bithacks.html#RoundUpPowerOf2
         const auto ceil_2pow = [](uint64_t x) {
             --x;
@@ -214,13 +430,127 @@ namespace detail {
             grid,
             heuristic,
             detail::OctreeBuilder(dim, cache),
-            stats
+            stats,
+            brick_params,
+            brick_voxels
         };
 
         detail::construct(context, Vec3Sz(0), dim, 0);
 
+        // The node list and cache are at their largest now, and after this only the octree itself remains
+        accounting::host_transient(accounting::HostCategory::Construction, context.builder.memory_footprint());
+
         return std::move(context.builder).build();
     }
+
+    struct ChunkedNode {
+        uint32_t index;
+        RegionSummary summary;
+    };
+
+    // Like construct, but regions of at most `chunk` voxels are constructed from a grid which is
+    // requested from the source, and the grid is released again afterwards. Whether a larger region
+    // is split is decided from the summaries of its children, after which the nodes of its children
+    // are discarded again if it becomes a leaf. Regions which the source reports as empty are not
+    // requested, but otherwise constructed as construct would, so the result is the same as
+    // build_octree of the whole volume. `empty` is set when the region is already known to be empty.
+    template <typename SplitHeuristic, typename Cache, typename Source>
+    ChunkedNode construct_chunked(
+        OctreeBuilder<Cache>& builder,
+        ConstructionStats& stats,
+        const SplitHeuristic& heuristic,
+        const Source& source,
+        const Vec3Sz& offset,
+        size_t extent,
+        size_t chunk,
+        size_t depth,
+        bool empty
+    ) {
+        stats.depth = std::max(stats.depth, depth);
+
+        auto insert_leaf = [&](Pixel color) {
+            const auto node = Octree::Node{
+                .children = {0},
+                .color = color,
+                .is_leaf_depth = Octree::LEAF | static_cast<uint32_t>(depth),
+            };
+
+            const auto [index, inserted] = builder.insert(node);
+            ++stats.total_nodes;
+            ++stats.total_leaves;
+            if (inserted) {
+                ++stats.unique_leaves;
+            }
+
+            return index;
+        };
+
+        const auto dim = source.dimensions();
+        if (offset.x >= dim.x || offset.y >= dim.y || offset.z >= dim.z) {
+            return {insert_leaf(Pixel{0, 0, 0, 0}), RegionSummary()};
+        }
+
+        // construct never makes a leaf of a region which is partly outside the volume, even if it is empty
+        const bool inside = offset.x + extent <= dim.x && offset.y + extent <= dim.y && offset.z + extent <= dim.z;
+        empty = empty || source.empty(offset, extent);
+
+        if (inside && empty) {
+            auto summary = RegionSummary();
+            summary.add(Pixel{0, 0, 0, 0}, extent * extent * extent);
+            return {insert_leaf(Pixel{0, 0, 0, 0}), summary};
+        }
+
+        if (extent <= chunk && !empty) {
+            const auto grid = source.grid(offset, extent);
+            auto context = Context<SplitHeuristic, Cache> {
+                grid,
+                heuristic,
+                std::move(builder),
+                stats,
+                nullptr,
+                nullptr
+            };
+
+            const uint32_t index = construct(context, Vec3Sz(0), extent, depth);
+            builder = std::move(context.builder);
+            return {index, RegionSummary::scan(grid)};
+        }
+
+        const auto stats_before = stats;
+        const size_t first_node = builder.nodes.size();
+        const size_t h_extent = extent / 2;
+        size_t child = 0;
+        auto summary = RegionSummary();
+
+        auto node = Octree::Node{
+            .children = {},
+            .color = Pixel{0, 0, 0, 0},
+            .is_leaf_depth = static_cast<uint32_t>(depth),
+        };
+
+        for (auto xoff : {size_t{0}, h_extent}) {
+            for (auto yoff : {size_t{0}, h_extent}) {
+                for (auto zoff : {size_t{0}, h_extent}) {
+                    const auto child_offset = Vec3Sz{offset.x + xoff, offset.y + yoff, offset.z + zoff};
+                    const auto result = construct_chunked(builder, stats, heuristic, source, child_offset, h_extent, chunk, depth + 1, empty);
+                    node.children[child++] = result.index;
+                    summary.combine(result.summary);
+                }
+            }
+        }
+
+        const auto [avg, split] = heuristic.summary_scan(summary);
+        if (!split && inside) {
+            // Only the children inserted the nodes since first_node, and nothing else refers to them
+            stats = stats_before;
+            builder.truncate(first_node);
+            return {insert_leaf(avg), summary};
+        }
+
+        node.color = avg;
+        ++stats.total_nodes;
+        return {builder.insert(node).first, summary};
+    }
 }
 
 template <typename SplitHeuristic>
@@ -236,4 +566,51 @@ Octree build_octree(const Grid& grid, ConstructionStats& stats, const SplitHeuri
     return std::move(octree);
 }
 
+// Construct an octree of a volume which is too large to be held in memory as a single grid.
+// The source provides `Vec3Sz dimensions()`, `Grid grid(offset, extent)`, which returns the
+// voxels of [offset, offset + extent) clipped to the volume, and `bool empty(offset, extent)`,
+// which may return true if that region has no voxels. At most one grid of `chunk`^3 voxels is
+// held at a time, where `chunk` is a power of 2. The octree is the same as that of build_octree,
+// except that StdDevHeuristic may decide differently on regions larger than a chunk, as the
+// standard deviation of those is rounded differently.
+template <typename SplitHeuristic, typename Source>
+Octree build_octree_chunked(const Source& source, size_t chunk, ConstructionStats& stats, const SplitHeuristic& heuristic, Octree::Type type) {
+    auto build = [&](auto cache) {
+        const auto src_dim = source.dimensions();
+        size_t dim = 1;
+        while (dim < std::max({src_dim.x, src_dim.y, src_dim.z})) {
+            dim *= 2;
+        }
+
+        auto builder = detail::OctreeBuilder(dim, cache);
+        detail::construct_chunked(builder, stats, heuristic, source, Vec3Sz(0), dim, chunk, 0, false);
+
+        accounting::host_transient(accounting::HostCategory::Construction, builder.memory_footprint());
+
+        return std::move(builder).build();
+    };
+
+    auto octree = type == Octree::Type::Dag ? build(HashCache{}) : build(NoopCache{});
+
+    if (type == Octree::Type::Rope) {
+        octree.generate_ropes();
+    }
+
+    return octree;
+}
+
+// Construct a hybrid tree, see BrickOctree. Ropes are not supported, as they would overwrite
+// the brick indices.
+template <typename SplitHeuristic>
+BrickOctree build_brick_octree(const Grid& grid, ConstructionStats& stats, const SplitHeuristic& heuristic, const BrickParams& params, bool dag) {
+    auto voxels = std::vector<Pixel>();
+
+    auto octree = dag ?
+        detail::build_octree(grid, stats, heuristic, HashCache{}, &params, &voxels) :
+        detail::build_octree(grid, stats, heuristic, NoopCache{}, &params, &voxels);
+
+    voxels.shrink_to_fit();
+    return BrickOctree(std::move(octree), params.size, std::move(voxels));
+}
+
 #endif
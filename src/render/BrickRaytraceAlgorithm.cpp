@@ -0,0 +1,263 @@
+#include "render/BrickRaytraceAlgorithm.h"
+#include <algorithm>
+#include <cmath>
+#include "resources.h"
+#include "graphics/utility.h"
+#include "core/Error.h"
+#include "core/Logger.h"
+
+namespace {
+    const auto BRICK_BINDINGS = std::array {
+        Binding {
+            2,
+            vk::DescriptorType::eStorageBuffer
+        },
+        Binding {
+            4,
+            vk::DescriptorType::eCombinedImageSampler
+        }
+    };
+
+    // Find the number of bricks along each axis of the atlas. The atlas is kept roughly cubic,
+    // as the maximum extent of a 3D image is the same along each axis.
+    Vec3Sz atlas_dimensions(size_t bricks, size_t brick_size, size_t max_extent) {
+        bricks = std::max(bricks, size_t{1});
+
+        const size_t max_bricks = max_extent / brick_size;
+        const auto side = std::min(static_cast<size_t>(std::ceil(std::cbrt(static_cast<double>(bricks)))), max_bricks);
+        const size_t layers = (bricks + side * side - 1) / (side * side);
+
+        if (layers > max_bricks) {
+            throw Error("Brick atlas of {} bricks does not fit in a 3D image", bricks);
+        }
+
+        return {side, side, layers};
+    }
+}
+
+BrickRaytraceResources::BrickRaytraceResources(const RenderDevice& rendev, const BrickOctree& octree, Vec3Sz atlas_dim):
+    node_buffer(
+        rendev.device,
+        octree.octree().data().size(),
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    ),
+    size(octree.octree().data().size()),
+    atlas_texture(
+        rendev.device,
+        vk::Format::eR8G8B8A8Unorm,
+        vk::Extent3D{
+            static_cast<uint32_t>(atlas_dim.x * octree.brick_size()),
+            static_cast<uint32_t>(atlas_dim.y * octree.brick_size()),
+            static_cast<uint32_t>(atlas_dim.z * octree.brick_size())
+        },
+        vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
+    ),
+    sampler(rendev.device->createSamplerUnique({
+        {},
+        vk::Filter::eNearest,
+        vk::Filter::eNearest,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge
+    })) {
+
+    const Span<Octree::Node> nodes = octree.octree().data();
+    const size_t brick_size = octree.brick_size();
+    const auto atlas_extent = atlas_dim * brick_size;
+
+    // The position of a brick in the atlas, in voxels
+    auto brick_position = [&](size_t brick) {
+        return Vec3Sz{
+            brick % atlas_dim.x,
+            brick / atlas_dim.x % atlas_dim.y,
+            brick / (atlas_dim.x * atlas_dim.y)
+        } * brick_size;
+    };
+
+    auto node_staging_buffer = Buffer<Octree::Node>(
+        rendev.device,
+        nodes.size(),
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+    );
+
+    {
+        Octree::Node* staging_nodes = node_staging_buffer.map(0, nodes.size());
+
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            staging_nodes[i] = nodes[i];
+
+            if (nodes[i].is_brick()) {
+                const auto pos = brick_position(nodes[i].children[0]);
+                staging_nodes[i].children[1] = static_cast<uint32_t>(pos.x);
+                staging_nodes[i].children[2] = static_cast<uint32_t>(pos.y);
+                staging_nodes[i].children[3] = static_cast<uint32_t>(pos.z);
+            }
+        }
+
+        node_staging_buffer.unmap();
+    }
+
+    const size_t atlas_voxels = atlas_extent.x * atlas_extent.y * atlas_extent.z;
+
+    auto atlas_staging_buffer = Buffer<Pixel>(
+        rendev.device,
+        atlas_voxels,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+    );
+
+    {
+        Pixel* mapping = atlas_staging_buffer.map(0, atlas_voxels);
+
+        // Rearrange the bricks into the atlas, so that it can be uploaded with a single copy
+        for (size_t brick = 0; brick < octree.num_bricks(); ++brick) {
+            const auto voxels = octree.brick(brick);
+            const auto pos = brick_position(brick);
+
+            for (size_t z = 0; z < brick_size; ++z) {
+                for (size_t y = 0; y < brick_size; ++y) {
+                    const size_t row = (pos.z + z) * atlas_extent.x * atlas_extent.y + (pos.y + y) * atlas_extent.x + pos.x;
+                    const auto* src = voxels.data() + (z * brick_size + y) * brick_size;
+                    std::copy(src, src + brick_size, mapping + row);
+                }
+            }
+        }
+
+        atlas_staging_buffer.unmap();
+    }
+
+    const auto node_copy_info = vk::BufferCopy{
+        0,
+        0,
+        nodes.size() * sizeof(Octree::Node)
+    };
+
+    const auto atlas_copy_info = vk::BufferImageCopy(
+        0,
+        0,
+        0,
+        vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+        {0, 0, 0},
+        vk::Extent3D{
+            static_cast<uint32_t>(atlas_extent.x),
+            static_cast<uint32_t>(atlas_extent.y),
+            static_cast<uint32_t>(atlas_extent.z)
+        }
+    );
+
+    rendev.compute_command_pool.one_time_submit([&, this](vk::CommandBuffer cmd_buf) {
+        cmd_buf.copyBuffer(node_staging_buffer.get(), this->node_buffer.get(), node_copy_info);
+
+        const auto initial_state = ImageState{
+            vk::ImageLayout::eUndefined,
+            vk::PipelineStageFlagBits::eTopOfPipe
+        };
+
+        const auto upload_state = ImageState{
+            vk::ImageLayout::eTransferDstOptimal,
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::AccessFlagBits::eTransferWrite
+        };
+
+        const auto render_state = ImageState{
+            vk::ImageLayout::eShaderReadOnlyOptimal,
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::AccessFlagBits::eShaderRead
+        };
+
+        image_transition(cmd_buf, this->atlas_texture.get(), initial_state, upload_state);
+
+        cmd_buf.copyBufferToImage(
+            atlas_staging_buffer.get(),
+            this->atlas_texture.get(),
+            upload_state.layout,
+            atlas_copy_info
+        );
+
+        image_transition(cmd_buf, this->atlas_texture.get(), upload_state, render_state);
+    });
+}
+
+void BrickRaytraceResources::update_descriptors(vk::DescriptorSet set) const {
+    const auto buffer_info = this->node_buffer.descriptor_info(0, this->size);
+
+    const auto image_info = vk::DescriptorImageInfo(
+        this->sampler.get(),
+        this->atlas_texture.view(),
+        vk::ImageLayout::eShaderReadOnlyOptimal
+    );
+
+    const auto descriptor_writes = std::array {
+        vk::WriteDescriptorSet(
+            set,
+            BRICK_BINDINGS[0].binding,
+            0,
+            1,
+            BRICK_BINDINGS[0].type,
+            nullptr,
+            &buffer_info,
+            nullptr
+        ),
+        vk::WriteDescriptorSet(
+            set,
+            BRICK_BINDINGS[1].binding,
+            0,
+            1,
+            BRICK_BINDINGS[1].type,
+            &image_info,
+            nullptr,
+            nullptr
+        )
+    };
+
+    this->node_buffer.device().updateDescriptorSets(descriptor_writes, nullptr);
+}
+
+BrickRaytraceAlgorithm::BrickRaytraceAlgorithm(std::string_view shader_source, std::shared_ptr<BrickOctree> octree, size_t bricks):
+    shader_source(shader_source),
+    octree(octree) {
+
+    if (bricks != 1) {
+        throw Error("Brick octrees cannot be rendered data-parallel");
+    }
+}
+
+std::string_view BrickRaytraceAlgorithm::shader() const {
+    return this->shader_source;
+}
+
+Span<Binding> BrickRaytraceAlgorithm::bindings() const {
+    return BRICK_BINDINGS;
+}
+
+size_t BrickRaytraceAlgorithm::bricks() const {
+    return 1;
+}
+
+Vec3<uint32_t> BrickRaytraceAlgorithm::brick_offset(size_t) const {
+    return {0, 0, 0};
+}
+
+std::unique_ptr<RenderResources> BrickRaytraceAlgorithm::upload_resources(const RenderDevice& rendev, size_t) const {
+    const auto limits = rendev.device.physical_device().getProperties().limits;
+    const auto atlas_dim = atlas_dimensions(this->octree->num_bricks(), this->octree->brick_size(), limits.maxImageDimension3D);
+
+    LOGGER.log(
+        "Brick atlas: {}x{}x{} bricks ({} MiB), nodes: {} MiB",
+        atlas_dim.x,
+        atlas_dim.y,
+        atlas_dim.z,
+        atlas_dim.x * atlas_dim.y * atlas_dim.z * this->octree->brick_volume() * sizeof(Pixel) / (1024 * 1024),
+        this->octree->nodes_footprint() / (1024 * 1024)
+    );
+
+    return std::make_unique<BrickRaytraceResources>(rendev, *this->octree, atlas_dim);
+}
+
+std::string_view BrickRaytraceAlgorithm::beam_shader() const {
+    // Brick leaves store the average color of their brick, so the octree pre-pass works as-is
+    return resources::open("resources/svo_beam.comp");
+}
@@ -0,0 +1,40 @@
+#ifndef _XENODON_RENDER_BRICKRAYTRACEALGORITHM_H
+#define _XENODON_RENDER_BRICKRAYTRACEALGORITHM_H
+
+#include <string_view>
+#include <memory>
+#include <cstddef>
+#include "render/RenderAlgorithm.h"
+#include "model/BrickOctree.h"
+#include "backend/RenderDevice.h"
+#include "graphics/memory/Buffer.h"
+#include "graphics/memory/Texture3D.h"
+
+class BrickRaytraceResources: public RenderResources {
+    Buffer<Octree::Node> node_buffer;
+    size_t size;
+    Texture3D atlas_texture;
+    vk::UniqueSampler sampler;
+
+public:
+    // The bricks are uploaded into a 3D atlas texture with `atlas_dim` bricks along each axis.
+    // Brick leaves are uploaded with the voxel offset of their brick in the atlas in children 1-3.
+    BrickRaytraceResources(const RenderDevice& rendev, const BrickOctree& octree, Vec3Sz atlas_dim);
+    void update_descriptors(vk::DescriptorSet set) const override;
+};
+
+class BrickRaytraceAlgorithm: public RenderAlgorithm {
+    std::string_view shader_source;
+    std::shared_ptr<BrickOctree> octree;
+
+public:
+    BrickRaytraceAlgorithm(std::string_view shader_source, std::shared_ptr<BrickOctree> octree, size_t bricks = 1);
+    std::string_view shader() const override;
+    Span<Binding> bindings() const override;
+    size_t bricks() const override;
+    Vec3<uint32_t> brick_offset(size_t brick) const override;
+    std::unique_ptr<RenderResources> upload_resources(const RenderDevice& rendev, size_t brick) const override;
+    std::string_view beam_shader() const override;
+};
+
+#endif
@@ -1,7 +1,8 @@
 #include "render/DdaRaytraceAlgorithm.h"
 #include <utility>
-#include "resources.h"
 #include "graphics/utility.h"
+#include "core/Error.h"
+#include "core/Logger.h"
 
 namespace {
     const auto DDA_BINDINGS = std::array {
@@ -12,14 +13,14 @@ namespace {
     };
 }
 
-DdaRaytraceResources::DdaRaytraceResources(const RenderDevice& rendev, const Grid& grid):
+DdaRaytraceResources::DdaRaytraceResources(const RenderDevice& rendev, Span<Pixel> pixels, Vec3Sz dim):
     grid_texture(
         rendev.device,
         vk::Format::eR8G8B8A8Unorm,
         vk::Extent3D{
-            static_cast<uint32_t>(grid.dimensions().x),
-            static_cast<uint32_t>(grid.dimensions().y),
-            static_cast<uint32_t>(grid.dimensions().z)
+            static_cast<uint32_t>(dim.x),
+            static_cast<uint32_t>(dim.y),
+            static_cast<uint32_t>(dim.z)
         },
         vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
     ),
@@ -40,14 +41,12 @@ DdaRaytraceResources::DdaRaytraceResources(const RenderDevice& rendev, const Gri
         vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
         {0, 0, 0},
         vk::Extent3D{
-            static_cast<uint32_t>(grid.dimensions().x),
-            static_cast<uint32_t>(grid.dimensions().y),
-            static_cast<uint32_t>(grid.dimensions().z)
+            static_cast<uint32_t>(dim.x),
+            static_cast<uint32_t>(dim.y),
+            static_cast<uint32_t>(dim.z)
         }
     );
 
-    const auto pixels = grid.pixels();
-
     auto staging_buffer = Buffer<Pixel>(
         rendev.device,
         pixels.size(),
@@ -117,18 +116,46 @@ void DdaRaytraceResources::update_descriptors(vk::DescriptorSet set) const {
     this->grid_texture.device().updateDescriptorSets(descriptor_write, nullptr);
 }
 
-DdaRaytraceAlgorithm::DdaRaytraceAlgorithm(std::shared_ptr<Grid> grid):
-    grid(grid) {
+DdaRaytraceAlgorithm::DdaRaytraceAlgorithm(std::string_view shader_source, std::shared_ptr<Grid> grid, size_t bricks):
+    shader_source(shader_source),
+    grid(grid),
+    num_bricks(bricks) {
+
+    if (this->grid->dimensions().z < bricks) {
+        throw Error("Volume depth {} is too small to divide into {} bricks", this->grid->dimensions().z, bricks);
+    }
 }
 
 std::string_view DdaRaytraceAlgorithm::shader() const {
-    return resources::open("resources/dda.comp");
+    return this->shader_source;
 }
 
 Span<Binding> DdaRaytraceAlgorithm::bindings() const {
     return DDA_BINDINGS;
 }
 
-std::unique_ptr<RenderResources> DdaRaytraceAlgorithm::upload_resources(const RenderDevice& rendev) const {
-    return std::make_unique<DdaRaytraceResources>(rendev, *this->grid.get());
+size_t DdaRaytraceAlgorithm::bricks() const {
+    return this->num_bricks;
+}
+
+Vec3<uint32_t> DdaRaytraceAlgorithm::brick_offset(size_t brick) const {
+    return {0, 0, static_cast<uint32_t>(this->slab_begin(brick))};
+}
+
+std::unique_ptr<RenderResources> DdaRaytraceAlgorithm::upload_resources(const RenderDevice& rendev, size_t brick) const {
+    const auto dim = this->grid->dimensions();
+    const size_t begin = this->slab_begin(brick);
+    const size_t end = this->slab_begin(brick + 1);
+    const size_t layer = dim.x * dim.y;
+
+    if (this->num_bricks > 1) {
+        LOGGER.log("Brick {}: layers {} to {} ({} MiB)", brick, begin, end, (end - begin) * layer * sizeof(Pixel) / (1024 * 1024));
+    }
+
+    const auto pixels = Span(layer * (end - begin), this->grid->pixels().data() + begin * layer);
+    return std::make_unique<DdaRaytraceResources>(rendev, pixels, Vec3Sz{dim.x, dim.y, end - begin});
+}
+
+size_t DdaRaytraceAlgorithm::slab_begin(size_t brick) const {
+    return brick * this->grid->dimensions().z / this->num_bricks;
 }
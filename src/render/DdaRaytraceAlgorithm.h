@@ -1,6 +1,7 @@
 #ifndef _XENODON_RENDER_DDARAYTRACEALGORITHM_H
 #define _XENODON_RENDER_DDARAYTRACEALGORITHM_H
 
+#include <string_view>
 #include <memory>
 #include "render/RenderAlgorithm.h"
 #include "model/Grid.h"
@@ -12,18 +13,27 @@ class DdaRaytraceResources: public RenderResources {
     vk::UniqueSampler sampler;
 
 public:
-    DdaRaytraceResources(const RenderDevice& rendev, const Grid& grid);
+    // Upload a part of a grid with the given dimensions
+    DdaRaytraceResources(const RenderDevice& rendev, Span<Pixel> pixels, Vec3Sz dim);
     void update_descriptors(vk::DescriptorSet set) const override;
 };
 
 class DdaRaytraceAlgorithm: public RenderAlgorithm {
+    std::string_view shader_source;
     std::shared_ptr<Grid> grid;
+    size_t num_bricks;
 
 public:
-    DdaRaytraceAlgorithm(std::shared_ptr<Grid> grid);
+    // The grid is divided into slabs along the z-axis, so that every brick is contiguous in memory
+    DdaRaytraceAlgorithm(std::string_view shader_source, std::shared_ptr<Grid> grid, size_t bricks = 1);
     std::string_view shader() const override;
     Span<Binding> bindings() const override;
-    std::unique_ptr<RenderResources> upload_resources(const RenderDevice& rendev) const override;
+    size_t bricks() const override;
+    Vec3<uint32_t> brick_offset(size_t brick) const override;
+    std::unique_ptr<RenderResources> upload_resources(const RenderDevice& rendev, size_t brick) const override;
+
+private:
+    size_t slab_begin(size_t brick) const;
 };
 
 #endif
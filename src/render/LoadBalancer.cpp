@@ -0,0 +1,117 @@
+#include "render/LoadBalancer.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include "core/Logger.h"
+
+namespace {
+    // The relative difference between the slowest device and the average, in percent
+    double imbalance(const std::vector<double>& times) {
+        const double total = std::accumulate(times.begin(), times.end(), 0.0);
+        if (total <= 0) {
+            return 0;
+        }
+
+        const double avg = total / static_cast<double>(times.size());
+        return (*std::max_element(times.begin(), times.end()) / avg - 1.0) * 100.0;
+    }
+}
+
+LoadBalancer::LoadBalancer(MultiplexRenderer& renderer, size_t interval):
+    display_region(renderer.display_region()),
+    interval(interval),
+    frames(0),
+    rows(renderer.num_devices()),
+    rays(renderer.num_devices(), 0),
+    render_times(renderer.num_devices(), 0) {
+
+    const size_t n = renderer.num_devices();
+    const uint32_t height = this->display_region.extent.height;
+
+    for (size_t i = 0; i < n; ++i) {
+        this->rows[i] = static_cast<uint32_t>((i + 1) * height / n - i * height / n);
+    }
+
+    LOGGER.log("Balancing load over {} devices every {} frames", n, interval);
+    this->apply(renderer);
+}
+
+void LoadBalancer::update(MultiplexRenderer& renderer) {
+    const size_t n = this->rows.size();
+
+    for (size_t i = 0; i < n; ++i) {
+        const auto stats = renderer.device_renderer(i).stats();
+        this->rays[i] += stats.total_rays;
+        this->render_times[i] += stats.total_render_time;
+    }
+
+    if (++this->frames < this->interval) {
+        return;
+    }
+
+    // Rays per ms each device achieved. Every row of a frame has the same number of rays on
+    // all devices, so this is proportional to the rows per ms. A device should at least get
+    // a single row.
+    auto speeds = std::vector<double>(n);
+    for (size_t i = 0; i < n; ++i) {
+        speeds[i] = static_cast<double>(this->rays[i]) / std::max(this->render_times[i], 1e-6);
+    }
+
+    const double total_speed = std::accumulate(speeds.begin(), speeds.end(), 0.0);
+    const uint32_t height = this->display_region.extent.height;
+
+    // Distribute the rows using the largest remainder method
+    auto new_rows = std::vector<uint32_t>(n);
+    auto remainders = std::vector<std::pair<double, size_t>>(n);
+    uint32_t assigned = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const double share = static_cast<double>(height - n) * speeds[i] / total_speed;
+        new_rows[i] = 1 + static_cast<uint32_t>(std::floor(share));
+        remainders[i] = {share - std::floor(share), i};
+        assigned += new_rows[i];
+    }
+
+    std::sort(remainders.begin(), remainders.end(), std::greater<>());
+    for (size_t i = 0; assigned < height; ++i, ++assigned) {
+        ++new_rows[remainders[i % n].second];
+    }
+
+    // The expected time of each device relative to the others, assuming the cost per row stays the same
+    auto expected_times = std::vector<double>(n);
+    for (size_t i = 0; i < n; ++i) {
+        expected_times[i] = static_cast<double>(new_rows[i]) / speeds[i];
+    }
+
+    LOGGER.log(
+        "Load imbalance over the last {} frames: {:.1f}%, expected after rebalancing: {:.1f}%",
+        this->frames,
+        imbalance(this->render_times),
+        imbalance(expected_times)
+    );
+
+    this->frames = 0;
+    std::fill(this->rays.begin(), this->rays.end(), 0);
+    std::fill(this->render_times.begin(), this->render_times.end(), 0);
+
+    if (new_rows != this->rows) {
+        this->rows = std::move(new_rows);
+        this->apply(renderer);
+    }
+}
+
+void LoadBalancer::apply(MultiplexRenderer& renderer) {
+    auto regions = std::vector<vk::Rect2D>(this->rows.size());
+    int32_t y = this->display_region.offset.y;
+
+    for (size_t i = 0; i < this->rows.size(); ++i) {
+        regions[i] = vk::Rect2D(
+            {this->display_region.offset.x, y},
+            {this->display_region.extent.width, this->rows[i]}
+        );
+
+        y += static_cast<int32_t>(this->rows[i]);
+    }
+
+    renderer.set_regions(regions);
+}
@@ -0,0 +1,34 @@
+#ifndef _XENODON_RENDER_LOADBALANCER_H
+#define _XENODON_RENDER_LOADBALANCER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <vulkan/vulkan.hpp>
+#include "render/MultiplexRenderer.h"
+
+// Distributes the rows of the display region over the render devices, proportional to the
+// speed at which each device rendered its rows over the last few frames. Every device renders
+// one horizontal band of the display. Requires a display which supports dynamic regions.
+// The speed is measured in rays, which are recorded with each frame, as the statistics lag
+// behind and may still belong to frames rendered with a previous partition.
+class LoadBalancer {
+    vk::Rect2D display_region;
+    size_t interval;
+    size_t frames;
+    std::vector<uint32_t> rows;
+    std::vector<size_t> rays;
+    std::vector<double> render_times;
+
+public:
+    // Initially splits the display region evenly. The partition is updated every interval frames.
+    LoadBalancer(MultiplexRenderer& renderer, size_t interval);
+
+    // Should be called after every frame
+    void update(MultiplexRenderer& renderer);
+
+private:
+    void apply(MultiplexRenderer& renderer);
+};
+
+#endif
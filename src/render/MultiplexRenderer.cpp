@@ -1,12 +1,26 @@
 #include "render/MultiplexRenderer.h"
+#include <algorithm>
+#include <cassert>
+#include <fmt/format.h>
+#include "core/Logger.h"
+#include "core/Trace.h"
 
-MultiplexRenderer::MultiplexRenderer(Display* display, std::unique_ptr<RenderAlgorithm>&& algorithm, const ShaderParameters& shader_params):
-    ctx(std::make_shared<RenderContext>(display, std::move(algorithm), shader_params)) {
+MultiplexRenderer::MultiplexRenderer(Display* display, std::unique_ptr<RenderAlgorithm>&& algorithm, const ShaderParameters& shader_params, bool dynamic_resolution, double tile_budget, bool beam, const Instrumentation& instrumentation):
+    ctx(std::make_shared<RenderContext>(display, std::move(algorithm), shader_params, dynamic_resolution, tile_budget, beam, instrumentation)),
+    stats_device(0) {
 
     const size_t n = display->num_render_devices();
     for (size_t i = 0; i < n; ++i) {
         this->renderers.emplace_back(this->ctx, i);
     }
+
+    // When frames are rendered in parallel, only one device is active per frame
+    if (n > 1 && !display->frame_parallel()) {
+        LOGGER.log("Using {} render threads", n);
+        for (size_t i = 0; i < n; ++i) {
+            this->threads.push_back(std::make_unique<RenderThread>(fmt::format("Render thread {}", i)));
+        }
+    }
 }
 
 void MultiplexRenderer::recreate(size_t device, size_t output) {
@@ -18,24 +32,174 @@ void MultiplexRenderer::recreate(size_t device, size_t output) {
     }
 }
 
-void MultiplexRenderer::render(const Camera& cam) {
+void MultiplexRenderer::set_regions(const std::vector<vk::Rect2D>& regions) {
+    // Change the regions of all devices first, so that the display rect is only calculated for
+    // the final configuration
+    for (size_t device = 0; device < this->renderers.size(); ++device) {
+        this->ctx->display->set_output_region(device, 0, regions[device]);
+    }
+
+    this->ctx->calculate_display_rect();
+
+    for (auto& renderer : this->renderers) {
+        renderer.recreate(0);
+    }
+}
+
+void MultiplexRenderer::set_render_scale(float scale) {
     for (auto& renderer : this->renderers) {
+        renderer.set_render_scale(scale);
+    }
+}
+
+void MultiplexRenderer::render(const Camera& cam) {
+    if (this->ctx->display->frame_parallel()) {
+        this->render_frame_parallel(cam);
+        return;
+    }
+
+    this->for_each_renderer([&cam](Renderer& renderer) {
         renderer.render(cam);
+    });
+
+    {
+        TRACE_SCOPE("Display::swap_buffers");
+        this->ctx->display->swap_buffers();
+    }
+
+    // Waiting for the results of one device should not delay the others
+    this->for_each_renderer([](Renderer& renderer) {
+        renderer.collect_stats();
+    });
+}
+
+bool MultiplexRenderer::render_slice(const Camera& cam) {
+    if (this->ctx->tile_budget <= 0) {
+        this->render(cam);
+        return true;
     }
 
-    this->ctx->display->swap_buffers();
+    auto* display = this->ctx->display;
+    bool finished = true;
 
-    for (auto& renderer : this->renderers) {
+    // Slices are submitted without waiting for them, so the render threads are not needed
+    if (display->frame_parallel()) {
+        this->stats_device = display->frame_device();
+        finished = this->renderers[this->stats_device].render_slice(cam);
+    } else {
+        for (auto& renderer : this->renderers) {
+            finished = renderer.render_slice(cam) && finished;
+        }
+    }
+
+    if (!finished) {
+        return false;
+    }
+
+    {
+        TRACE_SCOPE("Display::swap_buffers");
+        display->swap_buffers();
+    }
+
+    if (display->frame_parallel()) {
+        this->renderers[this->stats_device].collect_stats();
+    } else {
+        this->for_each_renderer([](Renderer& renderer) {
+            renderer.collect_stats();
+        });
+    }
+
+    return true;
+}
+
+bool MultiplexRenderer::frame_in_progress() const {
+    return std::any_of(this->renderers.begin(), this->renderers.end(), [](const Renderer& renderer) {
+        return renderer.frame_in_progress();
+    });
+}
+
+void MultiplexRenderer::render_batch(Span<Camera> cams) {
+    assert(!this->ctx->display->frame_parallel());
+
+    this->for_each_renderer([&cams](Renderer& renderer) {
+        renderer.render_batch(cams);
+    });
+
+    {
+        TRACE_SCOPE("Display::swap_batch");
+        this->ctx->display->swap_batch(cams.size());
+    }
+
+    this->for_each_renderer([](Renderer& renderer) {
         renderer.collect_stats();
+    });
+}
+
+size_t MultiplexRenderer::stats_frames() const {
+    if (this->ctx->display->frame_parallel()) {
+        return this->renderers[this->stats_device].stats_frames();
     }
+
+    // All devices render the same frames
+    return this->renderers.front().stats_frames();
 }
 
-RenderStats MultiplexRenderer::stats() const {
+RenderStats MultiplexRenderer::stats(size_t frame) const {
+    if (this->ctx->display->frame_parallel()) {
+        return this->renderers[this->stats_device].stats(frame);
+    }
+
     auto stats = RenderStats();
 
     for (const auto& renderer : this->renderers) {
-        stats.combine(renderer.stats());
+        stats.combine(renderer.stats(frame));
     }
 
     return stats;
-}
\ No newline at end of file
+}
+
+std::vector<RenderStats> MultiplexRenderer::finish_stats() {
+    auto all_stats = std::vector<RenderStats>();
+
+    if (this->ctx->display->frame_parallel()) {
+        // The device of the next frame rendered the oldest frame that is still in flight
+        const size_t n = this->renderers.size();
+        const size_t next = this->ctx->display->frame_device();
+
+        for (size_t i = 0; i < n; ++i) {
+            this->stats_device = (next + i) % n;
+            auto& renderer = this->renderers[this->stats_device];
+            renderer.finish_stats();
+
+            if (renderer.stats_frames() > 0) {
+                all_stats.push_back(renderer.stats());
+            }
+        }
+
+        return all_stats;
+    }
+
+    this->for_each_renderer([](Renderer& renderer) {
+        renderer.finish_stats();
+    });
+
+    for (size_t frame = 0; frame < this->stats_frames(); ++frame) {
+        all_stats.push_back(this->stats(frame));
+    }
+
+    return all_stats;
+}
+
+void MultiplexRenderer::render_frame_parallel(const Camera& cam) {
+    this->stats_device = this->ctx->display->frame_device();
+    auto& renderer = this->renderers[this->stats_device];
+    renderer.render(cam);
+
+    {
+        TRACE_SCOPE("Display::swap_buffers");
+        this->ctx->display->swap_buffers();
+    }
+
+    // The previous frame of this device was submitted one round ago, so it has most likely finished
+    renderer.collect_stats();
+}
@@ -7,20 +7,101 @@
 #include "render/Renderer.h"
 #include "render/RenderContext.h"
 #include "render/RenderStats.h"
+#include "render/RenderThread.h"
 #include "camera/Camera.h"
 #include "backend/Display.h"
+#include "utility/Span.h"
 
 class MultiplexRenderer {
     std::shared_ptr<RenderContext> ctx;
     std::vector<Renderer> renderers;
 
+    // With multiple devices, each device submits its work and waits for its results on its own thread
+    std::vector<std::unique_ptr<RenderThread>> threads;
+
+    // When frames are rendered in parallel, the device which rendered the frame of which
+    // the statistics were collected last
+    size_t stats_device;
+
 public:
     using ShaderParameters = RenderContext::ShaderParameters;
+    using Instrumentation = RenderContext::Instrumentation;
 
-    MultiplexRenderer(Display* display, std::unique_ptr<RenderAlgorithm>&& algorithm, const ShaderParameters& shader_params);
+    MultiplexRenderer(Display* display, std::unique_ptr<RenderAlgorithm>&& algorithm, const ShaderParameters& shader_params, bool dynamic_resolution = false, double tile_budget = 0, bool beam = false, const Instrumentation& instrumentation = Instrumentation());
     void recreate(size_t device, size_t output);
+    void set_regions(const std::vector<vk::Rect2D>& regions);
+    void set_render_scale(float scale);
     void render(const Camera& cam);
-    RenderStats stats() const;
+
+    // Like render, but when rendering in time slices, only submit the slices whose previous
+    // slice has finished, without waiting for the devices. Returns whether the frame has been
+    // completed and presented, so that events can be handled between slices. A new frame
+    // with `cam` is started when none is in progress.
+    bool render_slice(const Camera& cam);
+    bool frame_in_progress() const;
+
+    // Render up to Display::batch_size frames in one submission per device
+    void render_batch(Span<Camera> cams);
+
+    // Statistics are collected one frame or batch behind, so that the host does not wait
+    // for the frame it just submitted, see Renderer::collect_stats. stats_frames returns the
+    // number of frames of which statistics were collected during the last render or batch,
+    // which is 0 for the first one, and stats returns those of one of these frames.
+    size_t stats_frames() const;
+    RenderStats stats(size_t frame = 0) const;
+
+    // Wait for all frames in flight, and return the statistics of those which were not
+    // returned by stats yet, oldest first
+    std::vector<RenderStats> finish_stats();
+
+    size_t num_devices() const {
+        return this->renderers.size();
+    }
+
+    Renderer& device_renderer(size_t device) {
+        return this->renderers[device];
+    }
+
+    vk::Rect2D display_region() const {
+        return this->ctx->display_region;
+    }
+
+private:
+    void render_frame_parallel(const Camera& cam);
+
+    template <typename F>
+    void for_each_renderer(F f);
 };
 
+template <typename F>
+void MultiplexRenderer::for_each_renderer(F f) {
+    if (this->threads.empty()) {
+        for (auto& renderer : this->renderers) {
+            f(renderer);
+        }
+
+        return;
+    }
+
+    for (size_t i = 0; i < this->renderers.size(); ++i) {
+        this->threads[i]->run([&f, &renderer = this->renderers[i]] {
+            f(renderer);
+        });
+    }
+
+    // Wait for all threads before continuing, even if one of them failed
+    std::exception_ptr error;
+    for (auto& thread : this->threads) {
+        try {
+            thread->wait();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
 #endif
@@ -6,6 +6,7 @@
 #include <vulkan/vulkan.hpp>
 #include "backend/RenderDevice.h"
 #include "utility/Span.h"
+#include "math/Vec.h"
 
 struct Binding {
     uint32_t binding;
@@ -21,7 +22,21 @@ struct RenderAlgorithm {
     virtual ~RenderAlgorithm() = default;
     virtual std::string_view shader() const = 0;
     virtual Span<Binding> bindings() const = 0;
-    virtual std::unique_ptr<RenderResources> upload_resources(const RenderDevice& rendev) const = 0;
+
+    // The volume is divided into a number of bricks. In data-parallel mode every device renders
+    // its own brick, and the partial frames are summed. Otherwise there is a single brick.
+    virtual size_t bricks() const = 0;
+
+    // The offset of a brick in the volume, in voxels, which is passed to the shader
+    virtual Vec3<uint32_t> brick_offset(size_t brick) const = 0;
+
+    virtual std::unique_ptr<RenderResources> upload_resources(const RenderDevice& rendev, size_t brick) const = 0;
+
+    // Algorithms which support the beam optimization pre-pass return its shader, see
+    // resources/beam.glsl. Their shaders then also declare the beam buffer binding.
+    virtual std::string_view beam_shader() const {
+        return "";
+    }
 };
 
 
@@ -22,10 +22,14 @@ namespace {
     };
 }
 
-RenderContext::RenderContext(Display* display, std::unique_ptr<RenderAlgorithm>&& algorithm, const ShaderParameters& shader_params):
+RenderContext::RenderContext(Display* display, std::unique_ptr<RenderAlgorithm>&& algorithm, const ShaderParameters& shader_params, bool dynamic_resolution, double tile_budget, bool beam, const Instrumentation& instrumentation):
     display(display),
     algorithm(std::move(algorithm)),
-    shader_params(shader_params) {
+    shader_params(shader_params),
+    dynamic_resolution(dynamic_resolution),
+    tile_budget(tile_budget),
+    beam(beam),
+    instrumentation(instrumentation) {
     this->calculate_display_rect();
 
     std::copy(COMMON_BINDINGS.begin(), COMMON_BINDINGS.end(), std::back_inserter(this->bindings));
@@ -38,6 +42,28 @@ RenderContext::RenderContext(Display* display, std::unique_ptr<RenderAlgorithm>&
             vk::ShaderStageFlagBits::eCompute
         );
     }
+
+    if (!this->algorithm->beam_shader().empty()) {
+        this->beam_binding = vk::DescriptorSetLayoutBinding(
+            3, // layout(binding = 3) restrict buffer BeamBuffer
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        );
+
+        this->bindings.push_back(this->beam_binding.value());
+    }
+
+    if (this->instrumentation.enabled) {
+        this->counter_binding = vk::DescriptorSetLayoutBinding(
+            5, // layout(binding = 5) restrict writeonly buffer CounterBuffer
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        );
+
+        this->bindings.push_back(this->counter_binding.value());
+    }
 }
 
 void RenderContext::calculate_display_rect() {
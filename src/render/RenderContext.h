@@ -3,7 +3,9 @@
 
 #include <memory>
 #include <vector>
+#include <optional>
 #include <cstddef>
+#include <cstdint>
 #include <vulkan/vulkan.hpp>
 #include "backend/Display.h"
 #include "backend/Output.h"
@@ -13,19 +15,56 @@
 #include "math/Vec.h"
 
 struct RenderContext {
+    // Parameters which are passed to the shader as specialization constants
     struct ShaderParameters {
-        Vec4F voxel_ratio;
-        Vec4<unsigned> model_dim;
+        Vec3F voxel_ratio;
+        Vec3<uint32_t> model_dim;
         float emission_coeff;
     };
 
+    // The counter of the instrumented shaders which is shown instead of the color, see HEATMAP
+    // in instrument.glsl
+    enum class HeatmapCounter: uint32_t {
+        None = 0,
+        NodeFetches = 1,
+        StackOps = 2,
+        Steps = 3
+    };
+
+    // When enabled, the algorithm renders with the instrumented variant of its shader, which counts
+    // the traversal work of every ray into a counter buffer, see Renderer::collect_stats
+    struct Instrumentation {
+        bool enabled = false;
+        HeatmapCounter heatmap = HeatmapCounter::None;
+
+        // The count at the top of the heatmap color scale
+        float heatmap_max = 1024;
+    };
+
     Display* display;
     std::unique_ptr<RenderAlgorithm> algorithm;
     ShaderParameters shader_params;
     vk::Rect2D display_region;
     std::vector<vk::DescriptorSetLayoutBinding> bindings;
 
-    RenderContext(Display* display, std::unique_ptr<RenderAlgorithm>&& algorithm, const ShaderParameters& shader_params);
+    // Render into an intermediate image which is upscaled to the output, so that the
+    // resolution can be changed every frame, see Renderer::set_render_scale
+    bool dynamic_resolution;
+
+    // When nonzero, every output is rendered in tiles over several submissions, each of
+    // which should take about this many ms, see Renderer::render_slice
+    double tile_budget;
+
+    // Run the beam optimization pre-pass before every frame. The binding of its results is
+    // present whenever the algorithm supports it, even if the pre-pass is disabled.
+    bool beam;
+    std::optional<vk::DescriptorSetLayoutBinding> beam_binding;
+
+    // The counter buffer binding is only present when instrumenting
+    Instrumentation instrumentation;
+    std::optional<vk::DescriptorSetLayoutBinding> counter_binding;
+
+    RenderContext(Display* display, std::unique_ptr<RenderAlgorithm>&& algorithm, const ShaderParameters& shader_params, bool dynamic_resolution, double tile_budget, bool beam, const Instrumentation& instrumentation);
     void calculate_display_rect();
 };
 
@@ -2,12 +2,42 @@
 #include <array>
 #include <algorithm>
 #include <fstream>
+#include <cassert>
 #include <fmt/format.h>
 #include "core/Error.h"
+#include "core/Trace.h"
 
 namespace {
     // For each output, 2 queries must be made: start and end time
     constexpr const uint32_t QUERY_COUNT = 2;
+
+    // Every ray has a uvec4 of counters in the counter buffer of instrument.glsl
+    constexpr const size_t COUNTERS_PER_RAY = 4;
+}
+
+void TraversalCounters::add(const uint32_t* counters, size_t rays) {
+    this->rays += rays;
+
+    for (size_t i = 0; i < rays; ++i) {
+        const uint32_t* ray = &counters[i * COUNTERS_PER_RAY];
+        this->node_fetches += ray[0];
+        this->stack_ops += ray[1];
+        this->steps += ray[2];
+        this->max_node_fetches = std::max(this->max_node_fetches, ray[0]);
+        this->max_stack_ops = std::max(this->max_stack_ops, ray[1]);
+        this->max_steps = std::max(this->max_steps, ray[2]);
+    }
+}
+
+TraversalCounters& TraversalCounters::combine(const TraversalCounters& other) {
+    this->rays += other.rays;
+    this->node_fetches += other.node_fetches;
+    this->stack_ops += other.stack_ops;
+    this->steps += other.steps;
+    this->max_node_fetches = std::max(this->max_node_fetches, other.max_node_fetches);
+    this->max_stack_ops = std::max(this->max_stack_ops, other.max_stack_ops);
+    this->max_steps = std::max(this->max_steps, other.max_steps);
+    return *this;
 }
 
 RenderStats& RenderStats::combine(const RenderStats& other) {
@@ -16,6 +46,10 @@ RenderStats& RenderStats::combine(const RenderStats& other) {
     this->total_render_time += other.total_render_time;
     this->max_render_time = std::max(this->max_render_time, other.max_render_time);
     this->min_render_time = std::min(this->min_render_time, other.min_render_time);
+
+    // All devices render a frame at the same scale
+    this->render_scale = other.render_scale;
+    this->counters.combine(other.counters);
     return *this;
 }
 
@@ -24,61 +58,146 @@ double RenderStats::mrays_per_s() const {
 }
 
 RenderStatsCollector::RenderStatsCollector(Display* display, size_t device_index):
-    rendev(&display->render_device(device_index)) {
+    display(display),
+    device_index(device_index),
+    rendev(&display->render_device(device_index)),
+    batch_size(display->batch_size()),
+    swap_images(0),
+    frame_stats(this->batch_size),
+    calibration_ticks(0),
+    calibration_time(0) {
 
-    this->current_stats.outputs = this->rendev->outputs;
-    for (size_t output_index = 0; output_index < this->rendev->outputs; ++output_index) {
-        const auto region = display->output(device_index, output_index)->region();
-        this->current_stats.total_rays += region.extent.width * region.extent.height;
+    for (auto& stats : this->frame_stats) {
+        stats.outputs = this->rendev->outputs;
+    }
+
+    this->timestamp_buffer.resize(this->batch_size * this->rendev->outputs * QUERY_COUNT);
+    this->create_query_pool();
+
+    if (trace::enabled()) {
+        this->calibrate();
     }
+}
 
-    const uint32_t query_count = this->rendev->outputs * QUERY_COUNT;
+void RenderStatsCollector::create_query_pool() {
+    this->swap_images = 0;
+    for (size_t output_index = 0; output_index < this->rendev->outputs; ++output_index) {
+        this->swap_images = std::max(this->swap_images, this->display->output(this->device_index, output_index)->num_swap_images());
+    }
 
     this->query_pool = this->rendev->device->createQueryPoolUnique({
         {},
         vk::QueryType::eTimestamp,
-        query_count
+        static_cast<uint32_t>(this->swap_images * this->rendev->outputs * QUERY_COUNT)
     });
-
-    this->timestamp_buffer.resize(query_count);
 }
 
-void RenderStatsCollector::pre_dispatch(size_t output_index, vk::CommandBuffer cmd_buf) {
-    uint32_t query_index = static_cast<uint32_t>(output_index) * QUERY_COUNT;
+void RenderStatsCollector::pre_dispatch(size_t output_index, uint32_t swap_index, vk::CommandBuffer cmd_buf) {
+    uint32_t query_index = this->query_index(output_index, swap_index);
     cmd_buf.resetQueryPool(this->query_pool.get(), query_index, QUERY_COUNT);
     // Submit begin query
     cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, this->query_pool.get(), query_index);
 }
 
-void RenderStatsCollector::post_dispatch(size_t output_index, vk::CommandBuffer cmd_buf) {
-    uint32_t query_index = static_cast<uint32_t>(output_index) * QUERY_COUNT;
+void RenderStatsCollector::post_dispatch(size_t output_index, uint32_t swap_index, vk::CommandBuffer cmd_buf) {
+    uint32_t query_index = this->query_index(output_index, swap_index);
     // Submit end query
     cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, this->query_pool.get(), query_index + 1);
 }
 
-void RenderStatsCollector::collect() {
-    // This function should be called after Display::swap_buffers, to make sure all command queues are processed
+void RenderStatsCollector::collect(Span<uint32_t> swap_indices, size_t frames, size_t rays, float render_scale) {
+    assert(swap_indices.size() == this->rendev->outputs && frames <= this->batch_size);
+
+    // The timestamps are gathered in the order of the frames of the batch, and then by output
+    for (size_t frame = 0; frame < frames; ++frame) {
+        for (size_t output_index = 0; output_index < this->rendev->outputs; ++output_index) {
+            const auto swap_index = swap_indices[output_index] + static_cast<uint32_t>(frame);
+
+            this->rendev->device->getQueryPoolResults(
+                this->query_pool.get(),
+                this->query_index(output_index, swap_index),
+                QUERY_COUNT,
+                QUERY_COUNT * sizeof(uint64_t),
+                &this->timestamp_buffer[(frame * this->rendev->outputs + output_index) * QUERY_COUNT],
+                sizeof(uint64_t),
+                vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+            );
+        }
+    }
+
+    for (size_t frame = 0; frame < frames; ++frame) {
+        auto& stats = this->frame_stats[frame];
+        stats.total_rays = rays;
+        stats.render_scale = render_scale;
+        stats.total_render_time = 0;
+        stats.max_render_time = 0;
+        stats.min_render_time = std::numeric_limits<double>::max();
+
+        const size_t begin = frame * this->rendev->outputs * QUERY_COUNT;
+        const size_t end = begin + this->rendev->outputs * QUERY_COUNT;
+
+        for (size_t i = begin; i < end; i += QUERY_COUNT) {
+            uint64_t diff = this->timestamp_buffer[i + 1] - this->timestamp_buffer[i];
+            double time = static_cast<double>(diff) * static_cast<double>(this->rendev->timestamp_period) / 1'000'000.0;
+            stats.total_render_time += time;
+            stats.max_render_time = std::max(stats.max_render_time, time);
+            stats.min_render_time = std::min(stats.min_render_time, time);
+        }
+    }
+
+    if (trace::enabled()) {
+        this->trace_dispatches(frames);
+    }
+}
+
+uint32_t RenderStatsCollector::query_index(size_t output_index, uint32_t swap_index) const {
+    assert(swap_index < this->swap_images);
+    return static_cast<uint32_t>(swap_index * this->rendev->outputs + output_index) * QUERY_COUNT;
+}
+
+void RenderStatsCollector::calibrate() {
+    // Write a timestamp from an otherwise empty submission, and relate it to the host time halfway
+    // between submitting and its completion. GPU events in the trace are thus only accurate up to
+    // about half of the submission latency.
+    int64_t submitted = 0;
+    this->rendev->compute_command_pool.one_time_submit([&, this](vk::CommandBuffer cmd_buf) {
+        cmd_buf.resetQueryPool(this->query_pool.get(), 0, 1);
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, this->query_pool.get(), 0);
+        submitted = trace::now();
+    });
+
+    const int64_t completed = trace::now();
 
     this->rendev->device->getQueryPoolResults(
         this->query_pool.get(),
         0,
-        static_cast<uint32_t>(this->timestamp_buffer.size()),
-        static_cast<uint32_t>(this->timestamp_buffer.size()) * sizeof(uint64_t),
-        this->timestamp_buffer.data(),
+        1,
+        sizeof(uint64_t),
+        &this->calibration_ticks,
         sizeof(uint64_t),
-        vk::QueryResultFlagBits::e64
+        vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
     );
 
-    this->current_stats.total_render_time = 0;
-    this->current_stats.max_render_time = 0;
-    this->current_stats.min_render_time = std::numeric_limits<double>::max();
+    this->calibration_time = submitted + (completed - submitted) / 2;
+}
+
+void RenderStatsCollector::trace_dispatches(size_t frames) const {
+    auto to_host_time = [this](uint64_t ticks) {
+        const double diff = static_cast<double>(static_cast<int64_t>(ticks - this->calibration_ticks));
+        return this->calibration_time + static_cast<int64_t>(diff * static_cast<double>(this->rendev->timestamp_period));
+    };
 
-    for (size_t i = 0; i < this->timestamp_buffer.size(); i += QUERY_COUNT) {
-        uint64_t diff = this->timestamp_buffer[i + 1] - this->timestamp_buffer[i];
-        double time = static_cast<double>(diff) * static_cast<double>(this->rendev->timestamp_period) / 1'000'000.0;
-        this->current_stats.total_render_time += time;
-        this->current_stats.max_render_time = std::max(this->current_stats.max_render_time, time);
-        this->current_stats.min_render_time = std::min(this->current_stats.min_render_time, time);
+    for (size_t frame = 0; frame < frames; ++frame) {
+        for (size_t output_index = 0; output_index < this->rendev->outputs; ++output_index) {
+            const size_t i = (frame * this->rendev->outputs + output_index) * QUERY_COUNT;
+            trace::record_gpu(
+                this->device_index,
+                output_index,
+                "dispatch",
+                to_host_time(this->timestamp_buffer[i]),
+                to_host_time(this->timestamp_buffer[i + 1])
+            );
+        }
     }
 }
 
@@ -124,6 +243,15 @@ size_t RenderStatsAccumulator::frames() const {
     return this->all_stats.size();
 }
 
+TraversalCounters RenderStatsAccumulator::total_counters() const {
+    auto counters = TraversalCounters();
+    for (const auto& stats : this->all_stats) {
+        counters.combine(stats.counters);
+    }
+
+    return counters;
+}
+
 void RenderStatsAccumulator::save(std::filesystem::path path) const {
     fmt::memory_buffer out;
 
@@ -132,6 +260,15 @@ void RenderStatsAccumulator::save(std::filesystem::path path) const {
     fmt::format_to(out, "total mray/s: {}\n", this->mrays_per_s());
     fmt::format_to(out, "average fps: {}\n", this->fps());
     fmt::format_to(out, "frames: {}\n", this->frames());
+
+    const auto counters = this->total_counters();
+    if (counters.rays > 0) {
+        const auto rays = static_cast<double>(counters.rays);
+        fmt::format_to(out, "node fetches per ray: {} (max {})\n", static_cast<double>(counters.node_fetches) / rays, counters.max_node_fetches);
+        fmt::format_to(out, "stack operations per ray: {} (max {})\n", static_cast<double>(counters.stack_ops) / rays, counters.max_stack_ops);
+        fmt::format_to(out, "steps per ray: {} (max {})\n", static_cast<double>(counters.steps) / rays, counters.max_steps);
+    }
+
     fmt::format_to(out, "# Frame number: total rays, outputs, total render time, max render time, min render time, mray/s\n");
 
     for (size_t frame_index = 0; frame_index < this->frames(); ++frame_index) {
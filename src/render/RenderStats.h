@@ -10,6 +10,26 @@
 #include <vulkan/vulkan.hpp>
 #include "backend/Display.h"
 #include "backend/RenderDevice.h"
+#include "utility/Span.h"
+
+// The traversal work of the rays of a frame, as counted by the instrumented shader variants,
+// see resources/instrument.glsl
+struct TraversalCounters {
+    size_t rays = 0;
+    uint64_t node_fetches = 0;
+    uint64_t stack_ops = 0;
+    uint64_t steps = 0;
+
+    // The maximum counts of a single ray
+    uint32_t max_node_fetches = 0;
+    uint32_t max_stack_ops = 0;
+    uint32_t max_steps = 0;
+
+    // Add the counters of `rays` rays, laid out as written by instrument.glsl
+    void add(const uint32_t* counters, size_t rays);
+
+    TraversalCounters& combine(const TraversalCounters& other);
+};
 
 struct RenderStats {
     size_t total_rays = 0;
@@ -22,25 +42,59 @@ struct RenderStats {
     double max_render_time = 0;
     double min_render_time = std::numeric_limits<double>::max();
 
+    // The scale at which the frame was rendered, see Renderer::set_render_scale
+    float render_scale = 1;
+
+    // Only counted when rendering with an instrumented shader
+    TraversalCounters counters;
+
     RenderStats& combine(const RenderStats& other);
     double mrays_per_s() const;
 };
 
 class RenderStatsCollector {
+    Display* display;
+    size_t device_index;
     const RenderDevice* rendev;
+    size_t batch_size;
+
+    // Every swap image of every output has its own queries, so that frames in flight do not
+    // overwrite each other's timestamps
+    uint32_t swap_images;
     vk::UniqueQueryPool query_pool;
     std::vector<uint64_t> timestamp_buffer;
-    RenderStats current_stats;
+
+    // The statistics of every frame of the last batch, see Display::batch_size
+    std::vector<RenderStats> frame_stats;
+
+    // A GPU timestamp and the corresponding host time, see trace::now(). Only measured when
+    // tracing is enabled, in which case the dispatches are added to the trace.
+    uint64_t calibration_ticks;
+    int64_t calibration_time;
 
 public:
     RenderStatsCollector(Display* display, size_t device_index);
-    void pre_dispatch(size_t output_index, vk::CommandBuffer cmd_buf);
-    void post_dispatch(size_t output_index, vk::CommandBuffer cmd_buf);
-    void collect();
 
-    const RenderStats& stats() const {
-        return this->current_stats;
+    // Allocate the queries again after the number of swap images of an output has changed.
+    // Statistics of frames rendered before are lost.
+    void create_query_pool();
+
+    void pre_dispatch(size_t output_index, uint32_t swap_index, vk::CommandBuffer cmd_buf);
+    void post_dispatch(size_t output_index, uint32_t swap_index, vk::CommandBuffer cmd_buf);
+
+    // Collect the statistics of a batch of `frames` frames, which were rendered to consecutive
+    // swap images starting at swap_indices[output] for every output, with `rays` rays per
+    // frame at `render_scale`. Waits until the frames have finished.
+    void collect(Span<uint32_t> swap_indices, size_t frames, size_t rays, float render_scale);
+
+    const RenderStats& stats(size_t frame = 0) const {
+        return this->frame_stats[frame];
     }
+
+private:
+    uint32_t query_index(size_t output_index, uint32_t swap_index) const;
+    void calibrate();
+    void trace_dispatches(size_t frames) const;
 };
 
 class RenderStatsAccumulator {
@@ -62,6 +116,7 @@ public:
     std::chrono::duration<double> total_time() const;
     double fps() const;
     size_t frames() const;
+    TraversalCounters total_counters() const;
     void save(std::filesystem::path path) const;
 };
 
@@ -0,0 +1,76 @@
+#include "render/RenderThread.h"
+#include <utility>
+#include <cassert>
+#include "core/Trace.h"
+
+RenderThread::RenderThread(std::string name):
+    name(std::move(name)),
+    busy(false),
+    stopping(false) {
+    this->thread = std::thread(&RenderThread::work, this);
+}
+
+RenderThread::~RenderThread() {
+    {
+        auto lock = std::unique_lock(this->mutex);
+        this->stopping = true;
+    }
+
+    this->job_available.notify_one();
+    this->thread.join();
+}
+
+void RenderThread::run(std::function<void()> job) {
+    {
+        auto lock = std::unique_lock(this->mutex);
+        assert(!this->busy);
+        this->job = std::move(job);
+        this->busy = true;
+    }
+
+    this->job_available.notify_one();
+}
+
+void RenderThread::wait() {
+    auto lock = std::unique_lock(this->mutex);
+    this->job_finished.wait(lock, [this] {
+        return !this->busy;
+    });
+
+    if (this->error) {
+        std::rethrow_exception(std::exchange(this->error, nullptr));
+    }
+}
+
+void RenderThread::work() {
+    if (trace::enabled()) {
+        trace::set_thread_name(this->name);
+    }
+
+    auto lock = std::unique_lock(this->mutex);
+
+    while (true) {
+        this->job_available.wait(lock, [this] {
+            return this->busy || this->stopping;
+        });
+
+        if (!this->busy) {
+            return;
+        }
+
+        auto job = std::move(this->job);
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            job();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        this->error = error;
+        this->busy = false;
+        this->job_finished.notify_one();
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef _XENODON_RENDER_RENDERTHREAD_H
+#define _XENODON_RENDER_RENDERTHREAD_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+// A thread which performs the host side work of a single render device, such as submitting
+// its command buffers and waiting for its results. It runs one job at a time, and the owner
+// waits for the job of every thread before continuing, which acts as a frame barrier.
+class RenderThread {
+    std::string name;
+    std::thread thread;
+    std::function<void()> job;
+    std::exception_ptr error;
+    bool busy;
+    bool stopping;
+
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable job_finished;
+
+public:
+    // The name is used to identify the thread in traces, see core/Trace.h
+    explicit RenderThread(std::string name);
+
+    RenderThread(const RenderThread&) = delete;
+    RenderThread& operator=(const RenderThread&) = delete;
+
+    ~RenderThread();
+
+    // Start a job. The previous job must have been waited for.
+    void run(std::function<void()> job);
+
+    // Block until the current job has finished. Exceptions thrown by the job are rethrown here.
+    void wait();
+
+private:
+    void work();
+};
+
+#endif
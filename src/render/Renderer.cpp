@@ -3,30 +3,85 @@
 #include <algorithm>
 #include <iterator>
 #include <utility>
+#include <cassert>
+#include <cstddef>
+#include <limits>
 #include "utility/rect_union.h"
+#include "utility/scale_rect.h"
 #include "core/Logger.h"
+#include "core/Trace.h"
 #include "graphics/shader/Shader.h"
 #include "graphics/utility.h"
 #include "math/Vec.h"
+#include "resources.h"
 
 namespace {
-    // The local group size all RenderAlgorithm shaders should have
-    constexpr const Vec2<uint32_t> LOCAL_SIZE{8, 8};
+    // The local group size which is used unless a different one is set
+    constexpr const Vec2<uint32_t> DEFAULT_LOCAL_SIZE{8, 8};
+
+    constexpr const auto SCALED_IMAGE_FORMAT = vk::Format::eR8G8B8A8Unorm;
+
+    // The size of a tile when rendering in time slices, which is rounded up to a multiple of the local size
+    constexpr const uint32_t TILE_SIZE = 256;
+
+    // Factor by which the number of tiles submitted at once may grow from one slice to the next
+    constexpr const size_t MAX_SLICE_GROWTH = 2;
+
+    // The width and height in pixels of the block covered by a beam of the beam optimization pre-pass
+    constexpr const uint32_t BEAM_SIZE = 8;
+
+    // Every pixel has a uvec4 of traversal counters when instrumenting, see instrument.glsl
+    constexpr const vk::DeviceSize COUNTERS_PER_RAY = 4;
+
+    // Bindings of resources/upscale.comp
+    const auto UPSCALE_BINDINGS = std::array {
+        vk::DescriptorSetLayoutBinding(
+            0, // layout(binding = 0) uniform UniformBuffer
+            vk::DescriptorType::eUniformBuffer,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        ),
+        vk::DescriptorSetLayoutBinding(
+            1, // layout(binding = 1) restrict writeonly uniform image2D render_target
+            vk::DescriptorType::eStorageImage,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        ),
+        vk::DescriptorSetLayoutBinding(
+            2, // layout(binding = 2) uniform sampler2D scaled_image
+            vk::DescriptorType::eCombinedImageSampler,
+            1,
+            vk::ShaderStageFlagBits::eCompute
+        )
+    };
 }
 
 Renderer::Renderer(std::shared_ptr<RenderContext> ctx, size_t device_index):
     ctx(ctx),
     device_index(device_index),
+    brick(this->ctx->algorithm->bricks() > 1 ? device_index : 0),
     rendev(&this->ctx->display->render_device(this->device_index)),
-    stats_collector(this->ctx->display, this->device_index) {
+    stats_collector(this->ctx->display, this->device_index),
+    local_size(DEFAULT_LOCAL_SIZE),
+    render_scale(1),
+    tiles_per_slice(1),
+    collected_frames(0) {
 
     this->create_resources();
+    this->create_descriptor_set_layout();
     this->create_pipeline();
     this->create_descriptor_sets();
     this->create_command_buffers();
+    this->create_uniform_buffer();
+    this->create_upscale_resources();
+    this->create_beam_buffers();
+    this->create_counter_buffers();
+
+    this->frame_counters.resize(this->ctx->display->batch_size());
 
     this->update_descriptor_sets();
     this->upload_uniform_buffers();
+    this->record_command_buffers();
 }
 
 void Renderer::recreate(size_t output) {
@@ -34,9 +89,23 @@ void Renderer::recreate(size_t output) {
     orsc.region = orsc.output->region();
 
     const uint32_t images = this->ctx->display->output(this->device_index, output)->num_swap_images();
+    // Outputs are only recreated while the device is idle, so a frame which is being rendered
+    // in time slices can simply be dropped
+    this->sliced_frame.reset();
+
+    // The counter buffers are reallocated below, so the counters of pending submissions are lost
+    if (this->ctx->instrumentation.enabled) {
+        this->uncollected.clear();
+    }
+
     if (static_cast<size_t>(images) != this->output_resources[output].command_buffers.size()) {
+        // The queries of the pending submissions are reallocated, so their statistics are lost
+        this->uncollected.clear();
+        this->stats_collector.create_query_pool();
+
         this->create_descriptor_sets();
         this->create_command_buffers();
+        this->create_uniform_buffer();
     }
 
     for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
@@ -44,8 +113,14 @@ void Renderer::recreate(size_t output) {
         orsc.region = orsc.output->region();
     }
 
+    // The scaled images, beam buffers and counter buffers depend on the size of the outputs
+    this->create_upscale_resources();
+    this->create_beam_buffers();
+    this->create_counter_buffers();
+
     this->update_descriptor_sets();
     this->resize();
+    this->record_command_buffers();
 }
 
 void Renderer::resize() {
@@ -53,75 +128,172 @@ void Renderer::resize() {
 }
 
 void Renderer::render(const Camera& cam) {
-    const auto begin_info = vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
+    TRACE_SCOPE("Renderer::render");
 
-    const auto push_constants = PushConstantBuffer {
-        .camera = {
-            Vec4F(cam.forward, 0),
-            Vec4F(cam.up, 0),
-            Vec4F(cam.translation / this->ctx->shader_params.voxel_ratio.xyz, 0) // pre-divide
-        },
-    };
+    if (this->ctx->tile_budget > 0) {
+        while (!this->render_slice(cam)) {
+            this->wait_slices();
+        }
+
+        return;
+    }
+
+    auto submission = this->begin_submission(1);
 
     for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
         auto& orsc = this->output_resources[outputidx];
 
-        uint32_t index = orsc.output->current_swap_index();
+        uint32_t index = submission.swap_indices[outputidx];
         const auto swap_image = orsc.output->swap_image(index);
-        const auto attachment = orsc.output->color_attachment_descr();
-        auto& cmd_buf = orsc.command_buffers[index].get();
 
-        auto group_size = (Vec2<uint32_t>{orsc.region.extent.width, orsc.region.extent.height} - 1u) / LOCAL_SIZE + 1u;
+        // The previous submission of this swap image has finished by now, so its slot can be written
+        if (this->ctx->dynamic_resolution) {
+            this->write_regions(outputidx, index);
+        }
+
+        this->write_camera(outputidx, index, cam);
+        swap_image.submit(this->rendev->compute_queue, orsc.command_buffers[index].get(), vk::PipelineStageFlagBits::eBottomOfPipe);
+        this->signal_counters(outputidx, index);
+    }
 
-        cmd_buf.begin(&begin_info);
+    this->uncollected.push_back(std::move(submission));
+}
 
-        image_transition(
-            cmd_buf,
-            swap_image.image,
-            {attachment.initialLayout, vk::PipelineStageFlagBits::eTopOfPipe},
-            {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader}
-        );
+bool Renderer::render_slice(const Camera& cam) {
+    TRACE_SCOPE("Renderer::render_slice");
 
-        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, this->pipeline.get());
-        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, this->pipeline_layout.get(), 0, orsc.descriptor_sets[index], nullptr);
-        cmd_buf.pushConstants(this->pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstantBuffer), static_cast<const void*>(&push_constants));
-        this->stats_collector.pre_dispatch(outputidx, cmd_buf);
-        cmd_buf.dispatch(group_size.x, group_size.y, 1);
-        this->stats_collector.post_dispatch(outputidx, cmd_buf);
-
-        image_transition(
-            cmd_buf,
-            swap_image.image,
-            {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader},
-            {attachment.finalLayout, vk::PipelineStageFlagBits::eBottomOfPipe}
-        );
+    assert(this->ctx->tile_budget > 0);
+
+    if (!this->sliced_frame) {
+        this->sliced_frame = this->begin_submission(1);
+
+        for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
+            auto& orsc = this->output_resources[outputidx];
+            const uint32_t index = this->sliced_frame->swap_indices[outputidx];
+
+            if (this->ctx->dynamic_resolution) {
+                this->write_regions(outputidx, index);
+            }
+
+            this->write_camera(outputidx, index, cam);
+            orsc.next_tile = 0;
+            orsc.slice_tiles = 0;
+            orsc.finished = false;
+        }
+    }
 
-        cmd_buf.end();
+    bool finished = true;
+    for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
+        finished = this->advance_slices(outputidx) && finished;
+    }
 
-        swap_image.submit(this->rendev->compute_queue, cmd_buf, vk::PipelineStageFlagBits::eBottomOfPipe);
+    if (!finished) {
+        return false;
     }
+
+    this->uncollected.push_back(std::move(this->sliced_frame.value()));
+    this->sliced_frame.reset();
+    return true;
+}
+
+void Renderer::render_batch(Span<Camera> cams) {
+    TRACE_SCOPE("Renderer::render_batch");
+
+    assert(!cams.empty() && cams.size() <= this->ctx->display->batch_size());
+
+    auto cmd_bufs = std::vector<vk::CommandBuffer>(cams.size());
+    auto submission = this->begin_submission(cams.size());
+
+    for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
+        auto& orsc = this->output_resources[outputidx];
+
+        // The frames of the batch are rendered to consecutive swap images
+        const uint32_t base = submission.swap_indices[outputidx];
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(cams.size()); ++i) {
+            if (this->ctx->dynamic_resolution) {
+                this->write_regions(outputidx, base + i);
+            }
+
+            this->write_camera(outputidx, base + i, cams[i]);
+            cmd_bufs[i] = orsc.command_buffers[base + i].get();
+        }
+
+        // Submit all frames at once, and let the first swap image signal when they are all done
+        const auto swap_image = orsc.output->swap_image(base);
+        const auto submit_info = vk::SubmitInfo(
+            0,
+            nullptr,
+            nullptr,
+            static_cast<uint32_t>(cmd_bufs.size()),
+            cmd_bufs.data(),
+            static_cast<uint32_t>(swap_image.render_finished != vk::Semaphore()),
+            &swap_image.render_finished
+        );
+
+        this->rendev->compute_queue->submit(1, &submit_info, swap_image.frame_fence);
+        this->signal_counters(outputidx, base);
+    }
+
+    this->uncollected.push_back(std::move(submission));
 }
 
 void Renderer::collect_stats() {
-    this->stats_collector.collect();
+    TRACE_SCOPE("Renderer::collect_stats");
+
+    while (this->uncollected.size() > 1) {
+        this->collect(this->uncollected.front());
+        this->uncollected.pop_front();
+    }
 }
 
-RenderStats Renderer::stats() const {
-    return this->stats_collector.stats();
+void Renderer::finish_stats() {
+    TRACE_SCOPE("Renderer::finish_stats");
+    this->collected_frames = 0;
+
+    while (!this->uncollected.empty()) {
+        this->collect(this->uncollected.front());
+        this->uncollected.pop_front();
+    }
+}
+
+RenderStats Renderer::stats(size_t frame) const {
+    auto stats = this->stats_collector.stats(frame);
+    if (this->ctx->instrumentation.enabled) {
+        stats.counters = this->frame_counters[frame];
+    }
+
+    return stats;
+}
+
+void Renderer::set_render_scale(float scale) {
+    assert(this->ctx->dynamic_resolution);
+    this->render_scale = std::clamp(scale, 0.f, 1.f);
+}
+
+void Renderer::set_local_size(Vec2<uint32_t> local_size) {
+    this->rendev->device->waitIdle();
+    this->local_size = local_size;
+    this->create_pipeline();
+    this->record_command_buffers();
+}
+
+bool Renderer::supports_local_size(Vec2<uint32_t> local_size) const {
+    const auto limits = this->rendev->device.physical_device().getProperties().limits;
+
+    return local_size.x > 0 && local_size.y > 0 &&
+        local_size.x <= limits.maxComputeWorkGroupSize[0] &&
+        local_size.y <= limits.maxComputeWorkGroupSize[1] &&
+        local_size.x * local_size.y <= limits.maxComputeWorkGroupInvocations;
 }
 
 void Renderer::create_resources() {
-    const auto& device = this->rendev->device;
     const uint32_t outputs = static_cast<uint32_t>(this->rendev->outputs);
 
-    this->resources = this->ctx->algorithm->upload_resources(*this->rendev);
-
-    this->uniform_buffer = std::make_unique<Buffer<UniformBuffer>>(
-        device,
-        outputs,
-        vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
-        vk::MemoryPropertyFlagBits::eDeviceLocal
-    );
+    {
+        TRACE_SCOPE("RenderAlgorithm::upload_resources");
+        this->resources = this->ctx->algorithm->upload_resources(*this->rendev, this->brick);
+    }
 
     this->output_resources.reserve(outputs);
     for (size_t j = 0; j < outputs; ++j) {
@@ -130,12 +302,13 @@ void Renderer::create_resources() {
             output,
             output->region(),
             Span<vk::DescriptorSet>(nullptr),
-            std::vector<vk::UniqueCommandBuffer>()
+            std::vector<vk::UniqueCommandBuffer>(),
+            0
         });
     }
 }
 
-void Renderer::create_pipeline() {
+void Renderer::create_descriptor_set_layout() {
     const auto& device = this->rendev->device;
 
     this->descriptor_set_layout = device->createDescriptorSetLayoutUnique({
@@ -144,12 +317,70 @@ void Renderer::create_pipeline() {
         this->ctx->bindings.data()
     });
 
+    if (this->ctx->dynamic_resolution) {
+        this->upscale_set_layout = device->createDescriptorSetLayoutUnique({
+            {},
+            static_cast<uint32_t>(UPSCALE_BINDINGS.size()),
+            UPSCALE_BINDINGS.data()
+        });
+
+        this->upscale_sampler = device->createSamplerUnique({
+            {},
+            vk::Filter::eLinear,
+            vk::Filter::eLinear,
+            vk::SamplerMipmapMode::eNearest,
+            vk::SamplerAddressMode::eClampToEdge,
+            vk::SamplerAddressMode::eClampToEdge,
+            vk::SamplerAddressMode::eClampToEdge
+        });
+    }
+}
+
+void Renderer::create_pipeline() {
+    const auto& device = this->rendev->device;
+    const auto& params = this->ctx->shader_params;
+
     const auto shader = Shader(device, vk::ShaderStageFlagBits::eCompute, this->ctx->algorithm->shader());
+    const auto brick_offset = this->ctx->algorithm->brick_offset(this->brick);
+
+    const auto spec_data = SpecializationData {
+        .local_size_x = this->local_size.x,
+        .local_size_y = this->local_size.y,
+        .voxel_ratio_x = params.voxel_ratio.x,
+        .voxel_ratio_y = params.voxel_ratio.y,
+        .voxel_ratio_z = params.voxel_ratio.z,
+        .model_dim_x = params.model_dim.x,
+        .model_dim_y = params.model_dim.y,
+        .model_dim_z = params.model_dim.z,
+        .emission_coeff = params.emission_coeff,
+        .brick_offset_x = brick_offset.x,
+        .brick_offset_y = brick_offset.y,
+        .brick_offset_z = brick_offset.z,
+        .beam_size = this->ctx->beam ? BEAM_SIZE : 0,
+        .heatmap = static_cast<uint32_t>(this->ctx->instrumentation.heatmap),
+        .heatmap_max = this->ctx->instrumentation.heatmap_max
+    };
+
+    // Every member of SpecializationData is 4 bytes, and its constant id is its index
+    constexpr const uint32_t spec_constants = sizeof(SpecializationData) / sizeof(uint32_t);
+    static_assert(sizeof(SpecializationData) == spec_constants * sizeof(uint32_t));
+
+    auto spec_entries = std::array<vk::SpecializationMapEntry, spec_constants>();
+    for (uint32_t i = 0; i < spec_constants; ++i) {
+        spec_entries[i] = vk::SpecializationMapEntry(i, i * static_cast<uint32_t>(sizeof(uint32_t)), sizeof(uint32_t));
+    }
+
+    const auto spec_info = vk::SpecializationInfo(
+        spec_constants,
+        spec_entries.data(),
+        sizeof(SpecializationData),
+        static_cast<const void*>(&spec_data)
+    );
 
     const auto push_constant_range = vk::PushConstantRange(
         vk::ShaderStageFlagBits::eCompute,
         0,
-        sizeof(PushConstantBuffer)
+        sizeof(PushConstants)
     );
 
     this->pipeline_layout = device->createPipelineLayoutUnique({
@@ -162,9 +393,39 @@ void Renderer::create_pipeline() {
 
     this->pipeline = device->createComputePipelineUnique(vk::PipelineCache(), {
         {},
-        shader.info(),
+        shader.info(&spec_info),
         this->pipeline_layout.get()
     });
+
+    if (this->ctx->beam) {
+        // The pre-pass uses the same descriptor sets as the traversal shader
+        const auto beam_shader = Shader(device, vk::ShaderStageFlagBits::eCompute, this->ctx->algorithm->beam_shader());
+
+        this->beam_pipeline = device->createComputePipelineUnique(vk::PipelineCache(), {
+            {},
+            beam_shader.info(&spec_info),
+            this->pipeline_layout.get()
+        });
+    }
+
+    if (this->ctx->dynamic_resolution) {
+        // The upscale shader includes common.glsl as well, so it uses the same constants
+        const auto upscale_shader = Shader(device, vk::ShaderStageFlagBits::eCompute, resources::open("resources/upscale.comp"));
+
+        this->upscale_pipeline_layout = device->createPipelineLayoutUnique({
+            {},
+            1,
+            &this->upscale_set_layout.get(),
+            0,
+            nullptr
+        });
+
+        this->upscale_pipeline = device->createComputePipelineUnique(vk::PipelineCache(), {
+            {},
+            upscale_shader.info(&spec_info),
+            this->upscale_pipeline_layout.get()
+        });
+    }
 }
 
 void Renderer::create_descriptor_sets() {
@@ -205,22 +466,609 @@ void Renderer::create_command_buffers() {
     }
 }
 
+void Renderer::create_uniform_buffer() {
+    const auto& device = this->rendev->device;
+    const auto limits = device.physical_device().getProperties().limits;
+
+    // Round the slot size up to the minimum uniform buffer offset alignment
+    const vk::DeviceSize alignment = std::max(limits.minUniformBufferOffsetAlignment, vk::DeviceSize{1});
+    this->uniform_stride = (sizeof(UniformBuffer) + alignment - 1) / alignment * alignment;
+
+    size_t slots = 0;
+    for (auto& orsc : this->output_resources) {
+        orsc.uniform_base = slots;
+        slots += orsc.output->num_swap_images();
+    }
+
+    const vk::DeviceSize size = slots * this->uniform_stride;
+
+    // The buffer is written by the host every frame, so keep it mapped
+    this->uniform_buffer = std::make_unique<Buffer<uint8_t>>(
+        device,
+        size,
+        vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+    );
+
+    this->uniform_mapping = this->uniform_buffer->map(0, size);
+}
+
+void Renderer::create_upscale_resources() {
+    if (!this->ctx->dynamic_resolution) {
+        return;
+    }
+
+    const auto& device = this->rendev->device;
+
+    uint32_t total_images = 0;
+    for (const auto& orsc : this->output_resources) {
+        total_images += orsc.output->num_swap_images();
+    }
+
+    const auto pool_sizes = std::array {
+        vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, total_images),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, total_images),
+        vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, total_images)
+    };
+
+    this->upscale_descriptor_pool = device->createDescriptorPoolUnique({
+        {},
+        total_images,
+        static_cast<uint32_t>(pool_sizes.size()),
+        pool_sizes.data()
+    });
+
+    for (auto& orsc : this->output_resources) {
+        const uint32_t images = orsc.output->num_swap_images();
+
+        // At most the entire output is rendered to the scaled image
+        orsc.scaled_image = std::make_unique<Image>(
+            device,
+            orsc.region.extent,
+            SCALED_IMAGE_FORMAT,
+            vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled
+        );
+
+        orsc.scaled_view = device->createImageViewUnique({
+            {},
+            orsc.scaled_image->get(),
+            vk::ImageViewType::e2D,
+            SCALED_IMAGE_FORMAT,
+            vk::ComponentMapping(),
+            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)
+        });
+
+        const auto layouts = std::vector<vk::DescriptorSetLayout>(images, this->upscale_set_layout.get());
+        orsc.upscale_sets = device->allocateDescriptorSets({
+            this->upscale_descriptor_pool.get(),
+            images,
+            layouts.data()
+        });
+    }
+}
+
+void Renderer::create_beam_buffers() {
+    if (!this->ctx->beam_binding) {
+        return;
+    }
+
+    const auto& device = this->rendev->device;
+    const auto limits = device.physical_device().getProperties().limits;
+    const vk::DeviceSize alignment = std::max(limits.minStorageBufferOffsetAlignment / sizeof(float), vk::DeviceSize{1});
+
+    for (auto& orsc : this->output_resources) {
+        const uint32_t images = orsc.output->num_swap_images();
+
+        // Without the pre-pass, the shaders still declare the buffer, but never read it
+        vk::DeviceSize beams = 1;
+        if (this->ctx->beam) {
+            const auto extent = orsc.region.extent;
+            beams = ((extent.width - 1) / BEAM_SIZE + 1) * ((extent.height - 1) / BEAM_SIZE + 1);
+        }
+
+        orsc.beam_stride = (beams + alignment - 1) / alignment * alignment;
+        orsc.beam_buffer = std::make_unique<Buffer<float>>(
+            device,
+            images * orsc.beam_stride,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+    }
+}
+
+void Renderer::create_counter_buffers() {
+    if (!this->ctx->instrumentation.enabled) {
+        return;
+    }
+
+    const auto& device = this->rendev->device;
+    const auto limits = device.physical_device().getProperties().limits;
+    const vk::DeviceSize alignment = std::max(limits.minStorageBufferOffsetAlignment / sizeof(uint32_t), vk::DeviceSize{1});
+
+    for (auto& orsc : this->output_resources) {
+        const uint32_t images = orsc.output->num_swap_images();
+
+        // The rendered region is at most the entire output
+        const vk::DeviceSize counters = vk::DeviceSize{orsc.region.extent.width} * orsc.region.extent.height * COUNTERS_PER_RAY;
+
+        orsc.counter_stride = (counters + alignment - 1) / alignment * alignment;
+        orsc.counter_buffer = std::make_unique<Buffer<uint32_t>>(
+            device,
+            images * orsc.counter_stride,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+        );
+
+        orsc.counter_mapping = orsc.counter_buffer->map(0, images * orsc.counter_stride);
+
+        orsc.counter_fences.clear();
+        for (uint32_t image = 0; image < images; ++image) {
+            orsc.counter_fences.push_back(device->createFenceUnique({}));
+        }
+    }
+}
+
+void Renderer::create_tile_resources() {
+    const auto& device = this->rendev->device;
+    const auto tile_size = ((Vec2<uint32_t>(TILE_SIZE) - 1u) / this->local_size + 1u) * this->local_size;
+
+    uint32_t total_tiles = 0;
+    for (auto& orsc : this->output_resources) {
+        const auto extent = orsc.region.extent;
+        const uint32_t images = orsc.output->num_swap_images();
+
+        orsc.tiles.clear();
+        for (uint32_t y = 0; y < extent.height; y += tile_size.y) {
+            for (uint32_t x = 0; x < extent.width; x += tile_size.x) {
+                orsc.tiles.push_back({
+                    {static_cast<int32_t>(x), static_cast<int32_t>(y)},
+                    {std::min(tile_size.x, extent.width - x), std::min(tile_size.y, extent.height - y)}
+                });
+            }
+        }
+
+        const auto tiles = static_cast<uint32_t>(orsc.tiles.size());
+        orsc.tile_command_buffers = this->rendev->compute_command_pool.allocate_command_buffers(images * tiles);
+        orsc.finish_command_buffers = this->rendev->compute_command_pool.allocate_command_buffers(images);
+        orsc.tile_query_base = total_tiles;
+        total_tiles += tiles;
+
+        // The fence may have been left signaled by a frame which was dropped
+        orsc.slice_fence = device->createFenceUnique({});
+    }
+
+    // The results of every slice are read before the next slice of that output is submitted,
+    // so the tiles of all swap images can share queries
+    this->tile_query_pool = device->createQueryPoolUnique({
+        {},
+        vk::QueryType::eTimestamp,
+        std::max(total_tiles, 1u) * 2
+    });
+}
+
+void Renderer::record_command_buffers() {
+    const auto begin_info = vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
+    const auto no_tile = PushConstants{{0, 0}};
+
+    // The tiles depend on the regions and the local size, which may have changed since the last time
+    if (this->ctx->tile_budget > 0) {
+        this->create_tile_resources();
+    }
+
+    for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
+        auto& orsc = this->output_resources[outputidx];
+        const auto attachment = orsc.output->color_attachment_descr();
+        const uint32_t images = orsc.output->num_swap_images();
+
+        auto group_size = (Vec2<uint32_t>{orsc.region.extent.width, orsc.region.extent.height} - 1u) / this->local_size + 1u;
+
+        for (uint32_t index = 0; index < images; ++index) {
+            const auto swap_image = orsc.output->swap_image(index);
+            auto& cmd_buf = orsc.command_buffers[index].get();
+
+            cmd_buf.begin(&begin_info);
+
+            if (this->ctx->dynamic_resolution) {
+                this->record_scaled(outputidx, index, cmd_buf);
+                cmd_buf.end();
+                continue;
+            } else if (this->ctx->tile_budget > 0) {
+                this->record_tiled(outputidx, index, cmd_buf);
+                cmd_buf.end();
+                continue;
+            }
+
+            image_transition(
+                cmd_buf,
+                swap_image.image,
+                {attachment.initialLayout, vk::PipelineStageFlagBits::eTopOfPipe},
+                {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader}
+            );
+
+            this->stats_collector.pre_dispatch(outputidx, index, cmd_buf);
+            this->record_beam(outputidx, index, cmd_buf);
+            cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, this->pipeline.get());
+            cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, this->pipeline_layout.get(), 0, orsc.descriptor_sets[index], nullptr);
+            cmd_buf.pushConstants(this->pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), static_cast<const void*>(&no_tile));
+            cmd_buf.dispatch(group_size.x, group_size.y, 1);
+            this->stats_collector.post_dispatch(outputidx, index, cmd_buf);
+            this->record_counter_barrier(cmd_buf);
+
+            image_transition(
+                cmd_buf,
+                swap_image.image,
+                {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader},
+                {attachment.finalLayout, vk::PipelineStageFlagBits::eBottomOfPipe}
+            );
+
+            cmd_buf.end();
+        }
+    }
+}
+
+void Renderer::record_scaled(size_t output, uint32_t swap_index, vk::CommandBuffer cmd_buf) {
+    const auto& orsc = this->output_resources[output];
+    const auto attachment = orsc.output->color_attachment_descr();
+    const auto swap_image = orsc.output->swap_image(swap_index);
+    const auto scaled_image = orsc.scaled_image->get();
+
+    // The previous contents are not needed, but the upscale pass of the previous frame may still read them
+    image_transition(
+        cmd_buf,
+        scaled_image,
+        {vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eComputeShader},
+        {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite}
+    );
+
+    // The size of the dispatch depends on the render scale, so it is read from the uniform buffer slot
+    const vk::DeviceSize dispatch_offset = (orsc.uniform_base + swap_index) * this->uniform_stride + offsetof(UniformBuffer, dispatch);
+
+    this->stats_collector.pre_dispatch(output, swap_index, cmd_buf);
+    this->record_beam(output, swap_index, cmd_buf);
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, this->pipeline.get());
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, this->pipeline_layout.get(), 0, orsc.descriptor_sets[swap_index], nullptr);
+    const auto no_tile = PushConstants{{0, 0}};
+    cmd_buf.pushConstants(this->pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), static_cast<const void*>(&no_tile));
+    cmd_buf.dispatchIndirect(this->uniform_buffer->get(), dispatch_offset);
+    this->stats_collector.post_dispatch(output, swap_index, cmd_buf);
+    this->record_counter_barrier(cmd_buf);
+
+    image_transition(
+        cmd_buf,
+        scaled_image,
+        {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite},
+        {vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead}
+    );
+
+    image_transition(
+        cmd_buf,
+        swap_image.image,
+        {attachment.initialLayout, vk::PipelineStageFlagBits::eTopOfPipe},
+        {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader}
+    );
+
+    const auto group_size = (Vec2<uint32_t>{orsc.region.extent.width, orsc.region.extent.height} - 1u) / this->local_size + 1u;
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, this->upscale_pipeline.get());
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, this->upscale_pipeline_layout.get(), 0, orsc.upscale_sets[swap_index], nullptr);
+    cmd_buf.dispatch(group_size.x, group_size.y, 1);
+
+    image_transition(
+        cmd_buf,
+        swap_image.image,
+        {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader},
+        {attachment.finalLayout, vk::PipelineStageFlagBits::eBottomOfPipe}
+    );
+}
+
+void Renderer::record_tiled(size_t output, uint32_t swap_index, vk::CommandBuffer cmd_buf) {
+    const auto& orsc = this->output_resources[output];
+    const auto attachment = orsc.output->color_attachment_descr();
+    const auto swap_image = orsc.output->swap_image(swap_index);
+    const auto begin_info = vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
+    const size_t tiles = orsc.tiles.size();
+
+    image_transition(
+        cmd_buf,
+        swap_image.image,
+        {attachment.initialLayout, vk::PipelineStageFlagBits::eTopOfPipe},
+        {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader}
+    );
+
+    // The render time of the frame includes the time between slices
+    this->stats_collector.pre_dispatch(output, swap_index, cmd_buf);
+    this->record_beam(output, swap_index, cmd_buf);
+
+    // Tiles write disjoint parts of the swap image, so they need no barriers between them
+    for (size_t i = 0; i < tiles; ++i) {
+        const auto& tile = orsc.tiles[i];
+        const auto tile_cmd_buf = orsc.tile_command_buffers[swap_index * tiles + i].get();
+        const auto query = (orsc.tile_query_base + static_cast<uint32_t>(i)) * 2;
+        const auto push_constants = PushConstants{{static_cast<uint32_t>(tile.offset.x), static_cast<uint32_t>(tile.offset.y)}};
+        const auto group_size = (Vec2<uint32_t>{tile.extent.width, tile.extent.height} - 1u) / this->local_size + 1u;
+
+        tile_cmd_buf.begin(&begin_info);
+        tile_cmd_buf.resetQueryPool(this->tile_query_pool.get(), query, 2);
+        tile_cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, this->pipeline.get());
+        tile_cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, this->pipeline_layout.get(), 0, orsc.descriptor_sets[swap_index], nullptr);
+        tile_cmd_buf.pushConstants(this->pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), static_cast<const void*>(&push_constants));
+        tile_cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, this->tile_query_pool.get(), query);
+        tile_cmd_buf.dispatch(group_size.x, group_size.y, 1);
+        tile_cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, this->tile_query_pool.get(), query + 1);
+        tile_cmd_buf.end();
+    }
+
+    const auto finish_cmd_buf = orsc.finish_command_buffers[swap_index].get();
+    finish_cmd_buf.begin(&begin_info);
+    this->stats_collector.post_dispatch(output, swap_index, finish_cmd_buf);
+    this->record_counter_barrier(finish_cmd_buf);
+
+    image_transition(
+        finish_cmd_buf,
+        swap_image.image,
+        {vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader},
+        {attachment.finalLayout, vk::PipelineStageFlagBits::eBottomOfPipe}
+    );
+
+    finish_cmd_buf.end();
+}
+
+void Renderer::record_beam(size_t output, uint32_t swap_index, vk::CommandBuffer cmd_buf) {
+    if (!this->ctx->beam) {
+        return;
+    }
+
+    const auto& orsc = this->output_resources[output];
+    const auto no_tile = PushConstants{{0, 0}};
+
+    // When rendering at a reduced resolution, the shader skips the beams outside the rendered region
+    const auto beams = (Vec2<uint32_t>{orsc.region.extent.width, orsc.region.extent.height} - 1u) / BEAM_SIZE + 1u;
+    const auto group_size = (beams - 1u) / this->local_size + 1u;
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, this->beam_pipeline.get());
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, this->pipeline_layout.get(), 0, orsc.descriptor_sets[swap_index], nullptr);
+    cmd_buf.pushConstants(this->pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), static_cast<const void*>(&no_tile));
+    cmd_buf.dispatch(group_size.x, group_size.y, 1);
+
+    // The traversal shader reads the distances written by the pre-pass
+    const auto barrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+    cmd_buf.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::DependencyFlags(),
+        barrier,
+        nullptr,
+        nullptr
+    );
+}
+
+void Renderer::record_counter_barrier(vk::CommandBuffer cmd_buf) {
+    if (!this->ctx->instrumentation.enabled) {
+        return;
+    }
+
+    // The counters are read by the host once the frame has finished, see collect_counters
+    const auto barrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead);
+    cmd_buf.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eHost,
+        vk::DependencyFlags(),
+        barrier,
+        nullptr,
+        nullptr
+    );
+}
+
+Renderer::Submission Renderer::begin_submission(size_t frames) {
+    this->collected_frames = 0;
+
+    auto submission = Submission{std::vector<uint32_t>(this->output_resources.size()), frames, 0, this->render_scale};
+    for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
+        const auto& orsc = this->output_resources[outputidx];
+        const auto extent = scale_rect(orsc.output->region(), this->render_scale).extent;
+        submission.swap_indices[outputidx] = orsc.output->current_swap_index();
+        submission.rays += size_t{extent.width} * extent.height;
+    }
+
+    // The swap images of the oldest submissions are reused first. Those have been waited for
+    // by the display before it hands out their swap images again.
+    auto reused = [&submission](const Submission& pending) {
+        for (size_t i = 0; i < submission.swap_indices.size(); ++i) {
+            const uint32_t begin = submission.swap_indices[i];
+            const uint32_t pending_begin = pending.swap_indices[i];
+            if (begin < pending_begin + pending.frames && pending_begin < begin + submission.frames) {
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    while (!this->uncollected.empty() && reused(this->uncollected.front())) {
+        this->collect(this->uncollected.front());
+        this->uncollected.pop_front();
+    }
+
+    return submission;
+}
+
+void Renderer::collect(const Submission& submission) {
+    this->stats_collector.collect(submission.swap_indices, submission.frames, submission.rays, submission.render_scale);
+
+    if (this->ctx->instrumentation.enabled) {
+        this->collect_counters(submission);
+    }
+
+    this->collected_frames = submission.frames;
+}
+
+void Renderer::collect_counters(const Submission& submission) {
+    const auto& device = this->rendev->device;
+
+    // The counter buffers are host coherent, so they need no invalidation once the fence is signaled
+    for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
+        const auto fence = this->output_resources[outputidx].counter_fences[submission.swap_indices[outputidx]].get();
+        device->waitForFences(fence, true, std::numeric_limits<uint64_t>::max());
+        device->resetFences(fence);
+    }
+
+    for (size_t frame = 0; frame < submission.frames; ++frame) {
+        auto& counters = this->frame_counters[frame];
+        counters = TraversalCounters();
+
+        for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
+            const auto& orsc = this->output_resources[outputidx];
+            const auto extent = scale_rect(orsc.region, submission.render_scale).extent;
+            const size_t swap_index = submission.swap_indices[outputidx] + frame;
+            counters.add(&orsc.counter_mapping[swap_index * orsc.counter_stride], size_t{extent.width} * extent.height);
+        }
+    }
+}
+
+void Renderer::signal_counters(size_t output, uint32_t swap_index) const {
+    if (!this->ctx->instrumentation.enabled) {
+        return;
+    }
+
+    // An empty submission signals its fence once all earlier submissions to the queue have finished
+    this->rendev->compute_queue->submit(0, nullptr, this->output_resources[output].counter_fences[swap_index].get());
+}
+
+bool Renderer::advance_slices(size_t output) {
+    auto& orsc = this->output_resources[output];
+    if (orsc.finished) {
+        return true;
+    }
+
+    const uint32_t swap_index = this->sliced_frame->swap_indices[output];
+    const auto swap_image = orsc.output->swap_image(swap_index);
+    const auto& device = this->rendev->device;
+    const size_t tiles = orsc.tiles.size();
+
+    // Every slice is a separate submission, so that no single submission runs for too long
+    if (orsc.slice_tiles > 0) {
+        if (device->getFenceStatus(orsc.slice_fence.get()) == vk::Result::eNotReady) {
+            return false;
+        }
+
+        device->resetFences(orsc.slice_fence.get());
+        this->update_slice_size(orsc.tile_query_base + static_cast<uint32_t>(orsc.next_tile - orsc.slice_tiles), orsc.slice_tiles);
+        orsc.slice_tiles = 0;
+    }
+
+    if (orsc.next_tile < tiles) {
+        const size_t n = std::min(this->tiles_per_slice, tiles - orsc.next_tile);
+        const bool first = orsc.next_tile == 0;
+        const auto wait_stage = vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+
+        // The first slice prepares the swap image, once it is acquired
+        auto cmd_bufs = std::vector<vk::CommandBuffer>();
+        if (first) {
+            cmd_bufs.push_back(orsc.command_buffers[swap_index].get());
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            cmd_bufs.push_back(orsc.tile_command_buffers[swap_index * tiles + orsc.next_tile + i].get());
+        }
+
+        const auto submit_info = vk::SubmitInfo(
+            static_cast<uint32_t>(first && swap_image.image_acquired != vk::Semaphore()),
+            &swap_image.image_acquired,
+            &wait_stage,
+            static_cast<uint32_t>(cmd_bufs.size()),
+            cmd_bufs.data()
+        );
+
+        this->rendev->compute_queue->submit(1, &submit_info, orsc.slice_fence.get());
+        orsc.next_tile += n;
+        orsc.slice_tiles = n;
+        return false;
+    }
+
+    // The last submission finishes the frame like a regular one would
+    const auto finish_cmd_buf = orsc.finish_command_buffers[swap_index].get();
+    const auto submit_info = vk::SubmitInfo(
+        0,
+        nullptr,
+        nullptr,
+        1,
+        &finish_cmd_buf,
+        static_cast<uint32_t>(swap_image.render_finished != vk::Semaphore()),
+        &swap_image.render_finished
+    );
+
+    this->rendev->compute_queue->submit(1, &submit_info, swap_image.frame_fence);
+    this->signal_counters(output, swap_index);
+    orsc.finished = true;
+    return true;
+}
+
+void Renderer::wait_slices() const {
+    auto fences = std::vector<vk::Fence>();
+    for (const auto& orsc : this->output_resources) {
+        if (orsc.slice_tiles > 0) {
+            fences.push_back(orsc.slice_fence.get());
+        }
+    }
+
+    if (!fences.empty()) {
+        this->rendev->device->waitForFences(fences, false, std::numeric_limits<uint64_t>::max());
+    }
+}
+
+void Renderer::update_slice_size(uint32_t first_tile, size_t tiles) {
+    auto timestamps = std::vector<uint64_t>(tiles * 2);
+
+    this->rendev->device->getQueryPoolResults(
+        this->tile_query_pool.get(),
+        first_tile * 2,
+        static_cast<uint32_t>(timestamps.size()),
+        static_cast<uint32_t>(timestamps.size()) * sizeof(uint64_t),
+        timestamps.data(),
+        sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+    );
+
+    const uint64_t diff = timestamps.back() - timestamps.front();
+    const double time = static_cast<double>(diff) * static_cast<double>(this->rendev->timestamp_period) / 1'000'000.0;
+    if (time <= 0) {
+        this->tiles_per_slice = tiles * MAX_SLICE_GROWTH;
+        return;
+    }
+
+    // Assume that the next tiles take as long as the last ones
+    const double time_per_tile = time / static_cast<double>(tiles);
+    const auto fitting = static_cast<size_t>(this->ctx->tile_budget / time_per_tile);
+    this->tiles_per_slice = std::clamp(fitting, size_t{1}, tiles * MAX_SLICE_GROWTH);
+}
+
 void Renderer::update_descriptor_sets() {
     for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
         auto& orsc = this->output_resources[outputidx];
-        const auto uniform_buffer_info = this->uniform_buffer->descriptor_info(outputidx, 1);
         const uint32_t images = orsc.output->num_swap_images();
 
         for (uint32_t image = 0; image < images; ++image) {
             auto swap_image = orsc.output->swap_image(image);
             auto& set = orsc.descriptor_sets[image];
 
-            const auto render_target_info = vk::DescriptorImageInfo(
+            const auto uniform_buffer_info = this->uniform_buffer->descriptor_info(
+                (orsc.uniform_base + image) * this->uniform_stride,
+                sizeof(UniformBuffer)
+            );
+
+            const auto swap_image_info = vk::DescriptorImageInfo(
                 vk::Sampler(),
                 swap_image.view,
                 vk::ImageLayout::eGeneral
             );
 
+            // With dynamic resolution, the traversal shader renders to the scaled image instead
+            const auto render_target_info = !this->ctx->dynamic_resolution ? swap_image_info : vk::DescriptorImageInfo(
+                vk::Sampler(),
+                orsc.scaled_view.get(),
+                vk::ImageLayout::eGeneral
+            );
+
             const auto descriptor_writes = std::array{
                 write_set(set, this->ctx->bindings[0], uniform_buffer_info),
                 write_set(set, this->ctx->bindings[1], render_target_info)
@@ -228,43 +1076,72 @@ void Renderer::update_descriptor_sets() {
 
             this->rendev->device->updateDescriptorSets(descriptor_writes, nullptr);
 
+            if (this->ctx->beam_binding) {
+                const auto beam_buffer_info = orsc.beam_buffer->descriptor_info(image * orsc.beam_stride, orsc.beam_stride);
+                this->rendev->device->updateDescriptorSets(write_set(set, this->ctx->beam_binding.value(), beam_buffer_info), nullptr);
+            }
+
+            if (this->ctx->counter_binding) {
+                const auto counter_buffer_info = orsc.counter_buffer->descriptor_info(image * orsc.counter_stride, orsc.counter_stride);
+                this->rendev->device->updateDescriptorSets(write_set(set, this->ctx->counter_binding.value(), counter_buffer_info), nullptr);
+            }
+
             this->resources->update_descriptors(set);
+
+            if (this->ctx->dynamic_resolution) {
+                const auto scaled_image_info = vk::DescriptorImageInfo(
+                    this->upscale_sampler.get(),
+                    orsc.scaled_view.get(),
+                    vk::ImageLayout::eShaderReadOnlyOptimal
+                );
+
+                const auto upscale_set = orsc.upscale_sets[image];
+                const auto upscale_writes = std::array{
+                    write_set(upscale_set, UPSCALE_BINDINGS[0], uniform_buffer_info),
+                    write_set(upscale_set, UPSCALE_BINDINGS[1], swap_image_info),
+                    write_set(upscale_set, UPSCALE_BINDINGS[2], scaled_image_info)
+                };
+
+                this->rendev->device->updateDescriptorSets(upscale_writes, nullptr);
+            }
         }
     }
 }
 
 void Renderer::upload_uniform_buffers() {
-    const auto& device = this->rendev->device;
-    const uint32_t outputs = static_cast<uint32_t>(this->rendev->outputs);
-
-    auto staging_buffer = Buffer<UniformBuffer>(
-        device,
-        outputs,
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-    );
-
-    UniformBuffer* uniforms = staging_buffer.map(0, outputs);
-
     for (size_t outputidx = 0; outputidx < this->output_resources.size(); ++outputidx) {
         auto& orsc = this->output_resources[outputidx];
+        const uint32_t images = orsc.output->num_swap_images();
 
-        uniforms[outputidx].output_region = orsc.region;
-        uniforms[outputidx].display_region = this->ctx->display_region;
-        uniforms[outputidx].params = this->ctx->shader_params;
+        for (uint32_t image = 0; image < images; ++image) {
+            this->write_regions(outputidx, image);
+        }
     }
+}
 
-    staging_buffer.unmap();
+void Renderer::write_regions(size_t output, uint32_t swap_index) const {
+    const auto& orsc = this->output_resources[output];
+    auto* uniforms = this->uniform_slot(output, swap_index);
 
-    const auto copy_info = vk::BufferCopy{
-        0,
-        0,
-        sizeof(UniformBuffer) * outputs
-    };
+    uniforms->output_region = scale_rect(orsc.region, this->render_scale);
+    uniforms->display_region = scale_rect(this->ctx->display_region, this->render_scale);
+    uniforms->target_extent = orsc.region.extent;
 
-    this->rendev->compute_command_pool.one_time_submit([&](vk::CommandBuffer cmd_buf) {
-        cmd_buf.copyBuffer(staging_buffer.get(), this->uniform_buffer->get(), copy_info);
-    });
+    const auto extent = uniforms->output_region.extent;
+    const auto group_size = (Vec2<uint32_t>{extent.width, extent.height} - 1u) / this->local_size + 1u;
+    uniforms->dispatch = vk::DispatchIndirectCommand(group_size.x, group_size.y, 1);
+}
+
+void Renderer::write_camera(size_t output, uint32_t swap_index, const Camera& cam) const {
+    auto& camera = this->uniform_slot(output, swap_index)->camera;
+    camera.forward = Vec4F(cam.forward, 0);
+    camera.up = Vec4F(cam.up, 0);
+    camera.translation_scaled = Vec4F(cam.translation / this->ctx->shader_params.voxel_ratio, 0); // pre-divide
+}
+
+Renderer::UniformBuffer* Renderer::uniform_slot(size_t output, uint32_t swap_index) const {
+    const size_t slot = this->output_resources[output].uniform_base + swap_index;
+    return reinterpret_cast<UniformBuffer*>(this->uniform_mapping + slot * this->uniform_stride);
 }
 
 vk::UniqueDescriptorPool Renderer::create_descriptor_pool(const Device& device, uint32_t sets) {
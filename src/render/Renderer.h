@@ -3,28 +3,30 @@
 
 #include <vector>
 #include <memory>
+#include <deque>
+#include <optional>
 #include <cstddef>
+#include <cstdint>
 #include <vulkan/vulkan.hpp>
 #include "backend/Display.h"
 #include "backend/Output.h"
 #include "backend/RenderDevice.h"
 #include "graphics/memory/Buffer.h"
+#include "graphics/memory/Image.h"
 #include "render/RenderAlgorithm.h"
 #include "render/RenderStats.h"
 #include "render/RenderContext.h"
 #include "camera/Camera.h"
 #include "math/Vec.h"
+#include "utility/Span.h"
 
 class Renderer {
     using ShaderParameters = RenderContext::ShaderParameters;
 
+    // Each swap image of each output has its own uniform buffer slot, so that the
+    // command buffers only need to be recorded once. Only the camera is updated
+    // every frame.
     struct UniformBuffer {
-        vk::Rect2D output_region;
-        vk::Rect2D display_region;
-        ShaderParameters params;
-    };
-
-    struct PushConstantBuffer {
         // the Camera struct cant be used here directly because of
         // different alignment requirements of CPU and GPU.
         struct {
@@ -32,9 +34,36 @@ class Renderer {
             Vec4F up;
             Vec4F translation_scaled;
         } camera;
+
+        vk::Rect2D output_region;
+        vk::Rect2D display_region;
+
+        // The extent of the output. When rendering at a reduced resolution, the regions above
+        // are scaled, and the upscale pass scales the result back to this extent.
+        vk::Extent2D target_extent;
+
+        // Arguments of the indirect dispatch of the traversal shader, which depend on the scale
+        vk::DispatchIndirectCommand dispatch;
     };
 
-    static_assert(sizeof(PushConstantBuffer) <= 128, "Vulkan minimum supported push constant range is maximum 128 bytes");
+    // Layout of the data backing the specialization constants, see common.glsl
+    struct SpecializationData {
+        uint32_t local_size_x;
+        uint32_t local_size_y;
+        float voxel_ratio_x;
+        float voxel_ratio_y;
+        float voxel_ratio_z;
+        uint32_t model_dim_x;
+        uint32_t model_dim_y;
+        uint32_t model_dim_z;
+        float emission_coeff;
+        uint32_t brick_offset_x;
+        uint32_t brick_offset_y;
+        uint32_t brick_offset_z;
+        uint32_t beam_size;
+        uint32_t heatmap;
+        float heatmap_max;
+    };
 
     struct OutputResources {
         Output* output;
@@ -43,14 +72,74 @@ class Renderer {
 
         Span<vk::DescriptorSet> descriptor_sets;
         std::vector<vk::UniqueCommandBuffer> command_buffers;
+
+        // Index of the uniform buffer slot of the first swap image
+        size_t uniform_base;
+
+        // With dynamic resolution, the traversal shader renders into this image, which is
+        // upscaled into the swap image with the upscale descriptor set of that swap image
+        std::unique_ptr<Image> scaled_image;
+        vk::UniqueImageView scaled_view;
+        std::vector<vk::DescriptorSet> upscale_sets;
+
+        // With time slicing, the output is divided into tiles, which each have a command buffer per
+        // swap image, stored at [swap index * tiles + tile]. The command buffers above then only
+        // prepare the swap image, and the finish command buffers present it.
+        std::vector<vk::Rect2D> tiles;
+        std::vector<vk::UniqueCommandBuffer> tile_command_buffers;
+        std::vector<vk::UniqueCommandBuffer> finish_command_buffers;
+
+        // Index of the timestamp queries of the first tile
+        uint32_t tile_query_base;
+
+        // Progress of the frame which is rendered in time slices: the first tile which is not
+        // submitted yet, the number of tiles of the slice in flight, which signals slice_fence,
+        // and whether the frame has been finished
+        size_t next_tile;
+        size_t slice_tiles;
+        bool finished;
+        vk::UniqueFence slice_fence;
+
+        // Results of the beam optimization pre-pass. Every swap image has its own part of
+        // beam_stride elements.
+        std::unique_ptr<Buffer<float>> beam_buffer;
+        vk::DeviceSize beam_stride;
+
+        // When instrumenting, the traversal counters of every pixel. Every swap image has its own
+        // part of counter_stride elements, which stays mapped so that the host can sum them.
+        std::unique_ptr<Buffer<uint32_t>> counter_buffer;
+        const uint32_t* counter_mapping;
+        vk::DeviceSize counter_stride;
+
+        // Signaled once the counters of a submission starting at that swap image are written.
+        // The fences of the swap images themselves are waited for and reset by the display.
+        std::vector<vk::UniqueFence> counter_fences;
+    };
+
+    // The frames of a single render or render_batch call, which start at the given swap
+    // image of every output
+    struct Submission {
+        std::vector<uint32_t> swap_indices;
+        size_t frames;
+
+        // Regions and the render scale may change before the statistics are collected
+        size_t rays;
+        float render_scale;
+    };
+
+    // Offset of the tile which is rendered, see common.glsl
+    struct PushConstants {
+        Vec2<uint32_t> tile_offset;
     };
 
     std::shared_ptr<RenderContext> ctx;
     size_t device_index;
+    size_t brick;
 
     const RenderDevice* rendev;
     std::unique_ptr<RenderResources> resources;
     RenderStatsCollector stats_collector;
+    Vec2<uint32_t> local_size;
 
     vk::UniqueDescriptorSetLayout descriptor_set_layout;
     vk::UniqueDescriptorPool descriptor_pool;
@@ -58,26 +147,127 @@ class Renderer {
 
     vk::UniquePipelineLayout pipeline_layout;
     vk::UniquePipeline pipeline;
+    vk::UniquePipeline beam_pipeline;
+
+    float render_scale;
+    vk::UniqueSampler upscale_sampler;
+    vk::UniqueDescriptorSetLayout upscale_set_layout;
+    vk::UniqueDescriptorPool upscale_descriptor_pool;
+    vk::UniquePipelineLayout upscale_pipeline_layout;
+    vk::UniquePipeline upscale_pipeline;
+
+    std::unique_ptr<Buffer<uint8_t>> uniform_buffer;
+    uint8_t* uniform_mapping;
+    vk::DeviceSize uniform_stride;
+
+    // Every tile writes a timestamp before and after its dispatch, from which the number
+    // of tiles submitted at once is derived
+    vk::UniqueQueryPool tile_query_pool;
+    size_t tiles_per_slice;
 
-    std::unique_ptr<Buffer<UniformBuffer>> uniform_buffer;
+    // The frame which is being rendered in time slices, see render_slice
+    std::optional<Submission> sliced_frame;
 
     std::vector<OutputResources> output_resources;
 
+    // The traversal counters of every frame of the last batch, when instrumenting
+    std::vector<TraversalCounters> frame_counters;
+
+    // Submissions of which the statistics are not collected yet, oldest first. Statistics are
+    // collected one submission behind, so that the host does not wait for the frame it just
+    // submitted, see collect_stats.
+    std::deque<Submission> uncollected;
+
+    // The number of frames of which the statistics were collected during the last render or
+    // render_batch call, see stats_frames
+    size_t collected_frames;
+
 public:
     Renderer(std::shared_ptr<RenderContext> ctx, size_t device_index);
     void recreate(size_t output);
     void resize();
     void render(const Camera& cam);
+
+    // Submit the next slice of every output when the previous one has finished, starting a new
+    // frame with `cam` if none is in progress. Never waits for the device, and returns whether
+    // all slices of the frame have been submitted. Only used when rendering in time slices,
+    // render waits for every slice instead.
+    bool render_slice(const Camera& cam);
+
+    bool frame_in_progress() const {
+        return this->sliced_frame.has_value();
+    }
+
+    // Render a batch of frames in one submission, see Display::batch_size
+    void render_batch(Span<Camera> cams);
+
+    // Collect the statistics of all but the last submission. The previous submission has most
+    // likely finished by the time the next one is submitted, so waiting for it does not stall
+    // the device. When a submission reuses the swap images of an earlier one, the statistics
+    // of the earlier one are collected before it is overwritten.
     void collect_stats();
-    RenderStats stats() const;
+
+    // Collect the statistics of all submissions, waiting for the last one to finish
+    void finish_stats();
+
+    // The number of frames of which statistics were collected during the last render or batch,
+    // which are then returned by stats(frame). Lags one submission behind, and is 0 after
+    // the first one.
+    size_t stats_frames() const {
+        return this->collected_frames;
+    }
+
+    RenderStats stats(size_t frame = 0) const;
+
+    // Recreates the pipeline with a different local size. The size must be
+    // supported by the device, see Renderer::supports_local_size.
+    void set_local_size(Vec2<uint32_t> local_size);
+    bool supports_local_size(Vec2<uint32_t> local_size) const;
+
+    Vec2<uint32_t> current_local_size() const {
+        return this->local_size;
+    }
+
+    const RenderDevice& render_device() const {
+        return *this->rendev;
+    }
+
+    // Render at a fraction of the output resolution from the next frame on. Only
+    // supported when the render context enables dynamic resolution.
+    void set_render_scale(float scale);
+
+    float current_render_scale() const {
+        return this->render_scale;
+    }
 
 private:
     void create_resources();
+    void create_descriptor_set_layout();
     void create_pipeline();
     void create_descriptor_sets();
     void create_command_buffers();
+    void create_uniform_buffer();
+    void create_upscale_resources();
+    void create_tile_resources();
+    void create_beam_buffers();
+    void create_counter_buffers();
+    void record_command_buffers();
+    void record_scaled(size_t output, uint32_t swap_index, vk::CommandBuffer cmd_buf);
+    void record_tiled(size_t output, uint32_t swap_index, vk::CommandBuffer cmd_buf);
+    void record_beam(size_t output, uint32_t swap_index, vk::CommandBuffer cmd_buf);
+    void record_counter_barrier(vk::CommandBuffer cmd_buf);
+    Submission begin_submission(size_t frames);
+    void collect(const Submission& submission);
+    void collect_counters(const Submission& submission);
+    void signal_counters(size_t output, uint32_t swap_index) const;
+    bool advance_slices(size_t output);
+    void wait_slices() const;
+    void update_slice_size(uint32_t first_tile, size_t tiles);
     void update_descriptor_sets();
     void upload_uniform_buffers();
+    void write_regions(size_t output, uint32_t swap_index) const;
+    void write_camera(size_t output, uint32_t swap_index, const Camera& cam) const;
+    UniformBuffer* uniform_slot(size_t output, uint32_t swap_index) const;
     vk::UniqueDescriptorPool create_descriptor_pool(const Device& device, uint32_t sets);
 };
 
@@ -0,0 +1,48 @@
+#include "render/ResolutionScaler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // The lowest fraction of the output resolution which is rendered
+    constexpr const float MIN_SCALE = 0.25f;
+
+    // Limit the change per frame, so that a single slow frame does not drop the resolution too far
+    constexpr const float MAX_DECREASE = 0.75f;
+    constexpr const float MAX_INCREASE = 1.1f;
+
+    // The scale is not changed when the frame time is within this fraction of the budget,
+    // to avoid oscillating between two resolutions
+    constexpr const double TOLERANCE = 0.1;
+
+    // Factor with which the scale is increased every frame while the camera is still
+    constexpr const float RESTORE_STEP = 1.25f;
+}
+
+ResolutionScaler::ResolutionScaler(double target_fps):
+    budget(1000.0 / target_fps),
+    scale(1),
+    first(true) {
+}
+
+float ResolutionScaler::update(const RenderStats& stats, const Camera& cam) {
+    const bool moving = this->first || cam != this->last_camera;
+    this->last_camera = cam;
+    this->first = false;
+
+    if (!moving) {
+        this->scale = std::min(this->scale * RESTORE_STEP, 1.f);
+        return this->scale;
+    }
+
+    // Devices render in parallel, so the slowest determines the frame time
+    const double time = stats.max_render_time;
+    if (time <= 0 || std::abs(time - this->budget) < this->budget * TOLERANCE) {
+        return this->scale;
+    }
+
+    // The render time is roughly proportional to the number of pixels, which is quadratic in the scale.
+    // The statistics lag behind, so correct the scale at which the measured frame was rendered.
+    const auto factor = static_cast<float>(std::sqrt(this->budget / time));
+    this->scale = std::clamp(stats.render_scale * std::clamp(factor, MAX_DECREASE, MAX_INCREASE), MIN_SCALE, 1.f);
+    return this->scale;
+}
@@ -0,0 +1,28 @@
+#ifndef _XENODON_RENDER_RESOLUTIONSCALER_H
+#define _XENODON_RENDER_RESOLUTIONSCALER_H
+
+#include "render/RenderStats.h"
+#include "camera/Camera.h"
+
+// Chooses the render scale of the next frame. While the camera moves, the scale is adjusted
+// so that the GPU time of a frame fits within the budget of the target frame rate. Once the
+// camera stops moving, the scale is increased step by step until full resolution is restored.
+class ResolutionScaler {
+    double budget;
+    float scale;
+    Camera last_camera;
+    bool first;
+
+public:
+    ResolutionScaler(double target_fps);
+
+    // Update with the statistics of the frame rendered with the given camera, and
+    // return the scale of the next frame
+    float update(const RenderStats& stats, const Camera& cam);
+
+    float current_scale() const {
+        return this->scale;
+    }
+};
+
+#endif
@@ -1,4 +1,8 @@
 #include "render/SvoRaytraceAlgorithm.h"
+#include <algorithm>
+#include <numeric>
+#include "core/Logger.h"
+#include "resources.h"
 
 namespace {
     const auto SVO_BINDINGS = std::array {
@@ -7,6 +11,45 @@ namespace {
             vk::DescriptorType::eStorageBuffer
         }
     };
+
+    // Count the unique nodes in every subtree at the given depth. Leaves above this depth
+    // are counted in the subtree of their first descendant, see Octree::subset.
+    std::vector<size_t> count_subtree_nodes(const Octree& octree, size_t depth) {
+        const auto nodes = octree.data();
+        auto counts = std::vector<size_t>(size_t{1} << (3 * depth), 0);
+
+        // Nodes may be shared in a DAG, so remember the last subtree a node was counted in
+        auto counted_in = std::vector<size_t>(nodes.size(), counts.size());
+
+        auto count = [&](auto& self, uint32_t index, size_t subtree) -> void {
+            if (counted_in[index] == subtree) {
+                return;
+            }
+
+            counted_in[index] = subtree;
+            ++counts[subtree];
+
+            if (!nodes[index].is_leaf()) {
+                for (uint32_t child : nodes[index].children) {
+                    self(self, child, subtree);
+                }
+            }
+        };
+
+        auto walk = [&](auto& self, uint32_t index, size_t level, size_t path) -> void {
+            if (level == depth || nodes[index].is_leaf()) {
+                count(count, index, path << (3 * (depth - level)));
+                return;
+            }
+
+            for (size_t i = 0; i < 8; ++i) {
+                self(self, nodes[index].children[i], level + 1, path * 8 + i);
+            }
+        };
+
+        walk(walk, Octree::ROOT, 0, 0);
+        return counts;
+    }
 }
 
 SvoRaytraceResources::SvoRaytraceResources(const RenderDevice& rendev, const Octree& octree):
@@ -64,9 +107,42 @@ void SvoRaytraceResources::update_descriptors(vk::DescriptorSet set) const {
     this->node_buffer.device().updateDescriptorSets(descriptor_write, nullptr);
 }
 
-SvoRaytraceAlgorithm::SvoRaytraceAlgorithm(std::string_view shader_source, std::shared_ptr<Octree> octree):
+SvoRaytraceAlgorithm::SvoRaytraceAlgorithm(std::string_view shader_source, std::shared_ptr<Octree> octree, size_t bricks):
     shader_source(shader_source),
-    octree(octree) {
+    octree(octree),
+    num_bricks(bricks),
+    subtree_depth(0) {
+
+    if (bricks == 1) {
+        return;
+    }
+
+    // Use at least 8 subtrees per brick, so that they can be distributed somewhat evenly
+    while ((size_t{1} << (3 * this->subtree_depth)) < bricks * 8) {
+        ++this->subtree_depth;
+    }
+
+    const auto counts = count_subtree_nodes(*this->octree, this->subtree_depth);
+
+    auto order = std::vector<size_t>(counts.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&counts](size_t a, size_t b) {
+        return counts[a] > counts[b];
+    });
+
+    // Greedily assign the largest remaining subtree to the brick with the least nodes
+    auto brick_nodes = std::vector<size_t>(bricks, 0);
+    this->subtree_bricks.resize(counts.size());
+
+    for (size_t subtree : order) {
+        const auto brick = static_cast<size_t>(std::min_element(brick_nodes.begin(), brick_nodes.end()) - brick_nodes.begin());
+        this->subtree_bricks[subtree] = brick;
+        brick_nodes[brick] += counts[subtree];
+    }
+
+    for (size_t i = 0; i < bricks; ++i) {
+        LOGGER.log("Brick {}: {} nodes", i, brick_nodes[i]);
+    }
 }
 
 std::string_view SvoRaytraceAlgorithm::shader() const {
@@ -77,6 +153,28 @@ Span<Binding> SvoRaytraceAlgorithm::bindings() const {
     return SVO_BINDINGS;
 }
 
-std::unique_ptr<RenderResources> SvoRaytraceAlgorithm::upload_resources(const RenderDevice& rendev) const {
-    return std::make_unique<SvoRaytraceResources>(rendev, *this->octree.get());
+size_t SvoRaytraceAlgorithm::bricks() const {
+    return this->num_bricks;
+}
+
+Vec3<uint32_t> SvoRaytraceAlgorithm::brick_offset(size_t) const {
+    // Every brick is a pruned version of the whole octree, so its coordinates do not change
+    return {0, 0, 0};
+}
+
+std::unique_ptr<RenderResources> SvoRaytraceAlgorithm::upload_resources(const RenderDevice& rendev, size_t brick) const {
+    if (this->num_bricks == 1) {
+        return std::make_unique<SvoRaytraceResources>(rendev, *this->octree.get());
+    }
+
+    // Only construct the brick when it is needed, so that they dont all need to be in memory at once
+    const auto part = this->octree->subset(this->subtree_depth, [this, brick](size_t subtree) {
+        return this->subtree_bricks[subtree] == brick;
+    });
+
+    return std::make_unique<SvoRaytraceResources>(rendev, part);
+}
+
+std::string_view SvoRaytraceAlgorithm::beam_shader() const {
+    return resources::open("resources/svo_beam.comp");
 }
@@ -3,6 +3,7 @@
 
 #include <string_view>
 #include <memory>
+#include <vector>
 #include <cstddef>
 #include "render/RenderAlgorithm.h"
 #include "model/Octree.h"
@@ -22,11 +23,20 @@ class SvoRaytraceAlgorithm: public RenderAlgorithm {
     std::string_view shader_source;
     std::shared_ptr<Octree> octree;
 
+    // With multiple bricks, the subtrees at `subtree_depth` are distributed over the bricks,
+    // and the brick of every subtree is stored in `subtree_bricks`
+    size_t num_bricks;
+    size_t subtree_depth;
+    std::vector<size_t> subtree_bricks;
+
 public:
-    SvoRaytraceAlgorithm(std::string_view shader_source, std::shared_ptr<Octree> octree);
+    SvoRaytraceAlgorithm(std::string_view shader_source, std::shared_ptr<Octree> octree, size_t bricks = 1);
     std::string_view shader() const override;
     Span<Binding> bindings() const override;
-    std::unique_ptr<RenderResources> upload_resources(const RenderDevice& rendev) const override;
+    size_t bricks() const override;
+    Vec3<uint32_t> brick_offset(size_t brick) const override;
+    std::unique_ptr<RenderResources> upload_resources(const RenderDevice& rendev, size_t brick) const override;
+    std::string_view beam_shader() const override;
 };
 
 #endif
@@ -0,0 +1,200 @@
+#include "render/WorkgroupTuner.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include "core/Logger.h"
+
+namespace {
+    // Frames rendered before measuring a candidate, so that the new pipeline is warmed up
+    constexpr const size_t WARMUP_FRAMES = 2;
+
+    // Frames over which the render time of a candidate is measured
+    constexpr const size_t MEASURE_FRAMES = 16;
+
+    // Candidate local sizes: all power-of-two shapes of 32 to 256 invocations,
+    // so that at least a full subgroup is used on common hardware.
+    const auto CANDIDATES = std::vector<Vec2<uint32_t>> {
+        {32, 1}, {16, 2}, {8, 4}, {4, 8}, {2, 16}, {1, 32},
+        {64, 1}, {32, 2}, {16, 4}, {8, 8}, {4, 16}, {2, 32}, {1, 64},
+        {64, 2}, {32, 4}, {16, 8}, {8, 16}, {4, 32}, {2, 64},
+        {64, 4}, {32, 8}, {16, 16}, {8, 32}, {4, 64}
+    };
+
+    std::filesystem::path default_cache_path() {
+        if (const char* xdg_cache = std::getenv("XDG_CACHE_HOME"); xdg_cache && *xdg_cache) {
+            return std::filesystem::path(xdg_cache) / "xenodon" / "workgroup_sizes";
+        } else if (const char* home = std::getenv("HOME"); home && *home) {
+            return std::filesystem::path(home) / ".cache" / "xenodon" / "workgroup_sizes";
+        }
+
+        return std::filesystem::path();
+    }
+
+    std::string device_name(const Renderer& renderer) {
+        return renderer.render_device().device.physical_device().getProperties().deviceName;
+    }
+}
+
+WorkgroupCache::WorkgroupCache():
+    path(default_cache_path()) {
+    if (this->path.empty()) {
+        return;
+    }
+
+    auto in = std::ifstream(this->path);
+    if (!in) {
+        return;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        auto line_stream = std::istringstream(line);
+        Entry entry;
+
+        line_stream >> entry.local_size.x >> entry.local_size.y >> entry.shader >> std::ws;
+        std::getline(line_stream, entry.device_name);
+
+        // Silently skip malformed entries, the cache is only an optimization
+        if (!line_stream.fail() && !entry.device_name.empty()) {
+            this->entries.push_back(std::move(entry));
+        }
+    }
+}
+
+std::optional<Vec2<uint32_t>> WorkgroupCache::find(std::string_view device_name, std::string_view shader) const {
+    auto it = std::find_if(this->entries.begin(), this->entries.end(), [&](const auto& entry) {
+        return entry.device_name == device_name && entry.shader == shader;
+    });
+
+    if (it == this->entries.end()) {
+        return std::nullopt;
+    }
+
+    return it->local_size;
+}
+
+void WorkgroupCache::insert(std::string_view device_name, std::string_view shader, Vec2<uint32_t> local_size) {
+    auto it = std::find_if(this->entries.begin(), this->entries.end(), [&](const auto& entry) {
+        return entry.device_name == device_name && entry.shader == shader;
+    });
+
+    if (it == this->entries.end()) {
+        this->entries.push_back({local_size, std::string(shader), std::string(device_name)});
+    } else {
+        it->local_size = local_size;
+    }
+}
+
+void WorkgroupCache::save() const {
+    if (this->path.empty()) {
+        LOGGER.log("Warning: Cannot determine workgroup cache path, results are not saved");
+        return;
+    }
+
+    auto ec = std::error_code();
+    std::filesystem::create_directories(this->path.parent_path(), ec);
+
+    auto out = std::ofstream(this->path);
+    if (!out) {
+        LOGGER.log("Warning: Failed to open workgroup cache '{}'", this->path.native());
+        return;
+    }
+
+    for (const auto& entry : this->entries) {
+        out << entry.local_size.x << ' ' << entry.local_size.y << ' ' << entry.shader << ' ' << entry.device_name << '\n';
+    }
+
+    LOGGER.log("Saved workgroup sizes to '{}'", this->path.native());
+}
+
+void tune_workgroup_sizes(MultiplexRenderer& renderer, const Camera& cam, std::string_view shader, WorkgroupCache& cache) {
+    const size_t n = renderer.num_devices();
+
+    auto best_times = std::vector<double>(n, std::numeric_limits<double>::max());
+    auto best_sizes = std::vector<Vec2<uint32_t>>(n);
+    for (size_t i = 0; i < n; ++i) {
+        best_sizes[i] = renderer.device_renderer(i).current_local_size();
+    }
+
+    LOGGER.log("Tuning workgroup sizes for shader '{}' ({} candidates)...", shader, CANDIDATES.size());
+
+    for (const auto candidate : CANDIDATES) {
+        // Devices that do not support the candidate keep rendering with their current
+        // local size, their measurements are simply ignored.
+        auto supported = std::vector<bool>(n);
+        for (size_t i = 0; i < n; ++i) {
+            auto& dev_renderer = renderer.device_renderer(i);
+            supported[i] = dev_renderer.supports_local_size(candidate);
+            if (supported[i]) {
+                dev_renderer.set_local_size(candidate);
+            }
+        }
+
+        for (size_t frame = 0; frame < WARMUP_FRAMES; ++frame) {
+            renderer.render(cam);
+        }
+
+        renderer.finish_stats();
+
+        auto times = std::vector<double>(n, 0);
+        auto add_times = [&] {
+            for (size_t i = 0; i < n; ++i) {
+                times[i] += renderer.device_renderer(i).stats().total_render_time;
+            }
+        };
+
+        // Statistics lag one frame behind, the last frame is collected afterwards
+        for (size_t frame = 0; frame < MEASURE_FRAMES; ++frame) {
+            renderer.render(cam);
+            if (renderer.stats_frames() > 0) {
+                add_times();
+            }
+        }
+
+        renderer.finish_stats();
+        add_times();
+
+        for (size_t i = 0; i < n; ++i) {
+            if (!supported[i]) {
+                continue;
+            }
+
+            const double avg = times[i] / static_cast<double>(MEASURE_FRAMES);
+            LOGGER.log("Device {}: {}x{}: {} ms", i, candidate.x, candidate.y, avg);
+
+            if (avg < best_times[i]) {
+                best_times[i] = avg;
+                best_sizes[i] = candidate;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        auto& dev_renderer = renderer.device_renderer(i);
+        const auto name = device_name(dev_renderer);
+        LOGGER.log("Device {} ({}): best workgroup size {}x{}", i, name, best_sizes[i].x, best_sizes[i].y);
+
+        dev_renderer.set_local_size(best_sizes[i]);
+        cache.insert(name, shader, best_sizes[i]);
+    }
+}
+
+void apply_cached_workgroup_sizes(MultiplexRenderer& renderer, std::string_view shader, const WorkgroupCache& cache) {
+    const size_t n = renderer.num_devices();
+    for (size_t i = 0; i < n; ++i) {
+        auto& dev_renderer = renderer.device_renderer(i);
+        const auto local_size = cache.find(device_name(dev_renderer), shader);
+
+        if (!local_size) {
+            continue;
+        } else if (!dev_renderer.supports_local_size(local_size.value())) {
+            LOGGER.log("Warning: Ignoring unsupported cached workgroup size {}x{} for device {}", local_size->x, local_size->y, i);
+            continue;
+        }
+
+        LOGGER.log("Device {}: using cached workgroup size {}x{}", i, local_size->x, local_size->y);
+        dev_renderer.set_local_size(local_size.value());
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef _XENODON_RENDER_WORKGROUPTUNER_H
+#define _XENODON_RENDER_WORKGROUPTUNER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <cstdint>
+#include "render/MultiplexRenderer.h"
+#include "camera/Camera.h"
+#include "math/Vec.h"
+
+// Cache of the best local size found for each combination of device and shader.
+// It is stored in $XDG_CACHE_HOME/xenodon/workgroup_sizes (or ~/.cache/xenodon/ if
+// XDG_CACHE_HOME is not set), in which each line has the form
+// <width> <height> <shader> <device name>
+class WorkgroupCache {
+    struct Entry {
+        Vec2<uint32_t> local_size;
+        std::string shader;
+        std::string device_name;
+    };
+
+    std::filesystem::path path;
+    std::vector<Entry> entries;
+
+public:
+    WorkgroupCache();
+    std::optional<Vec2<uint32_t>> find(std::string_view device_name, std::string_view shader) const;
+    void insert(std::string_view device_name, std::string_view shader, Vec2<uint32_t> local_size);
+    void save() const;
+};
+
+// Benchmark a set of local sizes on every device, and store the best in the cache.
+void tune_workgroup_sizes(MultiplexRenderer& renderer, const Camera& cam, std::string_view shader, WorkgroupCache& cache);
+
+// Set the local size of every device to the cached value, if any.
+void apply_cached_workgroup_sizes(MultiplexRenderer& renderer, std::string_view shader, const WorkgroupCache& cache);
+
+#endif
@@ -0,0 +1,669 @@
+#include "serve.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fmt/format.h>
+#include <lodepng.h>
+#include "core/arg_parse.h"
+#include "core/Error.h"
+#include "core/Json.h"
+#include "core/Logger.h"
+#include "core/Trace.h"
+#include "backend/headless/headless.h"
+#include "utility/ThreadPool.h"
+#include "utility/rect_union.h"
+#include "utility/take_stdout.h"
+#include "main_loop.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr const size_t DEFAULT_MAX_BATCH = 16;
+
+    struct ServeOptions {
+        std::filesystem::path volume_path;
+        std::filesystem::path config;
+        std::filesystem::path socket;
+        std::string_view volume_type;
+        std::string_view shader;
+        float emission_coeff = 1.f;
+        uint32_t frames_in_flight = 2;
+        size_t max_batch = DEFAULT_MAX_BATCH;
+        bool beam = false;
+        bool quiet = false;
+        std::filesystem::path log_output;
+    };
+
+    // A client of the server. Requests are read from in_fd by a single thread, responses may be
+    // written to out_fd from any thread. For socket clients, both are the same descriptor.
+    class Connection {
+        int in_fd;
+        int out_fd;
+        std::string received;
+        std::mutex write_mutex;
+
+    public:
+        Connection(int in_fd, int out_fd):
+            in_fd(in_fd), out_fd(out_fd) {
+        }
+
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        ~Connection() {
+            close(this->in_fd);
+            if (this->out_fd != this->in_fd) {
+                close(this->out_fd);
+            }
+        }
+
+        // Returns the next line without the newline, or nothing at the end of the input
+        std::optional<std::string> read_line() {
+            while (true) {
+                const auto newline = this->received.find('\n');
+                if (newline != std::string::npos) {
+                    auto line = this->received.substr(0, newline);
+                    this->received.erase(0, newline + 1);
+                    return line;
+                }
+
+                char buffer[4096];
+                const ssize_t n = read(this->in_fd, buffer, sizeof buffer);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                } else if (n <= 0) {
+                    return std::nullopt;
+                }
+
+                this->received.append(buffer, static_cast<size_t>(n));
+            }
+        }
+
+        // Unblock the reading thread of a socket client
+        void stop_reading() {
+            shutdown(this->in_fd, SHUT_RD);
+        }
+
+        // Write a response header line, followed by its payload. Returns false if the client is gone.
+        bool send(std::string_view header, const std::vector<unsigned char>& payload = {}) {
+            auto lock = std::lock_guard(this->write_mutex);
+            return this->write_all(header.data(), header.size()) && this->write_all(payload.data(), payload.size());
+        }
+
+    private:
+        bool write_all(const void* data, size_t size) {
+            const auto* bytes = static_cast<const unsigned char*>(data);
+            while (size > 0) {
+                const ssize_t n = write(this->out_fd, bytes, size);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                } else if (n < 0) {
+                    return false;
+                }
+
+                bytes += n;
+                size -= static_cast<size_t>(n);
+            }
+
+            return true;
+        }
+    };
+
+    struct Request {
+        std::shared_ptr<Connection> connection;
+
+        // The id of the request as given by the client, as JSON
+        std::string id;
+
+        ServeFrame frame;
+        Clock::time_point received;
+        Clock::time_point started;
+    };
+
+    double elapsed_ms(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    std::string error_response(std::string_view id, std::string_view message) {
+        auto buf = fmt::memory_buffer();
+        fmt::format_to(buf, "{{\"id\": {}, \"status\": \"error\", \"message\": ", id);
+        json::write_string(buf, message);
+        fmt::format_to(buf, "}}\n");
+        return fmt::to_string(buf);
+    }
+
+    class RequestQueue {
+        std::deque<Request> requests;
+        bool closed = false;
+        std::mutex mutex;
+        std::condition_variable available;
+
+    public:
+        // Returns false if the queue is closed, in which case the request is dropped
+        bool push(Request&& request) {
+            {
+                auto lock = std::lock_guard(this->mutex);
+                if (this->closed) {
+                    return false;
+                }
+
+                this->requests.push_back(std::move(request));
+            }
+
+            this->available.notify_one();
+            return true;
+        }
+
+        // Stop accepting requests. Requests which are already queued are still taken.
+        void close() {
+            {
+                auto lock = std::lock_guard(this->mutex);
+                this->closed = true;
+            }
+
+            this->available.notify_one();
+        }
+
+        bool is_closed() {
+            auto lock = std::lock_guard(this->mutex);
+            return this->closed;
+        }
+
+        // Block until requests are queued, and take up to `max` of them in order. Returns nothing
+        // once the queue is closed and empty.
+        std::vector<Request> take(size_t max) {
+            auto lock = std::unique_lock(this->mutex);
+            this->available.wait(lock, [this] {
+                return this->closed || !this->requests.empty();
+            });
+
+            auto batch = std::vector<Request>();
+            const auto now = Clock::now();
+            while (!this->requests.empty() && batch.size() < max) {
+                batch.push_back(std::move(this->requests.front()));
+                this->requests.pop_front();
+                batch.back().started = now;
+            }
+
+            return batch;
+        }
+    };
+
+    // Receives the frames of the display in order, and sends each as PNG to the client which
+    // requested it. Encoding happens on a pool of worker threads.
+    class ResponseWriter final: public FrameWriter {
+        std::deque<Request> pending;
+        std::mutex mutex;
+
+        size_t served;
+        double total_latency;
+        double max_latency;
+
+        ThreadPool pool;
+
+    public:
+        explicit ResponseWriter(vk::Extent2D extent):
+            FrameWriter(extent, ThreadPool::default_threads() + 2),
+            served(0),
+            total_latency(0),
+            max_latency(0),
+            pool(ThreadPool::default_threads(), ThreadPool::default_threads()) {
+        }
+
+        // Queue the requests of the next frames, in the order they will be rendered
+        void expect(std::vector<Request>&& requests) {
+            auto lock = std::lock_guard(this->mutex);
+            for (auto& request : requests) {
+                this->pending.push_back(std::move(request));
+            }
+        }
+
+        void write(size_t frame, FrameBuffer&& buffer) override {
+            Request request;
+            {
+                auto lock = std::lock_guard(this->mutex);
+                request = std::move(this->pending.front());
+                this->pending.pop_front();
+            }
+
+            this->pool.submit([this, frame, request = std::move(request), buffer = std::move(buffer)]() mutable {
+                this->respond(frame, request, std::move(buffer));
+            });
+        }
+
+        void wait() override {
+            this->pool.wait();
+        }
+
+        void log_summary() {
+            auto lock = std::lock_guard(this->mutex);
+            LOGGER.log(
+                "served {} requests, mean latency: {}ms, max latency: {}ms",
+                this->served,
+                this->served > 0 ? this->total_latency / static_cast<double>(this->served) : 0.0,
+                this->max_latency
+            );
+        }
+
+    private:
+        void respond(size_t frame, const Request& request, FrameBuffer&& buffer) {
+            const auto extent = request.frame.extent;
+            const size_t stride = this->frame_extent().width;
+
+            // The frame is rendered to the top left of the display
+            auto pixels = std::vector<unsigned char>(static_cast<size_t>(extent.width) * extent.height * sizeof(Pixel));
+            for (size_t y = 0; y < extent.height; ++y) {
+                std::memcpy(&pixels[y * extent.width * sizeof(Pixel)], &buffer[y * stride], extent.width * sizeof(Pixel));
+            }
+
+            this->release(std::move(buffer));
+
+            auto png = std::vector<unsigned char>();
+            const unsigned error = [&] {
+                TRACE_SCOPE("lodepng::encode");
+                return lodepng::encode(png, pixels, extent.width, extent.height);
+            }();
+
+            if (error) {
+                LOGGER.log("Error encoding frame {}: {}", frame, lodepng_error_text(error));
+                request.connection->send(error_response(request.id, lodepng_error_text(error)));
+                return;
+            }
+
+            const auto now = Clock::now();
+            const double queue_ms = elapsed_ms(request.received, request.started);
+            const double latency_ms = elapsed_ms(request.received, now);
+
+            const auto header = fmt::format(
+                "{{\"id\": {}, \"status\": \"ok\", \"width\": {}, \"height\": {}, \"format\": \"png\", \"size\": {}, \"queue_ms\": {}, \"latency_ms\": {}}}\n",
+                request.id,
+                extent.width,
+                extent.height,
+                png.size(),
+                queue_ms,
+                latency_ms
+            );
+
+            if (!request.connection->send(header, png)) {
+                LOGGER.log("Failed to send frame {} to its client: {}", frame, std::strerror(errno));
+                return;
+            }
+
+            LOGGER.log("request {}: {}x{}, queued: {}ms, latency: {}ms", request.id, extent.width, extent.height, queue_ms, latency_ms);
+
+            auto lock = std::lock_guard(this->mutex);
+            ++this->served;
+            this->total_latency += latency_ms;
+            this->max_latency = std::max(this->max_latency, latency_ms);
+        }
+    };
+
+    Vec3F parse_vec3(const json::Object& obj, std::string_view key) {
+        const auto it = obj.find(key);
+        if (it == obj.end()) {
+            throw Error("Missing '{}'", key);
+        }
+
+        const auto& items = it->second.as_array();
+        if (items.size() != 3) {
+            throw Error("'{}' must have 3 elements", key);
+        }
+
+        return Vec3F(
+            static_cast<float>(items[0].as_number()),
+            static_cast<float>(items[1].as_number()),
+            static_cast<float>(items[2].as_number())
+        );
+    }
+
+    uint32_t parse_dim(const json::Object& obj, std::string_view key, uint32_t min, uint32_t max) {
+        const auto it = obj.find(key);
+        if (it == obj.end()) {
+            return max;
+        }
+
+        const double value = it->second.as_number();
+        // Check the range first, as converting an out-of-range or NaN value is undefined
+        if (!(value >= min && value <= max) || value != std::floor(value)) {
+            throw Error("'{}' must be an integer between {} and {}", key, min, max);
+        }
+
+        return static_cast<uint32_t>(value);
+    }
+
+    // Everything a reading thread needs to turn lines into requests
+    struct RequestParser {
+        RequestQueue& queue;
+        vk::Extent2D max_extent;
+        uint32_t devices;
+
+        // Handle one line of a client, and return false if the client asked to shut down the server
+        bool handle(const std::shared_ptr<Connection>& connection, std::string_view line) {
+            const auto received = Clock::now();
+            auto id = std::string("null");
+
+            try {
+                const auto value = json::parse(line);
+                const auto& obj = value.as_object();
+
+                if (const auto it = obj.find("id"); it != obj.end()) {
+                    if (it->second.is<std::string>()) {
+                        auto buf = fmt::memory_buffer();
+                        json::write_string(buf, it->second.as_string());
+                        id = fmt::to_string(buf);
+                    } else {
+                        id = fmt::format("{}", it->second.as_number());
+                    }
+                }
+
+                if (const auto it = obj.find("command"); it != obj.end()) {
+                    if (it->second.as_string() != "shutdown") {
+                        throw Error("Invalid command '{}'", it->second.as_string());
+                    }
+
+                    LOGGER.log("Shutdown requested");
+                    this->queue.close();
+                    return false;
+                }
+
+                // Every device renders at least one row
+                const auto frame = ServeFrame{
+                    .camera = {
+                        .forward = parse_vec3(obj, "forward"),
+                        .up = parse_vec3(obj, "up"),
+                        .translation = parse_vec3(obj, "position")
+                    },
+                    .extent = {
+                        parse_dim(obj, "width", 1, this->max_extent.width),
+                        parse_dim(obj, "height", this->devices, this->max_extent.height)
+                    }
+                };
+
+                if (!this->queue.push({connection, id, frame, received, received})) {
+                    throw Error("Server is shutting down");
+                }
+            } catch (const Error& e) {
+                connection->send(error_response(id, e.what()));
+            }
+
+            return true;
+        }
+
+        void read_all(const std::shared_ptr<Connection>& connection) {
+            while (auto line = connection->read_line()) {
+                if (!line->empty() && !this->handle(connection, *line)) {
+                    return;
+                }
+            }
+        }
+    };
+
+    // Listens on a UNIX socket, and reads the requests of every client on its own thread
+    class SocketListener {
+        std::filesystem::path path;
+        int fd;
+        RequestParser& parser;
+        std::thread acceptor;
+
+        // Every client has its own reading thread, which sets `done` once the client is gone
+        struct Reader {
+            std::thread thread;
+            std::weak_ptr<Connection> connection;
+            std::unique_ptr<std::atomic<bool>> done;
+        };
+
+        std::vector<Reader> readers;
+        std::mutex mutex;
+
+    public:
+        SocketListener(const std::filesystem::path& path, RequestParser& parser):
+            path(path), fd(-1), parser(parser) {
+
+            auto addr = sockaddr_un();
+            addr.sun_family = AF_UNIX;
+            if (path.native().size() >= sizeof addr.sun_path) {
+                throw Error("Socket path '{}' is too long", path.native());
+            }
+
+            std::strcpy(addr.sun_path, path.c_str());
+
+            // Remove a socket left behind by an earlier server, but nothing else
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                unlink(path.c_str());
+            }
+
+            this->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (this->fd < 0) {
+                throw Error("Failed to create socket: {}", std::strerror(errno));
+            }
+
+            if (bind(this->fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) < 0 || listen(this->fd, SOMAXCONN) < 0) {
+                const int err = errno;
+                close(this->fd);
+                throw Error("Failed to listen on '{}': {}", path.native(), std::strerror(err));
+            }
+
+            LOGGER.log("Listening on '{}'", path.native());
+            this->acceptor = std::thread(&SocketListener::accept_all, this);
+        }
+
+        SocketListener(const SocketListener&) = delete;
+        SocketListener& operator=(const SocketListener&) = delete;
+
+        ~SocketListener() {
+            // Wakes up the acceptor, which then stops
+            shutdown(this->fd, SHUT_RDWR);
+            this->acceptor.join();
+
+            {
+                auto lock = std::lock_guard(this->mutex);
+                for (const auto& reader : this->readers) {
+                    if (auto connection = reader.connection.lock()) {
+                        connection->stop_reading();
+                    }
+                }
+            }
+
+            for (auto& reader : this->readers) {
+                reader.thread.join();
+            }
+
+            close(this->fd);
+            unlink(this->path.c_str());
+        }
+
+    private:
+        void accept_all() {
+            while (!this->parser.queue.is_closed()) {
+                const int client = accept(this->fd, nullptr, nullptr);
+                if (client < 0 && errno == EINTR) {
+                    continue;
+                } else if (client < 0) {
+                    return;
+                }
+
+                auto connection = std::make_shared<Connection>(client, client);
+                auto done = std::make_unique<std::atomic<bool>>(false);
+
+                auto lock = std::lock_guard(this->mutex);
+                this->reap_readers();
+
+                auto thread = std::thread([this, connection, done = done.get()] {
+                    this->parser.read_all(connection);
+                    done->store(true);
+                });
+
+                this->readers.push_back({std::move(thread), connection, std::move(done)});
+            }
+        }
+
+        // Join the threads of the clients which are gone, so that a long running server does
+        // not accumulate them
+        void reap_readers() {
+            auto it = std::remove_if(this->readers.begin(), this->readers.end(), [](Reader& reader) {
+                if (!reader.done->load()) {
+                    return false;
+                }
+
+                reader.thread.join();
+                return true;
+            });
+
+            this->readers.erase(it, this->readers.end());
+        }
+    };
+}
+
+bool serve(Span<const char*> args) {
+    auto opts = ServeOptions();
+
+    auto cmd = args::Command {
+        .flags = {
+            {&opts.quiet, "--quiet", 'q'},
+            {&opts.beam, "--beam"}
+        },
+        .parameters = {
+            {args::path_opt(&opts.config), "config path", "--headless"},
+            {args::path_opt(&opts.socket), "socket path", "--socket"},
+            {args::string_opt(&opts.volume_type), "volume type", "--volume-type"},
+            {args::string_opt(&opts.shader), "shader", "--shader", 's'},
+            {args::float_range_opt(&opts.emission_coeff, 0.f), "emission coefficient", "--emission-coeff", 'e'},
+            {args::int_range_opt(&opts.frames_in_flight, uint32_t{1}), "amount", "--frames-in-flight"},
+            {args::int_range_opt(&opts.max_batch, size_t{1}), "requests", "--max-batch"},
+            {args::path_opt(&opts.log_output), "output path", "--log-output"}
+        },
+        .positional = {
+            {args::path_opt(&opts.volume_path), "volume path"}
+        }
+    };
+
+    try {
+        args::parse(args, cmd);
+
+        if (opts.config.empty()) {
+            throw Error("Missing required option --headless");
+        }
+    } catch (const Error& e) {
+        fmt::print(stderr, "Error: {}\n", e.what());
+        return false;
+    }
+
+    // A client which disconnects early should not terminate the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    try {
+        // Responses are written to the original standard output, so take it before anything is logged to it
+        const int out_fd = opts.socket.empty() ? take_stdout() : -1;
+
+        if (!opts.quiet) {
+            LOGGER.add_sink<ConsoleSink>();
+        }
+
+        if (!opts.log_output.empty()) {
+            LOGGER.add_sink<FileSink>(opts.log_output);
+        }
+
+        auto render_params = RenderParameters();
+        render_params.volume_path = opts.volume_path;
+        render_params.volume_type_override = opts.volume_type;
+        render_params.shader = opts.shader;
+        render_params.emission_coeff = opts.emission_coeff;
+        render_params.beam = opts.beam;
+
+        const auto config = load_headless_config(opts.config);
+        const auto max_extent = rect_union(config.gpus.begin(), config.gpus.end(), [](const HeadlessConfig::Device& gpu_config) {
+            return gpu_config.region;
+        }).extent;
+
+        // Outputs are moved around for every resolution, and frames are only sent to clients
+        auto display = HeadlessDisplay(config, HeadlessOptions{
+            .frames_in_flight = opts.frames_in_flight,
+            .dynamic_regions = true
+        });
+
+        auto writer = std::make_unique<ResponseWriter>(max_extent);
+        auto& responses = *writer;
+        display.set_writer(std::move(writer));
+
+        auto queue = RequestQueue();
+        auto parser = RequestParser{queue, max_extent, static_cast<uint32_t>(config.gpus.size())};
+
+        std::optional<SocketListener> listener;
+        std::thread stdin_reader;
+
+        if (opts.socket.empty()) {
+            LOGGER.log("Reading requests from standard input");
+            stdin_reader = std::thread([&parser, &queue, connection = std::make_shared<Connection>(STDIN_FILENO, out_fd)] {
+                parser.read_all(connection);
+                queue.close();
+            });
+        } else {
+            listener.emplace(opts.socket, parser);
+        }
+
+        auto next_batch = [&] {
+            auto batch = queue.take(opts.max_batch);
+
+            // Group the frames of the same size, so that the outputs are moved as little as possible
+            std::stable_sort(batch.begin(), batch.end(), [](const Request& lhs, const Request& rhs) {
+                return std::make_pair(lhs.frame.extent.width, lhs.frame.extent.height) <
+                    std::make_pair(rhs.frame.extent.width, rhs.frame.extent.height);
+            });
+
+            auto frames = std::vector<ServeFrame>();
+            for (const auto& request : batch) {
+                frames.push_back(request.frame);
+            }
+
+            responses.expect(std::move(batch));
+            return frames;
+        };
+
+        try {
+            serve_loop(&display, render_params, next_batch);
+        } catch (...) {
+            queue.close();
+            listener.reset();
+
+            // A read from standard input cannot be interrupted, but the process exits anyway
+            if (stdin_reader.joinable()) {
+                stdin_reader.detach();
+            }
+
+            throw;
+        }
+
+        listener.reset();
+        if (stdin_reader.joinable()) {
+            stdin_reader.join();
+        }
+
+        responses.log_summary();
+    } catch (const Error& e) {
+        fmt::print(stderr, "Error: {}\n", e.what());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,9 @@
+#ifndef _XENODON_SERVE_H
+#define _XENODON_SERVE_H
+
+#include "utility/Span.h"
+
+// Returns false if the server failed to start or stopped because of an error
+bool serve(Span<const char*> args);
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef _XENODON_UTILITY_THREADPOOL_H
+#define _XENODON_UTILITY_THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+// A fixed-size pool of worker threads with a bounded task queue. Submitting a task
+// blocks while the queue is full, so that a fast producer cannot run ahead of the
+// workers indefinitely.
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    size_t max_queued;
+    size_t active;
+    bool stopping;
+
+    std::mutex mutex;
+    std::condition_variable task_available;
+    std::condition_variable task_taken;
+    std::condition_variable idle;
+
+public:
+    ThreadPool(size_t threads, size_t max_queued);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+
+    // Block until all submitted tasks have finished
+    void wait();
+
+    static size_t default_threads() {
+        // Leave one thread for the submitting thread
+        const size_t hw = std::thread::hardware_concurrency();
+        return hw > 1 ? hw - 1 : 1;
+    }
+
+private:
+    void work();
+};
+
+inline ThreadPool::ThreadPool(size_t threads, size_t max_queued):
+    max_queued(max_queued),
+    active(0),
+    stopping(false) {
+    this->workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        this->workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        auto lock = std::unique_lock(this->mutex);
+        this->stopping = true;
+    }
+
+    this->task_available.notify_all();
+
+    for (auto& worker : this->workers) {
+        worker.join();
+    }
+}
+
+inline void ThreadPool::submit(std::function<void()> task) {
+    {
+        auto lock = std::unique_lock(this->mutex);
+        this->task_taken.wait(lock, [this] {
+            return this->tasks.size() < this->max_queued;
+        });
+
+        this->tasks.push_back(std::move(task));
+    }
+
+    this->task_available.notify_one();
+}
+
+inline void ThreadPool::wait() {
+    auto lock = std::unique_lock(this->mutex);
+    this->idle.wait(lock, [this] {
+        return this->tasks.empty() && this->active == 0;
+    });
+}
+
+inline void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+
+        {
+            auto lock = std::unique_lock(this->mutex);
+            this->task_available.wait(lock, [this] {
+                return this->stopping || !this->tasks.empty();
+            });
+
+            // Finish remaining tasks before stopping
+            if (this->tasks.empty()) {
+                return;
+            }
+
+            task = std::move(this->tasks.front());
+            this->tasks.pop_front();
+            ++this->active;
+        }
+
+        this->task_taken.notify_one();
+        task();
+
+        {
+            auto lock = std::unique_lock(this->mutex);
+            --this->active;
+        }
+
+        this->idle.notify_all();
+    }
+}
+
+#endif
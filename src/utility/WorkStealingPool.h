@@ -0,0 +1,167 @@
+#ifndef _XENODON_UTILITY_WORKSTEALINGPOOL_H
+#define _XENODON_UTILITY_WORKSTEALINGPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+// A fixed-size pool of worker threads which process a range of items, such as the tiles of
+// a frame. The items are divided evenly over per-worker queues. Workers take items from the
+// back of their own queue, and when it is empty steal from the front of the queues of the
+// other workers, so that the load stays balanced when some items take much longer than others.
+class WorkStealingPool {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Queue[]> queues;
+    const std::function<void(size_t)>* job;
+
+    // Incremented for every call to run(), which wakes up the workers
+    size_t generation;
+    size_t busy_workers;
+    bool stopping;
+
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+
+public:
+    explicit WorkStealingPool(size_t threads);
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool();
+
+    // Call `job` for every item in [0, items), and block until all calls have returned
+    void run(size_t items, const std::function<void(size_t)>& job);
+
+    size_t threads() const {
+        return this->workers.size();
+    }
+
+private:
+    void work(size_t index);
+    std::optional<size_t> take(size_t index);
+};
+
+inline WorkStealingPool::WorkStealingPool(size_t threads):
+    queues(std::make_unique<Queue[]>(threads)),
+    job(nullptr),
+    generation(0),
+    busy_workers(0),
+    stopping(false) {
+    this->workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        this->workers.emplace_back(&WorkStealingPool::work, this, i);
+    }
+}
+
+inline WorkStealingPool::~WorkStealingPool() {
+    {
+        auto lock = std::unique_lock(this->mutex);
+        this->stopping = true;
+    }
+
+    this->started.notify_all();
+
+    for (auto& worker : this->workers) {
+        worker.join();
+    }
+}
+
+inline void WorkStealingPool::run(size_t items, const std::function<void(size_t)>& job) {
+    const size_t n = this->workers.size();
+
+    // Give every worker a contiguous range, as neighbouring items tend to be similar
+    for (size_t i = 0; i < n; ++i) {
+        auto& queue = this->queues[i];
+        auto lock = std::unique_lock(queue.mutex);
+        for (size_t item = i * items / n; item < (i + 1) * items / n; ++item) {
+            queue.items.push_back(item);
+        }
+    }
+
+    auto lock = std::unique_lock(this->mutex);
+    this->job = &job;
+    this->busy_workers = n;
+    ++this->generation;
+    this->started.notify_all();
+
+    this->finished.wait(lock, [this] {
+        return this->busy_workers == 0;
+    });
+
+    this->job = nullptr;
+}
+
+inline void WorkStealingPool::work(size_t index) {
+    size_t seen_generation = 0;
+
+    while (true) {
+        const std::function<void(size_t)>* job;
+
+        {
+            auto lock = std::unique_lock(this->mutex);
+            this->started.wait(lock, [&] {
+                return this->stopping || this->generation != seen_generation;
+            });
+
+            if (this->stopping) {
+                return;
+            }
+
+            seen_generation = this->generation;
+            job = this->job;
+        }
+
+        while (auto item = this->take(index)) {
+            (*job)(*item);
+        }
+
+        {
+            auto lock = std::unique_lock(this->mutex);
+            --this->busy_workers;
+        }
+
+        this->finished.notify_one();
+    }
+}
+
+inline std::optional<size_t> WorkStealingPool::take(size_t index) {
+    {
+        auto& own = this->queues[index];
+        auto lock = std::unique_lock(own.mutex);
+        if (!own.items.empty()) {
+            const size_t item = own.items.back();
+            own.items.pop_back();
+            return item;
+        }
+    }
+
+    // Items are never added while workers are running, so once all queues are empty
+    // there is nothing left to steal
+    const size_t n = this->workers.size();
+    for (size_t i = 1; i < n; ++i) {
+        auto& victim = this->queues[(index + i) % n];
+        auto lock = std::unique_lock(victim.mutex);
+        if (!victim.items.empty()) {
+            const size_t item = victim.items.front();
+            victim.items.pop_front();
+            return item;
+        }
+    }
+
+    return std::nullopt;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _XENODON_UTILITY_SCALE_RECT_H
+#define _XENODON_UTILITY_SCALE_RECT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vulkan/vulkan.hpp>
+
+// Scale both corners of a rect and round them down, so that rects which are next to each
+// other are still next to each other after scaling. The extent is at least 1.
+inline vk::Rect2D scale_rect(vk::Rect2D rect, float scale) {
+    auto scale_coord = [scale](int64_t x) {
+        return static_cast<int32_t>(std::floor(static_cast<float>(x) * scale));
+    };
+
+    const int32_t x0 = scale_coord(rect.offset.x);
+    const int32_t y0 = scale_coord(rect.offset.y);
+    const int32_t x1 = scale_coord(int64_t{rect.offset.x} + rect.extent.width);
+    const int32_t y1 = scale_coord(int64_t{rect.offset.y} + rect.extent.height);
+
+    return {
+        {x0, y0},
+        {static_cast<uint32_t>(std::max(x1 - x0, 1)), static_cast<uint32_t>(std::max(y1 - y0, 1))}
+    };
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _XENODON_UTILITY_TAKE_STDOUT_H
+#define _XENODON_UTILITY_TAKE_STDOUT_H
+
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "core/Error.h"
+
+// Return a duplicate of the original standard output, and redirect standard output to standard
+// error for the remainder of the program, so that nothing else ends up in the data written to it
+inline int take_stdout() {
+    std::cout.flush();
+    std::fflush(stdout);
+
+    const int fd = dup(STDOUT_FILENO);
+    if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        throw Error("Failed to redirect standard output: {}", std::strerror(errno));
+    }
+
+    return fd;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#include "volume_output.h"
+#include <fstream>
+#include <fmt/format.h>
+#include "core/Error.h"
+
+void save_volume(const Grid& grid, const std::filesystem::path& path, const VolumeOutputOptions& opts) {
+    const auto ext = path.extension();
+    if (ext == ".tif" || ext == ".tiff") {
+        fmt::print("Saving TIFF image...\n");
+        grid.save_tiff(path);
+        return;
+    } else if (ext == ".raw") {
+        fmt::print("Saving raw voxels...\n");
+
+        auto out = std::ofstream(path, std::ios::binary);
+        const auto pixels = grid.pixels();
+        out.write(reinterpret_cast<const char*>(pixels.begin()), static_cast<std::streamsize>(pixels.size() * sizeof(Pixel)));
+        if (!out) {
+            throw Error("Failed to write '{}'", path.native());
+        }
+
+        return;
+    }
+
+    fmt::print("Converting to octree...\n");
+
+    auto stats = ConstructionStats();
+    const auto type = opts.dag ? Octree::Type::Dag : Octree::Type::Sparse;
+    const auto octree = build_octree(grid, stats, ChannelDiffHeuristic{opts.channel_difference}, type);
+
+    save_octree(octree, stats, path);
+}
+
+bool is_octree_path(const std::filesystem::path& path) {
+    const auto ext = path.extension();
+    return ext != ".tif" && ext != ".tiff" && ext != ".raw";
+}
+
+void save_octree(const Octree& octree, const ConstructionStats& stats, const std::filesystem::path& path) {
+    fmt::print("Generated octree:\n");
+    fmt::print(" Dimensions: {0}x{0}x{0}\n", octree.side());
+    fmt::print(" Size: {} bytes\n", octree.memory_footprint());
+    fmt::print(" Unique nodes: {}\n", octree.data().size());
+    fmt::print(" Total leaves: {}\n", stats.total_leaves);
+    fmt::print(" Depth: {}\n", stats.depth);
+
+    octree.save_svo(path);
+}
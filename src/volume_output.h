@@ -0,0 +1,27 @@
+#ifndef _XENODON_VOLUME_OUTPUT_H
+#define _XENODON_VOLUME_OUTPUT_H
+
+#include <filesystem>
+#include <cstdint>
+#include "model/Grid.h"
+#include "model/Octree.h"
+#include "model/OctreeConstruction.h"
+
+struct VolumeOutputOptions {
+    // Same as the options of 'xenodon convert'
+    bool dag = false;
+    uint8_t channel_difference = 0;
+};
+
+// Save a grid created by one of the import subcommands. Paths with the extension .tif or .tiff
+// are saved as 3D TIFF image, paths with the extension .raw as the RGBA voxels in memory order,
+// and other paths as sparse octree.
+void save_volume(const Grid& grid, const std::filesystem::path& path, const VolumeOutputOptions& opts);
+
+// Whether save_volume saves to `path` as octree
+bool is_octree_path(const std::filesystem::path& path);
+
+// Print the statistics of an octree, and save it as .svo
+void save_octree(const Octree& octree, const ConstructionStats& stats, const std::filesystem::path& path);
+
+#endif
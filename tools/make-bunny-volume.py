@@ -3,6 +3,7 @@
 # (https://graphics.stanford.edu/data/voldata/voldata.html#bunny)
 # to a 3D stacked TIFF image. This script is by no means optimized.
 # Usage make-bunny-volume.py <directory of bunny slices> <output directory>
+# 'xenodon import-raw' creates the same volume much faster, see the README.
 
 import numpy as np
 import struct
@@ -11,7 +11,8 @@
 # Parameters used for TNG300-3:
 # make-tng-volume.py TNG300-3 99 2048 TNG300.tif 90 99
 # Note that this script can take up quite some resources and time.
-# It took about 30 min for TNG100 for me.
+# It took about 30 min for TNG100 for me. 'xenodon import-particles' does the same
+# binning and coloring much faster, see the README.
 
 import numpy as np
 from PIL import Image
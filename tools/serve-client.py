@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+# Client for 'xenodon serve'. Sends a number of requests with the camera orbiting the volume,
+# saves the returned frames and prints the latency of every request.
+# Usage:
+#   serve-client.py --socket <path> [options]
+#   serve-client.py [options] -- <xenodon serve command>
+# In the second form, the server is started with the given command and requests are sent over
+# its standard input, for example:
+#   serve-client.py --count 8 -- build/xenodon serve bunny.svo --headless headless.conf
+
+import argparse
+import json
+import math
+import socket
+import subprocess
+import sys
+
+parser = argparse.ArgumentParser(description='Request frames from xenodon serve')
+parser.add_argument('--socket', help='path of the socket of a running server')
+parser.add_argument('--count', type=int, default=16, help='number of frames to request')
+parser.add_argument('--size', help='resolution of the frames, <width>x<height>')
+parser.add_argument('--distance', type=float, default=1.5, help='distance of the camera from the center of the volume')
+parser.add_argument('--output', default='frame-{:0>3}.png', help='path format of the saved frames')
+parser.add_argument('--no-save', action='store_true', help='do not save the frames')
+parser.add_argument('--shutdown', action='store_true', help='stop the server after the frames are received')
+parser.add_argument('command', nargs='*', help='command to start the server with')
+args = parser.parse_args()
+
+if bool(args.socket) == bool(args.command):
+    parser.error('exactly one of --socket and a server command is required')
+
+def request(i):
+    angle = 2 * math.pi * i / args.count
+    forward = [-math.sin(angle), 0, -math.cos(angle)]
+    req = {
+        'id': i,
+        'forward': forward,
+        'up': [0, 1, 0],
+        'position': [0.5 - forward[0] * args.distance, 0.5, 0.5 - forward[2] * args.distance]
+    }
+
+    if args.size:
+        width, height = args.size.split('x')
+        req['width'] = int(width)
+        req['height'] = int(height)
+
+    return req
+
+if args.socket:
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(args.socket)
+    out = sock.makefile('wb')
+    inp = sock.makefile('rb')
+    server = None
+else:
+    server = subprocess.Popen(args.command, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = server.stdin
+    inp = server.stdout
+
+# All requests are sent up front, so that the server can render them back-to-back
+for i in range(args.count):
+    out.write((json.dumps(request(i)) + '\n').encode())
+if args.shutdown or server:
+    out.write(b'{"command": "shutdown"}\n')
+out.flush()
+
+latencies = []
+for _ in range(args.count):
+    line = inp.readline()
+    if not line:
+        sys.exit('server closed the connection')
+
+    header = json.loads(line)
+    if header['status'] != 'ok':
+        print(f'request {header["id"]}: error: {header["message"]}')
+        continue
+
+    data = inp.read(header['size'])
+    if not args.no_save:
+        with open(args.output.format(header['id']), 'wb') as f:
+            f.write(data)
+
+    latencies.append(header['latency_ms'])
+    print(f'request {header["id"]}: {header["width"]}x{header["height"]}, queued {header["queue_ms"]:.2f} ms, latency {header["latency_ms"]:.2f} ms')
+
+if latencies:
+    latencies.sort()
+    print(f'{len(latencies)} frames, mean latency {sum(latencies) / len(latencies):.2f} ms, max latency {latencies[-1]:.2f} ms')
+
+if server:
+    out.close()
+    server.wait()